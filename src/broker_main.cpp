@@ -0,0 +1,52 @@
+#include <csignal>
+
+#include "monitor_broker.h"
+#include "unix_serial_connection.h"
+
+namespace {
+
+const std::string_view default_socket_path = "/tmp/m65dbg.sock";
+
+void print_usage(const char* argv0)
+{
+  fmt::print(stderr,
+             "Usage:\n"
+             "  {} <serial-device> [socket-path]\n\n"
+             "Shares the MEGA65 monitor on <serial-device> among several clients connecting to the Unix domain\n"
+             "socket [socket-path] (default {}). Debug sessions use it with \"serialPort\": \"unix#<socket-path>\".\n"
+             "Clients send \"#priority <n>\" to be served before clients with lower priority (default 0).\n",
+             std::filesystem::path(argv0).filename().string(), default_socket_path);
+}
+
+std::atomic<bool> stop_requested{false};
+
+void request_stop(int) { stop_requested = true; }
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2 || argc > 3) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, request_stop);
+  signal(SIGTERM, request_stop);
+
+  try {
+    const std::filesystem::path socket_path = argc > 2 ? argv[2] : default_socket_path;
+    m65dap::MonitorBroker broker(std::make_unique<m65dap::UnixSerialConnection>(argv[1]), socket_path);
+    fmt::print("Sharing {} on unix#{}\n", argv[1], socket_path.string());
+    std::fflush(stdout);
+    while (!stop_requested && !broker.target_failed()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return broker.target_failed() ? 1 : 0;
+  }
+  catch (const std::exception& e) {
+    fmt::print(stderr, "Error: {}\n", e.what());
+    return 1;
+  }
+}
@@ -0,0 +1,166 @@
+#include "buffered_connection.h"
+
+#include "duration.h"
+
+namespace m65dap {
+
+namespace {
+
+constexpr int receive_chunk_size = 4096;
+// Longest time the receive thread waits for data before checking whether it has to stop
+constexpr int receive_poll_ms = 10;
+constexpr std::size_t max_pending_chunks = 4096;
+
+auto to_us(BufferedConnection::clock::duration duration) -> std::int64_t
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+}  // namespace
+
+auto BufferedConnection::ReceiveStats::to_string() const -> std::string
+{
+  return fmt::format(
+      "Received {} bytes in {} chunks, {} replies after {:.1f} ms on average ({:.1f} ms max), consumed after "
+      "{:.1f} ms on average ({:.1f} ms max), receive buffer full {} times",
+      bytes, chunks, replies, replies > 0 ? total_reply_us / 1000.0 / replies : 0.0, max_reply_us / 1000.0,
+      chunks > 0 ? total_queue_us / 1000.0 / chunks : 0.0, max_queue_us / 1000.0, ring_full_stalls);
+}
+
+BufferedConnection::BufferedConnection(std::unique_ptr<Connection> connection, std::size_t capacity) :
+    conn_(std::move(connection)), data_(capacity), chunks_(max_pending_chunks)
+{
+  throw_if<std::invalid_argument>(!conn_, "Missing connection");
+  thread_ = std::thread([this] { receive_loop(); });
+}
+
+BufferedConnection::~BufferedConnection()
+{
+  stop_ = true;
+  thread_.join();
+}
+
+void BufferedConnection::write(std::span<const char> buffer)
+{
+  write_time_ = clock::now().time_since_epoch().count();
+  reply_pending_ = true;
+  conn_->write(buffer);
+}
+
+auto BufferedConnection::read(int bytes_to_read, int timeout_ms) -> std::string
+{
+  Duration t;
+  std::string result(bytes_to_read, '\0');
+  std::size_t sum{0};
+  while (sum < result.size()) {
+    // Check before popping, so no data pushed before the receiver finished is missed
+    const bool done = receiver_done_;
+    sum += data_.pop(std::span(result).subspan(sum));
+    if (sum == result.size()) {
+      break;
+    }
+    if (done) {
+      if (sum == 0 && error_) {
+        std::rethrow_exception(error_);
+      }
+      break;
+    }
+    const auto remaining_ms = timeout_ms - static_cast<int>(t.elapsed_ms());
+    if (remaining_ms <= 0) {
+      break;
+    }
+    wait_for_input(remaining_ms);
+  }
+
+  account_consumed(sum);
+  result.resize(sum);
+  return result;
+}
+
+void BufferedConnection::wait_for_input(int timeout_ms)
+{
+  std::unique_lock lock(mutex_);
+  data_available_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                           [this] { return !data_.empty() || receiver_done_; });
+}
+
+void BufferedConnection::discard_input()
+{
+  conn_->discard_input();
+  while (!read(receive_chunk_size, 0).empty()) {
+  }
+}
+
+auto BufferedConnection::get_stats() const -> ReceiveStats
+{
+  std::scoped_lock lock(stats_mutex_);
+  return stats_;
+}
+
+void BufferedConnection::account_consumed(std::size_t count)
+{
+  consumed_ += count;
+  const auto now = clock::now();
+  std::scoped_lock lock(stats_mutex_);
+  for (auto* chunk = chunks_.front(); chunk && chunk->end <= consumed_; chunk = chunks_.front()) {
+    const auto queue_us = to_us(now - chunk->time);
+    stats_.total_queue_us += queue_us;
+    stats_.max_queue_us = std::max(stats_.max_queue_us, queue_us);
+    chunks_.pop_front();
+  }
+}
+
+void BufferedConnection::receive_loop()
+{
+  std::uint64_t received{0};
+  try {
+    while (!stop_) {
+      conn_->wait_for_input(receive_poll_ms);
+      const auto data = conn_->read(receive_chunk_size, 0);
+      if (data.empty()) {
+        continue;
+      }
+
+      const auto now = clock::now();
+      received += data.size();
+      chunks_.push(ReceivedChunk{.end = received, .time = now});
+      {
+        std::scoped_lock lock(stats_mutex_);
+        stats_.bytes += data.size();
+        ++stats_.chunks;
+        if (reply_pending_.exchange(false)) {
+          const auto reply_us = to_us(now - clock::time_point(clock::duration(write_time_.load())));
+          ++stats_.replies;
+          stats_.total_reply_us += reply_us;
+          stats_.max_reply_us = std::max(stats_.max_reply_us, reply_us);
+        }
+      }
+
+      std::span<const char> remaining(data);
+      while (!remaining.empty() && !stop_) {
+        const auto pushed = data_.push(remaining);
+        remaining = remaining.subspan(pushed);
+        if (pushed > 0) {
+          std::scoped_lock lock(mutex_);
+          data_available_.notify_one();
+        }
+        if (!remaining.empty()) {
+          {
+            std::scoped_lock lock(stats_mutex_);
+            ++stats_.ring_full_stalls;
+          }
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      }
+    }
+  }
+  catch (...) {
+    error_ = std::current_exception();
+  }
+
+  std::scoped_lock lock(mutex_);
+  receiver_done_ = true;
+  data_available_.notify_one();
+}
+
+}  // namespace m65dap
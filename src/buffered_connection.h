@@ -0,0 +1,86 @@
+#pragma once
+
+#include "connection.h"
+#include "spsc_ring.h"
+
+namespace m65dap {
+
+/**
+ * @brief Connection drained by a receive thread into a ring buffer
+ *
+ * The receive thread reads whatever arrives on the wrapped connection right away, so replies don't pile up in the
+ * kernel or USB-serial buffers while the debugger thread is busy. Every chunk is stamped with its arrival time,
+ * which gives the time the target took to answer a command independent of when the reply is consumed.
+ */
+class BufferedConnection : public Connection {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  struct ReceiveStats {
+    std::uint64_t bytes{0};
+    std::uint64_t chunks{0};           // reads returning data
+    std::uint64_t replies{0};          // first chunks received after a write
+    std::int64_t total_reply_us{0};    // from a write until the first chunk after it arrived
+    std::int64_t max_reply_us{0};
+    std::int64_t total_queue_us{0};    // from the arrival of a chunk until it was consumed completely
+    std::int64_t max_queue_us{0};
+    std::uint64_t ring_full_stalls{0};  // times the receive thread had to wait for the consumer
+
+    auto to_string() const -> std::string;
+  };
+
+  /**
+   * @param connection Connection to read from, its read() and write() are called from different threads
+   * @param capacity Size of the receive buffer in bytes
+   */
+  explicit BufferedConnection(std::unique_ptr<Connection> connection, std::size_t capacity = 0x40000);
+  BufferedConnection(const BufferedConnection&) = delete;
+  auto operator=(const BufferedConnection&) -> BufferedConnection& = delete;
+  ~BufferedConnection() override;
+
+  void write(std::span<const char> buffer) override;
+
+  /**
+   * @brief Reads from the receive buffer, errors of the receive thread are rethrown once it is drained
+   */
+  auto read(int bytes_to_read, int timeout_ms = 1000) -> std::string override;
+
+  void wait_for_input(int timeout_ms) override;
+
+  /**
+   * @brief Discards the input of the wrapped connection and what the receive thread buffered so far
+   */
+  void discard_input() override;
+
+  auto get_stats() const -> ReceiveStats;
+
+ private:
+  struct ReceivedChunk {
+    std::uint64_t end{0};  // total number of bytes received up to and including the chunk
+    clock::time_point time;
+  };
+
+  void receive_loop();
+  void account_consumed(std::size_t count);
+
+  std::unique_ptr<Connection> conn_;
+  SpscRing<char> data_;
+  // Chunks not consumed completely yet, the bytes of chunks not fitting anymore are accounted to the next one
+  SpscRing<ReceivedChunk> chunks_;
+  std::uint64_t consumed_{0};
+  std::atomic<clock::rep> write_time_{0};
+  std::atomic<bool> reply_pending_{false};
+
+  std::mutex mutex_;
+  std::condition_variable data_available_;
+  std::atomic<bool> receiver_done_{false};
+  std::exception_ptr error_;  // set before receiver_done_
+
+  mutable std::mutex stats_mutex_;
+  ReceiveStats stats_;
+
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+}  // namespace m65dap
@@ -18,22 +18,45 @@ C64DebuggerData::C64DebuggerData(const std::filesystem::path& dbg_file)
   parse_file_list(root);
   parse_segments(root);
   parse_labels(root);
+  build_interval_index();
 }
 
 auto C64DebuggerData::get_block_entry(int addr, std::string* segment, std::string* block) const -> const BlockEntry*
 {
-  for (const auto& s : segments_) {
-    std::string block_name;
-    const auto* entry = s.get_block_entry(addr, &block_name);
-    if (entry != nullptr) {
-      if (segment) {
-        *segment = s.name;
-      }
-      return entry;
+  auto info = lookup_address(addr);
+  if (info.entry == nullptr) {
+    return nullptr;
+  }
+  if (segment) {
+    *segment = info.segment->name;
+  }
+  if (block) {
+    *block = info.block->name;
+  }
+  return info.entry;
+}
+
+auto C64DebuggerData::lookup_address(int addr) const -> AddressInfo
+{
+  auto it = std::upper_bound(interval_index_.begin(), interval_index_.end(), addr,
+                             [](int a, const IntervalIndexEntry& e) { return a < e.start; });
+
+  // All entries starting at or below addr are candidates, walking back ends once none before can reach addr
+  const IntervalIndexEntry* match{nullptr};
+  auto file_order = [](const IntervalIndexEntry& e) { return std::tie(e.segment_idx, e.block_idx, e.entry_idx); };
+  while (it != interval_index_.begin() && std::prev(it)->max_end >= addr) {
+    --it;
+    if (addr <= it->end && (match == nullptr || file_order(*it) < file_order(*match))) {
+      match = &*it;
     }
   }
+  if (match == nullptr) {
+    return {};
+  }
 
-  return nullptr;
+  const auto& segment = segments_[match->segment_idx];
+  const auto& block = segment.blocks[match->block_idx];
+  return {.segment = &segment, .block = &block, .entry = &block.entries[match->entry_idx]};
 }
 
 auto C64DebuggerData::get_file(int idx) const -> std::string { return files_.at(idx); }
@@ -52,11 +75,32 @@ auto C64DebuggerData::get_file_index(const std::filesystem::path& src_path) cons
 
 auto C64DebuggerData::get_label_info(std::string_view label) const -> const LabelEntry*
 {
-  auto it = std::find_if(labels_.begin(), labels_.end(), [&](const LabelEntry& e) { return e.name == label; });
-  if (it == labels_.end()) {
+  auto it = label_index_.find(std::string(label));
+  if (it == label_index_.end()) {
+    return nullptr;
+  }
+  return &labels_[it->second];
+}
+
+auto C64DebuggerData::get_label_before(int addr) const -> const LabelEntry*
+{
+  auto it = std::upper_bound(labels_by_address_.begin(), labels_by_address_.end(), addr,
+                             [&](int a, std::size_t idx) { return a < labels_[idx].address; });
+  if (it == labels_by_address_.begin()) {
     return nullptr;
   }
-  return &(*it);
+  return &labels_[*std::prev(it)];
+}
+
+auto C64DebuggerData::get_labels_in_range(int first_addr, int last_addr) const -> std::vector<const LabelEntry*>
+{
+  std::vector<const LabelEntry*> result;
+  auto it = std::lower_bound(labels_by_address_.begin(), labels_by_address_.end(), first_addr,
+                             [&](std::size_t idx, int a) { return labels_[idx].address < a; });
+  for (; it != labels_by_address_.end() && labels_[*it].address <= last_addr; ++it) {
+    result.push_back(&labels_[*it]);
+  }
+  return result;
 }
 
 auto C64DebuggerData::eval_breakpoint_line(const std::filesystem::path& src_path, int line) const -> const BlockEntry*
@@ -76,6 +120,31 @@ auto C64DebuggerData::eval_breakpoint_line(const std::filesystem::path& src_path
   return nullptr;
 }
 
+void C64DebuggerData::build_interval_index()
+{
+  interval_index_.clear();
+  for (std::size_t s_idx{0}; s_idx < segments_.size(); ++s_idx) {
+    const auto& blocks = segments_[s_idx].blocks;
+    for (std::size_t b_idx{0}; b_idx < blocks.size(); ++b_idx) {
+      const auto& entries = blocks[b_idx].entries;
+      for (std::size_t e_idx{0}; e_idx < entries.size(); ++e_idx) {
+        interval_index_.push_back({.start = entries[e_idx].start,
+                                   .end = entries[e_idx].end,
+                                   .max_end = entries[e_idx].end,
+                                   .segment_idx = s_idx,
+                                   .block_idx = b_idx,
+                                   .entry_idx = e_idx});
+      }
+    }
+  }
+
+  std::sort(interval_index_.begin(), interval_index_.end(),
+            [](const IntervalIndexEntry& a, const IntervalIndexEntry& b) { return a.start < b.start; });
+  for (std::size_t idx{1}; idx < interval_index_.size(); ++idx) {
+    interval_index_[idx].max_end = std::max(interval_index_[idx].max_end, interval_index_[idx - 1].max_end);
+  }
+}
+
 void C64DebuggerData::parse_file_list(tinyxml2::XMLElement* root)
 {
   auto* sources = root->FirstChildElement("Sources");
@@ -183,7 +252,14 @@ void C64DebuggerData::parse_labels(tinyxml2::XMLElement* root)
                                     .col1 = stoi(items[5]),
                                     .line2 = stoi(items[6]),
                                     .col2 = stoi(items[7])});
+    // Lookups by name return the first label defined with that name
+    label_index_.emplace(labels_.back().name, labels_.size() - 1);
   }
+
+  labels_by_address_.resize(labels_.size());
+  std::iota(labels_by_address_.begin(), labels_by_address_.end(), 0);
+  std::stable_sort(labels_by_address_.begin(), labels_by_address_.end(),
+                   [&](std::size_t a, std::size_t b) { return labels_[a].address < labels_[b].address; });
 }
 
 }  // namespace m65dap
@@ -55,6 +55,12 @@ struct Segment {
   }
 };
 
+struct AddressInfo {
+  const Segment* segment{nullptr};
+  const Block* block{nullptr};
+  const BlockEntry* entry{nullptr};
+};
+
 struct LabelEntry {
   std::string segment;
   int address;
@@ -67,18 +73,54 @@ struct LabelEntry {
 };
 
 class C64DebuggerData {
+  struct IntervalIndexEntry {
+    int start;
+    int end;
+    int max_end;  // highest end of this and all preceding entries, entries may nest or overlap
+    std::size_t segment_idx;
+    std::size_t block_idx;
+    std::size_t entry_idx;
+  };
+
   std::map<int, std::string> files_;
   std::vector<Segment> segments_;
   std::vector<LabelEntry> labels_;
+  std::unordered_map<std::string, std::size_t> label_index_;  // label name to index into labels_
+  std::vector<std::size_t> labels_by_address_;                 // indices into labels_ sorted by address
+  std::vector<IntervalIndexEntry> interval_index_;
 
  public:
   C64DebuggerData(const std::filesystem::path& dbg_file);
   auto get_block_entry(int addr, std::string* segment = nullptr, std::string* block = nullptr) const
       -> const BlockEntry*;
   auto get_file(int idx) const -> std::string;
+  auto get_segments() const -> const std::vector<Segment>& { return segments_; }
+
+  /**
+   * @brief Looks up segment, block and block entry for an address using the sorted interval index
+   *
+   * Of overlapping entries the first one in file order is returned. Only entries whose preceding ones reach up to
+   * the address are checked, O(log n) unless many entries span it.
+   *
+   * @param addr Address to look up
+   * @return AddressInfo Pointers to the matching segment, block and entry (all nullptr if address is unknown)
+   */
+  auto lookup_address(int addr) const -> AddressInfo;
   auto get_file_index(const std::filesystem::path& src_path) const -> int;
   auto get_label_info(std::string_view label) const -> const LabelEntry*;
 
+  /**
+   * @brief Finds the label with the highest address not above addr, e.g. the routine an address belongs to
+   *
+   * @return LabelEntry Matching label (nullptr if there is no label at or below addr)
+   */
+  auto get_label_before(int addr) const -> const LabelEntry*;
+
+  /**
+   * @brief Returns the labels between first_addr and last_addr (inclusive), sorted by address
+   */
+  auto get_labels_in_range(int first_addr, int last_addr) const -> std::vector<const LabelEntry*>;
+
   /**
    * @brief Calculates next possible line number to set breakpoint starting at "line"
    *
@@ -95,6 +137,7 @@ class C64DebuggerData {
   auto parse_segment(tinyxml2::XMLElement* segment_element) -> Segment;
   auto parse_block(tinyxml2::XMLElement* block_element) -> Block;
   void parse_labels(tinyxml2::XMLElement* root);
+  void build_interval_index();
 };
 
 }  // namespace m65dap
@@ -9,6 +9,26 @@ class Connection {
   virtual void write(std::span<const char> buffer) = 0;
 
   virtual auto read(int bytes_to_read, int timeout_ms = 1000) -> std::string = 0;
+
+  /**
+   * @brief Waits until data can be read or the timeout expires
+   *
+   * Connections that can't wait for data sleep for a millisecond, so callers polling with read() don't spin.
+   */
+  virtual void wait_for_input(int timeout_ms)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeout_ms, 1)));
+  }
+
+  /**
+   * @brief Drops data received by the device or driver that wasn't read yet
+   */
+  virtual void discard_input() {}
+
+  /**
+   * @brief File descriptor to wait for with poll() together with others, -1 if the connection has none
+   */
+  virtual auto native_handle() const -> int { return -1; }
 };
 
 }  // namespace m65dap
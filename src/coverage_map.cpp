@@ -0,0 +1,196 @@
+#include "coverage_map.h"
+
+namespace {
+
+constexpr std::array<char, 8> coverage_file_magic{'M', '6', '5', 'C', 'O', 'V', 'E', 'R'};
+constexpr std::uint32_t coverage_file_version = 1;
+
+const int num_addresses = 0x10000;
+
+template <typename T>
+void write_value(std::ostream& out, const T& value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+auto read_value(std::istream& in) -> T
+{
+  T value{};
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  m65dap::throw_if<std::runtime_error>(!in, "Unexpected end of coverage file");
+  return value;
+}
+
+}  // namespace
+
+namespace m65dap {
+
+CoverageMap::CoverageMap(const C64DebuggerData& dbg_data) : dbg_data_(&dbg_data)
+{
+  for (const auto& segment : dbg_data.get_segments()) {
+    SegmentCoverage coverage{.name = segment.name, .block_offsets = {}, .lines = {}, .bits = {}};
+    for (const auto& block : segment.blocks) {
+      coverage.block_offsets.push_back(coverage.lines.size());
+      for (const auto& entry : block.entries) {
+        coverage.lines.push_back({entry.file_index, entry.line1});
+        if (!files_.contains(entry.file_index)) {
+          files_[entry.file_index] = dbg_data.get_file(entry.file_index);
+        }
+      }
+    }
+    coverage.bits.resize((coverage.lines.size() + 63) / 64);
+    segments_.push_back(std::move(coverage));
+  }
+}
+
+auto CoverageMap::bit_position(int pc) const -> std::optional<std::pair<std::size_t, std::size_t>>
+{
+  const auto info = dbg_data_->lookup_address(pc);
+  if (info.entry == nullptr) {
+    return {};
+  }
+  const std::size_t segment_idx = info.segment - dbg_data_->get_segments().data();
+  const std::size_t block_idx = info.block - info.segment->blocks.data();
+  const std::size_t entry_idx = info.entry - info.block->entries.data();
+  return std::make_pair(segment_idx, segments_[segment_idx].block_offsets[block_idx] + entry_idx);
+}
+
+void CoverageMap::add_pc(int pc)
+{
+  const auto pos = bit_position(pc);
+  if (pos.has_value()) {
+    const auto [segment_idx, bit] = pos.value();
+    segments_[segment_idx].bits[bit / 64] |= std::uint64_t{1} << (bit % 64);
+  }
+}
+
+void CoverageMap::add_trace(const TraceFile& trace)
+{
+  // Look up every distinct PC only once
+  std::vector<bool> executed(num_addresses);
+  for (auto index = trace.first_index(); index < trace.total_records(); ++index) {
+    executed[trace.at(index).pc] = true;
+  }
+  for (int pc{0}; pc < num_addresses; ++pc) {
+    if (executed[pc]) {
+      add_pc(pc);
+    }
+  }
+}
+
+void CoverageMap::merge(const CoverageMap& other)
+{
+  throw_if<std::invalid_argument>(other.segments_.size() != segments_.size(), "Coverage layouts don't match");
+  for (std::size_t s{0}; s < segments_.size(); ++s) {
+    auto& bits = segments_[s].bits;
+    const auto& other_bits = other.segments_[s].bits;
+    throw_if<std::invalid_argument>(segments_[s].name != other.segments_[s].name ||
+                                        segments_[s].lines.size() != other.segments_[s].lines.size(),
+                                    "Coverage layouts don't match");
+    std::transform(bits.begin(), bits.end(), other_bits.begin(), bits.begin(), std::bit_or<>());
+  }
+}
+
+void CoverageMap::reset()
+{
+  for (auto& segment : segments_) {
+    std::fill(segment.bits.begin(), segment.bits.end(), 0);
+  }
+}
+
+auto CoverageMap::total_entries() const -> std::size_t
+{
+  return std::accumulate(segments_.begin(), segments_.end(), std::size_t{0},
+                         [](std::size_t acc, const SegmentCoverage& s) { return acc + s.lines.size(); });
+}
+
+auto CoverageMap::covered_entries() const -> std::size_t
+{
+  std::size_t count{0};
+  for (const auto& segment : segments_) {
+    for (auto word : segment.bits) {
+      count += std::popcount(word);
+    }
+  }
+  return count;
+}
+
+auto CoverageMap::is_covered(int pc) const -> bool
+{
+  const auto pos = bit_position(pc);
+  if (!pos.has_value()) {
+    return false;
+  }
+  const auto [segment_idx, bit] = pos.value();
+  return (segments_[segment_idx].bits[bit / 64] >> (bit % 64)) & 1;
+}
+
+auto CoverageMap::to_lcov() const -> std::string
+{
+  // file index -> line -> hit
+  std::map<int, std::map<int, bool>> file_lines;
+  for (const auto& segment : segments_) {
+    for (std::size_t bit{0}; bit < segment.lines.size(); ++bit) {
+      const auto& line = segment.lines[bit];
+      auto& hit = file_lines[line.file_index][line.line];
+      hit = hit || ((segment.bits[bit / 64] >> (bit % 64)) & 1);
+    }
+  }
+
+  std::string result;
+  for (const auto& [file_index, lines] : file_lines) {
+    result += fmt::format("SF:{}\n", files_.at(file_index));
+    int hit_count{0};
+    for (const auto& [line, hit] : lines) {
+      result += fmt::format("DA:{},{}\n", line, hit ? 1 : 0);
+      hit_count += hit ? 1 : 0;
+    }
+    result += fmt::format("LH:{}\nLF:{}\nend_of_record\n", hit_count, lines.size());
+  }
+  return result;
+}
+
+void CoverageMap::save(const std::filesystem::path& path) const
+{
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  throw_if<std::runtime_error>(!out, fmt::format("Can't create coverage file {}", path.string()));
+
+  out.write(coverage_file_magic.data(), coverage_file_magic.size());
+  write_value(out, coverage_file_version);
+  write_value(out, static_cast<std::uint32_t>(segments_.size()));
+  for (const auto& segment : segments_) {
+    write_value(out, static_cast<std::uint32_t>(segment.name.length()));
+    out.write(segment.name.data(), segment.name.length());
+    write_value(out, static_cast<std::uint32_t>(segment.lines.size()));
+    out.write(reinterpret_cast<const char*>(segment.bits.data()), segment.bits.size() * sizeof(std::uint64_t));
+  }
+  throw_if<std::runtime_error>(!out, fmt::format("Can't write coverage file {}", path.string()));
+}
+
+void CoverageMap::merge_file(const std::filesystem::path& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  throw_if<std::runtime_error>(!in, fmt::format("Can't open coverage file {}", path.string()));
+
+  std::array<char, 8> magic{};
+  in.read(magic.data(), magic.size());
+  throw_if<std::runtime_error>(magic != coverage_file_magic, "Not a coverage file");
+  throw_if<std::runtime_error>(read_value<std::uint32_t>(in) != coverage_file_version,
+                               "Unsupported coverage file version");
+  throw_if<std::runtime_error>(read_value<std::uint32_t>(in) != segments_.size(),
+                               "Coverage file doesn't match the program");
+
+  for (auto& segment : segments_) {
+    std::string name(read_value<std::uint32_t>(in), '\0');
+    in.read(name.data(), name.length());
+    const auto num_bits = read_value<std::uint32_t>(in);
+    throw_if<std::runtime_error>(name != segment.name || num_bits != segment.lines.size(),
+                                 "Coverage file doesn't match the program");
+    for (auto& word : segment.bits) {
+      word |= read_value<std::uint64_t>(in);
+    }
+  }
+}
+
+}  // namespace m65dap
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "c64_debugger_data.h"
+#include "trace_file.h"
+
+namespace m65dap {
+
+/**
+ * @brief Per source line code coverage of a program
+ *
+ * Every block entry of the debug data gets one bit in a bitmap of its segment, set once any address of the entry
+ * has been executed. The layout (segments and their entries) is copied from the debug data, so coverage of several
+ * runs of the same program can be merged by ORing the bitmaps, also after saving them to a file.
+ */
+class CoverageMap {
+  struct EntryLine {
+    int file_index;
+    int line;
+  };
+
+  struct SegmentCoverage {
+    std::string name;
+    std::vector<std::size_t> block_offsets;  // bit index of the first entry of each block
+    std::vector<EntryLine> lines;             // source line of each bit
+    std::vector<std::uint64_t> bits;
+  };
+
+  const C64DebuggerData* dbg_data_;
+  std::vector<SegmentCoverage> segments_;
+  std::map<int, std::string> files_;
+
+ public:
+  /**
+   * @param dbg_data Debug data of the program. Only used while adding PCs, must outlive these calls.
+   */
+  explicit CoverageMap(const C64DebuggerData& dbg_data);
+
+  void add_pc(int pc);
+  void add_trace(const TraceFile& trace);
+  void merge(const CoverageMap& other);
+  void reset();
+
+  auto total_entries() const -> std::size_t;
+  auto covered_entries() const -> std::size_t;
+  auto is_covered(int pc) const -> bool;
+
+  /**
+   * @brief Exports the coverage in LCOV tracefile format (one DA record per source line)
+   */
+  auto to_lcov() const -> std::string;
+
+  void save(const std::filesystem::path& path) const;
+
+  /**
+   * @brief Merges coverage previously saved for the same program
+   */
+  void merge_file(const std::filesystem::path& path);
+
+ private:
+  auto bit_position(int pc) const -> std::optional<std::pair<std::size_t, std::size_t>>;
+};
+
+}  // namespace m65dap
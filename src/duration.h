@@ -17,6 +17,12 @@ class Duration {
     auto cur_time = std::chrono::steady_clock::now();
     return std::chrono::duration_cast<std::chrono::milliseconds>(cur_time - start_time_).count();
   }
+
+  auto elapsed_us()
+  {
+    auto cur_time = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(cur_time - start_time_).count();
+  }
 };
 
 }  // namespace m65dap
@@ -7,4 +7,12 @@ class timeout_error : public std::runtime_error {
   timeout_error(const char* msg) : std::runtime_error(msg) {}
 };
 
+/**
+ * @brief The connection to the device failed, e.g. as the cable was unplugged or the emulator quit
+ */
+class connection_error : public std::runtime_error {
+ public:
+  connection_error(const std::string& msg) : std::runtime_error(msg) {}
+};
+
 }  // namespace m65dap
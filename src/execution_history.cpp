@@ -0,0 +1,266 @@
+#include "execution_history.h"
+
+namespace {
+
+const std::uint8_t flag_carry = 0x01;
+const std::uint8_t flag_break = 0x10;
+const std::uint8_t flag_extend = 0x20;  // 8 bit stack pointer if set
+
+// CPU addresses of the I/O area. Stores there reach the chips, not the RAM of bank 0 the snapshot was taken from.
+const int io_area_start = 0xD000;
+const int io_area_end = 0xE000;
+
+}  // namespace
+
+namespace m65dap {
+
+void ExecutionHistory::reset(std::span<const std::byte> memory, std::uint64_t first_index)
+{
+  throw_if<std::invalid_argument>(memory.size() != memory_size, "Memory snapshot must cover $0000-$FFFF");
+  clear();
+  initial_memory_.resize(memory_size);
+  std::transform(memory.begin(), memory.end(), initial_memory_.begin(),
+                 [](std::byte b) { return std::to_integer<std::uint8_t>(b); });
+  memory_ = initial_memory_;
+  address_writes_.resize(memory_size);
+  pc_positions_.resize(memory_size);
+  first_index_ = first_index;
+  end_index_ = first_index;
+}
+
+void ExecutionHistory::clear()
+{
+  initial_memory_ = {};
+  memory_ = {};
+  writes_ = {};
+  address_writes_ = {};
+  pc_positions_ = {};
+  first_index_ = 0;
+  end_index_ = 0;
+}
+
+void ExecutionHistory::add_step(const TraceRecord& r)
+{
+  assert(!initial_memory_.empty());
+  pc_positions_[r.pc].push_back(end_index_);
+
+  const auto& opcode = get_opcode(std::byte{r.instruction[0]});
+  const int operand_word = r.instruction[1] | (r.instruction[2] << 8);
+
+  int sp = r.sp;
+  auto push = [&](int value) {
+    write(sp, value);
+    sp = (r.flags & flag_extend) ? (sp & 0xff00) | ((sp - 1) & 0xff) : (sp - 1) & 0xffff;
+  };
+  auto push_word = [&](int value) {
+    push(value >> 8);
+    push(value & 0xff);
+  };
+  auto modify = [&](auto f) {
+    const int address = effective_address(opcode.mode, r);
+    write(address, f(memory_[address]));
+  };
+  auto modify_word = [&](auto f) {
+    const int address = effective_address(opcode.mode, r);
+    // Zero page word operands wrap around within the base page
+    const int address_hi = opcode.mode == AddressingMode::ZeroPage ? (address & 0xff00) | ((address + 1) & 0xff)
+                                                                     : (address + 1) & 0xffff;
+    const int value = f(memory_[address] | (memory_[address_hi] << 8));
+    write(address, value & 0xff);
+    write(address_hi, value >> 8);
+  };
+  const int carry = r.flags & flag_carry;
+  const int bit = 1 << ((r.instruction[0] >> 4) & 0x07);
+
+  switch (opcode.mnemonic) {
+    case Mnemonic::STA:
+      write(effective_address(opcode.mode, r), r.a);
+      break;
+    case Mnemonic::STX:
+      write(effective_address(opcode.mode, r), r.x);
+      break;
+    case Mnemonic::STY:
+      write(effective_address(opcode.mode, r), r.y);
+      break;
+    case Mnemonic::STZ:
+      write(effective_address(opcode.mode, r), r.z);
+      break;
+    case Mnemonic::INC:
+      modify([](int v) { return v + 1; });
+      break;
+    case Mnemonic::DEC:
+      modify([](int v) { return v - 1; });
+      break;
+    case Mnemonic::ASL:
+      modify([](int v) { return v << 1; });
+      break;
+    case Mnemonic::LSR:
+      modify([](int v) { return v >> 1; });
+      break;
+    case Mnemonic::ROL:
+      modify([&](int v) { return (v << 1) | carry; });
+      break;
+    case Mnemonic::ROR:
+      modify([&](int v) { return (v >> 1) | (carry << 7); });
+      break;
+    case Mnemonic::ASR:
+      modify([](int v) { return (v >> 1) | (v & 0x80); });
+      break;
+    case Mnemonic::TSB:
+      modify([&](int v) { return v | r.a; });
+      break;
+    case Mnemonic::TRB:
+      modify([&](int v) { return v & ~r.a; });
+      break;
+    case Mnemonic::RMB:
+      modify([&](int v) { return v & ~bit; });
+      break;
+    case Mnemonic::SMB:
+      modify([&](int v) { return v | bit; });
+      break;
+    case Mnemonic::INW:
+      modify_word([](int v) { return v + 1; });
+      break;
+    case Mnemonic::DEW:
+      modify_word([](int v) { return v - 1; });
+      break;
+    case Mnemonic::ASW:
+      modify_word([](int v) { return v << 1; });
+      break;
+    case Mnemonic::ROW:
+      modify_word([&](int v) { return (v << 1) | carry; });
+      break;
+    case Mnemonic::PHA:
+      push(r.a);
+      break;
+    case Mnemonic::PHP:
+      push(r.flags | flag_break);
+      break;
+    case Mnemonic::PHX:
+      push(r.x);
+      break;
+    case Mnemonic::PHY:
+      push(r.y);
+      break;
+    case Mnemonic::PHZ:
+      push(r.z);
+      break;
+    case Mnemonic::PHW:
+      push_word(opcode.mode == AddressingMode::ImmediateWord ? operand_word : read_word(operand_word));
+      break;
+    case Mnemonic::JSR:
+    case Mnemonic::BSR:
+      // Return address is the last byte of the 3 byte instruction
+      push_word((r.pc + 2) & 0xffff);
+      break;
+    case Mnemonic::BRK:
+      push_word((r.pc + 2) & 0xffff);
+      push(r.flags | flag_break);
+      break;
+    default:
+      break;
+  }
+
+  ++end_index_;
+}
+
+auto ExecutionHistory::memory_at(std::uint64_t index, int address) const -> std::uint8_t
+{
+  assert(address >= 0 && address < memory_size);
+  const auto& address_writes = address_writes_[address];
+  // Writes of the instruction at position i become visible at position i + 1
+  auto it = std::partition_point(address_writes.begin(), address_writes.end(),
+                                 [&](std::uint32_t w) { return writes_[w].index < index; });
+  if (it == address_writes.begin()) {
+    return initial_memory_[address];
+  }
+  return writes_[*std::prev(it)].value;
+}
+
+void ExecutionHistory::read_memory(std::uint64_t index, int address, std::span<std::byte> target) const
+{
+  throw_if<std::out_of_range>(address < 0 || address + target.size() > memory_size,
+                              "Address range not covered by execution history");
+  for (auto& b : target) {
+    b = std::byte{memory_at(index, address++)};
+  }
+}
+
+auto ExecutionHistory::find_previous(int pc, std::uint64_t index) const -> std::optional<std::uint64_t>
+{
+  if (pc_positions_.empty()) {
+    return {};
+  }
+  const auto& positions = pc_positions_[pc & 0xffff];
+  auto it = std::lower_bound(positions.begin(), positions.end(), index);
+  if (it == positions.begin()) {
+    return {};
+  }
+  return *std::prev(it);
+}
+
+auto ExecutionHistory::find_next(int pc, std::uint64_t index) const -> std::optional<std::uint64_t>
+{
+  if (pc_positions_.empty()) {
+    return {};
+  }
+  const auto& positions = pc_positions_[pc & 0xffff];
+  auto it = std::upper_bound(positions.begin(), positions.end(), index);
+  if (it == positions.end()) {
+    return {};
+  }
+  return *it;
+}
+
+auto ExecutionHistory::effective_address(AddressingMode mode, const TraceRecord& r) const -> int
+{
+  const int base_page = r.b << 8;
+  const int operand = r.instruction[1];
+  const int operand_word = r.instruction[1] | (r.instruction[2] << 8);
+  auto zero_page_pointer = [&](int offset) {
+    return memory_[base_page | (offset & 0xff)] | (memory_[base_page | ((offset + 1) & 0xff)] << 8);
+  };
+
+  switch (mode) {
+    case AddressingMode::ZeroPage:
+      return base_page | operand;
+    case AddressingMode::ZeroPageX:
+      return base_page | ((operand + r.x) & 0xff);
+    case AddressingMode::ZeroPageY:
+      return base_page | ((operand + r.y) & 0xff);
+    case AddressingMode::Absolute:
+      return operand_word;
+    case AddressingMode::AbsoluteX:
+      return (operand_word + r.x) & 0xffff;
+    case AddressingMode::AbsoluteY:
+      return (operand_word + r.y) & 0xffff;
+    case AddressingMode::IndirectX:
+      return zero_page_pointer(operand + r.x);
+    case AddressingMode::IndirectY:
+      return (zero_page_pointer(operand) + r.y) & 0xffff;
+    case AddressingMode::IndirectZ:
+      return (zero_page_pointer(operand) + r.z) & 0xffff;
+    case AddressingMode::StackIndirectY:
+      return (read_word((r.sp + operand) & 0xffff) + r.y) & 0xffff;
+    default:
+      throw std::logic_error("Addressing mode has no effective address");
+  }
+}
+
+auto ExecutionHistory::read_word(int address) const -> int
+{
+  return memory_[address] | (memory_[(address + 1) & 0xffff] << 8);
+}
+
+void ExecutionHistory::write(int address, int value)
+{
+  address &= 0xffff;
+  if (address >= io_area_start && address < io_area_end) {
+    return;
+  }
+  memory_[address] = static_cast<std::uint8_t>(value);
+  address_writes_[address].push_back(static_cast<std::uint32_t>(writes_.size()));
+  writes_.push_back({end_index_, static_cast<std::uint16_t>(address), static_cast<std::uint8_t>(value)});
+}
+
+}  // namespace m65dap
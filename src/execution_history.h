@@ -0,0 +1,82 @@
+#pragma once
+
+#include "opcodes.h"
+#include "trace_file.h"
+
+namespace m65dap {
+
+/**
+ * @brief Memory and PC history of a recorded instruction trace, used for reverse debugging
+ *
+ * Starts from a snapshot of bank 0 ($00000-$0FFFF) taken when the recording starts. For every recorded step, the
+ * memory written by its instruction is computed by decoding the effective address and the stored value from the
+ * register state of the trace record, and appended to a write log.
+ *
+ * Effective addresses are CPU addresses, which are taken as addresses in bank 0. This holds unless the program maps
+ * memory or banks out ROM. Stores to the I/O area ($D000-$DFFF) are assumed to reach the I/O chips and are not
+ * logged, so the history shows the RAM under I/O as it was at the start of the recording.
+ *
+ * The memory state at any position is looked up per address in O(log n) by binary searching the writes to that
+ * address. Positions where a PC was executed are indexed the same way for searching breakpoints backwards.
+ *
+ * A position is the absolute index of a trace record, i.e. the state before its instruction was executed.
+ */
+class ExecutionHistory {
+ public:
+  static constexpr int memory_size = 0x10000;
+
+  struct WriteEffect {
+    std::uint64_t index;
+    std::uint16_t address;
+    std::uint8_t value;
+  };
+
+ private:
+  std::vector<std::uint8_t> initial_memory_;
+  std::vector<std::uint8_t> memory_;  // memory state after executing the last added step
+  std::vector<WriteEffect> writes_;
+  std::vector<std::vector<std::uint32_t>> address_writes_;  // indices into writes_ per address
+  std::vector<std::vector<std::uint64_t>> pc_positions_;    // positions per PC
+  std::uint64_t first_index_{0};
+  std::uint64_t end_index_{0};
+
+ public:
+  /**
+   * @brief Starts a new history
+   *
+   * @param memory Snapshot of bank 0 ($00000-$0FFFF) at the start of the recording
+   * @param first_index Position of the first step that is going to be added
+   */
+  void reset(std::span<const std::byte> memory, std::uint64_t first_index);
+  void clear();
+
+  auto empty() const -> bool { return end_index_ == first_index_; }
+  auto first_index() const -> std::uint64_t { return first_index_; }
+  auto end_index() const -> std::uint64_t { return end_index_; }
+  auto write_count() const -> std::size_t { return writes_.size(); }
+
+  /**
+   * @brief Adds the next recorded step and logs the memory written by its instruction
+   */
+  void add_step(const TraceRecord& record);
+
+  auto memory_at(std::uint64_t index, int address) const -> std::uint8_t;
+  void read_memory(std::uint64_t index, int address, std::span<std::byte> target) const;
+
+  /**
+   * @brief Returns the last position before index where pc was executed
+   */
+  auto find_previous(int pc, std::uint64_t index) const -> std::optional<std::uint64_t>;
+
+  /**
+   * @brief Returns the first position after index where pc was executed
+   */
+  auto find_next(int pc, std::uint64_t index) const -> std::optional<std::uint64_t>;
+
+ private:
+  auto effective_address(AddressingMode mode, const TraceRecord& record) const -> int;
+  auto read_word(int address) const -> int;
+  void write(int address, int value);
+};
+
+}  // namespace m65dap
@@ -0,0 +1,576 @@
+#include "expression.h"
+
+#include "memory_cache.h"
+
+namespace {
+
+// Limit of the element count suffix, e.g. "$c000,w,16"
+const int max_elements = 256;
+
+// Limit of array types, e.g. "table as byte[4096]"
+const int max_array_elements = 0x10000;
+
+const std::size_t max_cached_expressions = 1024;
+
+enum class TokenKind { Number, Identifier, Symbol, End };
+
+struct Token {
+  TokenKind kind;
+  std::string_view text;
+  std::int64_t value{0};
+};
+
+auto is_identifier_start(char c) -> bool { return std::isalpha(static_cast<unsigned char>(c)) || c == '_'; }
+
+auto is_identifier_char(char c) -> bool
+{
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+}
+
+auto parse_number(std::string_view digits, int base, std::string_view text) -> std::int64_t
+{
+  std::int64_t value{0};
+  const auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.length(), value, base);
+  m65dap::throw_if<std::invalid_argument>(digits.empty() || ec != std::errc() ||
+                                              ptr != digits.data() + digits.length(),
+                                          fmt::format("Invalid number '{}'", text));
+  return value;
+}
+
+auto tokenize(std::string_view text) -> std::vector<Token>
+{
+  std::vector<Token> tokens;
+  std::size_t pos{0};
+
+  while (pos < text.length()) {
+    const char c = text[pos];
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      ++pos;
+      continue;
+    }
+
+    const std::size_t start = pos;
+    if (c == '$' || c == '%' || std::isdigit(static_cast<unsigned char>(c))) {
+      int base = 10;
+      std::size_t digits_start = pos;
+      if (c == '$') {
+        base = 16;
+        digits_start = pos + 1;
+      }
+      else if (c == '%') {
+        base = 2;
+        digits_start = pos + 1;
+      }
+      else if (c == '0' && pos + 1 < text.length() && (text[pos + 1] == 'x' || text[pos + 1] == 'X')) {
+        base = 16;
+        digits_start = pos + 2;
+      }
+      pos = digits_start;
+      while (pos < text.length() && std::isxdigit(static_cast<unsigned char>(text[pos]))) {
+        ++pos;
+      }
+      const auto token_text = text.substr(start, pos - start);
+      tokens.push_back(
+          {TokenKind::Number, token_text, parse_number(text.substr(digits_start, pos - digits_start), base, token_text)});
+      continue;
+    }
+
+    if (is_identifier_start(c)) {
+      while (pos < text.length() && is_identifier_char(text[pos])) {
+        ++pos;
+      }
+      tokens.push_back({TokenKind::Identifier, text.substr(start, pos - start)});
+      continue;
+    }
+
+    if ((c == '<' || c == '>') && pos + 1 < text.length() && text[pos + 1] == c) {
+      tokens.push_back({TokenKind::Symbol, text.substr(start, 2)});
+      pos += 2;
+      continue;
+    }
+
+    static constexpr std::string_view symbol_chars{"+-*/&|^~<>()[]{},:#"};
+    m65dap::throw_if<std::invalid_argument>(symbol_chars.find(c) == std::string_view::npos,
+                                            fmt::format("Unexpected character '{}' in expression", c));
+    tokens.push_back({TokenKind::Symbol, text.substr(start, 1)});
+    ++pos;
+  }
+
+  tokens.push_back({TokenKind::End, text.substr(text.length())});
+  return tokens;
+}
+
+auto make_scalar_type(int size) -> std::shared_ptr<const m65dap::TypeLayout>
+{
+  auto type = std::make_shared<m65dap::TypeLayout>();
+  type->size = size;
+  return type;
+}
+
+auto read_value(std::span<const std::byte> data, int size) -> std::uint32_t
+{
+  std::uint32_t value{0};
+  for (int idx{size - 1}; idx >= 0; --idx) {
+    value = (value << 8) | std::to_integer<std::uint32_t>(data[idx]);
+  }
+  return value;
+}
+
+}  // namespace
+
+namespace m65dap {
+
+auto TypeLayout::byte_type() -> std::shared_ptr<const TypeLayout>
+{
+  static const auto type = make_scalar_type(1);
+  return type;
+}
+
+auto TypeLayout::word_type() -> std::shared_ptr<const TypeLayout>
+{
+  static const auto type = make_scalar_type(2);
+  return type;
+}
+
+auto TypeLayout::quad_type() -> std::shared_ptr<const TypeLayout>
+{
+  static const auto type = make_scalar_type(4);
+  return type;
+}
+
+auto TypeLayout::name() const -> std::string
+{
+  if (is_struct()) {
+    return "struct";
+  }
+  switch (size) {
+    case 1:
+      return "byte";
+    case 2:
+      return "word";
+    default:
+      return "quad";
+  }
+}
+
+auto TypeLayout::format(std::span<const std::byte> data, int count, bool format_as_hex) const -> std::string
+{
+  assert(data.size() >= static_cast<std::size_t>(size * count));
+  std::string result;
+  for (int idx{0}; idx < count; ++idx) {
+    const auto element = data.subspan(idx * size, size);
+    if (idx > 0) {
+      result += ' ';
+    }
+    if (!is_struct()) {
+      const auto value = read_value(element, size);
+      result += format_as_hex ? fmt::format("{:0{}X}", value, size * 2) : fmt::format("{}", value);
+      continue;
+    }
+    result += '{';
+    for (const auto& field : fields) {
+      if (&field != &fields.front()) {
+        result += ", ";
+      }
+      result += fmt::format("{}: {}", field.name,
+                            field.type->format(element.subspan(field.offset), field.count, format_as_hex));
+    }
+    result += '}';
+  }
+  return result;
+}
+
+class ExpressionParser {
+  std::vector<Token> tokens_;
+  std::size_t pos_{0};
+  const C64DebuggerData* symbols_;
+  Expression& expr_;
+
+ public:
+  ExpressionParser(std::string_view text, const C64DebuggerData* symbols, Expression& expr) :
+      tokens_(tokenize(text)), symbols_(symbols), expr_(expr)
+  {
+  }
+
+  void parse()
+  {
+    expr_.immediate_ = accept("#");
+    const std::size_t start = pos_;
+    int root = parse_or();
+
+    // A location fully enclosed in parentheses is indirect, like (zp) in assembler
+    if (!expr_.immediate_ && tokens_[start].text == "(" && matching_paren(start) == pos_ - 1) {
+      root = add_node(Expression::Op::Deref, root, -1, 2);
+    }
+
+    expr_.type_ = TypeLayout::byte_type();
+    while (accept(",")) {
+      parse_suffix(root);
+    }
+    if (peek().kind == TokenKind::Identifier && peek().text == "as") {
+      ++pos_;
+      expr_.type_ = parse_type(expr_.count_);
+    }
+    throw_if<std::invalid_argument>(peek().kind != TokenKind::End,
+                                    fmt::format("Unexpected '{}' in expression", peek().text));
+    throw_if<std::invalid_argument>(expr_.immediate_ && (expr_.count_ != 1 || expr_.type_->size != 1),
+                                    "Immediate values have no type");
+
+    assign_index_scale(root, expr_.type_->size);
+    expr_.root_ = root;
+  }
+
+ private:
+  auto peek() const -> const Token& { return tokens_[pos_]; }
+
+  auto accept(std::string_view symbol) -> bool
+  {
+    if (peek().kind == TokenKind::Symbol && peek().text == symbol) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(std::string_view symbol)
+  {
+    throw_if<std::invalid_argument>(!accept(symbol),
+                                    fmt::format("Expected '{}' instead of '{}'", symbol, peek().text));
+  }
+
+  auto add_node(Expression::Op op, int lhs = -1, int rhs = -1, std::int64_t value = 0) -> int
+  {
+    expr_.nodes_.push_back({op, lhs, rhs, value});
+    return static_cast<int>(expr_.nodes_.size()) - 1;
+  }
+
+  auto matching_paren(std::size_t open_pos) const -> std::size_t
+  {
+    int depth{0};
+    for (std::size_t idx{open_pos}; idx < tokens_.size(); ++idx) {
+      if (tokens_[idx].kind != TokenKind::Symbol) {
+        continue;
+      }
+      if (tokens_[idx].text == "(") {
+        ++depth;
+      }
+      else if (tokens_[idx].text == ")" && --depth == 0) {
+        return idx;
+      }
+    }
+    return tokens_.size();
+  }
+
+  // Binary operators from lowest to highest precedence
+  auto parse_or() -> int { return parse_binary(&ExpressionParser::parse_xor, {{"|", Expression::Op::Or}}); }
+  auto parse_xor() -> int { return parse_binary(&ExpressionParser::parse_and, {{"^", Expression::Op::Xor}}); }
+  auto parse_and() -> int { return parse_binary(&ExpressionParser::parse_shift, {{"&", Expression::Op::And}}); }
+
+  auto parse_shift() -> int
+  {
+    return parse_binary(&ExpressionParser::parse_additive,
+                        {{"<<", Expression::Op::ShiftLeft}, {">>", Expression::Op::ShiftRight}});
+  }
+
+  auto parse_additive() -> int
+  {
+    return parse_binary(&ExpressionParser::parse_multiplicative,
+                        {{"+", Expression::Op::Add}, {"-", Expression::Op::Subtract}});
+  }
+
+  auto parse_multiplicative() -> int
+  {
+    return parse_binary(&ExpressionParser::parse_unary,
+                        {{"*", Expression::Op::Multiply}, {"/", Expression::Op::Divide}});
+  }
+
+  auto parse_binary(int (ExpressionParser::*parse_operand)(),
+                    std::initializer_list<std::pair<std::string_view, Expression::Op>> operators) -> int
+  {
+    int lhs = (this->*parse_operand)();
+    while (true) {
+      auto it = std::find_if(operators.begin(), operators.end(),
+                             [&](const auto& op) { return peek().kind == TokenKind::Symbol && peek().text == op.first; });
+      if (it == operators.end()) {
+        return lhs;
+      }
+      ++pos_;
+      lhs = add_node(it->second, lhs, (this->*parse_operand)());
+    }
+  }
+
+  auto parse_unary() -> int
+  {
+    static const std::array<std::pair<std::string_view, Expression::Op>, 4> unary_operators{{
+        {"-", Expression::Op::Negate},
+        {"~", Expression::Op::Complement},
+        {"<", Expression::Op::LowByte},
+        {">", Expression::Op::HighByte},
+    }};
+    for (const auto& [symbol, op] : unary_operators) {
+      if (accept(symbol)) {
+        return add_node(op, parse_unary());
+      }
+    }
+    return parse_postfix();
+  }
+
+  auto parse_postfix() -> int
+  {
+    int node = parse_primary();
+    while (accept("[")) {
+      node = add_node(Expression::Op::Index, node, parse_or());
+      expect("]");
+    }
+    return node;
+  }
+
+  auto parse_primary() -> int
+  {
+    const auto token = peek();
+    if (token.kind == TokenKind::Number) {
+      ++pos_;
+      return add_node(Expression::Op::Number, -1, -1, token.value);
+    }
+    if (accept("(")) {
+      const int node = parse_or();
+      expect(")");
+      return node;
+    }
+    throw_if<std::invalid_argument>(token.kind != TokenKind::Identifier,
+                                    token.kind == TokenKind::End ? "Unexpected end of expression"
+                                                                 : fmt::format("Unexpected '{}' in expression", token.text));
+    ++pos_;
+
+    const int access_size = scalar_size(token.text);
+    if (access_size > 0 && accept("(")) {
+      const int address = parse_or();
+      expect(")");
+      return add_node(Expression::Op::Deref, address, -1, access_size);
+    }
+
+    const auto* label = symbols_ ? symbols_->get_label_info(token.text) : nullptr;
+    throw_if<std::invalid_argument>(!label, fmt::format("Unknown label '{}'", token.text));
+    return add_node(Expression::Op::Number, -1, -1, label->address);
+  }
+
+  void parse_suffix(int& root)
+  {
+    const auto token = peek();
+    ++pos_;
+    if (token.kind == TokenKind::Number) {
+      throw_if<std::invalid_argument>(token.value < 1, "Element count must be positive");
+      expr_.count_ = static_cast<int>(std::min<std::int64_t>(max_elements, token.value));
+      return;
+    }
+    if (token.kind == TokenKind::Identifier && token.text.length() == 1) {
+      const char c = static_cast<char>(std::tolower(static_cast<unsigned char>(token.text.front())));
+      switch (c) {
+        case 'x':
+        case 'y':
+        case 'z':
+          root = add_node(Expression::Op::Add, root, add_node(Expression::Op::Register, -1, -1, c));
+          return;
+        case 'b':
+          expr_.type_ = TypeLayout::byte_type();
+          return;
+        case 'w':
+          expr_.type_ = TypeLayout::word_type();
+          return;
+        case 'q':
+          expr_.type_ = TypeLayout::quad_type();
+          return;
+      }
+    }
+    throw std::invalid_argument(fmt::format("Unexpected suffix '{}' in expression", token.text));
+  }
+
+  auto parse_type(int& count) -> std::shared_ptr<const TypeLayout>
+  {
+    std::shared_ptr<const TypeLayout> type;
+    if (accept("{")) {
+      auto layout = std::make_shared<TypeLayout>();
+      layout->size = 0;
+      do {
+        const auto name = peek();
+        throw_if<std::invalid_argument>(name.kind != TokenKind::Identifier, "Expected struct field name");
+        ++pos_;
+        expect(":");
+        TypeLayout::Field field{.name = std::string(name.text), .type = {}, .offset = layout->size};
+        field.type = parse_type(field.count);
+        layout->size += field.type->size * field.count;
+        layout->fields.push_back(std::move(field));
+      } while (accept(","));
+      expect("}");
+      type = std::move(layout);
+    }
+    else {
+      const auto name = peek();
+      const int size = name.kind == TokenKind::Identifier ? scalar_size(name.text) : 0;
+      throw_if<std::invalid_argument>(size == 0, fmt::format("Unknown type '{}'", name.text));
+      ++pos_;
+      type = size == 1 ? TypeLayout::byte_type() : size == 2 ? TypeLayout::word_type() : TypeLayout::quad_type();
+    }
+
+    count = 1;
+    if (accept("[")) {
+      const auto token = peek();
+      throw_if<std::invalid_argument>(token.kind != TokenKind::Number || token.value < 1,
+                                      "Expected element count");
+      ++pos_;
+      count = static_cast<int>(std::min<std::int64_t>(max_array_elements, token.value));
+      expect("]");
+    }
+    return type;
+  }
+
+  static auto scalar_size(std::string_view name) -> int
+  {
+    if (name == "byte") {
+      return 1;
+    }
+    if (name == "word") {
+      return 2;
+    }
+    if (name == "quad") {
+      return 4;
+    }
+    return 0;
+  }
+
+  // Indexing is scaled by the size of the element accessed with the indexed address
+  void assign_index_scale(int node_idx, int element_size)
+  {
+    if (node_idx < 0) {
+      return;
+    }
+    auto& node = expr_.nodes_[node_idx];
+    if (node.op == Expression::Op::Deref) {
+      element_size = static_cast<int>(node.value);
+    }
+    else if (node.op == Expression::Op::Index) {
+      node.value = element_size;
+    }
+    const int lhs = node.lhs;
+    const int rhs = node.rhs;
+    assign_index_scale(lhs, element_size);
+    assign_index_scale(rhs, element_size);
+  }
+};
+
+auto Expression::parse(std::string_view text, const C64DebuggerData* symbols) -> Expression
+{
+  Expression expr;
+  ExpressionParser(text, symbols, expr).parse();
+  return expr;
+}
+
+auto Expression::parse_type(std::string_view text, int& count) -> std::shared_ptr<const TypeLayout>
+{
+  const auto expr = parse(fmt::format("0 as {}", text), nullptr);
+  count = expr.count_;
+  return expr.type_;
+}
+
+auto Expression::evaluate(ExpressionContext& context, bool format_as_hex) const -> Result
+{
+  Result result;
+  if (immediate_) {
+    const auto value = eval(root_, context);
+    result.value = format_as_hex ? fmt::format("{:X}", value) : fmt::format("{}", value);
+    return result;
+  }
+
+  result.address = evaluate_address(context);
+  std::vector<std::byte> data(byte_size());
+  context.read_memory(result.address, data);
+  result.value = type_->format(data, count_, format_as_hex);
+  return result;
+}
+
+auto Expression::evaluate_address(ExpressionContext& context) const -> int
+{
+  throw_if<std::invalid_argument>(immediate_, "Immediate values have no address");
+  const auto address = eval(root_, context);
+  throw_if<std::out_of_range>(address < 0 || address + byte_size() > address_space_size,
+                              fmt::format("Address ${:X} outside of the address space", address));
+  return static_cast<int>(address);
+}
+
+auto Expression::eval(int node_idx, ExpressionContext& context) const -> std::int64_t
+{
+  const auto& node = nodes_[node_idx];
+  switch (node.op) {
+    case Op::Number:
+      return node.value;
+    case Op::Register:
+      return context.get_register(static_cast<char>(node.value));
+    case Op::Negate:
+      return -eval(node.lhs, context);
+    case Op::Complement:
+      return ~eval(node.lhs, context);
+    case Op::LowByte:
+      return eval(node.lhs, context) & 0xff;
+    case Op::HighByte:
+      return (eval(node.lhs, context) >> 8) & 0xff;
+    case Op::Deref: {
+      const auto address = eval(node.lhs, context);
+      throw_if<std::out_of_range>(address < 0 || address + node.value > address_space_size,
+                                  fmt::format("Address ${:X} outside of the address space", address));
+      std::array<std::byte, 4> data{};
+      const int size = static_cast<int>(node.value);
+      context.read_memory(static_cast<int>(address), std::span(data).first(size));
+      return read_value(data, size);
+    }
+    case Op::Index:
+      return eval(node.lhs, context) + eval(node.rhs, context) * node.value;
+    default:
+      break;
+  }
+
+  const auto lhs = eval(node.lhs, context);
+  const auto rhs = eval(node.rhs, context);
+  switch (node.op) {
+    case Op::Add:
+      return lhs + rhs;
+    case Op::Subtract:
+      return lhs - rhs;
+    case Op::Multiply:
+      return lhs * rhs;
+    case Op::Divide:
+      throw_if<std::domain_error>(rhs == 0, "Division by zero");
+      return lhs / rhs;
+    case Op::And:
+      return lhs & rhs;
+    case Op::Or:
+      return lhs | rhs;
+    case Op::Xor:
+      return lhs ^ rhs;
+    case Op::ShiftLeft:
+      return rhs < 0 || rhs > 62 ? 0 : lhs << rhs;
+    case Op::ShiftRight:
+      return rhs < 0 || rhs > 62 ? 0 : lhs >> rhs;
+    default:
+      throw std::logic_error("Unexpected expression node");
+  }
+}
+
+auto ExpressionCache::get(std::string_view text, const C64DebuggerData* symbols, std::uint64_t symbols_generation)
+    -> std::shared_ptr<const Expression>
+{
+  if (symbols_generation != symbols_generation_ || entries_.size() >= max_cached_expressions) {
+    entries_.clear();
+    symbols_generation_ = symbols_generation;
+  }
+
+  std::string key(text);
+  const auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    return it->second;
+  }
+  auto expr = std::make_shared<const Expression>(Expression::parse(text, symbols));
+  entries_.emplace(std::move(key), expr);
+  return expr;
+}
+
+}  // namespace m65dap
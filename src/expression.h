@@ -0,0 +1,152 @@
+#pragma once
+
+#include "c64_debugger_data.h"
+
+namespace m65dap {
+
+/**
+ * @brief Access to target memory and registers while evaluating an expression
+ */
+class ExpressionContext {
+ public:
+  virtual ~ExpressionContext() = default;
+
+  virtual void read_memory(int address, std::span<std::byte> target) = 0;
+  virtual auto get_register(char name) const -> int = 0;
+};
+
+/**
+ * @brief Layout of the data an expression refers to: byte, word, quad or a struct made of those
+ */
+struct TypeLayout {
+  struct Field {
+    std::string name;
+    std::shared_ptr<const TypeLayout> type;
+    int count{1};
+    int offset{0};
+  };
+
+  int size{1};
+  std::vector<Field> fields;  // empty for scalars
+
+  auto is_struct() const -> bool { return !fields.empty(); }
+
+  /**
+   * @brief Name of the type, "byte", "word", "quad" or "struct"
+   */
+  auto name() const -> std::string;
+
+  /**
+   * @brief Formats count consecutive elements, scalars are shown in hex (or decimal) and separated by blanks
+   */
+  auto format(std::span<const std::byte> data, int count, bool format_as_hex) const -> std::string;
+
+  static auto byte_type() -> std::shared_ptr<const TypeLayout>;
+  static auto word_type() -> std::shared_ptr<const TypeLayout>;
+  static auto quad_type() -> std::shared_ptr<const TypeLayout>;
+};
+
+/**
+ * @brief Expression parsed once for repeated evaluation
+ *
+ * An expression denotes a memory location, its value is the memory content:
+ *   $c000  0xc000  %1100  49152     addresses in hex, binary or decimal
+ *   label+2  label[3]  <label        labels and arithmetic (+ - * / & | ^ << >>, unary - ~ < >)
+ *   byte(e)  word(e)  quad(e)        values read from memory, e.g. word(ptr)+1
+ *   (ptr)                            indirect, the location is the word stored at ptr
+ *   e,x  e,b|w|q  e,N                index register, element type and element count
+ *   e as word[4]                     cast to a type, also to struct layouts like {x: byte, y: byte, hp: word}[8]
+ *   #e                               the value of the expression itself instead of memory content
+ *
+ * Indexing is scaled by the size of the accessed element. Labels are resolved while parsing, so evaluation only
+ * reads registers and memory.
+ */
+class Expression {
+ public:
+  struct Result {
+    std::string value;
+    int address{-1};
+  };
+
+  /**
+   * @brief Parses an expression, throws std::invalid_argument for syntax errors and unknown labels
+   *
+   * @param symbols Debug data to resolve labels with, may be nullptr
+   */
+  static auto parse(std::string_view text, const C64DebuggerData* symbols) -> Expression;
+
+  /**
+   * @brief Parses a type as accepted after "as", e.g. "word[4]" or "{x: byte, y: byte}[8]"
+   *
+   * @param count Receives the number of elements
+   */
+  static auto parse_type(std::string_view text, int& count) -> std::shared_ptr<const TypeLayout>;
+
+  auto evaluate(ExpressionContext& context, bool format_as_hex = true) const -> Result;
+
+  /**
+   * @brief Evaluates the address of the location denoted by the expression
+   */
+  auto evaluate_address(ExpressionContext& context) const -> int;
+
+  auto is_immediate() const -> bool { return immediate_; }
+  auto type() const -> const TypeLayout& { return *type_; }
+  auto count() const -> int { return count_; }
+  auto byte_size() const -> int { return type_->size * count_; }
+
+ private:
+  friend class ExpressionParser;
+
+  enum class Op : std::uint8_t {
+    Number,
+    Register,
+    Negate,
+    Complement,
+    LowByte,
+    HighByte,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    And,
+    Or,
+    Xor,
+    ShiftLeft,
+    ShiftRight,
+    Deref,  // value holds the access size
+    Index,  // value holds the element size the index is scaled with
+  };
+
+  struct Node {
+    Op op;
+    int lhs{-1};
+    int rhs{-1};
+    std::int64_t value{0};
+  };
+
+  // Nodes are stored in a flat array and refer to their operands by index
+  std::vector<Node> nodes_;
+  int root_{-1};
+  bool immediate_{false};
+  std::shared_ptr<const TypeLayout> type_;
+  int count_{1};
+
+  auto eval(int node_idx, ExpressionContext& context) const -> std::int64_t;
+};
+
+/**
+ * @brief Parsed expressions by expression text, so repeated evaluations (e.g. watches at every stop) skip parsing
+ *
+ * Entries are only valid for the symbols they were parsed with and dropped once the symbol generation changes.
+ */
+class ExpressionCache {
+  std::unordered_map<std::string, std::shared_ptr<const Expression>> entries_;
+  std::uint64_t symbols_generation_{0};
+
+ public:
+  auto get(std::string_view text, const C64DebuggerData* symbols, std::uint64_t symbols_generation)
+      -> std::shared_ptr<const Expression>;
+  auto size() const -> std::size_t { return entries_.size(); }
+};
+
+}  // namespace m65dap
@@ -0,0 +1,62 @@
+#include "frame_timer.h"
+
+namespace m65dap {
+
+void FrameTimer::Statistics::add(int value)
+{
+  min = count == 0 ? value : std::min(min, value);
+  max = count == 0 ? value : std::max(max, value);
+  sum += value;
+  ++count;
+}
+
+auto FrameTimer::Report::to_string() const -> std::string
+{
+  if (raster_lines.count == 0) {
+    return "No frames measured";
+  }
+
+  auto result = fmt::format("{} frames, raster lines min {} / avg {:.1f} / max {}\n", raster_lines.count,
+                            raster_lines.min, raster_lines.average(), raster_lines.max);
+  if (cia_ticks.count > 0) {
+    result.append(fmt::format("CIA timer ticks min {} / avg {:.1f} / max {}\n", cia_ticks.min, cia_ticks.average(),
+                              cia_ticks.max));
+  }
+  for (const auto& [first_line, frames] : histogram) {
+    result.append(fmt::format("{:3}-{:3}: {}\n", first_line, first_line + histogram_bucket_lines - 1, frames));
+  }
+  return result;
+}
+
+void FrameTimer::start(int start_pc, int end_pc, bool use_cia_timer, int lines_per_frame)
+{
+  start_pc_ = start_pc;
+  end_pc_ = end_pc;
+  use_cia_timer_ = use_cia_timer;
+  lines_per_frame_ = lines_per_frame;
+  waiting_for_end_ = false;
+  report_ = {};
+  active_ = true;
+}
+
+void FrameTimer::add_measurement(int raster_line, int cia_timer)
+{
+  if (!waiting_for_end_) {
+    start_raster_line_ = raster_line;
+    start_cia_timer_ = cia_timer;
+    waiting_for_end_ = true;
+    return;
+  }
+
+  waiting_for_end_ = false;
+  const int lines = (raster_line - start_raster_line_ + lines_per_frame_) % lines_per_frame_;
+  report_.raster_lines.add(lines);
+  ++report_.histogram[lines - lines % histogram_bucket_lines];
+
+  if (use_cia_timer_) {
+    // CIA timers count down
+    report_.cia_ticks.add((start_cia_timer_ - cia_timer) & 0xFFFF);
+  }
+}
+
+}  // namespace m65dap
@@ -0,0 +1,59 @@
+#pragma once
+
+namespace m65dap {
+
+/**
+ * @brief Collects frame time statistics between a start and an end breakpoint
+ *
+ * Each measurement consists of the raster line (and optionally the CIA timer value) read when the start and when the
+ * end breakpoint was hit. The numbers include the latency of the monitor between halting the CPU and reading the
+ * registers, so they are most meaningful for code spanning several raster lines.
+ */
+class FrameTimer {
+ public:
+  static constexpr int histogram_bucket_lines = 8;
+
+  struct Statistics {
+    int count{0};
+    int min{0};
+    int max{0};
+    std::int64_t sum{0};
+
+    void add(int value);
+    auto average() const -> double { return count > 0 ? static_cast<double>(sum) / count : 0.0; }
+  };
+
+  struct Report {
+    Statistics raster_lines;
+    Statistics cia_ticks;
+    // Number of frames per raster line bucket (key is the first line of the bucket)
+    std::map<int, int> histogram;
+
+    auto to_string() const -> std::string;
+  };
+
+ private:
+  bool active_{false};
+  bool waiting_for_end_{false};
+  int start_pc_{0};
+  int end_pc_{0};
+  bool use_cia_timer_{false};
+  int lines_per_frame_{312};
+  int start_raster_line_{0};
+  int start_cia_timer_{0};
+  Report report_;
+
+ public:
+  void start(int start_pc, int end_pc, bool use_cia_timer, int lines_per_frame);
+  void stop() { active_ = false; }
+  auto is_active() const -> bool { return active_; }
+  auto uses_cia_timer() const -> bool { return use_cia_timer_; }
+
+  // Address of the breakpoint to arm for the next measurement
+  auto next_breakpoint_pc() const -> int { return waiting_for_end_ ? end_pc_ : start_pc_; }
+
+  void add_measurement(int raster_line, int cia_timer = 0);
+  auto report() const -> const Report& { return report_; }
+};
+
+}  // namespace m65dap
@@ -0,0 +1,181 @@
+#include "io_registers.h"
+
+namespace m65dap {
+
+namespace {
+
+// $D000-$DFFF
+constexpr int io_area_size = 0x1000;
+
+constexpr auto vic_fields = std::to_array<RegisterField>({
+    {"S0X", 0x00}, {"S0Y", 0x01}, {"S1X", 0x02}, {"S1Y", 0x03}, {"S2X", 0x04}, {"S2Y", 0x05}, {"S3X", 0x06},
+    {"S3Y", 0x07}, {"S4X", 0x08}, {"S4Y", 0x09}, {"S5X", 0x0A}, {"S5Y", 0x0B}, {"S6X", 0x0C}, {"S6Y", 0x0D},
+    {"S7X", 0x0E}, {"S7Y", 0x0F}, {"SXMSB", 0x10},
+    {"YSCL", 0x11, 0, 3}, {"RSEL", 0x11, 3, 1}, {"BLNK", 0x11, 4, 1}, {"BMM", 0x11, 5, 1}, {"ECM", 0x11, 6, 1},
+    {"RC8", 0x11, 7, 1}, {"RC", 0x12}, {"LPX", 0x13}, {"LPY", 0x14}, {"SE", 0x15},
+    {"XSCL", 0x16, 0, 3}, {"CSEL", 0x16, 3, 1}, {"MCM", 0x16, 4, 1}, {"SEXY", 0x17},
+    {"CB", 0x18, 1, 3}, {"VS", 0x18, 4, 4}, {"IRQ", 0x19}, {"IRQMASK", 0x1A},
+    {"BSP", 0x1B}, {"SCM", 0x1C}, {"SEXX", 0x1D}, {"SSC", 0x1E}, {"SBC", 0x1F},
+    {"BORDERCOL", 0x20}, {"SCREENCOL", 0x21}, {"MC1", 0x22}, {"MC2", 0x23}, {"MC3", 0x24}, {"SPRMC0", 0x25},
+    {"SPRMC1", 0x26}, {"SPR0COL", 0x27}, {"SPR1COL", 0x28}, {"SPR2COL", 0x29}, {"SPR3COL", 0x2A},
+    {"SPR4COL", 0x2B}, {"SPR5COL", 0x2C}, {"SPR6COL", 0x2D}, {"SPR7COL", 0x2E}, {"KEY", 0x2F},
+    {"CRAM2K", 0x30, 0, 1}, {"PAL", 0x30, 2, 1}, {"ROM8", 0x30, 3, 1}, {"ROMA", 0x30, 4, 1}, {"ROMC", 0x30, 5, 1},
+    {"CROM9", 0x30, 6, 1}, {"ROME", 0x30, 7, 1},
+    {"INT", 0x31, 0, 1}, {"MONO", 0x31, 1, 1}, {"H1280", 0x31, 2, 1}, {"V400", 0x31, 3, 1}, {"BPM", 0x31, 4, 1},
+    {"ATTR", 0x31, 5, 1}, {"FAST", 0x31, 6, 1}, {"H640", 0x31, 7, 1},
+    {"TBDRPOS", 0x48, 0, 12}, {"BBDRPOS", 0x4A, 0, 12}, {"TEXTXPOS", 0x4C, 0, 12}, {"TEXTYPOS", 0x4E, 0, 12},
+    {"CHR16", 0x54, 0, 1}, {"FCLRLO", 0x54, 1, 1}, {"FCLRHI", 0x54, 2, 1}, {"SMTH", 0x54, 3, 1},
+    {"SPR640", 0x54, 4, 1}, {"PALEMU", 0x54, 5, 1}, {"VFAST", 0x54, 6, 1}, {"ALPHEN", 0x54, 7, 1},
+    {"LINESTEP", 0x58, 0, 16}, {"CHRXSCL", 0x5A}, {"CHRYSCL", 0x5B}, {"CHRCOUNT", 0x5E},
+    {"SCRNPTR", 0x60, 0, 28}, {"COLPTR", 0x64, 0, 16}, {"CHARPTR", 0x68, 0, 23}, {"SPRPTRADR", 0x6C, 0, 23},
+    {"SPRPTR16", 0x6E, 7, 1}, {"RASLINE0", 0x6F, 0, 6}, {"PALNTSC", 0x6F, 7, 1},
+    {"ABTPALSEL", 0x70, 0, 2}, {"SPRPALSEL", 0x70, 2, 2}, {"BTPALSEL", 0x70, 4, 2}, {"MAPEDPAL", 0x70, 6, 2},
+    {"BP16ENS", 0x71},
+});
+constexpr std::array<int, 1> vic_chips{0x000};
+// Sprite-sprite and sprite-background collisions are cleared when read
+constexpr std::array<int, 2> vic_read_sensitive{0x1E, 0x1F};
+
+constexpr auto sid_fields = std::to_array<RegisterField>({
+    {"V1 FREQ", 0x00, 0, 16}, {"V1 PW", 0x02, 0, 12}, {"V1 CTRL", 0x04}, {"V1 AD", 0x05}, {"V1 SR", 0x06},
+    {"V2 FREQ", 0x07, 0, 16}, {"V2 PW", 0x09, 0, 12}, {"V2 CTRL", 0x0B}, {"V2 AD", 0x0C}, {"V2 SR", 0x0D},
+    {"V3 FREQ", 0x0E, 0, 16}, {"V3 PW", 0x10, 0, 12}, {"V3 CTRL", 0x12}, {"V3 AD", 0x13}, {"V3 SR", 0x14},
+    {"FC LO", 0x15, 0, 3}, {"FC HI", 0x16}, {"RES FILT", 0x17}, {"MODE VOL", 0x18},
+    {"POTX", 0x19}, {"POTY", 0x1A}, {"OSC3", 0x1B}, {"ENV3", 0x1C},
+});
+constexpr std::array<int, 4> sid_chips{0x400, 0x420, 0x440, 0x460};
+
+constexpr auto cia_fields = std::to_array<RegisterField>({
+    {"PRA", 0x00}, {"PRB", 0x01}, {"DDRA", 0x02}, {"DDRB", 0x03}, {"TA", 0x04, 0, 16}, {"TB", 0x06, 0, 16},
+    {"TOD 10THS", 0x08}, {"TOD SEC", 0x09}, {"TOD MIN", 0x0A}, {"TOD HR", 0x0B},
+    {"SDR", 0x0C}, {"ICR", 0x0D}, {"CRA", 0x0E}, {"CRB", 0x0F},
+});
+constexpr std::array<int, 2> cia_chips{0xC00, 0xD00};
+// The interrupt flags are cleared when read, reading the hours latches the time of day clock until the tenths of
+// seconds are read
+constexpr std::array<int, 2> cia_read_sensitive{0x0B, 0x0D};
+
+constexpr auto dma_fields = std::to_array<RegisterField>({
+    {"ADDRLSBTRIG", 0x00}, {"ADDRMSB", 0x01}, {"ADDRBANK", 0x02, 0, 7}, {"EN018B", 0x03, 0, 1}, {"ADDRMB", 0x04},
+    {"ETRIG", 0x05}, {"ADDRLSB", 0x0E},
+});
+constexpr std::array<int, 1> dma_chips{0x700};
+
+constexpr std::array<RegisterBank, 4> register_banks{{
+    {"VIC-IV", vic_fields, vic_chips, vic_read_sensitive},
+    {"SID", sid_fields, sid_chips, {}},
+    {"CIA", cia_fields, cia_chips, cia_read_sensitive},
+    {"DMAgic", dma_fields, dma_chips, {}},
+}};
+
+auto field_byte_count(const RegisterField& field) -> int { return (field.bit + field.bits + 7) / 8; }
+
+// Read sensitive registers of all banks, a window must not touch the ones of neighbouring chips either
+auto read_sensitive_offsets() -> const std::vector<bool>&
+{
+  static const auto sensitive = [] {
+    std::vector<bool> offsets(io_area_size);
+    for (const auto& bank : register_banks) {
+      for (const int chip : bank.chip_offsets) {
+        for (const int reg : bank.read_sensitive) {
+          offsets[chip + reg] = true;
+        }
+      }
+    }
+    return offsets;
+  }();
+  return sensitive;
+}
+
+}  // namespace
+
+auto get_register_banks() -> std::span<const RegisterBank> { return register_banks; }
+
+auto plan_register_window(int offset, int count) -> std::optional<int>
+{
+  const auto& sensitive = read_sensitive_offsets();
+  auto is_safe_window = [&](int start) {
+    if (start < 0 || start + register_window_size > io_area_size) {
+      return false;
+    }
+    const auto first = sensitive.begin() + start;
+    return std::none_of(first, first + register_window_size, std::identity());
+  };
+
+  // Start the window at the register if possible, otherwise move it back until it ends before the sensitive
+  // register following it
+  for (int start{offset}; start > offset + count - register_window_size - 1; --start) {
+    if (is_safe_window(start)) {
+      return start;
+    }
+  }
+  return {};
+}
+
+auto plan_register_reads(const RegisterBank& bank) -> std::vector<int>
+{
+  const auto& sensitive = read_sensitive_offsets();
+  std::vector<bool> wanted(io_area_size);
+  for (const int chip : bank.chip_offsets) {
+    for (const auto& field : bank.fields) {
+      for (int idx{0}; idx < field_byte_count(field); ++idx) {
+        wanted[chip + field.offset + idx] = !sensitive[chip + field.offset + idx];
+      }
+    }
+  }
+
+  std::vector<int> plan;
+  for (int offset{0}; offset < io_area_size; ++offset) {
+    if (!wanted[offset] || (!plan.empty() && offset < plan.back() + register_window_size)) {
+      continue;
+    }
+    if (const auto start = plan_register_window(offset, 1)) {
+      plan.push_back(start.value());
+    }
+  }
+  return plan;
+}
+
+auto decode_registers(const RegisterBank& bank, std::span<const int> plan, std::span<const std::byte> windows)
+    -> std::vector<RegisterValue>
+{
+  throw_if<std::invalid_argument>(windows.size() != plan.size() * register_window_size,
+                                  "Register windows don't match plan");
+
+  auto read_byte = [&](int offset) -> std::optional<std::uint32_t> {
+    for (std::size_t idx{0}; idx < plan.size(); ++idx) {
+      if (offset >= plan[idx] && offset < plan[idx] + register_window_size) {
+        return std::to_integer<std::uint32_t>(windows[idx * register_window_size + offset - plan[idx]]);
+      }
+    }
+    return {};
+  };
+
+  std::vector<RegisterValue> result;
+  result.reserve(bank.chip_offsets.size() * bank.fields.size());
+  for (std::size_t chip_idx{0}; chip_idx < bank.chip_offsets.size(); ++chip_idx) {
+    const int chip = bank.chip_offsets[chip_idx];
+    const auto prefix =
+        bank.chip_offsets.size() > 1 ? fmt::format("{}{} ", bank.name, chip_idx + 1) : std::string();
+    for (const auto& field : bank.fields) {
+      RegisterValue value{.name = prefix + std::string(field.name),
+                          .address = 0xD000 + chip + field.offset,
+                          .value = {},
+                          .bits = field.bits};
+      std::uint32_t raw{0};
+      bool complete{true};
+      for (int idx{0}; idx < field_byte_count(field) && complete; ++idx) {
+        const auto byte = read_byte(chip + field.offset + idx);
+        complete = byte.has_value();
+        raw |= byte.value_or(0) << (8 * idx);
+      }
+      if (complete) {
+        value.value = (raw >> field.bit) & static_cast<std::uint32_t>((std::uint64_t{1} << field.bits) - 1);
+      }
+      result.push_back(std::move(value));
+    }
+  }
+  return result;
+}
+
+}  // namespace m65dap
@@ -0,0 +1,70 @@
+#pragma once
+
+namespace m65dap {
+
+// Bytes returned by one memory read command of the monitor, the unit register reads are planned in
+constexpr int register_window_size = 16;
+
+/**
+ * @brief Bit field of an I/O register, fields wider than 8 bits span consecutive registers in little endian order
+ */
+struct RegisterField {
+  std::string_view name;
+  int offset{0};  // relative to the chip
+  int bit{0};     // lowest bit of the field
+  int bits{8};
+};
+
+/**
+ * @brief Register layout of one kind of I/O chip and the places it is mapped to
+ */
+struct RegisterBank {
+  std::string_view name;
+  std::span<const RegisterField> fields;
+  std::span<const int> chip_offsets;    // chips sharing the layout, relative to $D000
+  std::span<const int> read_sensitive;  // registers changing state when read, relative to the chip
+};
+
+struct RegisterValue {
+  std::string name;
+  int address{0};                      // $Dxxx
+  std::optional<std::uint32_t> value;  // no value if the field can't be read without side effects
+  int bits{8};
+};
+
+/**
+ * @brief VIC-IV, SID, CIA and DMAgic register banks, in the order they are shown
+ */
+auto get_register_banks() -> std::span<const RegisterBank>;
+
+/**
+ * @brief Plans the read of consecutive registers as one window of register_window_size bytes
+ *
+ * The window doesn't cover any read sensitive register, it starts at the first register if possible.
+ *
+ * @param offset First register relative to $D000
+ * @param count Number of registers, at most register_window_size
+ * @return Start offset of the window relative to $D000, no value if there is no such window
+ */
+auto plan_register_window(int offset, int count) -> std::optional<int>;
+
+/**
+ * @brief Plans the reads of all fields of a bank as windows of register_window_size bytes
+ *
+ * Read sensitive registers (e.g. the CIA interrupt control register, cleared when read) are never covered by a
+ * window. Windows may start before or end behind a field to avoid them, but stay within the I/O area. Fields that
+ * can't be covered this way are left out of the plan.
+ *
+ * @return Start offsets of the windows relative to $D000, ascending
+ */
+auto plan_register_reads(const RegisterBank& bank) -> std::vector<int>;
+
+/**
+ * @brief Decodes the fields of a bank from the windows read according to plan_register_reads()
+ *
+ * @param windows Content of the windows, register_window_size bytes per planned window
+ */
+auto decode_registers(const RegisterBank& bank, std::span<const int> plan, std::span<const std::byte> windows)
+    -> std::vector<RegisterValue>;
+
+}  // namespace m65dap
@@ -1,9 +1,82 @@
 #include "m65_dap_session.h"
 
+#include "monitor_devices.h"
+
 using namespace std::chrono_literals;
 
 namespace dap {
 
+// The bundled protocol definitions predate the writeMemory request, so its capability is added here
+struct M65InitializeResponse : InitializeResponse {
+  optional<boolean> supportsWriteMemoryRequest;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65InitializeResponse);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO_EXT(M65InitializeResponse,
+                                  InitializeResponse,
+                                  "",
+                                  DAP_FIELD(supportsWriteMemoryRequest, "supportsWriteMemoryRequest"));
+
+struct M65InitializeRequest : InitializeRequest {
+  using Response = M65InitializeResponse;
+
+  optional<boolean> supportsMemoryEvent;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65InitializeRequest);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO_EXT(M65InitializeRequest,
+                                  InitializeRequest,
+                                  "initialize",
+                                  DAP_FIELD(supportsMemoryEvent, "supportsMemoryEvent"));
+
+// memory event, also missing in the bundled protocol definitions. Tells the client which memory to fetch again.
+struct M65MemoryEvent : Event {
+  string memoryReference;
+  integer offset;
+  integer count;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65MemoryEvent);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65MemoryEvent,
+                              "memory",
+                              DAP_FIELD(memoryReference, "memoryReference"),
+                              DAP_FIELD(offset, "offset"),
+                              DAP_FIELD(count, "count"));
+
+struct M65WriteMemoryResponse : Response {
+  optional<integer> offset;
+  optional<integer> bytesWritten;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65WriteMemoryResponse);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65WriteMemoryResponse,
+                              "",
+                              DAP_FIELD(offset, "offset"),
+                              DAP_FIELD(bytesWritten, "bytesWritten"));
+
+// writeMemory request as defined by the DAP specification, data is base64 encoded
+struct M65WriteMemoryRequest : Request {
+  using Response = M65WriteMemoryResponse;
+
+  string memoryReference;
+  optional<integer> offset;
+  optional<boolean> allowPartial;
+  string data;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65WriteMemoryRequest);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65WriteMemoryRequest,
+                              "writeMemory",
+                              DAP_FIELD(memoryReference, "memoryReference"),
+                              DAP_FIELD(offset, "offset"),
+                              DAP_FIELD(allowPartial, "allowPartial"),
+                              DAP_FIELD(data, "data"));
+
 struct M65LaunchRequest : LaunchRequest {
   using Response = LaunchResponse;
 
@@ -14,6 +87,11 @@ struct M65LaunchRequest : LaunchRequest {
   optional<string> serialPort;
   optional<dap::boolean> resetBeforeRun;
   optional<dap::boolean> resetAfterDisconnect;
+  optional<dap::boolean> receiveThread;
+  optional<string> recordSession;
+  optional<dap::number> replaySpeed;
+  // Types of labels shown as local variables, e.g. {"table": "byte[4096]", "sprites": "{x: word, y: byte}[8]"}
+  optional<object> variableTypes;
 };
 
 DAP_DECLARE_STRUCT_TYPEINFO(M65LaunchRequest);
@@ -25,7 +103,200 @@ DAP_IMPLEMENT_STRUCT_TYPEINFO(M65LaunchRequest,
                               DAP_FIELD(program, "program"),
                               DAP_FIELD(serialPort, "serialPort"),
                               DAP_FIELD(resetBeforeRun, "resetBeforeRun"),
-                              DAP_FIELD(resetAfterDisconnect, "resetAfterDisconnect"));
+                              DAP_FIELD(resetAfterDisconnect, "resetAfterDisconnect"),
+                              DAP_FIELD(receiveThread, "receiveThread"),
+                              DAP_FIELD(recordSession, "recordSession"),
+                              DAP_FIELD(replaySpeed, "replaySpeed"),
+                              DAP_FIELD(variableTypes, "variableTypes"));
+
+struct M65ProfileResponse : Response {
+  integer totalSamples;
+  optional<string> collapsedStacks;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65ProfileResponse);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65ProfileResponse,
+                              "",
+                              DAP_FIELD(totalSamples, "totalSamples"),
+                              DAP_FIELD(collapsedStacks, "collapsedStacks"));
+
+// Custom request controlling the PC sampling profiler.
+// action is one of "start", "stop", "reset" or "report". "stop" and "report" return the profile in collapsed stack
+// format, optionally also written to outputFile.
+struct M65ProfileRequest : Request {
+  using Response = M65ProfileResponse;
+
+  string action;
+  optional<integer> sampleRate;
+  optional<string> outputFile;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65ProfileRequest);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65ProfileRequest,
+                              "profile",
+                              DAP_FIELD(action, "action"),
+                              DAP_FIELD(sampleRate, "sampleRate"),
+                              DAP_FIELD(outputFile, "outputFile"));
+
+struct M65FrameTimingResponse : Response {
+  integer frames;
+  optional<integer> minLines;
+  optional<integer> maxLines;
+  optional<number> avgLines;
+  optional<integer> minTicks;
+  optional<integer> maxTicks;
+  optional<number> avgTicks;
+  array<integer> histogram;
+  integer histogramBucketLines;
+  string summary;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65FrameTimingResponse);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65FrameTimingResponse,
+                              "",
+                              DAP_FIELD(frames, "frames"),
+                              DAP_FIELD(minLines, "minLines"),
+                              DAP_FIELD(maxLines, "maxLines"),
+                              DAP_FIELD(avgLines, "avgLines"),
+                              DAP_FIELD(minTicks, "minTicks"),
+                              DAP_FIELD(maxTicks, "maxTicks"),
+                              DAP_FIELD(avgTicks, "avgTicks"),
+                              DAP_FIELD(histogram, "histogram"),
+                              DAP_FIELD(histogramBucketLines, "histogramBucketLines"),
+                              DAP_FIELD(summary, "summary"));
+
+// Custom request controlling the raster line frame timer.
+// action is one of "start" (requires start and end location), "stop" or "report". All actions return the
+// statistics collected so far.
+struct M65FrameTimingRequest : Request {
+  using Response = M65FrameTimingResponse;
+
+  string action;
+  optional<string> start;
+  optional<string> end;
+  optional<boolean> useCiaTimer;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65FrameTimingRequest);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65FrameTimingRequest,
+                              "frameTiming",
+                              DAP_FIELD(action, "action"),
+                              DAP_FIELD(start, "start"),
+                              DAP_FIELD(end, "end"),
+                              DAP_FIELD(useCiaTimer, "useCiaTimer"));
+
+struct M65TraceRecordingResponse : Response {
+  integer totalRecords;
+  optional<array<string>> instructions;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65TraceRecordingResponse);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65TraceRecordingResponse,
+                              "",
+                              DAP_FIELD(totalRecords, "totalRecords"),
+                              DAP_FIELD(instructions, "instructions"));
+
+// Custom request controlling the instruction trace recorder.
+// action is one of "start" (requires file, capacity is the number of steps kept), "stop" or "query". "query" returns
+// the last count instructions, or the ones executed before pc was reached the last time if pc is given.
+struct M65TraceRecordingRequest : Request {
+  using Response = M65TraceRecordingResponse;
+
+  string action;
+  optional<string> file;
+  optional<integer> capacity;
+  optional<integer> count;
+  optional<integer> pc;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65TraceRecordingRequest);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65TraceRecordingRequest,
+                              "traceRecording",
+                              DAP_FIELD(action, "action"),
+                              DAP_FIELD(file, "file"),
+                              DAP_FIELD(capacity, "capacity"),
+                              DAP_FIELD(count, "count"),
+                              DAP_FIELD(pc, "pc"));
+
+struct M65CoverageResponse : Response {
+  integer coveredStatements;
+  integer totalStatements;
+  optional<string> lcov;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65CoverageResponse);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65CoverageResponse,
+                              "",
+                              DAP_FIELD(coveredStatements, "coveredStatements"),
+                              DAP_FIELD(totalStatements, "totalStatements"),
+                              DAP_FIELD(lcov, "lcov"));
+
+// Custom request returning the code coverage gathered by the profiler and the trace recorder.
+// The coverage is written to outputFile in LCOV format if given, otherwise returned as lcov. If mergeFile is given,
+// the coverage saved there by previous runs is merged in and the result is saved back to it.
+struct M65CoverageRequest : Request {
+  using Response = M65CoverageResponse;
+
+  optional<string> outputFile;
+  optional<string> mergeFile;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65CoverageRequest);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65CoverageRequest,
+                              "coverage",
+                              DAP_FIELD(outputFile, "outputFile"),
+                              DAP_FIELD(mergeFile, "mergeFile"));
+
+struct M65MemorySearchResponse : Response {
+  array<string> addresses;
+  boolean truncated;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65MemorySearchResponse);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65MemorySearchResponse,
+                              "",
+                              DAP_FIELD(addresses, "addresses"),
+                              DAP_FIELD(truncated, "truncated"));
+
+// Custom request searching count bytes of memory starting at memoryReference for a pattern as described for
+// m65dap::SearchPattern. Matches are sent as memorySearchResults events while the memory is transferred, the
+// response holds all of them. truncated is set if the search ended at maxResults matches.
+struct M65MemorySearchRequest : Request {
+  using Response = M65MemorySearchResponse;
+
+  string memoryReference;
+  integer count;
+  string pattern;
+  optional<integer> maxResults;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65MemorySearchRequest);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65MemorySearchRequest,
+                              "memorySearch",
+                              DAP_FIELD(memoryReference, "memoryReference"),
+                              DAP_FIELD(count, "count"),
+                              DAP_FIELD(pattern, "pattern"),
+                              DAP_FIELD(maxResults, "maxResults"));
+
+struct M65MemorySearchResultsEvent : Event {
+  array<string> addresses;
+};
+
+DAP_DECLARE_STRUCT_TYPEINFO(M65MemorySearchResultsEvent);
+
+DAP_IMPLEMENT_STRUCT_TYPEINFO(M65MemorySearchResultsEvent,
+                              "memorySearchResults",
+                              DAP_FIELD(addresses, "addresses"));
 
 }  // namespace dap
 
@@ -33,7 +304,33 @@ namespace {
 
 const int thread_id = 1;
 
+const int default_profile_sample_rate = 200;
+
+const int default_trace_capacity = 4 * 1024 * 1024;
+const int default_trace_query_count = 100;
+
+const int default_search_max_results = 1000;
+
+// More changed ranges are reported as a single one spanning all of them
+const std::size_t max_memory_events = 16;
+
 const int var_registers_id = 1;
+// Local variables of stack frame n (starting at 1) have the id var_locals_first_id + n - 1
+const int var_locals_first_id = 100;
+// Registers of the I/O chip banks returned by m65dap::get_register_banks()
+const int var_io_registers_first_id = 10;
+
+// Memory references handed out to the client are "$<hex address>", hex with "0x" prefix and decimal are accepted too
+auto parse_memory_reference(std::string_view reference) -> std::int64_t
+{
+  if (reference.starts_with('$')) {
+    return m65dap::str_to_int(reference.substr(1), 16);
+  }
+  if (reference.starts_with("0x") || reference.starts_with("0X")) {
+    return m65dap::str_to_int(reference.substr(2), 16);
+  }
+  return m65dap::str_to_int(reference);
+}
 
 }  // namespace
 
@@ -84,6 +381,37 @@ void M65DapSession::handle_debugger_stopped(M65Debugger::StoppedReason reason)
   session_->send(event);
 }
 
+void M65DapSession::handle_memory_changed(std::span<const std::pair<int, int>> ranges)
+{
+  if (!client_supports_memory_event_ || ranges.empty()) {
+    return;
+  }
+  auto send_event = [&](int first_address, int last_address) {
+    dap::M65MemoryEvent event;
+    event.memoryReference = fmt::format("${:X}", first_address);
+    event.offset = 0;
+    event.count = last_address - first_address + 1;
+    session_->send(event);
+  };
+  if (ranges.size() > max_memory_events) {
+    send_event(ranges.front().first, ranges.back().second);
+    return;
+  }
+  for (const auto& [first_address, last_address] : ranges) {
+    send_event(first_address, last_address);
+  }
+}
+
+void M65DapSession::send_memory_invalidated()
+{
+  // Values shown in the variables and watch views may depend on the written memory
+  if (client_supports_invalidated_event_) {
+    dap::InvalidatedEvent event;
+    event.areas = {"variables"};
+    session_->send(event);
+  }
+}
+
 void M65DapSession::debug_out(std::string_view msg)
 {
   dap::OutputEvent event;
@@ -106,20 +434,26 @@ void M65DapSession::register_error_handler()
 
 void M65DapSession::register_request_handlers()
 {
-  session_->registerHandler([&](const dap::InitializeRequest& req) {
+  session_->registerHandler([&](const dap::M65InitializeRequest& req) {
     client_supports_variable_type_ = req.supportsVariableType.value(false);
     client_supports_memory_references_ = req.supportsMemoryReferences.value(false);
+    client_supports_invalidated_event_ = req.supportsInvalidatedEvent.value(false);
+    client_supports_memory_event_ = req.supportsMemoryEvent.value(false);
 
-    dap::InitializeResponse res;
+    dap::M65InitializeResponse res;
     res.supportsConfigurationDoneRequest = true;
     res.supportsValueFormattingOptions = true;
     res.supportsReadMemoryRequest = true;
+    res.supportsWriteMemoryRequest = true;
+    res.supportsSetExpression = true;
+    res.supportsDelayedStackTraceLoading = true;
     res.supportsDisassembleRequest = true;
+    res.supportsStepBack = true;
     return res;
   });
 
   session_->registerSentHandler(
-      [&](const dap::ResponseOrError<dap::InitializeResponse>&) { session_->send(dap::InitializedEvent()); });
+      [&](const dap::ResponseOrError<dap::M65InitializeResponse>&) { session_->send(dap::InitializedEvent()); });
 
   session_->registerHandler(
       [&](const dap::ConfigurationDoneRequest&) -> dap::ResponseOrError<dap::ConfigurationDoneResponse> {
@@ -150,13 +484,28 @@ void M65DapSession::register_request_handlers()
     dap::boolean reset_before_run = req.resetBeforeRun.has_value() ? req.resetBeforeRun.value() : dap::boolean(false);
     dap::boolean reset_after_disconnect =
         req.resetAfterDisconnect.has_value() ? req.resetAfterDisconnect.value() : dap::boolean(true);
+    dap::boolean receive_thread = req.receiveThread.has_value() ? req.receiveThread.value() : dap::boolean(true);
+    const std::string record_session = req.recordSession.value("");
+    const std::u8string recording_path_u8(record_session.begin(), record_session.end());
+    const double replay_speed = req.replaySpeed.value(1.0);
+
+    std::string serial_port = req.serialPort.value();
+    if (serial_port == "auto") {
+      const auto candidates = monitor_candidates();
+      const auto monitor = discover_monitor(candidates, default_discovery_cache_path());
+      if (!monitor.has_value()) {
+        return dap::Error(fmt::format("No MEGA65 or Xemu monitor found, tried {}", fmt::join(candidates, ", ")));
+      }
+      serial_port = monitor->device;
+      debug_out(fmt::format("Found {} monitor on {}\n", monitor->is_xemu ? "Xemu" : "MEGA65", serial_port));
+    }
 
     try {
-      debugger_ =
-          std::make_unique<M65Debugger>(req.serialPort.value(), this, this, reset_before_run, reset_after_disconnect);
+      debugger_ = std::make_unique<M65Debugger>(serial_port, this, this, reset_before_run, reset_after_disconnect,
+                                                receive_thread, std::filesystem::path(recording_path_u8), replay_speed);
     }
     catch (const std::exception& e) {
-      return dap::Error(fmt::format("Can't open connection to '{}'\n{}", req.serialPort.value(), e.what()));
+      return dap::Error(fmt::format("Can't open connection to '{}'\n{}", serial_port, e.what()));
     }
 
     std::u8string file_path_u8(req.program.value().begin(), req.program.value().end());
@@ -164,6 +513,18 @@ void M65DapSession::register_request_handlers()
       return dap::Error("Can't find program '%s'", file_path_u8.c_str());
     }
 
+    try {
+      std::map<std::string, std::string> variable_types;
+      for (const auto& [label, type] : req.variableTypes.value({})) {
+        throw_if<std::invalid_argument>(!type.is<dap::string>(), fmt::format("Type of '{}' must be a string", label));
+        variable_types.emplace(label, type.get<dap::string>());
+      }
+      debugger_->set_variable_types(variable_types);
+    }
+    catch (const std::exception& e) {
+      return dap::Error("Invalid variableTypes: '%s'", e.what());
+    }
+
     try {
       debugger_->set_target(file_path_u8);
     }
@@ -240,27 +601,68 @@ void M65DapSession::register_request_handlers()
     return dap::NextResponse();
   });
 
-  session_->registerHandler([&](const dap::StackTraceRequest&) -> dap::ResponseOrError<dap::StackTraceResponse> {
+  session_->registerHandler([&](const dap::StepBackRequest&) -> dap::ResponseOrError<dap::StepBackResponse> {
     if (!debugger_) {
       return dap::Error("Debugger not initialized");
     }
-    auto src_pos = debugger_->get_current_source_position();
+    try {
+      debugger_->step_back();
+    }
+    catch (const std::exception& e) {
+      return dap::Error(e.what());
+    }
+    return dap::StepBackResponse();
+  });
+
+  session_->registerHandler(
+      [&](const dap::ReverseContinueRequest&) -> dap::ResponseOrError<dap::ReverseContinueResponse> {
+        if (!debugger_) {
+          return dap::Error("Debugger not initialized");
+        }
+        try {
+          debugger_->reverse_cont();
+        }
+        catch (const std::exception& e) {
+          return dap::Error(e.what());
+        }
+        return dap::ReverseContinueResponse();
+      });
+
+  session_->registerHandler([&](const dap::StackTraceRequest& req) -> dap::ResponseOrError<dap::StackTraceResponse> {
+    if (!debugger_) {
+      return dap::Error("Debugger not initialized");
+    }
+
+    std::vector<StackFrame> frames;
+    try {
+      frames = debugger_->get_call_stack();
+    }
+    catch (const std::exception& e) {
+      return dap::Error(e.what());
+    }
 
     dap::StackTraceResponse response;
-    response.totalFrames = 1;
-    dap::StackFrame frame;
-    frame.id = 1;
-    frame.name = fmt::format("{}::{}", src_pos.segment, src_pos.block);
-    dap::Source src;
-    src.sourceReference = 0;
-
-    std::filesystem::path src_path{src_pos.src_path};
-    src.name = from_u8string(src_pos.src_path.filename().u8string());
-    src.path = from_u8string(src_pos.src_path.u8string());
-    frame.source = src;
-    frame.line = src_pos.line;
-
-    response.stackFrames.push_back(frame);
+    response.totalFrames = frames.size();
+    const auto start_frame = std::min<std::size_t>(req.startFrame.value(0), frames.size());
+    const auto levels = req.levels.value(0);
+    const auto end_frame = levels > 0 ? std::min<std::size_t>(start_frame + levels, frames.size()) : frames.size();
+
+    for (auto idx{start_frame}; idx < end_frame; ++idx) {
+      const auto src_pos = debugger_->get_source_position(frames[idx].pc);
+      dap::StackFrame frame;
+      frame.id = idx + 1;
+      frame.name = frames[idx].name;
+      frame.instructionPointerReference = fmt::format("${:X}", frames[idx].pc);
+      if (!src_pos.src_path.empty()) {
+        dap::Source src;
+        src.sourceReference = 0;
+        src.name = from_u8string(src_pos.src_path.filename().u8string());
+        src.path = from_u8string(src_pos.src_path.u8string());
+        frame.source = src;
+      }
+      frame.line = src_pos.line;
+      response.stackFrames.push_back(frame);
+    }
     return response;
   });
 
@@ -274,7 +676,8 @@ void M65DapSession::register_request_handlers()
   });
 
   session_->registerHandler([](const dap::ScopesRequest& req) {
-    if (req.frameId != 1) {
+    // Registers are the same for all frames
+    if (req.frameId < 1) {
       throw std::invalid_argument("Invalid scope id requested");
     }
 
@@ -289,14 +692,28 @@ void M65DapSession::register_request_handlers()
     dap::Scope local_scope;
     local_scope.name = "Local Vars";
     local_scope.presentationHint = "locals";
-    local_scope.variablesReference = 2;
+    local_scope.variablesReference = var_locals_first_id + req.frameId - 1;
     local_scope.expensive = false;
     response.scopes.push_back(local_scope);
 
+    // Each bank costs a batch of reads, so they are only fetched when expanded
+    const auto banks = m65dap::get_register_banks();
+    for (std::size_t idx{0}; idx < banks.size(); ++idx) {
+      dap::Scope io_scope;
+      io_scope.name = std::string(banks[idx].name);
+      io_scope.presentationHint = "registers";
+      io_scope.variablesReference = var_io_registers_first_id + static_cast<int>(idx);
+      io_scope.expensive = true;
+      response.scopes.push_back(io_scope);
+    }
+
     return response;
   });
 
-  session_->registerHandler([&](const dap::VariablesRequest& req) {
+  session_->registerHandler([&](const dap::VariablesRequest& req) -> dap::ResponseOrError<dap::VariablesResponse> {
+    if (!debugger_) {
+      return dap::Error("Debugger not initialized");
+    }
     dap::VariablesResponse response;
 
     /*if (req.format.has_value() && req.format.value().hex.value(false))
@@ -342,10 +759,50 @@ void M65DapSession::register_request_handlers()
 
       v.name = "FL";
       v.type = "Flags";
-      v.value = fmt::format("0x{:02X} ({})", reg.flags, reg.flags_string);
+      v.value = fmt::format("0x{:02X} ({})", reg.flags, reg.flags_string());
       response.variables.push_back(v);
+      return response;
     }
 
+    const bool format_as_hex = req.format.has_value() ? req.format.value().hex.value(true) : dap::boolean(true);
+    std::vector<M65Debugger::Variable> variables;
+    try {
+      if (req.variablesReference >= var_locals_first_id && req.variablesReference < var_locals_first_id + 100) {
+        variables = debugger_->get_local_variables(req.variablesReference - var_locals_first_id, format_as_hex);
+      }
+      else if (const int bank_idx = req.variablesReference - var_io_registers_first_id;
+               bank_idx >= 0 && bank_idx < static_cast<int>(m65dap::get_register_banks().size())) {
+        variables = debugger_->get_io_registers(bank_idx, format_as_hex);
+      }
+      else {
+        // Arrays are paged with start and count, structs always return all of their fields
+        variables = debugger_->get_child_variables(req.variablesReference, req.start.value(0), req.count.value(0),
+                                                   format_as_hex);
+      }
+    }
+    catch (const std::exception& e) {
+      return dap::Error(e.what());
+    }
+
+    for (auto& variable : variables) {
+      dap::Variable v;
+      v.name = std::move(variable.name);
+      v.value = std::move(variable.value);
+      if (client_supports_variable_type_) {
+        v.type = std::move(variable.type);
+      }
+      v.variablesReference = variable.variables_reference;
+      if (variable.indexed_children > 0) {
+        v.indexedVariables = variable.indexed_children;
+      }
+      if (variable.named_children > 0) {
+        v.namedVariables = variable.named_children;
+      }
+      if (client_supports_memory_references_ && variable.address > -1) {
+        v.memoryReference = fmt::format("${:X}", variable.address);
+      }
+      response.variables.push_back(v);
+    }
     return response;
   });
 
@@ -356,20 +813,417 @@ void M65DapSession::register_request_handlers()
 
     dap::EvaluateResponse response;
 
+    if (req.context.value("") == "repl") {
+      try {
+        auto console_result = handle_console_command(req.expression);
+        if (console_result.has_value()) {
+          response.result = console_result.value();
+          response.variablesReference = 0;
+          return response;
+        }
+      }
+      catch (const std::exception& e) {
+        return dap::Error(e.what());
+      }
+    }
+
     bool format_as_hex = req.format.has_value() ? req.format.value().hex.value(true) : dap::boolean(true);
 
-    auto eval_result = debugger_->evaluate_expression(req.expression, format_as_hex);
-    response.variablesReference = 0;
-    response.result = eval_result.result_string;
-    if (client_supports_memory_references_ && eval_result.address > -1) {
-      response.memoryReference = fmt::format("${:X}", eval_result.address);
+    try {
+      auto eval_result =
+          debugger_->evaluate_expression(req.expression, format_as_hex, req.context.value("") == "watch");
+      response.variablesReference = 0;
+      response.result = eval_result.result_string;
+      if (client_supports_memory_references_ && eval_result.address > -1) {
+        response.memoryReference = fmt::format("${:X}", eval_result.address);
+      }
+    }
+    catch (const std::exception& e) {
+      return dap::Error(e.what());
     }
     return response;
   });
 
+  session_->registerHandler([&](const dap::ReadMemoryRequest& req) -> dap::ResponseOrError<dap::ReadMemoryResponse> {
+    if (!debugger_) {
+      return dap::Error("Debugger not initialized");
+    }
+
+    try {
+      const std::int64_t start = parse_memory_reference(req.memoryReference) + req.offset.value(0);
+
+      // Only the part of the range within the address space can be read, bytes beyond it are reported unreadable
+      const auto range = clamp_to_address_space(start, req.count);
+
+      std::vector<std::byte> data(range.size);
+      debugger_->read_memory(static_cast<int>(range.first), data);
+
+      dap::ReadMemoryResponse response;
+      response.address = fmt::format("0x{:X}", range.first);
+      response.data = base64_encode(data);
+      if (range.unreadable > 0) {
+        response.unreadableBytes = range.unreadable;
+      }
+      return response;
+    }
+    catch (const std::exception& e) {
+      return dap::Error(e.what());
+    }
+  });
+
+  session_->registerHandler(
+      [&](const dap::M65WriteMemoryRequest& req) -> dap::ResponseOrError<dap::M65WriteMemoryResponse> {
+        if (!debugger_) {
+          return dap::Error("Debugger not initialized");
+        }
+
+        try {
+          const std::int64_t address = parse_memory_reference(req.memoryReference) + req.offset.value(0);
+          const auto data = base64_decode(req.data);
+          debugger_->write_memory(static_cast<int>(address), data);
+          send_memory_invalidated();
+
+          dap::M65WriteMemoryResponse response;
+          response.bytesWritten = static_cast<dap::integer>(data.size());
+          return response;
+        }
+        catch (const std::exception& e) {
+          return dap::Error(e.what());
+        }
+      });
+
+  session_->registerHandler(
+      [&](const dap::SetExpressionRequest& req) -> dap::ResponseOrError<dap::SetExpressionResponse> {
+        if (!debugger_) {
+          return dap::Error("Debugger not initialized");
+        }
+
+        try {
+          const auto eval_result = debugger_->set_expression(req.expression, req.value);
+          send_memory_invalidated();
+
+          dap::SetExpressionResponse response;
+          response.value = eval_result.result_string;
+          response.variablesReference = 0;
+          return response;
+        }
+        catch (const std::exception& e) {
+          return dap::Error(e.what());
+        }
+      });
+
+  session_->registerHandler([&](const dap::M65ProfileRequest& req) -> dap::ResponseOrError<dap::M65ProfileResponse> {
+    if (!debugger_) {
+      return dap::Error("Debugger not initialized");
+    }
+
+    bool report = false;
+    if (req.action == "start") {
+      try {
+        debugger_->start_profiling(req.sampleRate.value(default_profile_sample_rate));
+      }
+      catch (const std::exception& e) {
+        return dap::Error("Can't start profiler: %s", e.what());
+      }
+    }
+    else if (req.action == "stop") {
+      debugger_->stop_profiling();
+      report = true;
+    }
+    else if (req.action == "reset") {
+      debugger_->reset_profile();
+    }
+    else if (req.action == "report") {
+      report = true;
+    }
+    else {
+      return dap::Error("Unknown profile action '%s'", req.action.c_str());
+    }
+
+    dap::M65ProfileResponse response;
+    if (report) {
+      auto collapsed_stacks = debugger_->get_profile_collapsed_stacks();
+      if (req.outputFile.has_value()) {
+        std::ofstream out_file(std::filesystem::path(req.outputFile.value()));
+        out_file << collapsed_stacks;
+      }
+      response.collapsedStacks = std::move(collapsed_stacks);
+    }
+    response.totalSamples = static_cast<dap::integer>(debugger_->get_profile_sample_count());
+    return response;
+  });
+
+  session_->registerHandler(
+      [&](const dap::M65FrameTimingRequest& req) -> dap::ResponseOrError<dap::M65FrameTimingResponse> {
+        if (!debugger_) {
+          return dap::Error("Debugger not initialized");
+        }
+
+        try {
+          if (req.action == "start") {
+            if (!req.start.has_value() || !req.end.has_value()) {
+              return dap::Error("Frame timing needs a start and an end location");
+            }
+            debugger_->start_frame_timing(req.start.value(), req.end.value(), req.useCiaTimer.value(false));
+          }
+          else if (req.action == "stop") {
+            debugger_->stop_frame_timing();
+          }
+          else if (req.action != "report") {
+            return dap::Error("Unknown frame timing action '%s'", req.action.c_str());
+          }
+        }
+        catch (const std::exception& e) {
+          return dap::Error("Frame timing error: %s", e.what());
+        }
+
+        auto report = debugger_->get_frame_timing_report();
+        dap::M65FrameTimingResponse response;
+        response.frames = report.raster_lines.count;
+        if (report.raster_lines.count > 0) {
+          response.minLines = report.raster_lines.min;
+          response.maxLines = report.raster_lines.max;
+          response.avgLines = report.raster_lines.average();
+        }
+        if (report.cia_ticks.count > 0) {
+          response.minTicks = report.cia_ticks.min;
+          response.maxTicks = report.cia_ticks.max;
+          response.avgTicks = report.cia_ticks.average();
+        }
+        for (const auto& [first_line, frames] : report.histogram) {
+          const int bucket = first_line / FrameTimer::histogram_bucket_lines;
+          response.histogram.resize(std::max<std::size_t>(response.histogram.size(), bucket + 1));
+          response.histogram[bucket] = frames;
+        }
+        response.histogramBucketLines = FrameTimer::histogram_bucket_lines;
+        response.summary = report.to_string();
+        return response;
+      });
+
+  session_->registerHandler(
+      [&](const dap::M65TraceRecordingRequest& req) -> dap::ResponseOrError<dap::M65TraceRecordingResponse> {
+        if (!debugger_) {
+          return dap::Error("Debugger not initialized");
+        }
+
+        dap::M65TraceRecordingResponse response;
+        try {
+          if (req.action == "start") {
+            if (!req.file.has_value()) {
+              return dap::Error("Trace recording needs a file");
+            }
+            debugger_->start_trace_recording(req.file.value(), req.capacity.value(default_trace_capacity));
+          }
+          else if (req.action == "stop") {
+            debugger_->stop_trace_recording();
+          }
+          else if (req.action == "query") {
+            std::optional<int> pc;
+            if (req.pc.has_value()) {
+              pc = static_cast<int>(req.pc.value());
+            }
+            auto records = debugger_->get_trace_instructions(req.count.value(default_trace_query_count), pc);
+            dap::array<dap::string> instructions;
+            std::transform(records.begin(), records.end(), std::back_inserter(instructions),
+                           [](const TraceRecord& r) { return r.to_string(); });
+            response.instructions = std::move(instructions);
+          }
+          else {
+            return dap::Error("Unknown trace recording action '%s'", req.action.c_str());
+          }
+        }
+        catch (const std::exception& e) {
+          return dap::Error("Trace recording error: %s", e.what());
+        }
+
+        response.totalRecords = static_cast<dap::integer>(debugger_->get_trace_record_count());
+        return response;
+      });
+
+  session_->registerHandler([&](const dap::M65CoverageRequest& req) -> dap::ResponseOrError<dap::M65CoverageResponse> {
+    if (!debugger_) {
+      return dap::Error("Debugger not initialized");
+    }
+
+    dap::M65CoverageResponse response;
+    try {
+      auto coverage = debugger_->get_coverage();
+      if (req.mergeFile.has_value()) {
+        const std::filesystem::path merge_file(req.mergeFile.value());
+        if (std::filesystem::exists(merge_file)) {
+          coverage.merge_file(merge_file);
+        }
+        coverage.save(merge_file);
+      }
+
+      auto lcov = coverage.to_lcov();
+      if (req.outputFile.has_value()) {
+        std::ofstream out_file(std::filesystem::path(req.outputFile.value()));
+        out_file << lcov;
+      }
+      else {
+        response.lcov = std::move(lcov);
+      }
+      response.coveredStatements = static_cast<dap::integer>(coverage.covered_entries());
+      response.totalStatements = static_cast<dap::integer>(coverage.total_entries());
+    }
+    catch (const std::exception& e) {
+      return dap::Error("Coverage error: %s", e.what());
+    }
+    return response;
+  });
+
+  session_->registerHandler(
+      [&](const dap::M65MemorySearchRequest& req) -> dap::ResponseOrError<dap::M65MemorySearchResponse> {
+        if (!debugger_) {
+          return dap::Error("Debugger not initialized");
+        }
+
+        dap::M65MemorySearchResponse response;
+        try {
+          const auto pattern = SearchPattern::parse(req.pattern);
+          const auto first_address = static_cast<int>(parse_memory_reference(req.memoryReference));
+          const auto max_results = static_cast<std::size_t>(req.maxResults.value(default_search_max_results));
+          const auto matches = debugger_->search_memory(
+              first_address, first_address + static_cast<int>(req.count) - 1, pattern, max_results,
+              [&](std::span<const int> chunk_matches) {
+                dap::M65MemorySearchResultsEvent event;
+                for (const int address : chunk_matches) {
+                  event.addresses.push_back(fmt::format("${:X}", address));
+                }
+                session_->send(event);
+              });
+          for (const int address : matches) {
+            response.addresses.push_back(fmt::format("${:X}", address));
+          }
+          response.truncated = matches.size() >= max_results;
+        }
+        catch (const std::exception& e) {
+          return dap::Error("Memory search error: %s", e.what());
+        }
+        return response;
+      });
+
   // session_->registerHandler([&](const dap::DisassembleRequest& req) {
 
   //});
 }
 
+auto M65DapSession::handle_console_command(std::string_view command_line) -> std::optional<std::string>
+{
+  auto args = split(std::string(command_line), ' ');
+  std::erase_if(args, [](std::string& arg) { return trim(arg).empty(); });
+  if (args.empty()) {
+    return {};
+  }
+
+  const auto& cmd = args[0];
+  const std::string action = args.size() > 1 ? args[1] : "";
+
+  if (cmd == "profile") {
+    throw_if<std::runtime_error>(!debugger_, "Debugger not initialized");
+    if (action == "start") {
+      debugger_->start_profiling(args.size() > 2 ? str_to_int(args[2]) : default_profile_sample_rate);
+      return "Profiler started";
+    }
+    if (action == "stop") {
+      debugger_->stop_profiling();
+      return debugger_->get_profile_collapsed_stacks();
+    }
+    if (action == "reset") {
+      debugger_->reset_profile();
+      return "Profile reset";
+    }
+    if (action == "report") {
+      return debugger_->get_profile_collapsed_stacks();
+    }
+    throw std::runtime_error("Usage: profile start [rate] | stop | reset | report");
+  }
+
+  if (cmd == "timing") {
+    throw_if<std::runtime_error>(!debugger_, "Debugger not initialized");
+    if (action == "start" && (args.size() == 4 || args.size() == 5)) {
+      const bool use_cia_timer = args.size() == 5 && args[4] == "cia";
+      debugger_->start_frame_timing(args[2], args[3], use_cia_timer);
+      return "Frame timing started";
+    }
+    if (action == "stop") {
+      debugger_->stop_frame_timing();
+      return debugger_->get_frame_timing_report().to_string();
+    }
+    if (action == "report") {
+      return debugger_->get_frame_timing_report().to_string();
+    }
+    throw std::runtime_error("Usage: timing start <start> <end> [cia] | stop | report");
+  }
+
+  if (cmd == "trace") {
+    throw_if<std::runtime_error>(!debugger_, "Debugger not initialized");
+    if (action == "start" && (args.size() == 3 || args.size() == 4)) {
+      debugger_->start_trace_recording(args[2], args.size() == 4 ? str_to_int(args[3]) : default_trace_capacity);
+      return "Trace recording started";
+    }
+    if (action == "stop") {
+      debugger_->stop_trace_recording();
+      return fmt::format("Trace recording stopped, {} steps recorded", debugger_->get_trace_record_count());
+    }
+    if (action == "last" && (args.size() == 3 || args.size() == 4)) {
+      std::optional<int> pc;
+      if (args.size() == 4) {
+        pc = parse_c64_hex(args[3]);
+      }
+      auto records = debugger_->get_trace_instructions(str_to_int(args[2]), pc);
+      std::string result;
+      for (const auto& record : records) {
+        result += record.to_string() + '\n';
+      }
+      return result;
+    }
+    throw std::runtime_error("Usage: trace start <file> [capacity] | stop | last <count> [$pc]");
+  }
+
+  if (cmd == "search") {
+    throw_if<std::runtime_error>(!debugger_, "Debugger not initialized");
+    throw_if<std::runtime_error>(args.size() < 4, "Usage: search <first> <last> <pattern>");
+    std::vector<std::string_view> pattern_args(args.begin() + 3, args.end());
+    const auto pattern = SearchPattern::parse(fmt::format("{}", fmt::join(pattern_args, " ")));
+    const auto matches =
+        debugger_->search_memory(static_cast<int>(parse_memory_reference(args[1])),
+                                 static_cast<int>(parse_memory_reference(args[2])), pattern, default_search_max_results);
+    if (matches.empty()) {
+      return "No matches";
+    }
+    return fmt::format("{} matches: ${:X}", matches.size(), fmt::join(matches, " $"));
+  }
+
+  if (cmd == "warmup") {
+    throw_if<std::runtime_error>(!debugger_, "Debugger not initialized");
+    return debugger_->get_stop_metrics().to_string();
+  }
+
+  if (cmd == "link") {
+    throw_if<std::runtime_error>(!debugger_, "Debugger not initialized");
+    const auto stats = debugger_->get_receive_stats();
+    const std::string result =
+        stats.has_value() ? stats->to_string() : "No receive thread, enable it with 'receiveThread'";
+    const int reconnects = debugger_->get_reconnect_count();
+    return reconnects > 0 ? fmt::format("{}\nReconnects: {}", result, reconnects) : result;
+  }
+
+  if (cmd == "coverage") {
+    throw_if<std::runtime_error>(!debugger_, "Debugger not initialized");
+    throw_if<std::runtime_error>(args.size() > 2, "Usage: coverage [lcov-file]");
+    auto coverage = debugger_->get_coverage();
+    if (args.size() == 2) {
+      std::ofstream out_file{std::filesystem::path(args[1])};
+      out_file << coverage.to_lcov();
+    }
+    const auto total = coverage.total_entries();
+    return fmt::format("Covered {} of {} statements ({:.1f}%)", coverage.covered_entries(), total,
+                       total > 0 ? 100.0 * coverage.covered_entries() / total : 0.0);
+  }
+
+  return {};
+}
+
 }  // namespace m65dap
@@ -15,6 +15,8 @@ class M65DapSession : public M65Debugger::EventHandlerInterface, public LoggerIn
   std::promise<void> exit_promise_;
   bool client_supports_variable_type_{false};
   bool client_supports_memory_references_{false};
+  bool client_supports_invalidated_event_{false};
+  bool client_supports_memory_event_{false};
 
  public:
   M65DapSession(const std::filesystem::path& log_file = "");
@@ -23,6 +25,7 @@ class M65DapSession : public M65Debugger::EventHandlerInterface, public LoggerIn
 
   // Event handlers of M65Debugger
   void handle_debugger_stopped(M65Debugger::StoppedReason reason) override;
+  void handle_memory_changed(std::span<const std::pair<int, int>> ranges) override;
 
   // Implements Logger::debug_out
   void debug_out(std::string_view msg) final;
@@ -30,6 +33,8 @@ class M65DapSession : public M65Debugger::EventHandlerInterface, public LoggerIn
  private:
   void register_error_handler();
   void register_request_handlers();
+  void send_memory_invalidated();
+  auto handle_console_command(std::string_view command_line) -> std::optional<std::string>;
 };
 
 }  // namespace m65dap
@@ -1,19 +1,215 @@
 #include "m65_debugger.h"
 
-#include "duration.h"
-#include "serial_connection.h"
-#include "unix_domain_socket_connection.h"
-#include "unix_serial_connection.h"
+#include "monitor_devices.h"
+#include "session_recording.h"
 
 using namespace std::chrono_literals;
 
+namespace {
+
+const int vic_raster_offset = 0x011;  // $D011 bit 7 is raster bit 8, $D012 holds raster bits 0-7
+const int vic_palntsc_offset = 0x06F;
+const int cia1_timer_a_offset = 0xC04;
+
+const int pal_lines_per_frame = 312;
+const int ntsc_lines_per_frame = 263;
+
+// Number of step commands sent at once while recording a trace. Responses are parsed while the following steps are
+// already on the way, so the link doesn't idle for a round trip per step. Kept small to not overrun the input
+// buffer of the monitor.
+constexpr int trace_pipeline_depth = 16;
+
+// Memory read commands in flight at once, each one returns up to 256 bytes
+constexpr std::size_t max_memory_reads_in_flight = 8;
+
+// Reads up to this size go through the memory cache, larger ones are streamed in chunks of memory_read_chunk_size
+constexpr std::size_t max_cached_memory_read = 0x1000;
+constexpr std::size_t memory_read_chunk_size = 0x4000;
+
+// Bytes per store command, longer spans are sent as a binary load. The end address of the load command only has 16
+// bits, so loads are kept within a 64 KB bank.
+constexpr int max_bytes_per_store = 16;
+constexpr int min_load_size = 64;
+constexpr int max_load_size = 0x8000;
+// Load data is written in blocks, so an interrupted load knows how many bytes the monitor still waits for
+constexpr std::size_t load_block_size = 0x1000;
+
+// Backoff of reconnect attempts after the connection was lost. Once the stall exceeds max_reconnect_stall_ms,
+// requests fail and reconnecting is tried every lost_link_retry_ms.
+constexpr int first_reconnect_delay_ms = 100;
+constexpr int max_reconnect_delay_ms = 2000;
+constexpr int max_reconnect_stall_ms = 15000;
+constexpr int lost_link_retry_ms = 2000;
+
+// Receiving is considered finished once nothing arrived for this time, waiting stops after max_flush_ms anyway
+constexpr int rx_idle_ms = 20;
+constexpr int max_flush_ms = 1000;
+// A load command left hanging takes up to 64K bytes. Spaces are sent in blocks of this size until the monitor
+// answers, so a load close to completion is finished without sending all of them.
+constexpr std::size_t load_escape_block_size = 0x400;
+constexpr std::size_t max_load_escape_size = 0x10000;
+
+// Memory around the PC fetched when the target stops, for the disassembly view
+constexpr int warmup_bytes_before_pc = 0x20;
+constexpr int warmup_bytes_after_pc = 0x40;
+
+// Variables references handed out for arrays and structs start here, lower ids are used for scopes
+constexpr int first_variables_reference = 1000;
+
+// Watch expressions are prefetched in rounds, each round resolves one more level of pointers read by the watches
+constexpr int max_watch_prefetch_rounds = 3;
+
+// Stands in for the connection while it can't be opened again
+class LostConnection : public m65dap::Connection {
+ public:
+  void write(std::span<const char>) override { throw m65dap::connection_error("Connection to the MEGA65 lost"); }
+  auto read(int, int) -> std::string override { throw m65dap::connection_error("Connection to the MEGA65 lost"); }
+};
+
+// Parses the numbers assigned by set_expression(), separated by blanks or commas
+auto parse_assigned_values(std::string_view value) -> std::vector<std::uint32_t>
+{
+  std::vector<std::uint32_t> result;
+  auto tokens = m65dap::split(std::string(value), ' ');
+  for (auto& token_list : tokens) {
+    for (auto& token : m65dap::split(token_list, ',')) {
+      if (m65dap::trim(token).empty()) {
+        continue;
+      }
+      std::string_view number(token);
+      int base = 16;
+      if (number.starts_with('$')) {
+        number.remove_prefix(1);
+      }
+      else if (number.starts_with("0x") || number.starts_with("0X")) {
+        number.remove_prefix(2);
+      }
+      else if (number.starts_with('%')) {
+        number.remove_prefix(1);
+        base = 2;
+      }
+      std::uint32_t v{0};
+      const auto [ptr, ec] = std::from_chars(number.data(), number.data() + number.length(), v, base);
+      m65dap::throw_if<std::invalid_argument>(number.empty() || ec != std::errc() ||
+                                                  ptr != number.data() + number.length(),
+                                              fmt::format("Invalid value '{}'", token));
+      result.push_back(v);
+    }
+  }
+  return result;
+}
+
+// Evaluates expressions against the memory cache and the registers of the last stop
+class DebuggerExpressionContext : public m65dap::ExpressionContext {
+  m65dap::MemoryCache& memory_cache_;
+  const m65dap::M65Debugger::Registers& registers_;
+
+ public:
+  DebuggerExpressionContext(m65dap::MemoryCache& memory_cache, const m65dap::M65Debugger::Registers& registers) :
+      memory_cache_(memory_cache), registers_(registers)
+  {
+  }
+
+  void read_memory(int address, std::span<std::byte> target) override { memory_cache_.read(address, target); }
+
+  auto get_register(char name) const -> int override
+  {
+    switch (name) {
+      case 'x':
+        return registers_.x;
+      case 'y':
+        return registers_.y;
+      case 'z':
+        return registers_.z;
+      default:
+        throw std::invalid_argument(fmt::format("Unknown register '{}'", name));
+    }
+  }
+};
+
+// Evaluates expressions against cached memory only and collects the memory still missing, which is read as zeros
+class FootprintContext : public DebuggerExpressionContext {
+  m65dap::MemoryCache& memory_cache_;
+  std::vector<std::pair<int, int>> regions_;
+  bool complete_{true};
+
+ public:
+  FootprintContext(m65dap::MemoryCache& memory_cache, const m65dap::M65Debugger::Registers& registers) :
+      DebuggerExpressionContext(memory_cache, registers), memory_cache_(memory_cache)
+  {
+  }
+
+  void read_memory(int address, std::span<std::byte> target) override
+  {
+    const int size = static_cast<int>(target.size());
+    if (memory_cache_.is_cached(address, size) || memory_cache_.is_volatile(address, size)) {
+      memory_cache_.read(address, target);
+      return;
+    }
+    add_region(address, size);
+    std::fill(target.begin(), target.end(), std::byte{0});
+    complete_ = false;
+  }
+
+  void add_region(int address, int size) { regions_.emplace_back(address, address + size - 1); }
+  auto regions() const -> const std::vector<std::pair<int, int>>& { return regions_; }
+
+  /**
+   * @brief Whether all memory read since the last reset was cached, i.e. the evaluation result is valid
+   */
+  auto complete() const -> bool { return complete_; }
+  void reset() { complete_ = true; }
+};
+
+// Parses the instruction bytes of the disassembly line following the registers, e.g. ",07772058  85 02     STA   $02"
+auto parse_instruction_bytes(std::string_view line, m65dap::TraceRecord& record) -> bool
+{
+  static const int bytes_column = 11;
+  if (!line.starts_with(",0777") || line.length() < bytes_column + 2) {
+    return false;
+  }
+
+  auto bytes = line.substr(bytes_column);
+  int count{0};
+  while (count < static_cast<int>(record.instruction.size()) && bytes.length() >= 2 && std::isxdigit(bytes[0]) &&
+         std::isxdigit(bytes[1])) {
+    record.instruction[count++] = static_cast<std::uint8_t>(m65dap::str_to_int(bytes.substr(0, 2), 16));
+    if (bytes.length() < 3 || bytes[2] != ' ') {
+      break;
+    }
+    bytes.remove_prefix(3);
+  }
+  record.instruction_length = static_cast<std::uint8_t>(count);
+  return count > 0;
+}
+
+// Temporarily replaces a logger by the NullLogger, to not flood the debug console with bulk transfers
+class MutedLogger {
+  m65dap::LoggerInterface*& logger_;
+  m65dap::LoggerInterface* saved_logger_;
+
+ public:
+  explicit MutedLogger(m65dap::LoggerInterface*& logger) :
+      logger_(logger), saved_logger_(std::exchange(logger, m65dap::NullLogger::instance()))
+  {
+  }
+  MutedLogger(const MutedLogger&) = delete;
+  MutedLogger& operator=(const MutedLogger&) = delete;
+  ~MutedLogger() { logger_ = saved_logger_; }
+};
+
+}  // namespace
+
 namespace m65dap {
 
 M65Debugger::M65Debugger(std::string_view serial_port_device,
                          EventHandlerInterface* event_handler,
                          LoggerInterface* logger,
                          bool reset_on_run,
-                         bool reset_on_disconnect) :
+                         bool reset_on_disconnect,
+                         bool receive_thread,
+                         const std::filesystem::path& recording_path,
+                         double replay_speed) :
     event_handler_(event_handler),
     logger_(logger), memory_cache_(this), reset_on_disconnect_(reset_on_disconnect)
 {
@@ -21,21 +217,39 @@ M65Debugger::M65Debugger(std::string_view serial_port_device,
     logger_ = NullLogger::instance();
   }
 
-#ifdef _POSIX_VERSION
-  if (serial_port_device.starts_with("unix#")) {
-    std::string_view socket_path = serial_port_device.substr(5);
-    conn_ = std::make_unique<UnixDomainSocketConnection>(socket_path);
-    is_xemu_ = true;
+  std::string device(serial_port_device);
+  if (serial_port_device.starts_with("replay#")) {
+    auto replay = std::make_unique<ReplayConnection>(SessionRecording::load(std::string(serial_port_device.substr(7))),
+                                                     replay_speed);
+    // The replay talks the dialect of the device the session was recorded with
+    device = replay->device();
+    detect_dialect_ = device.starts_with("unix#") || device.starts_with("tcp#");
+    conn_ = std::move(replay);
   }
   else {
-    conn_ = std::make_unique<UnixSerialConnection>(serial_port_device);
-    flush_rx_buffers();
+    // Xemu, the broker sharing the serial port of a MEGA65 or a MEGA65 attached to another host are told apart by
+    // the reply to the help command
+    detect_dialect_ = device.starts_with("unix#") || device.starts_with("tcp#");
+    conn_ = open_device(device);
+    if (!detect_dialect_) {
+      flush_rx_buffers();
+    }
+    // A session recording isn't continued after a reconnect
+    reconnect_ = [device, receive_thread]() -> std::unique_ptr<m65dap::Connection> {
+      auto conn = open_device(device);
+      return receive_thread ? std::make_unique<BufferedConnection>(std::move(conn)) : std::move(conn);
+    };
   }
-#endif
 
-#ifdef _WIN32
-  conn_ = std::make_unique<SerialConnection>(serial_port_device);
-#endif
+  if (!recording_path.empty()) {
+    conn_ = std::make_unique<RecordingConnection>(std::move(conn_), recording_path, device);
+  }
+
+  if (receive_thread) {
+    auto buffered_conn = std::make_unique<BufferedConnection>(std::move(conn_));
+    buffered_conn_ = buffered_conn.get();
+    conn_ = std::move(buffered_conn);
+  }
 
   initialize(reset_on_run);
 }
@@ -45,14 +259,16 @@ M65Debugger::M65Debugger(std::unique_ptr<Connection> connection,
                          LoggerInterface* logger,
                          bool is_xemu,
                          bool reset_on_run,
-                         bool reset_on_disconnect) :
-    conn_(std::move(connection)),
-    logger_(logger), event_handler_(event_handler), memory_cache_(this), is_xemu_(is_xemu),
-    reset_on_disconnect_(reset_on_disconnect)
+                         bool reset_on_disconnect,
+                         ConnectionFactory reconnect) :
+    event_handler_(event_handler),
+    logger_(logger), memory_cache_(this), conn_(std::move(connection)), reconnect_(std::move(reconnect)),
+    dialect_(is_xemu ? &xemu_dialect() : &mega65_dialect()), reset_on_disconnect_(reset_on_disconnect)
 {
   if (logger_ == nullptr) {
     logger_ = NullLogger::instance();
   }
+  buffered_conn_ = dynamic_cast<BufferedConnection*>(conn_.get());
 
   initialize(reset_on_run);
 }
@@ -61,7 +277,7 @@ M65Debugger::~M65Debugger()
 {
   main_loop_exit_signal_.set_value();
   main_loop_thread_.join();
-  if (reset_on_disconnect_ && !is_xemu_) {
+  if (reset_on_disconnect_ && dialect_->can_reset() && !link_lost_) {
     reset_target();
   }
 }
@@ -69,11 +285,14 @@ M65Debugger::~M65Debugger()
 void M65Debugger::set_target(const std::filesystem::path& prg_path)
 {
   run_task([&]() -> DebuggerTaskResult {
+    discard_history();
     upload_prg_file(prg_path);
 
     auto dbg_file = prg_path;
     dbg_file.replace_extension("dbg");
     load_debug_symbols(dbg_file);
+    working_set_.load(working_set_dir_.empty() ? std::filesystem::path()
+                                               : WorkingSet::file_path(working_set_dir_, prg_path));
     return {};
   });
 }
@@ -81,6 +300,7 @@ void M65Debugger::set_target(const std::filesystem::path& prg_path)
 void M65Debugger::run_target()
 {
   run_task([&]() -> DebuggerTaskResult {
+    discard_history();
     simulate_keypresses("RUN\r");
     return {};
   });
@@ -88,23 +308,34 @@ void M65Debugger::run_target()
 
 void M65Debugger::pause()
 {
-  run_task([&]() -> DebuggerTaskResult {
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    end_trace_recording();
+    replay_index_.reset();
     execute_command("t1\n");
     stopped_ = true;
     update_registers();
     memory_cache_.invalidate();
-    if (event_handler_) {
-      auto f = std::async(std::launch::async, &EventHandlerInterface::handle_debugger_stopped, event_handler_,
-                          StoppedReason::Pause);
-      f.wait();
-    }
+    notify_stopped(StoppedReason::Pause);
     return {};
   });
 }
 
 void M65Debugger::cont()
 {
-  run_task([&]() -> DebuggerTaskResult {
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    end_trace_recording();
+    if (replay_index_.has_value()) {
+      // Continue through the execution history first, live execution resumes at its end
+      const auto index = breakpoint_.has_value() ? history_.find_next(breakpoint_->pc, replay_index_.value())
+                                                 : std::nullopt;
+      if (index.has_value() && index.value() + 1 < history_.end_index()) {
+        seek_history(index.value());
+        notify_stopped(StoppedReason::Breakpoint);
+        return {};
+      }
+      seek_history(history_.end_index() - 1);
+    }
+    discard_history();
     execute_command("t0\n");
     stopped_ = false;
     return {};
@@ -115,26 +346,28 @@ void M65Debugger::next()
 {
   run_task([&]() -> DebuggerTaskResult {
     throw_if<std::runtime_error>(!stopped_, "Debugger not in stopped state");
+    if (replay_index_.has_value()) {
+      seek_history(replay_index_.value() + 1);
+      notify_stopped(StoppedReason::Step);
+      return {};
+    }
+    discard_history();
     auto lines = execute_command("\n");
-    if (is_xemu_) {
+    for (int idx{1}; idx < dialect_->step_reply_prompts(); ++idx) {
       lines = get_lines_until_prompt();
     }
     if (!update_registers(lines)) {
       update_registers();
     }
-    memory_cache_.refresh_accessed();
-    if (event_handler_) {
-      auto f = std::async(std::launch::async, &EventHandlerInterface::handle_debugger_stopped, event_handler_,
-                          StoppedReason::Step);
-      f.wait();
-    }
+    memory_cache_.invalidate();
+    notify_stopped(StoppedReason::Step);
     return {};
   });
 }
 
 void M65Debugger::set_breakpoint(const std::filesystem::path& src_path, int line)
 {
-  run_task([&]() -> DebuggerTaskResult {
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
     if (!dbg_data_) {
       throw std::runtime_error("Can't set breakpoint, no debug symbols loaded");
     }
@@ -158,6 +391,11 @@ void M65Debugger::clear_breakpoint()
 }
 
 auto M65Debugger::get_current_source_position() const -> SourcePosition
+{
+  return get_source_position(current_registers_.pc);
+}
+
+auto M65Debugger::get_source_position(int address) const -> SourcePosition
 {
   SourcePosition result;
 
@@ -165,7 +403,7 @@ auto M65Debugger::get_current_source_position() const -> SourcePosition
     return result;
   }
 
-  auto entry = dbg_data_->get_block_entry(current_registers_.pc, &result.segment, &result.block);
+  auto entry = dbg_data_->get_block_entry(address, &result.segment, &result.block);
   if (entry) {
     result.src_path = dbg_data_->get_file(entry->file_index);
     result.line = entry->line1;
@@ -173,6 +411,191 @@ auto M65Debugger::get_current_source_position() const -> SourcePosition
   return result;
 }
 
+auto M65Debugger::get_call_stack() -> std::vector<StackFrame>
+{
+  std::vector<StackFrame> result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    throw_if<std::runtime_error>(!stopped_, "Debugger not in stopped state");
+    if (!call_stack_.has_value()) {
+      call_stack_ = unwind_stack(current_registers_.pc, current_registers_.sp, dbg_data_.get(),
+                                 [&](int address, std::span<std::byte> target) { memory_cache_.read(address, target); });
+    }
+    result = call_stack_.value();
+    return {};
+  });
+  return result;
+}
+
+void M65Debugger::set_variable_types(const std::map<std::string, std::string>& types)
+{
+  std::map<std::string, VariableType> variable_types;
+  for (const auto& [label, type_name] : types) {
+    VariableType type{.name = type_name, .layout = {}};
+    try {
+      type.layout = Expression::parse_type(type_name, type.count);
+    }
+    catch (const std::invalid_argument& e) {
+      throw std::invalid_argument(fmt::format("Invalid type '{}' of '{}': {}", type_name, label, e.what()));
+    }
+    variable_types.emplace(label, std::move(type));
+  }
+
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    variable_types_ = std::move(variable_types);
+    return {};
+  });
+}
+
+auto M65Debugger::get_local_variables(std::size_t frame_index, bool format_as_hex) -> std::vector<Variable>
+{
+  const auto frames = get_call_stack();
+  throw_if<std::out_of_range>(frame_index >= frames.size(), "Invalid stack frame");
+
+  std::vector<Variable> result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    if (!dbg_data_) {
+      return {};
+    }
+    const auto info = dbg_data_->lookup_address(frames[frame_index].pc);
+    if (!info.block) {
+      return {};
+    }
+    for (const auto* label : dbg_data_->get_labels_in_range(info.block->min_addr, info.block->max_addr)) {
+      const auto type_it = variable_types_.find(label->name);
+      if (type_it == variable_types_.end()) {
+        result.push_back(make_variable(label->name, label->address, TypeLayout::byte_type(), 1, format_as_hex));
+        continue;
+      }
+      const auto& type = type_it->second;
+      result.push_back(
+          make_variable(label->name, label->address, type.layout, type.count, format_as_hex, type.name));
+    }
+    record_client_access();
+    return {};
+  });
+  return result;
+}
+
+auto M65Debugger::get_child_variables(int variables_reference, int start, int count, bool format_as_hex)
+    -> std::vector<Variable>
+{
+  std::vector<Variable> result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    const int idx = variables_reference - first_variables_reference;
+    throw_if<std::out_of_range>(idx < 0 || idx >= static_cast<int>(variable_containers_.size()),
+                                "Invalid variables reference");
+    // Copied, the table grows while children are added
+    const auto container = variable_containers_[idx];
+    const auto& layout = *container.layout;
+
+    if (container.count > 1) {
+      const int first = std::clamp(start, 0, container.count);
+      const int last = count > 0 ? std::min(container.count, first + count) : container.count;
+      if (!layout.is_struct() && first < last) {
+        // Scalars are formatted from a single read of the slice
+        std::vector<std::byte> data((last - first) * layout.size);
+        memory_cache_.read(container.address + first * layout.size, data);
+        for (int element{first}; element < last; ++element) {
+          const auto element_data = std::span(data).subspan((element - first) * layout.size, layout.size);
+          result.push_back({.name = fmt::format("[{}]", element),
+                            .value = layout.format(element_data, 1, format_as_hex),
+                            .type = layout.name(),
+                            .address = container.address + element * layout.size});
+        }
+      }
+      else {
+        for (int element{first}; element < last; ++element) {
+          result.push_back(make_variable(fmt::format("[{}]", element), container.address + element * layout.size,
+                                         container.layout, 1, format_as_hex));
+        }
+      }
+    }
+    else {
+      for (const auto& field : layout.fields) {
+        result.push_back(
+            make_variable(field.name, container.address + field.offset, field.type, field.count, format_as_hex));
+      }
+    }
+    record_client_access();
+    return {};
+  });
+  return result;
+}
+
+auto M65Debugger::get_io_registers(std::size_t bank_index, bool format_as_hex) -> std::vector<Variable>
+{
+  const auto banks = get_register_banks();
+  throw_if<std::out_of_range>(bank_index >= banks.size(), "Invalid register bank");
+  const auto& bank = banks[bank_index];
+
+  std::vector<Variable> result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    auto bank_it = io_registers_.find(bank_index);
+    if (bank_it == io_registers_.end()) {
+      // I/O is volatile and bypasses the memory cache, so the decoded bank is kept until the target continues
+      const auto plan = plan_register_reads(bank);
+      std::vector<std::byte> windows(plan.size() * register_window_size);
+      std::vector<MemoryRange> ranges;
+      ranges.reserve(plan.size());
+      for (std::size_t idx{0}; idx < plan.size(); ++idx) {
+        ranges.push_back({.address = io_personality_base + plan[idx],
+                          .target = std::span(windows).subspan(idx * register_window_size, register_window_size)});
+      }
+      get_memory_ranges(ranges);
+      bank_it = io_registers_.emplace(bank_index, decode_registers(bank, plan, windows)).first;
+    }
+
+    for (const auto& reg : bank_it->second) {
+      Variable variable{.name = reg.name,
+                        .value = {},
+                        .type = reg.bits > 1 ? fmt::format("{} bits", reg.bits) : "bit",
+                        .address = io_personality_base + reg.address - 0xD000};
+      if (!reg.value.has_value()) {
+        variable.value = "(not read, changes when read)";
+      }
+      else if (format_as_hex) {
+        variable.value = fmt::format("0x{:0{}X}", reg.value.value(), (reg.bits + 3) / 4);
+      }
+      else {
+        variable.value = fmt::format("{}", reg.value.value());
+      }
+      result.push_back(std::move(variable));
+    }
+    record_client_access();
+    return {};
+  });
+  return result;
+}
+
+auto M65Debugger::make_variable(std::string name,
+                                int address,
+                                const std::shared_ptr<const TypeLayout>& layout,
+                                int count,
+                                bool format_as_hex,
+                                std::string type_name) -> Variable
+{
+  Variable variable{.name = std::move(name), .value = {}, .type = {}, .address = address};
+  variable.type = type_name.empty() ? (count > 1 ? fmt::format("{}[{}]", layout->name(), count) : layout->name())
+                                    : std::move(type_name);
+
+  if (count > 1 || layout->is_struct()) {
+    variable_containers_.push_back({.address = address, .layout = layout, .count = count});
+    variable.variables_reference = first_variables_reference + static_cast<int>(variable_containers_.size()) - 1;
+  }
+  if (count > 1) {
+    // Elements are only read when the array is expanded
+    variable.value = fmt::format("{}[{}] at ${:X}", layout->name(), count, address);
+    variable.indexed_children = count;
+    return variable;
+  }
+
+  std::vector<std::byte> data(layout->size);
+  memory_cache_.read(address, data);
+  variable.value = layout->format(data, 1, format_as_hex);
+  variable.named_children = static_cast<int>(layout->fields.size());
+  return variable;
+}
+
 void M65Debugger::write(std::span<const char> buffer)
 {
   if (is_ascii(buffer)) {
@@ -185,117 +608,328 @@ void M65Debugger::write(std::span<const char> buffer)
     logger_->debug_out(fmt::format("-> binary data (size {0:}/${0:X} bytes)\n", buffer.size_bytes()));
   }
 
-  conn_->write(buffer);
+  send(buffer);
+}
+
+void M65Debugger::send(std::span<const char> data)
+{
+  conn_->write(data);
+  ++writes_sent_;
+}
+
+auto M65Debugger::evaluate_expression(std::string_view expression, bool format_as_hex, bool is_watch)
+    -> EvaluateResult
+{
+  auto task_result = run_task(TaskRetry::Idempotent, [&]() {
+    throw_if<std::runtime_error>(!stopped_, "Debugger not in stopped state");
+    if (is_watch && std::find(watch_expressions_.begin(), watch_expressions_.end(), expression) ==
+                        watch_expressions_.end()) {
+      watch_expressions_.emplace_back(expression);
+    }
+    DebuggerExpressionContext context(memory_cache_, current_registers_);
+    const auto result = parse_expression(expression)->evaluate(context, format_as_hex);
+    record_client_access();
+    return EvaluateResult{.result_string = result.value, .address = result.address};
+  });
+
+  return std::get<EvaluateResult>(task_result.value());
 }
 
-auto M65Debugger::evaluate_expression(std::string_view expression, bool format_as_hex) -> EvaluateResult
+auto M65Debugger::set_expression(std::string_view expression, std::string_view value) -> EvaluateResult
 {
   auto task_result = run_task([&]() {
     throw_if<std::runtime_error>(!stopped_, "Debugger not in stopped state");
-    EvaluateResult result;
-    if (!dbg_data_) {
-      return result;
+    throw_if<std::runtime_error>(replay_index_.has_value(),
+                                 "Memory can't be changed while stepping through the execution history");
+    const auto expr = parse_expression(expression);
+    throw_if<std::runtime_error>(expr->is_immediate() || expr->type().is_struct(),
+                                 fmt::format("Can't assign to '{}'", expression));
+
+    DebuggerExpressionContext context(memory_cache_, current_registers_);
+    const int address = expr->evaluate_address(context);
+    const int type_size = expr->type().size;
+
+    const auto values = parse_assigned_values(value);
+    throw_if<std::invalid_argument>(
+        values.size() != static_cast<std::size_t>(expr->count()),
+        fmt::format("Expected {} value(s) for '{}', got {}", expr->count(), expression, values.size()));
+
+    std::vector<std::byte> bytes;
+    bytes.reserve(expr->byte_size());
+    for (auto v : values) {
+      throw_if<std::out_of_range>(type_size < 4 && v >= (1u << (8 * type_size)),
+                                  fmt::format("Value ${:X} doesn't fit into {} byte(s)", v, type_size));
+      for (int idx{0}; idx < type_size; ++idx) {
+        bytes.push_back(static_cast<std::byte>(v >> (8 * idx)));
+      }
     }
+    store_memory(address, bytes);
+    flush_memory_writes();
+
+    const auto result = expr->evaluate(context);
+    return EvaluateResult{.result_string = result.value, .address = result.address};
+  });
 
-    static const std::regex direct_regex(
-        R"(^\s*(\$[0-9a-fA-F]{1,7}?|\w+)(?:\s*,\s*([xyz]))?(?:\s*,\s*([bwq]))?(?:\s*,\s*(\d+))?\s*$)",
-        std::regex::icase | std::regex::optimize);
-    static const std::regex indirect_regex(
-        R"(^\s*\(\s*(\w+)\s*\)(?:\s*,\s*([xyz]))?(?:\s*,\s*([bwq]))?(?:\s*,\s*(\d+))?\s*$)",
-        std::regex::icase | std::regex::optimize);
+  return std::get<EvaluateResult>(task_result.value());
+}
 
-    std::cmatch match;
+auto M65Debugger::parse_expression(std::string_view expression) -> std::shared_ptr<const Expression>
+{
+  return expression_cache_.get(expression, dbg_data_.get(), symbols_generation_);
+}
 
-    bool indirect;
-    if (regex_search(expression, match, direct_regex)) {
-      indirect = false;
+void M65Debugger::prefetch_watch_expressions(std::vector<std::pair<int, int>> regions)
+{
+  std::vector<std::shared_ptr<const Expression>> pending;
+  for (const auto& expression : watch_expressions_) {
+    try {
+      pending.push_back(parse_expression(expression));
     }
-    else if (regex_search(expression, match, indirect_regex)) {
-      indirect = true;
+    catch (const std::invalid_argument&) {
+    }
+  }
+  // The client evaluates its watches again after the stop, which refills the set for the next stop
+  watch_expressions_.clear();
+
+  // The first round includes the given regions, so they are fetched in the same batch
+  std::vector<std::pair<int, int>> watched_regions;
+  for (int round{0}; round < max_watch_prefetch_rounds && (round == 0 || !pending.empty()); ++round) {
+    FootprintContext context(memory_cache_, current_registers_);
+    for (const auto& [first_address, last_address] : std::exchange(regions, {})) {
+      context.add_region(first_address, last_address - first_address + 1);
+    }
+    std::vector<std::shared_ptr<const Expression>> unresolved;
+    for (auto& expr : pending) {
+      context.reset();
+      try {
+        if (expr->is_immediate()) {
+          expr->evaluate(context);
+        }
+        else {
+          const int address = expr->evaluate_address(context);
+          if (context.complete()) {
+            context.add_region(address, expr->byte_size());
+            watched_regions.emplace_back(address, address + expr->byte_size() - 1);
+          }
+        }
+      }
+      catch (const std::exception&) {
+        // Computed from memory not fetched yet, or invalid anyway and reported once the client evaluates it
+      }
+      if (!context.complete()) {
+        unresolved.push_back(std::move(expr));
+      }
+    }
+    memory_cache_.prefetch(context.regions());
+    pending = std::move(unresolved);
+  }
+  memory_cache_.set_shadowed_regions(watched_regions);
+}
+
+void M65Debugger::start_profiling(int sample_rate_hz) { profiler_.start(sample_rate_hz); }
+
+void M65Debugger::stop_profiling() { profiler_.stop(); }
+
+void M65Debugger::reset_profile() { profiler_.reset(); }
+
+auto M65Debugger::get_profile_collapsed_stacks() -> std::string
+{
+  std::string result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    result = profiler_.to_collapsed_stacks(dbg_data_.get());
+    return {};
+  });
+  return result;
+}
+
+void M65Debugger::start_frame_timing(std::string_view start_location,
+                                     std::string_view end_location,
+                                     bool use_cia_timer)
+{
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    const int start_pc = resolve_address(start_location);
+    const int end_pc = resolve_address(end_location);
+    std::byte palntsc{0};
+    get_io_register_bytes(vic_palntsc_offset, std::span(&palntsc, 1));
+    const bool is_ntsc = (palntsc & std::byte{0x80}) != std::byte{0};
+
+    discard_history();
+    frame_timer_.start(start_pc, end_pc, use_cia_timer, is_ntsc ? ntsc_lines_per_frame : pal_lines_per_frame);
+    execute_command(fmt::format("b{:X}\n", frame_timer_.next_breakpoint_pc()));
+    if (stopped_) {
+      execute_command("t0\n");
+      stopped_ = false;
+    }
+    return {};
+  });
+}
+
+void M65Debugger::stop_frame_timing()
+{
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    if (!frame_timer_.is_active()) {
+      return {};
+    }
+    frame_timer_.stop();
+    if (breakpoint_.has_value()) {
+      execute_command(fmt::format("b{:X}\n", breakpoint_->pc));
     }
     else {
-      return result;
+      execute_command("b\n");
     }
+    return {};
+  });
+}
 
-    const auto& label_match = match[1];
-    const auto& index_match = match[2];
-    const auto& type_match = match[3];
-    const auto& num_elements_match = match[4];
+auto M65Debugger::get_frame_timing_report() -> FrameTimer::Report
+{
+  FrameTimer::Report result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    result = frame_timer_.report();
+    return {};
+  });
+  return result;
+}
 
-    int type_size{1};
-    if (type_match.matched) {
-      char type_char = type_match.str().front();
-      switch (type_char) {
-        case 'b':
-          type_size = 1;
-          break;
-        case 'w':
-          type_size = 2;
-          break;
-        case 'q':
-          type_size = 4;
-          break;
-        default:
-          throw std::logic_error(fmt::format("Unexpected expression data type '{}'", match[2].str()));
-      }
+void M65Debugger::start_trace_recording(const std::filesystem::path& path, std::uint64_t capacity)
+{
+  run_task([&]() -> DebuggerTaskResult {
+    throw_if<std::runtime_error>(is_trace_recording(), "Trace recording already active");
+    throw_if<std::runtime_error>(frame_timer_.is_active(), "Can't record a trace while frame timing is active");
+
+    discard_history();
+    trace_file_.reset();
+    trace_file_ = std::make_unique<TraceFile>(path, capacity);
+    if (!stopped_) {
+      execute_command("t1\n");
+      stopped_ = true;
     }
+    memory_cache_.invalidate();
 
-    std::string_view label{label_match.str()};
+    // Snapshot of bank 0, the base for reconstructing memory when stepping back. The history maps CPU addresses to
+    // bank 0 and skips stores to I/O, see ExecutionHistory.
+    std::vector<std::byte> memory(ExecutionHistory::memory_size);
+    {
+      MutedLogger muted_logger(logger_);
+      get_memory_bytes(0, memory);
+    }
+    history_.reset(memory, trace_file_->total_records());
 
-    int num_elements{1};
-    if (num_elements_match.matched) {
-      num_elements = std::min(256, std::atoi(num_elements_match.str().c_str()));
+    auto lines = execute_command("r\n");
+    throw_if<std::runtime_error>(!update_registers(lines), "Unable to retrieve registers");
+    auto record = make_trace_record(lines);
+    if (record.instruction_length == 0) {
+      read_trace_instruction(record);
     }
+    append_trace_record(record);
+    trace_recording_ = true;
+    return {};
+  });
+}
 
-    static const std::regex address_regex(R"(^\$([0-9a-fA-F]{1,7})$)", std::regex::icase | std::regex::optimize);
-    int address{0};
-    if (regex_search(label, address_regex)) {
-      address = parse_c64_hex(label);
+void M65Debugger::stop_trace_recording()
+{
+  run_task([&]() -> DebuggerTaskResult {
+    if (!is_trace_recording()) {
+      return {};
     }
-    else {
-      const auto* label_entry = dbg_data_->get_label_info(label);
-      if (!label_entry) {
-        return result;
+    end_trace_recording();
+    memory_cache_.invalidate();
+    notify_stopped(StoppedReason::Pause);
+    return {};
+  });
+}
+
+auto M65Debugger::get_trace_record_count() -> std::uint64_t
+{
+  std::uint64_t result{0};
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    if (trace_file_) {
+      result = trace_file_->total_records();
+    }
+    return {};
+  });
+  return result;
+}
+
+auto M65Debugger::get_trace_instructions(std::uint64_t count, std::optional<int> pc) -> std::vector<TraceRecord>
+{
+  std::vector<TraceRecord> result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    throw_if<std::runtime_error>(!trace_file_, "No trace recorded");
+    result = pc.has_value() ? trace_file_->last_instructions_before_pc(pc.value(), count)
+                            : trace_file_->last_instructions(count);
+    return {};
+  });
+  return result;
+}
+
+auto M65Debugger::get_coverage() -> CoverageMap
+{
+  std::optional<CoverageMap> result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    throw_if<std::runtime_error>(!dbg_data_, "No debug symbols loaded");
+    result.emplace(*dbg_data_);
+    for (int pc{0}; pc < Profiler::num_addresses; ++pc) {
+      if (profiler_.sample_count(pc) > 0) {
+        result->add_pc(pc);
       }
-      address = label_entry->address;
     }
+    if (trace_file_) {
+      result->add_trace(*trace_file_);
+    }
+    return {};
+  });
+  return std::move(result.value());
+}
 
-    std::vector<std::byte> tmp(type_size * num_elements);
-    memory_cache_.read(address, tmp);
+void M65Debugger::step_back()
+{
+  run_task([&]() -> DebuggerTaskResult {
+    throw_if<std::runtime_error>(history_.empty() || is_trace_recording(),
+                                 "No execution history available, record a trace first");
+    const auto index = replay_index_.value_or(history_.end_index() - 1);
+    throw_if<std::runtime_error>(index <= history_start(), "Reached the start of the execution history");
+    seek_history(index - 1);
+    notify_stopped(StoppedReason::Step);
+    return {};
+  });
+}
 
-    result.address = address;
-    switch (type_size) {
-      case 1:
-        result.result_string.reserve(3 * num_elements);
-        for (int idx{0}; idx < num_elements; ++idx) {
-          result.result_string.append(fmt::format("{:02X} ", tmp[idx]));
-        }
-        break;
-      case 2:
-        result.result_string.reserve(5 * num_elements);
-        for (int idx{0}; idx < num_elements * 2; idx += 2) {
-          result.result_string.append(fmt::format("{:02X}{:02X} ", tmp[idx + 1], tmp[idx]));
-        }
-        break;
-      case 4:
-        result.result_string.reserve(9 * num_elements);
-        for (int idx{0}; idx < num_elements * 4; idx += 4) {
-          result.result_string.append(
-              fmt::format("{:02X}{:02X}{:02X}{:02X} ", tmp[idx + 3], tmp[idx + 2], tmp[idx + 1], tmp[idx]));
-        }
-        break;
+void M65Debugger::reverse_cont()
+{
+  run_task([&]() -> DebuggerTaskResult {
+    throw_if<std::runtime_error>(history_.empty() || is_trace_recording(),
+                                 "No execution history available, record a trace first");
+    const auto index = replay_index_.value_or(history_.end_index() - 1);
+    const auto breakpoint_index = breakpoint_.has_value() ? history_.find_previous(breakpoint_->pc, index)
+                                                          : std::nullopt;
+    if (breakpoint_index.has_value() && breakpoint_index.value() >= history_start()) {
+      seek_history(breakpoint_index.value());
+      notify_stopped(StoppedReason::Breakpoint);
     }
-    result.result_string.pop_back();
-    return result;
+    else {
+      seek_history(history_start());
+      notify_stopped(StoppedReason::Step);
+    }
+    return {};
   });
+}
 
-  return std::get<EvaluateResult>(task_result.value());
+auto M65Debugger::get_replay_position() -> std::optional<std::uint64_t>
+{
+  std::optional<std::uint64_t> result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    result = replay_index_;
+    return {};
+  });
+  return result;
 }
 
 void M65Debugger::initialize(bool reset_on_run)
 {
   sync_connection();
-  if (reset_on_run && !is_xemu_) {
+  if (reset_on_run && dialect_->can_reset()) {
     reset_target();
     std::this_thread::sleep_for(3s);
   }
@@ -310,6 +944,8 @@ void M65Debugger::initialize(bool reset_on_run)
 void M65Debugger::main_loop(std::future<void> future_exit_object)
 {
   Duration duration_since_last_interaction;
+  Duration duration_since_last_sample;
+  Duration duration_since_reconnect;
 
   do {
     std::optional<DebuggerTask> next_task;
@@ -319,22 +955,127 @@ void M65Debugger::main_loop(std::future<void> future_exit_object)
         next_task = std::move(debugger_tasks_.front());
         debugger_tasks_.pop();
       }
-      if (next_task.has_value()) {
-        (*next_task)();
+    }
+    // Run without holding the lock, so requests keep being queued while a task waits for a reconnect
+    if (next_task.has_value()) {
+      (*next_task)();
+      duration_since_last_interaction.reset();
+    }
+
+    if (link_lost_ && duration_since_reconnect.elapsed_ms() < lost_link_retry_ms) {
+      continue;
+    }
+    try {
+      if (link_lost_) {
+        duration_since_reconnect.reset();
+        if (!reconnect("link lost")) {
+          continue;
+        }
+      }
+      do_event_processing();
+      if (is_trace_recording()) {
+        record_trace_steps();
+        continue;
+      }
+      if (profiler_.is_active() && duration_since_last_sample.elapsed_us() >= profiler_.sample_interval_us()) {
+        sample_pc();
+        duration_since_last_sample.reset();
+      }
+      if (duration_since_last_interaction.elapsed_ms() > 1000) {
+        check_breakpoint_by_pc();
         duration_since_last_interaction.reset();
       }
     }
+    catch (const connection_error& e) {
+      reconnect(e.what());
+      duration_since_reconnect.reset();
+    }
+  } while (future_exit_object.wait_for(is_trace_recording() ? 0ms : profiler_.is_active() ? 1ms : 10ms) ==
+           std::future_status::timeout);
+}
 
-    do_event_processing();
-    if (duration_since_last_interaction.elapsed_ms() > 1000) {
-      check_breakpoint_by_pc();
-      duration_since_last_interaction.reset();
+auto M65Debugger::reconnect(std::string_view reason) -> bool
+{
+  if (!reconnect_) {
+    link_lost_ = true;
+    return false;
+  }
+  // Once given up, only single attempts are made, so requests fail quickly until the device is back
+  const int max_stall_ms = link_lost_ ? 0 : max_reconnect_stall_ms;
+  if (!link_lost_) {
+    logger_->debug_out(fmt::format("Connection lost ({}), reconnecting\n", reason));
+  }
+
+  Duration t;
+  int delay_ms{first_reconnect_delay_ms};
+  while (true) {
+    try {
+      reopen_connection();
+      link_lost_ = false;
+      ++reconnects_;
+      logger_->debug_out(fmt::format("Reconnected after {} ms\n", t.elapsed_ms()));
+      return true;
+    }
+    catch (const std::exception& e) {
+      logger_->debug_out(fmt::format("Reconnect failed: {}\n", e.what()));
     }
-  } while (future_exit_object.wait_for(10ms) == std::future_status::timeout);
+    if (t.elapsed_ms() + delay_ms > max_stall_ms) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+    delay_ms = std::min(delay_ms * 2, max_reconnect_delay_ms);
+  }
+  link_lost_ = true;
+  return false;
+}
+
+void M65Debugger::reopen_connection()
+{
+  // The old connection is closed first, a serial port can only be opened once
+  buffered_conn_ = nullptr;
+  conn_ = std::make_unique<LostConnection>();
+  conn_ = reconnect_();
+  buffered_conn_ = dynamic_cast<BufferedConnection*>(conn_.get());
+  last_line_was_empty_ = false;
+  flush_rx_buffers();
+  sync_connection();
+  restore_session_state();
+}
+
+void M65Debugger::restore_session_state()
+{
+  // The monitor keeps its state over a glitch of the link, but not when the emulator or the MEGA65 was restarted
+  if (frame_timer_.is_active()) {
+    execute_command(fmt::format("b{:X}\n", frame_timer_.next_breakpoint_pc()));
+  }
+  else if (breakpoint_.has_value()) {
+    execute_command(fmt::format("b{:X}\n", breakpoint_->pc));
+  }
+  else {
+    execute_command("b\n");
+  }
+
+  if (!stopped_ && !is_trace_recording()) {
+    execute_command("t0\n");
+    return;
+  }
+  execute_command("t1\n");
+  // Memory read while stopped is still valid if the target didn't move on
+  const auto registers = current_registers_;
+  update_registers();
+  if (registers.pc != current_registers_.pc || registers.sp != current_registers_.sp) {
+    memory_cache_.invalidate();
+    call_stack_.reset();
+    io_registers_.clear();
+  }
 }
 
 void M65Debugger::do_event_processing()
 {
+  if (pending_load_bytes_ > 0) {
+    // Only the echo of the load command arrived, it is discarded once the load is completed by the next command
+    return;
+  }
   auto result = read_line(0);
   if (result.second) {
     // No line available now
@@ -346,120 +1087,216 @@ void M65Debugger::do_event_processing()
     throw std::runtime_error("Unexpected breakpoint trigger response");
   }
 
-  std::vector<std::string> lines;
-  if (is_xemu_) {
-    result = read_line();
-    throw_if<timeout_error>(result.second, "Timeout reading breakpoint registers header");
-    lines.emplace_back(std::move(result.first));
-    if (!lines.back().starts_with("PC   A")) {
-      throw std::runtime_error("Expected register header in breakpoint response");
-    }
-    result = read_line();
-    throw_if<timeout_error>(result.second, "Timeout reading breakpoint registers values");
-    lines.emplace_back(std::move(result.first));
-    result = read_line();
-    throw_if<timeout_error>(result.second, "Timeout reading breakpoint memory location");
-    lines.emplace_back(std::move(result.first));
-    if (!lines.back().starts_with(",0777")) {
-      throw std::runtime_error("Expected register header in breakpoint response");
-    }
-  }
-  else {
-    // Real HW monitor
-    lines = get_lines_until_prompt();
-  }
-
+  auto lines = dialect_->read_breakpoint_block([&] {
+    auto next = read_line();
+    throw_if<timeout_error>(next.second, "Timeout reading breakpoint registers");
+    return std::move(next.first);
+  });
   handle_breakpoint(lines);
 }
 
 void M65Debugger::check_breakpoint_by_pc()
 {
-  if (!breakpoint_.has_value() || stopped_) {
+  if (!breakpoint_.has_value() || stopped_ || frame_timer_.is_active()) {
     return;
   }
   update_registers();
   if (is_breakpoint_trigger_valid()) {
     stopped_ = true;
-    if (event_handler_) {
-      auto f = std::async(std::launch::async, &EventHandlerInterface::handle_debugger_stopped, event_handler_,
-                          StoppedReason::Breakpoint);
-      f.wait();
-    }
+    notify_stopped(StoppedReason::Breakpoint);
   }
 }
 
-auto M65Debugger::read_line(int timeout_ms) -> std::pair<std::string, bool>
+void M65Debugger::sample_pc()
 {
-  std::size_t pos;
+  if (stopped_) {
+    return;
+  }
+  {
+    // Don't flood the debug console with the register dumps of every sample
+    MutedLogger muted_logger(logger_);
+    update_registers();
+  }
+  if (stopped_) {
+    // A breakpoint event was handled while waiting for the register dump
+    return;
+  }
+  profiler_.record_sample(current_registers_.pc);
+}
 
-  Duration t;
+void M65Debugger::record_trace_steps()
+{
+  const std::string steps(trace_pipeline_depth, '\n');
+  std::array<TraceRecord, trace_pipeline_depth> batch;
+
+  try {
+    // Don't flood the debug console with the register dumps of every step
+    MutedLogger muted_logger(logger_);
+    send(steps);
+    for (auto& record : batch) {
+      auto lines = read_command_response("");
+      for (int idx{1}; idx < dialect_->step_reply_prompts(); ++idx) {
+        lines = get_lines_until_prompt();
+      }
+      throw_if<std::runtime_error>(!update_registers(lines), "Unable to parse registers of trace step");
+      record = make_trace_record(lines);
+    }
 
-  while ((pos = buffer_.find_first_of("\n")) == std::string::npos) {
-    if (!buffer_.empty()) {
-      if (buffer_.front() == '.') {
-        // Prompt found, no eol will follow, treat it as line
-        logger_->debug_out("Prompt (.) found\n");
-        buffer_.erase(0);
-        return {".", false};
+    // Memory can only be read once no more steps are in flight
+    memory_cache_.invalidate();
+    std::optional<std::uint64_t> breakpoint_index;
+    for (auto& record : batch) {
+      if (record.instruction_length == 0) {
+        read_trace_instruction(record);
       }
-      if (buffer_.front() == '!') {
-        // Breakpoint found, no eol will follow, treat it as line
-        logger_->debug_out("Breakpoint trigger (!) found\n");
-        buffer_.erase(0);
-        return {"!", false};
+      if (!breakpoint_index.has_value() && breakpoint_.has_value() && record.pc == breakpoint_->pc) {
+        breakpoint_index = history_.end_index();
       }
+      append_trace_record(record);
     }
 
+    if (breakpoint_index.has_value()) {
+      // The steps of the batch behind the breakpoint were executed already, so the target is shown at the
+      // breakpoint by replaying the execution history
+      end_trace_recording();
+      seek_history(breakpoint_index.value());
+      notify_stopped(StoppedReason::Breakpoint);
+    }
+  }
+  catch (const connection_error&) {
+    // Recording goes on once the connection is restored
+    throw;
+  }
+  catch (const std::exception& e) {
+    logger_->debug_out(fmt::format("Trace recording aborted: {}\n", e.what()));
+    end_trace_recording();
+    notify_stopped(StoppedReason::Pause);
+  }
+}
+
+auto M65Debugger::make_trace_record(const std::vector<std::string>& lines) const -> TraceRecord
+{
+  TraceRecord record;
+  record.pc = static_cast<std::uint16_t>(current_registers_.pc);
+  record.sp = static_cast<std::uint16_t>(current_registers_.sp);
+  record.a = static_cast<std::uint8_t>(current_registers_.a);
+  record.x = static_cast<std::uint8_t>(current_registers_.x);
+  record.y = static_cast<std::uint8_t>(current_registers_.y);
+  record.z = static_cast<std::uint8_t>(current_registers_.z);
+  record.b = static_cast<std::uint8_t>(current_registers_.b);
+  record.flags = static_cast<std::uint8_t>(current_registers_.flags);
+
+  const auto it = std::find_if(lines.rbegin(), lines.rend(), [](const std::string& l) { return l.starts_with(","); });
+  if (it != lines.rend()) {
+    parse_instruction_bytes(*it, record);
+  }
+  return record;
+}
+
+void M65Debugger::read_trace_instruction(TraceRecord& record)
+{
+  // Xemu doesn't disassemble the instruction at PC, so the instruction length remains unknown
+  std::byte instruction[3];
+  memory_cache_.read(record.pc, instruction);
+  std::transform(std::begin(instruction), std::end(instruction), record.instruction.begin(),
+                 [](std::byte b) { return std::to_integer<std::uint8_t>(b); });
+}
+
+void M65Debugger::append_trace_record(const TraceRecord& record)
+{
+  trace_file_->append(record);
+  history_.add_step(record);
+}
+
+void M65Debugger::end_trace_recording()
+{
+  if (!is_trace_recording()) {
+    return;
+  }
+  trace_recording_ = false;
+  trace_file_->flush();
+  logger_->debug_out(fmt::format("Trace recording ended after {} steps\n", trace_file_->total_records()));
+}
+
+auto M65Debugger::read_line(int timeout_ms) -> std::pair<std::string, bool>
+{
+  Duration t;
+  std::optional<std::string> line;
+  while (!(line = dialect_->take_line(buffer_)).has_value()) {
     auto read_data = conn_->read(1024, 0);
 
     if (read_data.empty()) {
-      if (t.elapsed_ms() > timeout_ms) {
+      const auto elapsed_ms = t.elapsed_ms();
+      if (elapsed_ms > timeout_ms) {
         return {{}, true};
       }
-      std::this_thread::sleep_for(1ms);
+      conn_->wait_for_input(static_cast<int>(timeout_ms - elapsed_ms) + 1);
     }
     else {
       buffer_.append(read_data);
     }
   }
 
-  if (is_xemu_) {
-    if (buffer_.starts_with(".\r\n")) {
-      logger_->debug_out("Prompt (.) found (Xemu style)\n");
-      buffer_.erase(0, 3);
-      return {".", false};
-    }
+  if (line.value() == ".") {
+    logger_->debug_out("Prompt (.) found\n");
+    return {".", false};
   }
-  else {
-    if (buffer_.front() == '.') {
-      logger_->debug_out("Prompt (.) found\n");
-      buffer_.erase(0);
-      return {".", false};
-    }
-  }
-
-  auto line = buffer_.substr(0, pos);
-  buffer_.erase(0, pos + 1);
-  if (!line.empty() && line.back() == '\r') {
-    line.pop_back();
-  }
-  last_line_was_empty_ = line.empty();
+  last_line_was_empty_ = line->empty();
 
-  auto dbg_str = line;
+  auto dbg_str = line.value();
   replace_all(dbg_str, "\n", "\\n");
   replace_all(dbg_str, "\r", "\\r");
   logger_->debug_out(fmt::format("<- \"{}\"\n", dbg_str));
-  return {line, false};
+  return {std::move(line.value()), false};
 }
 
 void M65Debugger::flush_rx_buffers()
 {
-  // Do a dummy read of 64K to flush the buffer
-  auto dummy_str = conn_->read(65536, 100);
-  if (!dummy_str.empty()) {
-    buffer_.clear();
-    logger_->debug_out(fmt::format("Flushing rx buffer ({0:}/${0:X} bytes)\n", dummy_str.size()));
+  // Drop what the device buffered already, then read until nothing arrives anymore
+  conn_->discard_input();
+  std::size_t flushed{buffer_.size()};
+  buffer_.clear();
+  for (Duration t; t.elapsed_ms() < max_flush_ms;) {
+    conn_->wait_for_input(rx_idle_ms);
+    const auto data = conn_->read(65536, 0);
+    if (data.empty()) {
+      break;
+    }
+    flushed += data.size();
+  }
+  if (flushed > 0) {
+    logger_->debug_out(fmt::format("Flushing rx buffer ({0:}/${0:X} bytes)\n", flushed));
+  }
+}
+
+void M65Debugger::complete_interrupted_load()
+{
+  if (pending_load_bytes_ == 0) {
+    return;
   }
+  // The monitor takes everything for load data until it got all bytes of the load command
+  logger_->debug_out(fmt::format("Completing interrupted load command ({} bytes missing)\n", pending_load_bytes_));
+  const std::string padding(pending_load_bytes_, ' ');
+  pending_load_bytes_ = 0;
+  send(padding);
+  flush_rx_buffers();
+}
+
+void M65Debugger::escape_load_command()
+{
+  // Unknown whether a load command is waiting for data, e.g. one left by another session. Its prompt appears as
+  // soon as it got all bytes, without one the spaces end up in the command line that is ended at last.
+  const std::string block(load_escape_block_size, ' ');
+  std::size_t sent{0};
+  while (sent < max_load_escape_size) {
+    send(block);
+    sent += block.size();
+    if (!conn_->read(1, 0).empty()) {
+      break;
+    }
+  }
+  send(std::string_view("\n"));
+  logger_->debug_out(fmt::format("Sent {} bytes to escape a hanging load command\n", sent));
 }
 
 void M65Debugger::sync_connection()
@@ -467,9 +1304,10 @@ void M65Debugger::sync_connection()
   int retries = 10;
   bool first_try = true;
 
+  complete_interrupted_load();
   while (retries-- > 0) {
-    auto cmd = is_xemu_ ? std::string("?\n") : fmt::format("?{}\n", retries);
-    conn_->write(cmd);
+    auto cmd = detect_dialect_ ? std::string("?\n") : dialect_->sync_command(retries);
+    send(cmd);
     auto reply = read_line(500);
     if (reply.second) {
       // timeout
@@ -486,8 +1324,13 @@ void M65Debugger::sync_connection()
         timeout = true;
       }
 
-      const std::string ident = is_xemu_ ? "Xemu/MEGA65 Serial Monitor" : "MEGA65 Serial Monitor";
-      if (!timeout && lines.front().starts_with(ident)) {
+      if (!timeout && detect_dialect_ && !lines.empty() && lines.front().starts_with(xemu_ident)) {
+        // Replies are read the MEGA65 way until here, which leaves the line break following Xemu's prompt
+        dialect_ = &xemu_dialect();
+        flush_rx_buffers();
+      }
+      if (!timeout && !lines.empty() && lines.front().starts_with(dialect_->ident())) {
+        detect_dialect_ = false;
         logger_->debug_out(" === Successfully synced with target debugger ===\n");
         return;
       }
@@ -495,11 +1338,7 @@ void M65Debugger::sync_connection()
 
     if (first_try && reply.second) {
       first_try = false;
-      // write dummy data to exit hanging 'l' command
-      std::array<char, 65536> dummy_array;
-      std::fill(dummy_array.begin(), dummy_array.end(), ' ');
-      dummy_array.back() = '\n';
-      conn_->write(dummy_array);
+      escape_load_command();
     }
     flush_rx_buffers();
   }
@@ -510,11 +1349,10 @@ void M65Debugger::sync_connection()
 void M65Debugger::reset_target()
 {
   std::string cmd = "!\n";
-  conn_->write(cmd);
+  send(cmd);
 
   auto reply = conn_->read(4);
-  auto expected = is_xemu_ ? "!\r\n?" : "!\r\n@";
-  if (reply.empty() || reply != expected) {
+  if (reply != dialect_->reset_reply()) {
     throw std::runtime_error("Unable to reset target");
   }
 
@@ -544,7 +1382,7 @@ auto M65Debugger::update_registers(std::vector<std::string> lines) -> bool
     return false;
   }
 
-  if (!it->starts_with("PC   A  X  Y  Z  B  SP")) {
+  if (!it->starts_with(register_header)) {
     return false;
   }
 
@@ -552,39 +1390,7 @@ auto M65Debugger::update_registers(std::vector<std::string> lines) -> bool
     return false;
   }
 
-  std::istringstream sstr(*it);
-  sstr >> std::hex;
-
-  sstr >> current_registers_.pc;
-  sstr >> current_registers_.a;
-  sstr >> current_registers_.x;
-  sstr >> current_registers_.y;
-  sstr >> current_registers_.z;
-  sstr >> current_registers_.b;
-  sstr >> current_registers_.sp;
-  sstr >> current_registers_.maph;
-  sstr >> current_registers_.mapl;
-  sstr >> current_registers_.last_op;
-  sstr >> current_registers_.in;
-  sstr >> current_registers_.p;
-  sstr >> current_registers_.flags_string;
-  sstr >> current_registers_.rgp_string;
-  sstr >> current_registers_.us;
-  sstr >> current_registers_.io;
-  sstr >> current_registers_.ws;
-  sstr >> current_registers_.h;
-  sstr >> current_registers_.reca8lhc;
-
-  int val = 0b10000000;
-  current_registers_.flags = 0;
-  for (int i = 0; i < 7; ++i) {
-    if (current_registers_.flags_string[i] != '.') {
-      current_registers_.flags |= val;
-    }
-    val >>= 1;
-  }
-
-  return true;
+  return dialect_->parse_registers(*it, current_registers_);
 }
 
 void M65Debugger::upload_prg_file(const std::filesystem::path& prg_path)
@@ -606,20 +1412,13 @@ void M65Debugger::upload_prg_file(const std::filesystem::path& prg_path)
   int load_address = static_cast<int>(prg_data[0]) + static_cast<int>(prg_data[1]) * 256;
 
   std::span<char> payload(prg_data.data() + 2, prg_data.size() - 2);
-
-  auto end_address_plus_one = load_address + payload.size();
-
-  auto cmd = fmt::format("l{:X} {:X}\n", load_address, end_address_plus_one);
-
-  conn_->write(cmd);
-  conn_->write(payload);
-
-  get_lines_until_prompt();
+  load_memory(load_address, payload);
 }
 
 void M65Debugger::load_debug_symbols(const std::filesystem::path& dbg_path)
 {
   dbg_data_ = std::make_unique<C64DebuggerData>(dbg_path);
+  ++symbols_generation_;
 }
 
 void M65Debugger::simulate_keypresses(std::string_view keys)
@@ -670,22 +1469,32 @@ auto M65Debugger::get_lines_until_prompt() -> std::vector<std::string>
 
 std::vector<std::string> M65Debugger::execute_command(std::string_view cmd)
 {
-  conn_->write(cmd);
+  complete_interrupted_load();
+  send(cmd);
+  return read_command_response(cmd.substr(0, cmd.length() - 1));
+}
 
+auto M65Debugger::read_command_response(std::string_view cmd_echo) -> std::vector<std::string>
+{
+  std::vector<std::vector<std::string>> pending_events;
   while (true) {
     auto lines = get_lines_until_prompt();
     if (lines.empty()) {
       throw std::runtime_error("Expected echo of cmd, but received empty reply before prompt");
     }
 
-    if (lines.front() == cmd.substr(0, cmd.length() - 1)) {
+    if (lines.front() == cmd_echo) {
       // first line matches our cmd, this is our response data
       lines.erase(lines.begin());
+      for (auto& event_lines : pending_events) {
+        handle_breakpoint(event_lines);
+      }
       return lines;
     }
 
-    // Received a line,  but it did not match our cmd, treat it as an event
-    handle_breakpoint(lines);
+    // Received a line, but it did not match our cmd, treat it as an event. Handling it may issue commands itself,
+    // so defer it until the response to our cmd has been received.
+    pending_events.push_back(std::move(lines));
   }
 }
 
@@ -695,11 +1504,22 @@ void M65Debugger::handle_breakpoint(std::vector<std::string>& lines)
   if (lines[0] == "!") {
     lines.erase(lines.begin());
   }
-  if (!lines[0].starts_with("PC   A  X  Y  Z  B  SP")) {
+  if (!lines[0].starts_with(register_header)) {
     throw std::runtime_error("Unexpected breakpoint trigger response");
   }
 
   logger_->debug_out("Breakpoint triggered\n");
+  if (is_trace_recording()) {
+    // The steps behind the trigger are still in flight, recording stops once it parsed the step reaching the
+    // breakpoint
+    return;
+  }
+  if (frame_timer_.is_active()) {
+    update_registers(lines);
+    handle_frame_timing_breakpoint();
+    return;
+  }
+
   if (!update_registers(lines) || !is_breakpoint_trigger_valid()) {
     execute_command("t0\n");
     return;
@@ -707,43 +1527,391 @@ void M65Debugger::handle_breakpoint(std::vector<std::string>& lines)
 
   memory_cache_.invalidate();
   stopped_ = true;
+  notify_stopped(StoppedReason::Breakpoint);
+}
+
+void M65Debugger::handle_frame_timing_breakpoint()
+{
+  std::byte raster[2];
+  get_io_register_bytes(vic_raster_offset, raster);
+  const int raster_line = std::to_integer<int>(raster[1]) + ((std::to_integer<int>(raster[0]) & 0x80) << 1);
+
+  int cia_timer{0};
+  if (frame_timer_.uses_cia_timer()) {
+    std::byte timer[2];
+    get_io_register_bytes(cia1_timer_a_offset, timer);
+    cia_timer = to_word(timer);
+  }
+
+  frame_timer_.add_measurement(raster_line, cia_timer);
+  execute_command(fmt::format("b{:X}\n", frame_timer_.next_breakpoint_pc()));
+  execute_command("t0\n");
+}
+
+auto M65Debugger::resolve_address(std::string_view location) const -> int
+{
+  if (location.starts_with('$')) {
+    return parse_c64_hex(location);
+  }
+  throw_if<std::runtime_error>(!dbg_data_, "Can't resolve label, no debug symbols loaded");
+  const auto* label_entry = dbg_data_->get_label_info(location);
+  throw_if<std::runtime_error>(!label_entry, fmt::format("Unknown label '{}'", location));
+  return label_entry->address;
+}
+
+void M65Debugger::notify_stopped(StoppedReason reason)
+{
+  stop_duration_.reset();
+  call_stack_.reset();
+  variable_containers_.clear();
+  io_registers_.clear();
+  std::future<void> f;
   if (event_handler_) {
-    auto f = std::async(std::launch::async, &EventHandlerInterface::handle_debugger_stopped, event_handler_,
-                        StoppedReason::Breakpoint);
+    f = std::async(std::launch::async, &EventHandlerInterface::handle_debugger_stopped, event_handler_, reason);
+  }
+
+  // The client requests registers, stack and watches as soon as it got the event, fetch their memory meanwhile
+  std::vector<std::pair<int, int>> changed_ranges;
+  try {
+    warm_up_memory_cache();
+    changed_ranges = memory_cache_.take_changed_ranges();
+  }
+  catch (const std::exception& e) {
+    logger_->debug_out(fmt::format("Memory cache warmup failed: {}\n", e.what()));
+  }
+
+  if (f.valid()) {
     f.wait();
   }
+  if (event_handler_ && !changed_ranges.empty()) {
+    event_handler_->handle_memory_changed(changed_ranges);
+  }
+}
+
+void M65Debugger::warm_up_memory_cache()
+{
+  working_set_.learn(memory_cache_.take_read_lines());
+  // Changes found by on demand reads during the last stop were shown to the client already
+  memory_cache_.take_changed_ranges();
+
+  std::vector<std::pair<int, int>> regions;
+  const int stack_page = current_registers_.sp & 0xff00;
+  const int base_page = (current_registers_.b & 0xff) << 8;
+  regions.emplace_back(stack_page, stack_page + 0xff);
+  regions.emplace_back(base_page, base_page + 0xff);
+  regions.emplace_back(std::max(0, current_registers_.pc - warmup_bytes_before_pc),
+                       current_registers_.pc + warmup_bytes_after_pc - 1);
+  for (auto line_address : working_set_.line_addresses()) {
+    regions.emplace_back(line_address, line_address + 0xff);
+  }
+
+  const auto fetched_lines_before = memory_cache_.fetched_lines();
+  Duration warmup_duration;
+  prefetch_watch_expressions(std::move(regions));
+
+  fetched_lines_after_warmup_ = memory_cache_.fetched_lines();
+  stop_metrics_ = StopMetrics{.warmup_lines = static_cast<int>(fetched_lines_after_warmup_ - fetched_lines_before),
+                              .warmup_us = warmup_duration.elapsed_us()};
+  // The reads of the warmup itself are not part of the working set
+  memory_cache_.take_read_lines();
+}
+
+void M65Debugger::record_client_access()
+{
+  stop_metrics_.populated_us = stop_duration_.elapsed_us();
+  stop_metrics_.missed_lines = memory_cache_.fetched_lines() - fetched_lines_after_warmup_;
+}
+
+auto M65Debugger::get_stop_metrics() -> StopMetrics
+{
+  StopMetrics result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    result = stop_metrics_;
+    return {};
+  });
+  return result;
+}
+
+auto M65Debugger::get_receive_stats() -> std::optional<BufferedConnection::ReceiveStats>
+{
+  // Read by the main loop, as the connection is replaced when reconnecting
+  std::optional<BufferedConnection::ReceiveStats> result;
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    if (buffered_conn_ != nullptr) {
+      result = buffered_conn_->get_stats();
+    }
+    return {};
+  });
+  return result;
+}
+
+auto M65Debugger::get_reconnect_count() -> int
+{
+  int result{0};
+  run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+    result = reconnects_;
+    return {};
+  });
+  return result;
+}
+
+auto M65Debugger::StopMetrics::to_string() const -> std::string
+{
+  return fmt::format(
+      "Warmup fetched {} lines in {:.1f} ms, client data complete after {:.1f} ms with {} lines fetched on demand",
+      warmup_lines, warmup_us / 1000.0, populated_us / 1000.0, missed_lines);
+}
+
+auto M65Debugger::history_start() const -> std::uint64_t
+{
+  // Older trace records may have been overwritten in the ring buffer
+  return std::max(history_.first_index(), trace_file_->first_index());
+}
+
+void M65Debugger::seek_history(std::uint64_t index)
+{
+  if (index + 1 == history_.end_index()) {
+    // The end of the history is the current state of the target
+    replay_index_.reset();
+    update_registers();
+  }
+  else {
+    const auto record = trace_file_->at(index);
+    replay_index_ = index;
+    current_registers_.pc = record.pc;
+    current_registers_.a = record.a;
+    current_registers_.x = record.x;
+    current_registers_.y = record.y;
+    current_registers_.z = record.z;
+    current_registers_.b = record.b;
+    current_registers_.sp = record.sp;
+    current_registers_.flags = record.flags;
+  }
+  memory_cache_.invalidate();
+}
+
+void M65Debugger::discard_history()
+{
+  replay_index_.reset();
+  history_.clear();
+}
+
+void M65Debugger::read_memory(int address, std::span<std::byte> target)
+{
+  throw_if<std::out_of_range>(address < 0 || address + target.size() > address_space_size,
+                              "Memory range outside of the address space");
+
+  if (target.size() <= max_cached_memory_read) {
+    run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+      memory_cache_.read(address, target);
+      record_client_access();
+      return {};
+    });
+    return;
+  }
+
+  for (std::size_t pos{0}; pos < target.size(); pos += memory_read_chunk_size) {
+    auto chunk = target.subspan(pos, std::min(memory_read_chunk_size, target.size() - pos));
+    run_task(TaskRetry::Idempotent, [&]() -> DebuggerTaskResult {
+      get_memory_bytes(address + static_cast<int>(pos), chunk);
+      return {};
+    });
+  }
+}
+
+auto M65Debugger::search_memory(int first_address,
+                                int last_address,
+                                const SearchPattern& pattern,
+                                std::size_t max_matches,
+                                const std::function<void(std::span<const int>)>& on_matches) -> std::vector<int>
+{
+  throw_if<std::out_of_range>(first_address < 0 || last_address < first_address || last_address >= address_space_size,
+                              "Memory range outside of the address space");
+
+  // Each fetch owns its buffer, so a search ending early doesn't leave a task writing into freed memory
+  struct ChunkFetch {
+    std::shared_ptr<std::vector<std::byte>> data;
+    std::future<DebuggerTaskResult> done;
+  };
+  const std::size_t size = last_address - first_address + 1;
+  auto fetch_chunk = [&](std::size_t pos) {
+    const int address = first_address + static_cast<int>(pos);
+    auto data = std::make_shared<std::vector<std::byte>>(std::min(memory_read_chunk_size, size - pos));
+    auto done = post_task(TaskRetry::Idempotent, [this, address, data]() -> DebuggerTaskResult {
+      if (data->size() <= max_cached_memory_read) {
+        memory_cache_.read(address, *data);
+      }
+      else {
+        get_memory_bytes(address, *data);
+      }
+      return {};
+    });
+    return ChunkFetch{std::move(data), std::move(done)};
+  };
+
+  StreamSearch search(pattern);
+  std::vector<int> result;
+  auto next = fetch_chunk(0);
+  for (std::size_t pos{0}; pos < size && result.size() < max_matches; pos += memory_read_chunk_size) {
+    auto current = std::move(next);
+    if (pos + memory_read_chunk_size < size) {
+      next = fetch_chunk(pos + memory_read_chunk_size);
+    }
+    current.done.get();
+
+    auto matches = search.feed(first_address + static_cast<int>(pos), *current.data);
+    matches.resize(std::min(matches.size(), max_matches - result.size()));
+    if (!matches.empty()) {
+      result.insert(result.end(), matches.begin(), matches.end());
+      if (on_matches) {
+        on_matches(matches);
+      }
+    }
+  }
+  return result;
+}
+
+void M65Debugger::write_memory(int address, std::span<const std::byte> data)
+{
+  throw_if<std::out_of_range>(address < 0 || address + data.size() > address_space_size,
+                              "Memory range outside of the address space");
+
+  run_task([&]() -> DebuggerTaskResult {
+    throw_if<std::runtime_error>(replay_index_.has_value(),
+                                 "Memory can't be changed while stepping through the execution history");
+    store_memory(address, data);
+    flush_memory_writes();
+    return {};
+  });
+}
+
+void M65Debugger::store_memory(int address, std::span<const std::byte> data)
+{
+  memory_writes_.add(address, data);
+  memory_cache_.update(address, data);
+  call_stack_.reset();
+  io_registers_.clear();
+}
+
+void M65Debugger::flush_memory_writes()
+{
+  for (const auto& [address, data] : memory_writes_.spans()) {
+    const int size = static_cast<int>(data.size());
+    int pos{0};
+    while (pos < size) {
+      const int span_address = address + pos;
+      const int load_size = std::min({size - pos, 0x10000 - (span_address & 0xffff), max_load_size});
+      if (load_size >= min_load_size) {
+        load_memory(span_address, std::span(reinterpret_cast<const char*>(data.data()) + pos, load_size));
+        pos += load_size;
+        continue;
+      }
+      const auto store_bytes = std::span(data).subspan(pos, std::min(size - pos, max_bytes_per_store));
+      execute_command(fmt::format("s{:X} {:02X}\n", span_address, fmt::join(store_bytes, " ")));
+      pos += store_bytes.size();
+    }
+  }
+  memory_writes_.clear();
+}
+
+void M65Debugger::load_memory(int address, std::span<const char> data)
+{
+  auto cmd = fmt::format("l{:X} {:X}\n", address, (address + data.size()) & 0xffff);
+
+  complete_interrupted_load();
+  send(cmd);
+  pending_load_bytes_ = data.size();
+  for (std::size_t pos{0}; pos < data.size(); pos += load_block_size) {
+    const auto block = data.subspan(pos, std::min(load_block_size, data.size() - pos));
+    send(block);
+    pending_load_bytes_ -= block.size();
+  }
+
+  get_lines_until_prompt();
 }
 
 void M65Debugger::get_memory_bytes(int address, std::span<std::byte> target)
 {
-  assert(address >= 0);
-  const int count = target.size();
-  int pos = 0;
-  static const int bytes_per_line = 16;
+  const MemoryRange range{.address = address, .target = target};
+  get_memory_ranges(std::span(&range, 1));
+}
 
-  while (pos < count) {
-    std::vector<std::string> lines;
-    if (count - pos <= bytes_per_line) {
-      lines = execute_command(fmt::format("m{:X}\n", address));
+void M65Debugger::get_io_register_bytes(int offset, std::span<std::byte> target)
+{
+  // A read command always returns a whole window, which must not include registers cleared by reading them (e.g.
+  // the VIC collision latches following the raster registers)
+  const auto start = plan_register_window(offset, static_cast<int>(target.size()));
+  throw_if<std::logic_error>(!start.has_value(), fmt::format("Can't read register ${:04X} safely", 0xD000 + offset));
+  std::array<std::byte, register_window_size> window;
+  get_memory_bytes(io_personality_base + start.value(), window);
+  std::copy_n(window.begin() + (offset - start.value()), target.size(), target.begin());
+}
+
+void M65Debugger::get_memory_ranges(std::span<const MemoryRange> ranges)
+{
+  static const int bytes_per_line = 16;
+  static const int bytes_per_block = 16 * bytes_per_line;
+
+  // Keep several read commands in flight to hide the round trip latency, but only a bounded number to not overrun
+  // the input buffer of the monitor. Commands for the next range are sent while the previous one is still arriving.
+  struct PendingRead {
+    std::string cmd_echo;
+    const MemoryRange* range;
+    int pos;
+  };
+  std::deque<PendingRead> pending;
+  auto range_it = ranges.begin();
+  complete_interrupted_load();
+  int next_pos{0};
+
+  while (range_it != ranges.end() || !pending.empty()) {
+    std::string cmds;
+    while (range_it != ranges.end() && pending.size() < max_memory_reads_in_flight) {
+      const int address = range_it->address;
+      const int count = range_it->target.size();
+      assert(address >= 0);
+      if (next_pos == 0 && replay_index_.has_value() && address + count <= ExecutionHistory::memory_size) {
+        history_.read_memory(replay_index_.value(), address, range_it->target);
+        next_pos = count;
+      }
+      if (next_pos >= count) {
+        ++range_it;
+        next_pos = 0;
+        continue;
+      }
+      const bool single_line = count - next_pos <= bytes_per_line;
+      pending.push_back({fmt::format("{}{:X}", single_line ? 'm' : 'M', address + next_pos), &(*range_it), next_pos});
+      cmds.append(pending.back().cmd_echo).append("\n");
+      next_pos += single_line ? bytes_per_line : bytes_per_block;
     }
-    else {
-      lines = execute_command(fmt::format("M{:X}\n", address));
+    if (!cmds.empty()) {
+      send(cmds);
     }
-    for (const auto& line : lines) {
+    if (pending.empty()) {
+      continue;
+    }
+
+    const auto read = std::move(pending.front());
+    pending.pop_front();
+    const int address = read.range->address;
+    const auto target = read.range->target;
+    int pos = read.pos;
+    const int block_end = std::min(static_cast<int>(target.size()), pos + bytes_per_block);
+    for (const auto& line : read_command_response(read.cmd_echo)) {
       if (line.empty()) {
         continue;
       }
-      if (pos >= count) {
+      if (pos >= block_end) {
         break;
       }
-      auto needed = std::min(count - pos, bytes_per_line);
+      auto needed = std::min(block_end - pos, bytes_per_line);
       auto ret_addr = parse_address_line(line, target.subspan(pos, needed));
-      if (ret_addr != address) {
+      if (ret_addr != address + pos) {
         throw std::runtime_error("Unexpected address range provided by read memory command");
       }
-      address += bytes_per_line;
       pos += needed;
     }
+    throw_if<std::runtime_error>(pos < block_end, "Incomplete response to read memory command");
   }
 }
 
@@ -767,6 +1935,10 @@ auto M65Debugger::parse_address_line(std::string_view mem_string, std::span<std:
 
 auto M65Debugger::is_breakpoint_trigger_valid() -> bool
 {
+  if (!breakpoint_.has_value()) {
+    return false;
+  }
+
   std::byte cmd_at_breakpoint[5];
   memory_cache_.read(breakpoint_->pc, cmd_at_breakpoint);
 
@@ -794,8 +1966,10 @@ auto M65Debugger::calculate_address(int addr, AddressingMode mode, int pc) -> in
       return memory_cache_.read_word(addr + current_registers_.x);
     case AddressingMode::RelativeWord:
       return pc + (addr > 0x7fff ? addr - 0x10000 : addr);
+    default:
+      // Only the modes of JSR and BSR are needed to check a breakpoint on a subroutine call
+      throw std::logic_error("Unimplemented AddressingMode");
   }
-  throw std::logic_error("Unimplemented AddressingMode");
 }
 
 }  // namespace m65dap
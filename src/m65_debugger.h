@@ -1,10 +1,24 @@
 #pragma once
 
+#include "buffered_connection.h"
 #include "c64_debugger_data.h"
 #include "connection.h"
+#include "coverage_map.h"
+#include "duration.h"
+#include "execution_history.h"
+#include "expression.h"
+#include "frame_timer.h"
+#include "io_registers.h"
 #include "logger.h"
 #include "memory_cache.h"
+#include "memory_search.h"
+#include "memory_write_buffer.h"
+#include "monitor_dialect.h"
 #include "opcodes.h"
+#include "profiler.h"
+#include "stack_unwinder.h"
+#include "trace_file.h"
+#include "working_set.h"
 
 namespace m65dap {
 
@@ -12,41 +26,28 @@ class M65Debugger {
  public:
   enum class StoppedReason { Pause, Step, Breakpoint };
 
+  // Opens the connection again after it was lost
+  using ConnectionFactory = std::function<std::unique_ptr<Connection>()>;
+
   class EventHandlerInterface {
    public:
     virtual ~EventHandlerInterface() = default;
 
     virtual void handle_debugger_stopped([[maybe_unused]] StoppedReason reason){};
-  };
 
-  struct Registers {
-    int pc;
-    int a;
-    int x;
-    int y;
-    int z;
-    int b;
-    int sp;
-    int maph;
-    int mapl;
-    int last_op;
-    int in;
-    int p;
-
-    std::string flags_string;
-    int flags;
-
-    std::string rgp_string;
-    int rgp;
-
-    int us;
-    char io;
-    int ws;
-    char h;
-
-    std::string reca8lhc;
+    /**
+     * @brief Called after handle_debugger_stopped() with the memory the target changed since the last stop
+     *
+     * Covers the memory fetched at both stops (stack, base page, code at PC, watches and the memory the client read
+     * in the last stop). Watched memory is reported byte exact, other memory in 256 byte lines.
+     *
+     * @param ranges Sorted ranges as pairs of first and last (inclusive) address
+     */
+    virtual void handle_memory_changed([[maybe_unused]] std::span<const std::pair<int, int>> ranges){};
   };
 
+  using Registers = m65dap::Registers;
+
   struct SourcePosition {
     std::filesystem::path src_path;
     int line{0};
@@ -65,25 +66,97 @@ class M65Debugger {
     int address{-1};
   };
 
+  /**
+   * @brief Variable shown in the variables view, either a label of the current block or a part of one
+   */
+  struct Variable {
+    std::string name;
+    std::string value;
+    std::string type;
+    int address{-1};
+    int variables_reference{0};  // > 0 if the variable has elements or fields to expand
+    int indexed_children{0};
+    int named_children{0};
+  };
+
+  /**
+   * @brief How quickly the client got its data after the target stopped
+   */
+  struct StopMetrics {
+    int warmup_lines{0};               // lines fetched ahead of the client requests
+    std::int64_t warmup_us{0};         // duration of the warmup burst
+    std::int64_t populated_us{0};      // time from the stop until the last memory access of the client
+    std::uint64_t missed_lines{0};     // lines fetched on demand after the warmup
+
+    auto to_string() const -> std::string;
+  };
+
  private:
   friend class MemoryCache;
 
   using DebuggerTaskResult = std::optional<std::variant<EvaluateResult>>;
   using DebuggerTask = std::packaged_task<DebuggerTaskResult()>;
 
+  // Whether a task failing as the connection was lost is run again once it is restored
+  enum class TaskRetry {
+    Idempotent,          // always, running it again has the same effect (e.g. reading memory)
+    BeforeFirstCommand,  // only if it didn't send anything yet, running it twice would e.g. step twice
+  };
+
   std::string buffer_;
   bool last_line_was_empty_{false};
+  std::size_t pending_load_bytes_{0};  // data the monitor still expects for a load command that was interrupted
 
   EventHandlerInterface* event_handler_{nullptr};
   LoggerInterface* logger_{nullptr};
   MemoryCache memory_cache_;
+  MemoryWriteBuffer memory_writes_;
+  Profiler profiler_;
+  FrameTimer frame_timer_;
+  std::unique_ptr<TraceFile> trace_file_;
+  std::atomic<bool> trace_recording_{false};
+  ExecutionHistory history_;
+  std::optional<std::uint64_t> replay_index_;
   std::unique_ptr<Connection> conn_;
+  BufferedConnection* buffered_conn_{nullptr};  // conn_ if it has a receive thread
+  ConnectionFactory reconnect_;
+  bool link_lost_{false};  // reconnecting failed, conn_ fails all reads and writes
+  int reconnects_{0};
+  std::uint64_t writes_sent_{0};  // writes to the connection, a task sent something if it changed
   std::thread main_loop_thread_;
   std::promise<void> main_loop_exit_signal_;
   std::queue<DebuggerTask> debugger_tasks_;
 
   std::unique_ptr<C64DebuggerData> dbg_data_;
-  bool is_xemu_{false};
+  std::uint64_t symbols_generation_{0};
+  ExpressionCache expression_cache_;
+  std::vector<std::string> watch_expressions_;
+  WorkingSet working_set_;
+  std::filesystem::path working_set_dir_{WorkingSet::default_dir()};
+  StopMetrics stop_metrics_;
+  Duration stop_duration_;
+  std::uint64_t fetched_lines_after_warmup_{0};
+  std::optional<std::vector<StackFrame>> call_stack_;
+  std::map<std::size_t, std::vector<RegisterValue>> io_registers_;  // decoded banks of the current stop
+
+  struct VariableType {
+    std::string name;
+    std::shared_ptr<const TypeLayout> layout;
+    int count{1};
+  };
+
+  // Memory a variables reference refers to, reference ids are indices into the table offset by
+  // first_variables_reference
+  struct VariableContainer {
+    int address{0};
+    std::shared_ptr<const TypeLayout> layout;
+    int count{1};
+  };
+
+  std::map<std::string, VariableType> variable_types_;
+  std::vector<VariableContainer> variable_containers_;
+  const MonitorDialect* dialect_{&mega65_dialect()};
+  bool detect_dialect_{false};  // dialect_ is set while syncing with the monitor
   bool reset_on_disconnect_{true};
   bool stopped_{false};
   Registers current_registers_;
@@ -91,22 +164,44 @@ class M65Debugger {
   std::mutex task_queue_mutex_;
 
  public:
+  /**
+   * @param serial_port_device Serial port, "unix#<socket path>", "tcp#<host:port>" or "replay#<session recording>"
+   * @param recording_path Session recording to write everything sent over the connection to, none if empty
+   * @param replay_speed Factor the delays of a replayed session are divided by, 0 replies without delay
+   *
+   * A lost connection to the device is opened again, see reconnect().
+   */
   M65Debugger(std::string_view serial_port_device,
               EventHandlerInterface* event_handler,
               LoggerInterface* logger = nullptr,
               bool reset_on_run = false,
-              bool reset_on_disconnect = true);
+              bool reset_on_disconnect = true,
+              bool receive_thread = true,
+              const std::filesystem::path& recording_path = {},
+              double replay_speed = 1.0);
 
+  /**
+   * @param reconnect Opens the connection again once it was lost, no reconnects if empty
+   */
   M65Debugger(std::unique_ptr<Connection> connection,
               EventHandlerInterface* event_handler,
               LoggerInterface* logger = nullptr,
               bool is_xemu = false,
               bool reset_on_run = false,
-              bool reset_on_disconnect = true);
+              bool reset_on_disconnect = true,
+              ConnectionFactory reconnect = {});
 
   ~M65Debugger();
 
   void set_target(const std::filesystem::path& prg_path);
+
+  /**
+   * @brief Sets the directory the working sets of the programs are stored in, they aren't stored if empty
+   *
+   * Takes effect with the next call of set_target().
+   */
+  void set_working_set_dir(const std::filesystem::path& dir) { working_set_dir_ = dir; }
+
   void run_target();
   void pause();
   void cont();
@@ -117,29 +212,265 @@ class M65Debugger {
   auto get_registers() const -> Registers { return current_registers_; }
   auto get_pc() -> const int { return current_registers_.pc; }
   auto get_current_source_position() const -> SourcePosition;
-  auto evaluate_expression(std::string_view expression, bool format_as_hex) -> EvaluateResult;
+  auto get_source_position(int address) const -> SourcePosition;
+
+  /**
+   * @brief Returns the call stack of the stopped target, innermost frame first
+   *
+   * The stack is unwound once per stop, further calls (e.g. for paging through the frames) return the same result.
+   */
+  auto get_call_stack() -> std::vector<StackFrame>;
+
+  /**
+   * @brief Sets the types of labels shown as local variables, labels without a type are shown as byte
+   *
+   * @param types Type by label name as accepted by Expression::parse_type(), e.g. "word[16]" or
+   * "{x: byte, y: byte}[8]". Throws std::invalid_argument for invalid types.
+   */
+  void set_variable_types(const std::map<std::string, std::string>& types);
+
+  /**
+   * @brief Returns the labels of the block a stack frame is in as variables
+   *
+   * Arrays and structs get a variables reference to expand them with get_child_variables(). References are valid
+   * until the target continues.
+   */
+  auto get_local_variables(std::size_t frame_index, bool format_as_hex) -> std::vector<Variable>;
+
+  /**
+   * @brief Returns a slice of the elements of an array, or the fields of a struct
+   *
+   * Only the memory of the returned elements is read, so large arrays can be paged through.
+   *
+   * @param start First element to return
+   * @param count Number of elements to return, 0 for all
+   */
+  auto get_child_variables(int variables_reference, int start, int count, bool format_as_hex)
+      -> std::vector<Variable>;
+
+  /**
+   * @brief Returns the registers of a bank of get_register_banks() as variables
+   *
+   * A bank is read once per stop, in a single batch of memory reads that leaves out registers changing state when
+   * read. Those are shown without a value.
+   */
+  auto get_io_registers(std::size_t bank_index, bool format_as_hex) -> std::vector<Variable>;
+
+  /**
+   * @brief Evaluates an expression as described for Expression, throws std::invalid_argument for invalid ones
+   *
+   * @param is_watch The expression is watched by the client and evaluated again at every stop. The memory of all
+   * watched expressions is fetched in a single batch when the target stops, before the client is notified.
+   */
+  auto evaluate_expression(std::string_view expression, bool format_as_hex, bool is_watch = false)
+      -> EvaluateResult;
+
+  /**
+   * @brief Reads target memory, e.g. for the memory view
+   *
+   * Small ranges are served by the memory cache. Large ranges bypass the cache and are streamed from the target in
+   * bounded chunks, each one a separate task so that other requests get their turn during long transfers.
+   *
+   * @param address First address, the range must lie within the 28-bit address space
+   * @param target Receives the memory content
+   */
+  void read_memory(int address, std::span<std::byte> target);
+
+  /**
+   * @brief Searches target memory for a pattern
+   *
+   * The range is transferred in chunks like large read_memory() requests. Each chunk is requested before the
+   * previous one is searched, so searching overlaps with the transfer.
+   *
+   * @param first_address First address of the range
+   * @param last_address Last address of the range (inclusive)
+   * @param max_matches The search ends once this many matches were found
+   * @param on_matches Called from the calling thread with the matches of each chunk as soon as it was searched
+   * @return All matches in ascending order
+   */
+  auto search_memory(int first_address,
+                     int last_address,
+                     const SearchPattern& pattern,
+                     std::size_t max_matches,
+                     const std::function<void(std::span<const int>)>& on_matches = {}) -> std::vector<int>;
+
+  /**
+   * @brief Writes target memory
+   *
+   * Cached lines are updated in place. Spans are sent as store commands of up to 16 bytes each, longer ones as a
+   * binary load.
+   */
+  void write_memory(int address, std::span<const std::byte> data);
+
+  /**
+   * @brief Assigns a value to the memory referenced by an expression as accepted by evaluate_expression()
+   *
+   * @param value One number per element, separated by blanks or commas. Numbers are hex like the evaluated values
+   * ("$" and "0x" prefixes are accepted), "%" denotes binary.
+   * @return The new value of the expression
+   */
+  auto set_expression(std::string_view expression, std::string_view value) -> EvaluateResult;
+
+  void start_profiling(int sample_rate_hz);
+  void stop_profiling();
+  void reset_profile();
+  auto get_profile_sample_count() const -> std::uint64_t { return profiler_.total_samples(); }
+  auto get_profile_collapsed_stacks() -> std::string;
+
+  /**
+   * @brief Starts measuring raster lines (and optionally CIA timer ticks) between two code locations
+   *
+   * The target is continued automatically after each hit of the start and end location until
+   * stop_frame_timing() is called. The user breakpoint is restored afterwards.
+   *
+   * @param start_location Label or $address where the measurement starts
+   * @param end_location Label or $address where the measurement ends
+   * @param use_cia_timer Additionally measure the elapsed ticks of CIA1 timer A (must be free-running)
+   */
+  void start_frame_timing(std::string_view start_location, std::string_view end_location, bool use_cia_timer);
+  void stop_frame_timing();
+  auto get_frame_timing_report() -> FrameTimer::Report;
+
+  /**
+   * @brief Stops the target and keeps single stepping it, recording every step into a trace file
+   *
+   * Recording ends when stop_trace_recording(), pause() or cont() is called, or when a step reaches the user
+   * breakpoint. Steps are sent in batches, so the target may have executed a few more steps by then. These are
+   * recorded too, and the target is shown stopped at the breakpoint by replaying the execution history up to it.
+   * The recorded trace stays available for queries until the next recording is started.
+   *
+   * @param path Path of the trace file to be created
+   * @param capacity Number of steps kept in the ring buffer file
+   */
+  void start_trace_recording(const std::filesystem::path& path, std::uint64_t capacity);
+  void stop_trace_recording();
+  auto is_trace_recording() const -> bool { return trace_recording_.load(std::memory_order_relaxed); }
+  auto get_trace_record_count() -> std::uint64_t;
+
+  /**
+   * @brief Returns the metrics of the current stop, or of the last one while the target is running
+   */
+  auto get_stop_metrics() -> StopMetrics;
+
+  /**
+   * @brief Returns the statistics of the receive thread since the last reconnect, no value without a receive thread
+   */
+  auto get_receive_stats() -> std::optional<BufferedConnection::ReceiveStats>;
+
+  /**
+   * @brief Returns how often the connection was restored after it was lost
+   */
+  auto get_reconnect_count() -> int;
+
+  /**
+   * @brief Returns recorded instructions in execution order
+   *
+   * @param count Maximum number of instructions to return
+   * @param pc If set, return the instructions executed before the last time this PC was reached
+   */
+  auto get_trace_instructions(std::uint64_t count, std::optional<int> pc = {}) -> std::vector<TraceRecord>;
+
+  /**
+   * @brief Returns the code coverage of the PCs sampled by the profiler and recorded in the last trace
+   *
+   * Sampling doesn't stop the target per instruction, but only finds code executed often enough to be sampled.
+   * A trace covers every executed instruction.
+   */
+  auto get_coverage() -> CoverageMap;
+
+  /**
+   * @brief Steps back one instruction in the execution history of the last trace recording
+   *
+   * While positioned in the history, registers and memory ($0000-$FFFF) are reconstructed from the trace. next()
+   * and cont() move forward through the history, live execution continues once its end is reached.
+   */
+  void step_back();
+
+  /**
+   * @brief Runs backwards through the execution history until the breakpoint or the start of the history is reached
+   */
+  void reverse_cont();
+
+  /**
+   * @brief Returns the trace record index shown while stepping through the history, no value if showing live state
+   */
+  auto get_replay_position() -> std::optional<std::uint64_t>;
 
  private:
   void initialize(bool reset_on_run);
   void main_loop(std::future<void> future_exit_object);
   void do_event_processing();
+  auto reconnect(std::string_view reason) -> bool;
+  void reopen_connection();
+  void restore_session_state();
   void check_breakpoint_by_pc();
+  void sample_pc();
+  void record_trace_steps();
+  auto make_trace_record(const std::vector<std::string>& lines) const -> TraceRecord;
+  void read_trace_instruction(TraceRecord& record);
+  void append_trace_record(const TraceRecord& record);
+  void end_trace_recording();
+  void notify_stopped(StoppedReason reason);
+  void warm_up_memory_cache();
+  void record_client_access();
+  auto make_variable(std::string name, int address, const std::shared_ptr<const TypeLayout>& layout, int count,
+                     bool format_as_hex, std::string type_name = {}) -> Variable;
+  auto history_start() const -> std::uint64_t;
+  void seek_history(std::uint64_t index);
+  void discard_history();
 
   template <typename Func>
-  DebuggerTaskResult run_task(Func f)
+  auto post_task(TaskRetry retry, Func f) -> std::future<DebuggerTaskResult>
   {
-    auto task = DebuggerTask(f);
+    // Tasks failing as the connection was lost are run again once it is restored, see TaskRetry. Others fail after
+    // the session was restored, as do all of them if reconnecting fails.
+    auto task = DebuggerTask([this, f, retry]() mutable -> DebuggerTaskResult {
+      while (true) {
+        const auto writes_before = writes_sent_;
+        try {
+          return f();
+        }
+        catch (const connection_error& e) {
+          // Reconnecting sends commands itself, so check what the task sent before
+          const bool sent = writes_sent_ != writes_before;
+          if (!reconnect(e.what()) || (retry != TaskRetry::Idempotent && sent)) {
+            throw;
+          }
+        }
+      }
+    });
     auto fut = task.get_future();
     {
       std::scoped_lock sl(task_queue_mutex_);
       debugger_tasks_.push(std::move(task));
     }
-    return fut.get();
+    return fut;
+  }
+
+  template <typename Func>
+  auto post_task(Func f) -> std::future<DebuggerTaskResult>
+  {
+    return post_task(TaskRetry::BeforeFirstCommand, f);
+  }
+
+  template <typename Func>
+  DebuggerTaskResult run_task(TaskRetry retry, Func f)
+  {
+    return post_task(retry, f).get();
+  }
+
+  template <typename Func>
+  DebuggerTaskResult run_task(Func f)
+  {
+    return post_task(f).get();
   }
 
   auto read_line(int timeout_ms = 1000) -> std::pair<std::string, bool>;
   void write(std::span<const char> buffer);
+  void send(std::span<const char> data);  // writes to the connection without logging
   void flush_rx_buffers();
+  void complete_interrupted_load();
+  void escape_load_command();
 
   void sync_connection();
   void reset_target();
@@ -151,8 +482,18 @@ class M65Debugger {
   void simulate_keypresses(std::string_view keys);
   auto get_lines_until_prompt() -> std::vector<std::string>;
   auto execute_command(std::string_view cmd) -> std::vector<std::string>;
+  auto read_command_response(std::string_view cmd_echo) -> std::vector<std::string>;
   void handle_breakpoint(std::vector<std::string>& lines);
+  void handle_frame_timing_breakpoint();
+  auto resolve_address(std::string_view location) const -> int;
   void get_memory_bytes(int address, std::span<std::byte> target);
+  void get_memory_ranges(std::span<const MemoryRange> ranges);
+  void get_io_register_bytes(int offset, std::span<std::byte> target);
+  void store_memory(int address, std::span<const std::byte> data);
+  void flush_memory_writes();
+  void load_memory(int address, std::span<const char> data);
+  auto parse_expression(std::string_view expression) -> std::shared_ptr<const Expression>;
+  void prefetch_watch_expressions(std::vector<std::pair<int, int>> regions);
   auto parse_address_line(std::string_view mem_string, std::span<std::byte> target) -> int;
   auto is_breakpoint_trigger_valid() -> bool;
   auto calculate_address(int addr, AddressingMode am, int pc) -> int;
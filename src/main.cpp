@@ -20,6 +20,11 @@ int main(int argc, const char* argv[])
   _setmode(_fileno(stdout), _O_BINARY);
 #endif
 
+#ifdef _POSIX_VERSION
+  // Writes to a monitor connection closed by the remote side have to fail instead of terminating the adapter
+  signal(SIGPIPE, SIG_IGN);
+#endif
+
   std::filesystem::path log_path;
 
   // Wait for debugger to attach
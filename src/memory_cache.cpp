@@ -6,32 +6,128 @@ namespace {
 
 const int bytes_per_cache_line = 256;
 
+// Lines remembered by take_read_lines(), more than the working set of a stop needs
+const std::size_t max_read_lines = 256;
+
+// The complete MEGA65 I/O area including all I/O personalities
+const int io_area_first = 0xFFD0000;
+const int io_area_last = 0xFFDFFFF;
+
+// Hashes of 8 bytes per line, enough for 4 MB of memory seen by the client
+const std::size_t max_line_hashes = 0x4000;
+// Watched memory is usually a handful of variables
+const std::size_t max_shadowed_lines = 16;
+
+// FNV-1a
+auto hash_line(std::span<const std::byte> data) -> std::uint64_t
+{
+  std::uint64_t hash{0xcbf29ce484222325};
+  for (const auto b : data) {
+    hash = (hash ^ std::to_integer<std::uint64_t>(b)) * 0x100000001b3;
+  }
+  return hash;
+}
+
 }
 
 namespace m65dap {
 
+auto clamp_to_address_space(std::int64_t start, std::int64_t count) -> ReadableRange
+{
+  const std::int64_t end = start + count;
+  const std::int64_t first = std::clamp<std::int64_t>(start, 0, address_space_size);
+  const std::int64_t last = std::clamp<std::int64_t>(end, first, address_space_size);
+  return {.first = first, .size = last - first, .unreadable = std::min(end - last, count)};
+}
+
 MemoryCache::MemoryCache(M65Debugger* parent, int num_cache_lines) :
     debugger_(parent), data_(num_cache_lines * bytes_per_cache_line), lines_(num_cache_lines)
 {
   for (int idx{0}; idx < num_cache_lines; ++idx) {
     lines_[idx].table_idx = idx;
   }
+  add_volatile_region(io_area_first, io_area_last);
 }
 
-void MemoryCache::refresh_accessed()
+void MemoryCache::add_volatile_region(int first_address, int last_address)
 {
-  for (auto& entry : address_view_) {
-    if (entry.second->accessed) {
-      ensure_valid_cache_line(entry.first);
+  throw_if<std::invalid_argument>(first_address > last_address, "Invalid volatile memory region");
+  volatile_regions_.emplace_back(first_address, last_address);
+}
+
+auto MemoryCache::is_volatile(int address, int size) const -> bool
+{
+  const int last_address = address + size - 1;
+  return std::any_of(volatile_regions_.begin(), volatile_regions_.end(),
+                     [&](const auto& region) { return address <= region.second && last_address >= region.first; });
+}
+
+auto MemoryCache::take_read_lines() -> std::vector<int> { return std::exchange(read_lines_, {}); }
+
+auto MemoryCache::is_cached(int address, int size) const -> bool
+{
+  const int last_line_address = (address + size - 1) & ~(bytes_per_cache_line - 1);
+  for (int line_address = address & ~(bytes_per_cache_line - 1); line_address <= last_line_address;
+       line_address += bytes_per_cache_line) {
+    if (!address_view_.contains(line_address)) {
+      return false;
     }
-    else {
-      entry.second->address = 0;
-      entry.second->valid = false;
+  }
+  return !is_volatile(address, size);
+}
+
+void MemoryCache::prefetch(std::span<const std::pair<int, int>> regions)
+{
+  std::vector<int> missing_lines;
+  for (const auto& [first_address, last_address] : regions) {
+    if (is_volatile(first_address, last_address - first_address + 1)) {
+      continue;
+    }
+    for (int line_address = first_address & ~(bytes_per_cache_line - 1); line_address <= last_address;
+         line_address += bytes_per_cache_line) {
+      if (!address_view_.contains(line_address)) {
+        missing_lines.push_back(line_address);
+      }
+    }
+  }
+  std::sort(missing_lines.begin(), missing_lines.end());
+  missing_lines.erase(std::unique(missing_lines.begin(), missing_lines.end()), missing_lines.end());
+  missing_lines.resize(std::min(missing_lines.size(), lines_.size() / 2));
+  if (missing_lines.empty()) {
+    return;
+  }
+
+  // Lines are marked accessed while the plan is allocated to not evict each other, and fetched directly into the
+  // cache table
+  std::vector<MemoryRange> plan;
+  std::vector<LineInfo*> plan_lines;
+  plan.reserve(missing_lines.size());
+  plan_lines.reserve(missing_lines.size());
+  for (auto line_address : missing_lines) {
+    auto* info = allocate_cache_line(line_address);
+    info->accessed = true;
+    plan_lines.push_back(info);
+    plan.push_back(
+        {line_address, std::span(data_).subspan(info->table_idx * bytes_per_cache_line, bytes_per_cache_line)});
+  }
+
+  try {
+    debugger_->get_memory_ranges(plan);
+  }
+  catch (...) {
+    for (auto* info : plan_lines) {
+      address_view_.erase(info->address);
+      info->valid = false;
+      info->address = 0;
     }
-    entry.second->accessed = false;
+    throw;
   }
-  std::erase_if(address_view_,
-                [](const decltype(address_view_)::value_type& entry) { return !entry.second->accessed; });
+
+  for (auto* info : plan_lines) {
+    info->accessed = false;
+    detect_changes(*info);
+  }
+  fetched_lines_ += plan.size();
 }
 
 void MemoryCache::invalidate()
@@ -46,17 +142,30 @@ void MemoryCache::invalidate()
 
 void MemoryCache::read(int address, std::span<std::byte> target)
 {
+  if (is_volatile(address, target.size())) {
+    debugger_->get_memory_bytes(address, target);
+    return;
+  }
+
   int line_address = address & ~(bytes_per_cache_line - 1);
   int line_offset = address % bytes_per_cache_line;
   int num_bytes = bytes_per_cache_line - line_offset;
   num_bytes = std::min(num_bytes, static_cast<int>(target.size()));
   auto target_it = target.begin();
 
+  const int last_line_address = (address + static_cast<int>(target.size()) - 1) & ~(bytes_per_cache_line - 1);
+  if (last_line_address > line_address) {
+    const std::pair<int, int> region{address, address + static_cast<int>(target.size()) - 1};
+    prefetch(std::span(&region, 1));
+  }
+
   while (target_it != target.end()) {
     auto* line_info = ensure_valid_cache_line(line_address);
     line_info->accessed = true;
+    record_read(line_address);
     auto it = data_.begin() + line_info->table_idx * bytes_per_cache_line + line_offset;
     std::copy(it, it + num_bytes, target_it);
+    line_address += bytes_per_cache_line;
     line_offset = 0;
     target_it += num_bytes;
     num_bytes = std::min(static_cast<int>(std::distance(target_it, target.end())), bytes_per_cache_line);
@@ -65,10 +174,17 @@ void MemoryCache::read(int address, std::span<std::byte> target)
 
 auto MemoryCache::read_byte(int address) -> std::byte
 {
+  if (is_volatile(address)) {
+    std::byte value;
+    debugger_->get_memory_bytes(address, std::span(&value, 1));
+    return value;
+  }
+
   int line_address = address & ~(bytes_per_cache_line - 1);
   int line_offset = address % bytes_per_cache_line;
   auto* line_info = ensure_valid_cache_line(line_address);
   line_info->accessed = true;
+  record_read(line_address);
   return *(data_.begin() + line_info->table_idx * bytes_per_cache_line + line_offset);
 }
 
@@ -79,6 +195,34 @@ auto MemoryCache::read_word(int address) -> int
   return std::to_integer<int>(word_bytes[0]) + 256 * std::to_integer<int>(word_bytes[1]);
 }
 
+void MemoryCache::update(int address, std::span<const std::byte> data)
+{
+  int line_address = address & ~(bytes_per_cache_line - 1);
+  int line_offset = address % bytes_per_cache_line;
+  auto data_it = data.begin();
+
+  while (data_it != data.end()) {
+    const int num_bytes =
+        std::min(static_cast<int>(std::distance(data_it, data.end())), bytes_per_cache_line - line_offset);
+    const auto it = address_view_.find(line_address);
+    if (it != address_view_.end()) {
+      const auto& line = *it->second;
+      std::copy_n(data_it, num_bytes, line_data(line).begin() + line_offset);
+      // Own writes are not reported as changes
+      if (const auto hash_it = line_hashes_.find(line_address); hash_it != line_hashes_.end()) {
+        hash_it->second = hash_line(line_data(line));
+      }
+      if (const auto shadow_it = line_shadows_.find(line_address);
+          shadow_it != line_shadows_.end() && !shadow_it->second.empty()) {
+        std::copy_n(data_it, num_bytes, shadow_it->second.begin() + line_offset);
+      }
+    }
+    line_address += bytes_per_cache_line;
+    line_offset = 0;
+    data_it += num_bytes;
+  }
+}
+
 auto MemoryCache::ensure_valid_cache_line(int line_address) -> LineInfo*
 {
   assert(line_address % bytes_per_cache_line == 0);
@@ -87,6 +231,103 @@ auto MemoryCache::ensure_valid_cache_line(int line_address) -> LineInfo*
     return it->second;
   }
 
+  auto* info = allocate_cache_line(line_address);
+  debugger_->get_memory_bytes(line_address, line_data(*info));
+  ++fetched_lines_;
+  detect_changes(*info);
+  return info;
+}
+
+auto MemoryCache::line_data(const LineInfo& line) -> std::span<std::byte>
+{
+  return std::span(data_).subspan(line.table_idx * bytes_per_cache_line, bytes_per_cache_line);
+}
+
+void MemoryCache::set_shadowed_regions(std::span<const std::pair<int, int>> regions)
+{
+  std::unordered_map<int, std::vector<std::byte>> shadows;
+  for (const auto& [first_address, last_address] : regions) {
+    for (int line_address = first_address & ~(bytes_per_cache_line - 1);
+         line_address <= last_address && shadows.size() < max_shadowed_lines; line_address += bytes_per_cache_line) {
+      if (shadows.contains(line_address)) {
+        continue;
+      }
+      auto& shadow = shadows[line_address];
+      if (const auto it = line_shadows_.find(line_address); it != line_shadows_.end()) {
+        shadow = std::move(it->second);
+      }
+      else if (const auto cached = address_view_.find(line_address); cached != address_view_.end()) {
+        const auto data = line_data(*cached->second);
+        shadow.assign(data.begin(), data.end());
+      }
+    }
+  }
+  line_shadows_ = std::move(shadows);
+}
+
+auto MemoryCache::take_changed_ranges() -> std::vector<std::pair<int, int>>
+{
+  auto ranges = std::exchange(changed_ranges_, {});
+  std::sort(ranges.begin(), ranges.end());
+  std::vector<std::pair<int, int>> merged;
+  for (const auto& range : ranges) {
+    if (!merged.empty() && range.first <= merged.back().second + 1) {
+      merged.back().second = std::max(merged.back().second, range.second);
+    }
+    else {
+      merged.push_back(range);
+    }
+  }
+  return merged;
+}
+
+void MemoryCache::detect_changes(const LineInfo& line)
+{
+  const auto data = line_data(line);
+  const auto hash = hash_line(data);
+  if (line_hashes_.size() >= max_line_hashes && !line_hashes_.contains(line.address)) {
+    // Only loses the change detection of the forgotten lines for one fetch
+    line_hashes_.clear();
+  }
+  const auto [hash_it, inserted] = line_hashes_.try_emplace(line.address, hash);
+  const bool changed = !inserted && hash_it->second != hash;
+  hash_it->second = hash;
+
+  const auto shadow_it = line_shadows_.find(line.address);
+  if (changed && shadow_it != line_shadows_.end() && !shadow_it->second.empty()) {
+    // Runs of changed bytes
+    const auto& shadow = shadow_it->second;
+    int idx{0};
+    while (idx < bytes_per_cache_line) {
+      if (shadow[idx] == data[idx]) {
+        ++idx;
+        continue;
+      }
+      const int first = idx;
+      while (idx < bytes_per_cache_line && shadow[idx] != data[idx]) {
+        ++idx;
+      }
+      changed_ranges_.emplace_back(line.address + first, line.address + idx - 1);
+    }
+  }
+  else if (changed) {
+    changed_ranges_.emplace_back(line.address, line.address + bytes_per_cache_line - 1);
+  }
+  if (shadow_it != line_shadows_.end()) {
+    shadow_it->second.assign(data.begin(), data.end());
+  }
+}
+
+void MemoryCache::record_read(int line_address)
+{
+  if (read_lines_.size() < max_read_lines &&
+      std::find(read_lines_.begin(), read_lines_.end(), line_address) == read_lines_.end()) {
+    read_lines_.push_back(line_address);
+  }
+}
+
+auto MemoryCache::allocate_cache_line(int line_address) -> LineInfo*
+{
   auto table_it = std::find_if(lines_.begin(), lines_.end(), [](const LineInfo& i) { return i.valid == false; });
   if (table_it == lines_.end()) {
     table_it = std::find_if(lines_.begin(), lines_.end(), [](const LineInfo& i) { return i.accessed == false; });
@@ -95,9 +336,10 @@ auto MemoryCache::ensure_valid_cache_line(int line_address) -> LineInfo*
     }
   }
 
-  auto cache_line_data = std::span(data_).subspan(table_it->table_idx * bytes_per_cache_line, bytes_per_cache_line);
-  debugger_->get_memory_bytes(line_address, cache_line_data);
   LineInfo* info = &(*table_it);
+  if (info->valid) {
+    address_view_.erase(info->address);
+  }
   info->address = line_address;
   info->valid = true;
   address_view_[line_address] = info;
@@ -4,6 +4,34 @@ namespace m65dap {
 
 class M65Debugger;
 
+// Size of the 28-bit address space of the MEGA65 as seen by the serial monitor
+constexpr int address_space_size = 0x10000000;
+
+// 28-bit address of the I/O area as mapped with the VIC-IV I/O personality ($D000-$DFFF in CPU address space)
+constexpr int io_personality_base = 0xFFD3000;
+
+/**
+ * @brief Part of a requested memory range within the address space
+ */
+struct ReadableRange {
+  std::int64_t first{0};
+  std::int64_t size{0};
+  std::int64_t unreadable{0};  // requested bytes behind the end of the address space, at most the requested count
+};
+
+/**
+ * @brief Clamps a requested memory range to the address space
+ */
+auto clamp_to_address_space(std::int64_t start, std::int64_t count) -> ReadableRange;
+
+/**
+ * @brief Target memory to read into, one entry of a batched memory request
+ */
+struct MemoryRange {
+  int address{0};
+  std::span<std::byte> target;
+};
+
 class MemoryCache {
   M65Debugger* debugger_;
 
@@ -17,19 +45,89 @@ class MemoryCache {
   std::vector<std::byte> data_;
   std::vector<LineInfo> lines_;
   std::map<int, LineInfo*> address_view_;
+  std::vector<std::pair<int, int>> volatile_regions_;
+  std::vector<int> read_lines_;
+  std::uint64_t fetched_lines_{0};
+
+  // Content hashes of the lines as last fetched, and full copies of the lines of watched regions, to find the
+  // memory changed by the target between two fetches of a line
+  std::unordered_map<int, std::uint64_t> line_hashes_;
+  std::unordered_map<int, std::vector<std::byte>> line_shadows_;
+  std::vector<std::pair<int, int>> changed_ranges_;
 
  public:
   MemoryCache(M65Debugger* parent, int num_cache_lines = 512);
 
+  /**
+   * @brief Marks an address range as volatile (e.g. I/O registers)
+   *
+   * Reads touching a volatile region always fetch fresh data from the target and never populate the cache.
+   *
+   * @param first_address First address of the region
+   * @param last_address Last address of the region (inclusive)
+   */
+  void add_volatile_region(int first_address, int last_address);
+  auto is_volatile(int address, int size = 1) const -> bool;
+
   void invalidate();
   void read(int address, std::span<std::byte> target);
   auto read_byte(int address) -> std::byte;
   auto read_word(int address) -> int;
 
-  void refresh_accessed();
+  /**
+   * @brief Writes data into the cached lines it overlaps, so written memory doesn't need to be fetched again
+   */
+  void update(int address, std::span<const std::byte> data);
+
+  /**
+   * @brief Checks whether reading the range is served without a round trip to the target
+   */
+  auto is_cached(int address, int size) const -> bool;
+
+  /**
+   * @brief Fetches all missing lines of the given regions with a single batch of pipelined memory requests
+   *
+   * Volatile regions are skipped, and at most half of the cache is filled so the plan doesn't evict its own lines.
+   *
+   * @param regions Address ranges as pairs of first and last (inclusive) address
+   */
+  void prefetch(std::span<const std::pair<int, int>> regions);
+
+  /**
+   * @brief Returns the lines read since the last call in order of their first read, invalidating keeps them
+   */
+  auto take_read_lines() -> std::vector<int>;
+
+  /**
+   * @brief Number of lines fetched from the target so far
+   */
+  auto fetched_lines() const -> std::uint64_t { return fetched_lines_; }
+
+  /**
+   * @brief Sets the regions whose changes are reported byte exact, changes elsewhere are reported per line
+   *
+   * The lines of the regions are copied when fetched (or right away if cached), at most a few KB.
+   *
+   * @param regions Address ranges as pairs of first and last (inclusive) address
+   */
+  void set_shadowed_regions(std::span<const std::pair<int, int>> regions);
+
+  /**
+   * @brief Returns the memory the target changed since the lines were fetched before, and forgets it
+   *
+   * A change is detected when a line is fetched again after invalidate(), so only lines read in both stops are
+   * covered. Writes through update() are not reported.
+   *
+   * @return Sorted and merged ranges as pairs of first and last (inclusive) address
+   */
+  auto take_changed_ranges() -> std::vector<std::pair<int, int>>;
 
  private:
   auto ensure_valid_cache_line(int line_address) -> LineInfo*;
+  void record_read(int line_address);
+  void detect_changes(const LineInfo& line);
+  auto line_data(const LineInfo& line) -> std::span<std::byte>;
+  auto allocate_cache_line(int line_address) -> LineInfo*;
 };
 
 }  // namespace m65dap
@@ -0,0 +1,163 @@
+#include "memory_search.h"
+
+namespace m65dap {
+
+namespace {
+
+// Patterns shorter than this are located with memchr, the shifts of Horspool don't pay off for them
+constexpr std::size_t min_horspool_size = 4;
+constexpr std::size_t max_pattern_size = 256;
+
+auto parse_nibble(char c, std::uint8_t& value, std::uint8_t& mask) -> bool
+{
+  value <<= 4;
+  mask <<= 4;
+  if (c == '?') {
+    return true;
+  }
+  std::uint8_t nibble{0};
+  const auto [ptr, ec] = std::from_chars(&c, &c + 1, nibble, 16);
+  value |= nibble;
+  mask |= 0x0f;
+  return ec == std::errc();
+}
+
+// Unshifted PETSCII, lower case letters are shown as upper case ones
+auto to_petscii(char c) -> std::uint8_t
+{
+  if (c >= 'a' && c <= 'z') {
+    return static_cast<std::uint8_t>(c - 'a' + 0x41);
+  }
+  return static_cast<std::uint8_t>(c);
+}
+
+}  // namespace
+
+SearchPattern::SearchPattern(std::vector<std::uint8_t> values, std::vector<std::uint8_t> masks) :
+    values_(std::move(values)), masks_(std::move(masks))
+{
+  throw_if<std::invalid_argument>(values_.empty() || values_.size() != masks_.size(), "Invalid search pattern");
+  throw_if<std::invalid_argument>(values_.size() > max_pattern_size,
+                                  fmt::format("Search pattern longer than {} bytes", max_pattern_size));
+  for (std::size_t idx{0}; idx < values_.size(); ++idx) {
+    values_[idx] &= masks_[idx];
+    if (masks_[idx] == 0xff) {
+      anchor_ = static_cast<int>(idx);
+    }
+  }
+
+  // Horspool shift of a byte is the distance of its last possible match before the end of the pattern
+  const std::size_t size = values_.size();
+  shifts_.fill(size);
+  for (std::size_t idx{0}; idx + 1 < size; ++idx) {
+    for (int b{0}; b < 256; ++b) {
+      if ((b & masks_[idx]) == values_[idx]) {
+        shifts_[b] = size - 1 - idx;
+      }
+    }
+  }
+}
+
+auto SearchPattern::parse(std::string_view text) -> SearchPattern
+{
+  std::vector<std::uint8_t> values;
+  std::vector<std::uint8_t> masks;
+  std::size_t pos{0};
+  while (pos < text.size()) {
+    const char c = text[pos];
+    if (c == ' ' || c == ',') {
+      ++pos;
+      continue;
+    }
+    if (c == '"') {
+      const auto end = text.find('"', pos + 1);
+      throw_if<std::invalid_argument>(end == std::string_view::npos, "Unterminated text in search pattern");
+      for (const char t : text.substr(pos + 1, end - pos - 1)) {
+        values.push_back(to_petscii(t));
+        masks.push_back(0xff);
+      }
+      pos = end + 1;
+      continue;
+    }
+    const auto end = std::min(text.find_first_of(" ,\"", pos), text.size());
+    const auto token = text.substr(pos, end - pos);
+    std::uint8_t value{0};
+    std::uint8_t mask{0};
+    const bool valid = token == "?" ? parse_nibble('?', value, mask) && parse_nibble('?', value, mask)
+                                    : token.size() == 2 && parse_nibble(token[0], value, mask) &&
+                                          parse_nibble(token[1], value, mask);
+    throw_if<std::invalid_argument>(!valid, fmt::format("Invalid byte '{}' in search pattern", token));
+    values.push_back(value);
+    masks.push_back(mask);
+    pos = end;
+  }
+  throw_if<std::invalid_argument>(values.empty(), "Empty search pattern");
+  return SearchPattern(std::move(values), std::move(masks));
+}
+
+auto SearchPattern::matches_at(const std::byte* data) const -> bool
+{
+  for (std::size_t idx{0}; idx < values_.size(); ++idx) {
+    if ((std::to_integer<std::uint8_t>(data[idx]) & masks_[idx]) != values_[idx]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto SearchPattern::find(std::span<const std::byte> data, std::size_t start) const -> std::optional<std::size_t>
+{
+  const std::size_t size = values_.size();
+  if (data.size() < size || start > data.size() - size) {
+    return {};
+  }
+  const std::size_t last_start = data.size() - size;
+
+  if (size < min_horspool_size && anchor_ >= 0) {
+    const auto* first = data.data() + start + anchor_;
+    const auto* end = data.data() + last_start + anchor_ + 1;
+    while (first < end) {
+      const auto* hit = static_cast<const std::byte*>(std::memchr(first, values_[anchor_], end - first));
+      if (!hit) {
+        return {};
+      }
+      const auto* candidate = hit - anchor_;
+      if (matches_at(candidate)) {
+        return candidate - data.data();
+      }
+      first = hit + 1;
+    }
+    return {};
+  }
+
+  for (std::size_t pos{start}; pos <= last_start;) {
+    const auto last_byte = std::to_integer<std::uint8_t>(data[pos + size - 1]);
+    if ((last_byte & masks_[size - 1]) == values_[size - 1] && matches_at(data.data() + pos)) {
+      return pos;
+    }
+    pos += shifts_[last_byte];
+  }
+  return {};
+}
+
+auto StreamSearch::feed(int address, std::span<const std::byte> chunk) -> std::vector<int>
+{
+  // The end of the previous chunk is kept, so matches starting there are completed with this chunk
+  const std::size_t carry = buffer_.empty() ? 0 : pattern_.size() - 1;
+  throw_if<std::invalid_argument>(!buffer_.empty() && buffer_address_ + static_cast<int>(buffer_.size()) != address,
+                                  "Search chunks have to be consecutive");
+  const std::size_t kept = std::min(carry, buffer_.size());
+  buffer_.erase(buffer_.begin(), buffer_.end() - kept);
+  buffer_address_ = address - static_cast<int>(kept);
+  buffer_.insert(buffer_.end(), chunk.begin(), chunk.end());
+
+  std::vector<int> result;
+  std::size_t pos{0};
+  while (const auto match = pattern_.find(buffer_, pos)) {
+    result.push_back(buffer_address_ + static_cast<int>(match.value()));
+    pos = match.value() + 1;
+  }
+  return result;
+}
+
+}  // namespace m65dap
@@ -0,0 +1,65 @@
+#pragma once
+
+namespace m65dap {
+
+/**
+ * @brief Byte pattern with wildcards to search memory for
+ *
+ * Patterns are written as hex bytes and quoted PETSCII text, which can be mixed:
+ *   A9 00 8D        bytes separated by blanks
+ *   20 ?? C0        "??" matches any byte
+ *   4? ?F           "?" nibbles match any nibble
+ *   "READY." 00     text, letters of either case are matched as unshifted PETSCII letters ($41-$5A)
+ */
+class SearchPattern {
+  std::vector<std::uint8_t> values_;
+  std::vector<std::uint8_t> masks_;  // set bits have to match
+  std::array<std::size_t, 256> shifts_{};
+  int anchor_{-1};  // position of the last byte without wildcard, -1 if all bytes have some
+
+ public:
+  /**
+   * @param values Bytes to match, bits not set in the mask are ignored
+   * @param masks Bits to compare per byte
+   */
+  SearchPattern(std::vector<std::uint8_t> values, std::vector<std::uint8_t> masks);
+
+  /**
+   * @brief Parses a pattern as described above, throws std::invalid_argument for invalid ones
+   */
+  static auto parse(std::string_view text) -> SearchPattern;
+
+  auto size() const -> std::size_t { return values_.size(); }
+
+  /**
+   * @brief Returns the offset of the first match at or after start, no value if there is none
+   *
+   * Short patterns are anchored at a byte without wildcards and located with memchr, longer ones are searched with
+   * Boyer-Moore-Horspool, skipping ahead by the shift of the byte aligned with the end of the pattern.
+   */
+  auto find(std::span<const std::byte> data, std::size_t start = 0) const -> std::optional<std::size_t>;
+
+ private:
+  auto matches_at(const std::byte* data) const -> bool;
+};
+
+/**
+ * @brief Searches memory arriving in consecutive chunks, matches spanning two chunks are found as well
+ */
+class StreamSearch {
+  const SearchPattern& pattern_;
+  std::vector<std::byte> buffer_;
+  int buffer_address_{0};
+
+ public:
+  explicit StreamSearch(const SearchPattern& pattern) : pattern_(pattern) {}
+
+  /**
+   * @brief Searches the next chunk, which has to follow the previous one
+   *
+   * @return Addresses of the matches ending in the chunk
+   */
+  auto feed(int address, std::span<const std::byte> chunk) -> std::vector<int>;
+};
+
+}  // namespace m65dap
@@ -0,0 +1,39 @@
+#include "memory_write_buffer.h"
+
+namespace m65dap {
+
+void MemoryWriteBuffer::add(int address, std::span<const std::byte> data)
+{
+  if (data.empty()) {
+    return;
+  }
+  const int end = address + static_cast<int>(data.size());
+
+  // First span touching the new data, either starting before it and reaching up to it or starting within it
+  auto first = spans_.upper_bound(address);
+  if (first != spans_.begin()) {
+    auto prev = std::prev(first);
+    if (prev->first + static_cast<int>(prev->second.size()) >= address) {
+      first = prev;
+    }
+  }
+  auto last = first;
+  int merged_start = address;
+  int merged_end = end;
+  while (last != spans_.end() && last->first <= end) {
+    merged_start = std::min(merged_start, last->first);
+    merged_end = std::max(merged_end, last->first + static_cast<int>(last->second.size()));
+    ++last;
+  }
+
+  std::vector<std::byte> merged(merged_end - merged_start);
+  for (auto it = first; it != last; ++it) {
+    std::copy(it->second.begin(), it->second.end(), merged.begin() + (it->first - merged_start));
+  }
+  std::copy(data.begin(), data.end(), merged.begin() + (address - merged_start));
+
+  spans_.erase(first, last);
+  spans_.emplace(merged_start, std::move(merged));
+}
+
+}  // namespace m65dap
@@ -0,0 +1,21 @@
+#pragma once
+
+namespace m65dap {
+
+/**
+ * @brief Collects memory writes, merging overlapping and adjacent ones into contiguous spans
+ *
+ * Where writes overlap, the later one wins. The spans are ordered by address, so they can be flushed to the target
+ * with as few store commands as possible.
+ */
+class MemoryWriteBuffer {
+  std::map<int, std::vector<std::byte>> spans_;
+
+ public:
+  void add(int address, std::span<const std::byte> data);
+  void clear() { spans_.clear(); }
+  auto empty() const -> bool { return spans_.empty(); }
+  auto spans() const -> const std::map<int, std::vector<std::byte>>& { return spans_; }
+};
+
+}  // namespace m65dap
@@ -0,0 +1,363 @@
+#ifdef _POSIX_VERSION
+
+#include "monitor_broker.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace m65dap {
+
+namespace {
+
+constexpr int target_read_size = 4096;
+// Longest time the broker waits for input before checking whether it has to stop
+constexpr int poll_interval_ms = 10;
+// Longer lines aren't commands, e.g. the padding clients send to end a load command left hanging
+constexpr std::size_t max_command_length = 256;
+// Longest first line of a reply, longer ones can't be matched with a command
+constexpr std::size_t max_echo_length = 4096;
+// Clients not reading their replies are disconnected
+constexpr std::size_t max_client_output = 0x1000000;
+// Commands not answered in time are considered lost, e.g. as the target was reset
+constexpr auto command_timeout = std::chrono::seconds(5);
+
+// Number of data bytes following a load command, the end address only has 16 bits
+auto load_data_size(std::string_view line) -> std::optional<int>
+{
+  static const std::regex r(R"(^\s*l\s*([0-9a-fA-F]{1,7})\s+([0-9a-fA-F]{1,4})\s*$)");
+
+  std::cmatch match;
+  if (!regex_search(line, match, r)) {
+    return {};
+  }
+  const int start = str_to_int(match[1].str(), 16);
+  const int end = str_to_int(match[2].str(), 16);
+  const int size = end - (start & 0xffff);
+  return size < 0 ? size + 0x10000 : size;
+}
+
+auto trimmed(std::string_view text) -> std::string
+{
+  std::string result(text);
+  return trim(result);
+}
+
+}  // namespace
+
+MonitorBroker::MonitorBroker(std::unique_ptr<Connection> target, std::filesystem::path socket_path) :
+    target_(std::move(target)), socket_path_(std::move(socket_path))
+{
+  throw_if<std::invalid_argument>(!target_, "Missing target connection");
+  const std::string native_path = socket_path_.native();
+  throw_if<std::runtime_error>(native_path.length() > 107,
+                               "Unix domain socket address exceeds maximum length of 107 characters");
+
+  listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  throw_if<std::runtime_error>(listen_fd_ < 0, fmt::format("Open error: {}", strerror(errno)));
+  ::fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, native_path.c_str());
+  ::unlink(native_path.c_str());
+  if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(listen_fd_, 8) < 0) {
+    const int error = errno;
+    ::close(listen_fd_);
+    throw std::runtime_error(fmt::format("Can't listen on '{}': {}", native_path, strerror(error)));
+  }
+
+  thread_ = std::thread([this] { run(); });
+}
+
+MonitorBroker::~MonitorBroker()
+{
+  stop_ = true;
+  thread_.join();
+  for (const auto& client : clients_) {
+    ::close(client.fd);
+  }
+  ::close(listen_fd_);
+  ::unlink(socket_path_.c_str());
+}
+
+void MonitorBroker::run()
+{
+  std::vector<pollfd> fds;
+  while (!stop_) {
+    const int target_fd = target_->native_handle();
+    fds.clear();
+    fds.push_back({.fd = listen_fd_, .events = POLLIN, .revents = 0});
+    fds.push_back({.fd = target_fd, .events = POLLIN, .revents = 0});
+    for (const auto& client : clients_) {
+      const short events = client.output.empty() ? POLLIN : POLLIN | POLLOUT;
+      fds.push_back({.fd = client.fd, .events = events, .revents = 0});
+    }
+    // Connections without a descriptor are polled every millisecond
+    ::poll(fds.data(), fds.size(), target_fd >= 0 ? poll_interval_ms : 1);
+
+    if (fds[0].revents & POLLIN) {
+      accept_client();
+    }
+    for (std::size_t idx{0}; idx + 2 < fds.size(); ++idx) {
+      auto& client = clients_[idx];
+      if (fds[idx + 2].revents & (POLLIN | POLLHUP | POLLERR)) {
+        read_client(client);
+      }
+      if (fds[idx + 2].revents & POLLOUT) {
+        flush_client(client);
+      }
+    }
+
+    std::erase_if(clients_, [](const Client& client) {
+      if (client.closed) {
+        ::close(client.fd);
+      }
+      return client.closed;
+    });
+    client_count_ = static_cast<int>(clients_.size());
+
+    try {
+      if (const auto data = target_->read(target_read_size, 0); !data.empty()) {
+        process_target_output(data);
+      }
+      expire_commands();
+      send_commands();
+    }
+    catch (const std::exception& e) {
+      fmt::print(stderr, "Target connection failed: {}\n", e.what());
+      target_failed_ = true;
+      return;
+    }
+  }
+}
+
+void MonitorBroker::accept_client()
+{
+  const int fd = ::accept(listen_fd_, nullptr, nullptr);
+  if (fd < 0) {
+    return;
+  }
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  ::fcntl(fd, F_SETFL, O_NONBLOCK);
+  clients_.push_back(
+      Client{.id = next_client_id_++, .fd = fd, .priority = 0, .input = {}, .output = {}, .commands = {}});
+  client_count_ = static_cast<int>(clients_.size());
+}
+
+void MonitorBroker::read_client(Client& client)
+{
+  std::array<char, 4096> buffer;
+  while (true) {
+    const auto n = ::recv(client.fd, buffer.data(), buffer.size(), 0);
+    if (n > 0) {
+      client.input.append(buffer.data(), n);
+      continue;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      client.closed = true;
+    }
+    break;
+  }
+  parse_client_input(client);
+}
+
+void MonitorBroker::parse_client_input(Client& client)
+{
+  while (!client.input.empty()) {
+    if (client.load_remaining > 0) {
+      auto& command = client.commands.back();
+      const auto count = std::min<std::size_t>(client.load_remaining, client.input.size());
+      command.text.append(client.input, 0, count);
+      client.input.erase(0, count);
+      client.load_remaining -= static_cast<int>(count);
+      command.complete = client.load_remaining == 0;
+      continue;
+    }
+
+    const auto eol = client.input.find('\n');
+    if (eol == std::string::npos) {
+      if (client.input.size() > max_command_length) {
+        client.input.clear();
+      }
+      return;
+    }
+    std::string line = client.input.substr(0, eol);
+    client.input.erase(0, eol + 1);
+    if (line.ends_with('\r')) {
+      line.pop_back();
+    }
+    if (line.size() > max_command_length) {
+      continue;
+    }
+    if (line.starts_with("#priority")) {
+      const auto value = trimmed(line.substr(9));
+      std::from_chars(value.data(), value.data() + value.size(), client.priority);
+      continue;
+    }
+
+    Command command{.text = line + '\n', .echo = trimmed(line)};
+    if (const auto data_size = load_data_size(line); data_size.value_or(0) > 0) {
+      command.complete = false;
+      client.load_remaining = data_size.value();
+    }
+    client.commands.push_back(std::move(command));
+  }
+}
+
+void MonitorBroker::send_commands()
+{
+  while (sent_.size() < max_commands_in_flight) {
+    // Highest priority first, the search starts after the client served last so equal priorities take turns
+    Client* next{nullptr};
+    std::size_t next_idx{0};
+    for (std::size_t offset{0}; offset < clients_.size(); ++offset) {
+      const auto idx = (next_turn_ + offset) % clients_.size();
+      auto& client = clients_[idx];
+      if (client.commands.empty() || !client.commands.front().complete) {
+        continue;
+      }
+      if (next == nullptr || client.priority > next->priority) {
+        next = &client;
+        next_idx = idx;
+      }
+    }
+    if (next == nullptr) {
+      return;
+    }
+
+    auto command = std::move(next->commands.front());
+    next->commands.pop_front();
+    next_turn_ = next_idx + 1;
+    sent_.push_back(SentCommand{.client_id = next->id, .echo = std::move(command.echo), .time = clock::now()});
+    target_->write(command.text);
+  }
+}
+
+void MonitorBroker::expire_commands()
+{
+  // The first command stays while its reply is passed on
+  const std::size_t first_expirable = reply_to_command_ ? 1 : 0;
+  const auto now = clock::now();
+  while (sent_.size() > first_expirable && now - sent_[first_expirable].time > command_timeout) {
+    sent_.erase(sent_.begin() + first_expirable);
+  }
+}
+
+void MonitorBroker::process_target_output(std::string_view data)
+{
+  for (std::size_t pos{0}; pos < data.size();) {
+    if (destination_ == Destination::Undecided) {
+      if (first_line_.empty() && data[pos] == '.') {
+        // A prompt without reply, nothing to pass on
+        ++pos;
+        continue;
+      }
+      const auto eol = data.find('\n', pos);
+      const auto end = eol == std::string_view::npos ? data.size() : eol + 1;
+      first_line_.append(data.substr(pos, end - pos));
+      pos = end;
+      if (eol == std::string_view::npos && first_line_.size() <= max_echo_length) {
+        return;
+      }
+      start_reply();
+      continue;
+    }
+
+    // Pass on the reply up to and including the prompt, a '.' at the start of a line
+    std::size_t end = pos;
+    bool prompt{false};
+    for (; end < data.size() && !prompt; ++end) {
+      prompt = at_line_start_ && data[end] == '.';
+      at_line_start_ = data[end] == '\n';
+    }
+    forward_reply(data.substr(pos, end - pos));
+    pos = end;
+    if (prompt) {
+      if (reply_to_command_) {
+        sent_.pop_front();
+      }
+      destination_ = Destination::Undecided;
+      reply_to_command_ = false;
+      at_line_start_ = true;
+    }
+  }
+}
+
+void MonitorBroker::start_reply()
+{
+  // Commands sent before the one echoed were lost, their clients time out as with an unreliable serial link
+  const auto echo = trimmed(first_line_);
+  const auto it = std::find_if(sent_.begin(), sent_.end(), [&](const auto& command) { return command.echo == echo; });
+  if (it != sent_.end()) {
+    sent_.erase(sent_.begin(), it);
+    destination_ = Destination::Client;
+    reply_to_command_ = true;
+  }
+  else {
+    destination_ = echo == "!" ? Destination::All : Destination::Nobody;
+  }
+
+  const std::string line = std::move(first_line_);
+  first_line_.clear();
+  at_line_start_ = line.ends_with('\n');
+  forward_reply(line);
+}
+
+void MonitorBroker::forward_reply(std::string_view data)
+{
+  if (destination_ == Destination::Client) {
+    if (auto* client = find_client(sent_.front().client_id)) {
+      send_to_client(*client, data);
+    }
+  }
+  else if (destination_ == Destination::All) {
+    for (auto& client : clients_) {
+      send_to_client(client, data);
+    }
+  }
+}
+
+void MonitorBroker::send_to_client(Client& client, std::string_view data)
+{
+  if (client.closed) {
+    return;
+  }
+  client.output.append(data);
+  if (client.output.size() > max_client_output) {
+    client.closed = true;
+    return;
+  }
+  flush_client(client);
+}
+
+void MonitorBroker::flush_client(Client& client)
+{
+  while (!client.output.empty()) {
+    const auto n = ::send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+    if (n > 0) {
+      client.output.erase(0, n);
+      continue;
+    }
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      client.closed = true;
+    }
+    return;
+  }
+}
+
+auto MonitorBroker::find_client(int id) -> Client*
+{
+  const auto it = std::find_if(clients_.begin(), clients_.end(), [id](const auto& client) { return client.id == id; });
+  return it == clients_.end() ? nullptr : &*it;
+}
+
+}  // namespace m65dap
+
+#endif  // _POSIX_VERSION
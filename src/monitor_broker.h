@@ -0,0 +1,100 @@
+#pragma once
+
+#include "connection.h"
+
+namespace m65dap {
+
+/**
+ * @brief Shares the monitor of one MEGA65 among several clients connected to a Unix domain socket
+ *
+ * Clients talk to the broker as they would to the monitor. Their command lines are queued per client and sent to
+ * the target by client priority, up to max_commands_in_flight at once, so clients keep pipelining. The echo
+ * starting each reply tells which command it belongs to, the reply is passed on to the client that sent it.
+ * Replies starting with '!' that don't answer a command are breakpoint triggers and passed on to all clients.
+ *
+ * A client sets its priority with the line "#priority <n>", which isn't sent to the target. Higher priorities are
+ * served first, clients of the same priority take turns.
+ */
+class MonitorBroker {
+ public:
+  static constexpr std::size_t max_commands_in_flight = 8;
+
+  /**
+   * @param target Connection to the monitor, the broker is its only user
+   * @param socket_path Path of the socket clients connect to, an existing socket file is replaced
+   */
+  MonitorBroker(std::unique_ptr<Connection> target, std::filesystem::path socket_path);
+  MonitorBroker(const MonitorBroker&) = delete;
+  auto operator=(const MonitorBroker&) -> MonitorBroker& = delete;
+  ~MonitorBroker();
+
+  auto socket_path() const -> const std::filesystem::path& { return socket_path_; }
+  auto client_count() const -> int { return client_count_; }
+
+  /**
+   * @brief Returns true once the connection to the target failed, the broker doesn't serve clients anymore then
+   */
+  auto target_failed() const -> bool { return target_failed_; }
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  struct Command {
+    std::string text;  // command line, followed by the data of load commands
+    std::string echo;
+    bool complete{true};  // all data of a load command received
+  };
+
+  struct Client {
+    int id{0};
+    int fd{-1};
+    int priority{0};
+    std::string input;
+    std::string output;
+    std::deque<Command> commands;
+    int load_remaining{0};
+    bool closed{false};
+  };
+
+  struct SentCommand {
+    int client_id{0};
+    std::string echo;
+    clock::time_point time;
+  };
+
+  // Receiver of the reply currently read from the target
+  enum class Destination { Undecided, Client, All, Nobody };
+
+  void run();
+  void accept_client();
+  void read_client(Client& client);
+  void parse_client_input(Client& client);
+  void send_commands();
+  void expire_commands();
+  void process_target_output(std::string_view data);
+  void start_reply();
+  void forward_reply(std::string_view data);
+  void send_to_client(Client& client, std::string_view data);
+  void flush_client(Client& client);
+  auto find_client(int id) -> Client*;
+
+  std::unique_ptr<Connection> target_;
+  std::filesystem::path socket_path_;
+  int listen_fd_{-1};
+  std::vector<Client> clients_;
+  std::atomic<int> client_count_{0};
+  int next_client_id_{1};
+  std::size_t next_turn_{0};
+  std::deque<SentCommand> sent_;
+
+  Destination destination_{Destination::Undecided};
+  bool reply_to_command_{false};  // reply answers the first sent command
+  std::string first_line_;        // start of the reply until its destination is known
+  bool at_line_start_{true};
+
+  std::atomic<bool> target_failed_{false};
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+}  // namespace m65dap
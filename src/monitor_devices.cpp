@@ -0,0 +1,185 @@
+#include "monitor_devices.h"
+
+#include "duration.h"
+#include "serial_connection.h"
+#include "tcp_connection.h"
+#include "unix_domain_socket_connection.h"
+#include "unix_serial_connection.h"
+
+namespace {
+
+// USB serial adapters the MEGA65 shows up as (FTDI on the JTAG adapter, CDC ACM on the Nexys boards), macOS names
+// them cu.usbserial-<serial number>
+constexpr std::array<std::string_view, 3> serial_port_prefixes{"ttyUSB", "ttyACM", "cu.usbserial"};
+// Sockets created by Xemu (-uartmon) and by the monitor broker contain one of these in their names
+constexpr std::array<std::string_view, 2> monitor_socket_names{"xemu", "m65dbg"};
+// Xemu's monitor is usually started with -uartmon :4510
+constexpr std::string_view xemu_tcp_address = "tcp#127.0.0.1:4510";
+#ifdef _WIN32
+constexpr int max_com_port = 32;
+#endif
+
+// Probes wait for replies in slices of this length, checking in between whether another device answered already
+constexpr int probe_poll_ms = 10;
+
+auto probe_monitor(const std::string& device, int timeout_ms, const std::atomic<bool>& cancelled)
+    -> std::optional<m65dap::DiscoveredMonitor>
+{
+  try {
+    auto conn = m65dap::open_device(device);
+    conn->discard_input();
+    conn->write(std::string_view("?\n"));
+    std::string reply;
+    m65dap::Duration t;
+    while (!cancelled && t.elapsed_ms() < timeout_ms) {
+      reply += conn->read(256, probe_poll_ms);
+      // Xemu's ident ends with the one of the MEGA65, so it is complete once the MEGA65 ident is found
+      if (reply.find(m65dap::mega65_ident) != std::string::npos) {
+        return m65dap::DiscoveredMonitor{.device = device,
+                                         .is_xemu = reply.find(m65dap::xemu_ident) != std::string::npos};
+      }
+    }
+  }
+  catch (const std::exception&) {
+    // Devices that can't be opened or fail while probing are no monitor
+  }
+  return {};
+}
+
+auto read_cached_device(const std::filesystem::path& cache_path) -> std::string
+{
+  std::ifstream file(cache_path);
+  std::string device;
+  std::getline(file, device);
+  return device;
+}
+
+void write_cached_device(const std::filesystem::path& cache_path, std::string_view device)
+{
+  // The cache only saves time on the next launch, failing to write it is no error
+  std::error_code ec;
+  std::filesystem::create_directories(cache_path.parent_path(), ec);
+  std::ofstream file(cache_path, std::ios::trunc);
+  file << device << '\n';
+}
+
+}  // namespace
+
+namespace m65dap {
+
+auto open_device(std::string_view device) -> std::unique_ptr<Connection>
+{
+#ifdef _POSIX_VERSION
+  if (device.starts_with("unix#")) {
+    return std::make_unique<UnixDomainSocketConnection>(device.substr(5));
+  }
+  if (device.starts_with("tcp#")) {
+    return std::make_unique<TcpConnection>(device.substr(4));
+  }
+  return std::make_unique<UnixSerialConnection>(device);
+#endif
+
+#ifdef _WIN32
+  return std::make_unique<SerialConnection>(device);
+#endif
+}
+
+auto monitor_candidates(const std::filesystem::path& dev_dir) -> std::vector<std::string>
+{
+  std::vector<std::string> result;
+#ifdef _POSIX_VERSION
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(dev_dir, ec)) {
+    const auto name = entry.path().filename().string();
+    if (std::ranges::any_of(serial_port_prefixes, [&](auto prefix) { return name.starts_with(prefix); })) {
+      result.push_back(entry.path().string());
+    }
+  }
+  for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::temp_directory_path(), ec)) {
+    const auto name = entry.path().filename().string();
+    if (entry.is_socket(ec) &&
+        std::ranges::any_of(monitor_socket_names, [&](auto part) { return name.find(part) != std::string::npos; })) {
+      result.push_back("unix#" + entry.path().string());
+    }
+  }
+  // Directory order is arbitrary, sorted the candidates are listed the same way on every launch
+  std::ranges::sort(result);
+#endif
+
+#ifdef _WIN32
+  for (int port{1}; port <= max_com_port; ++port) {
+    result.push_back(fmt::format("COM{}", port));
+  }
+#endif
+  result.emplace_back(xemu_tcp_address);
+  return result;
+}
+
+auto probe_monitors(const std::vector<std::string>& devices, int timeout_ms) -> std::optional<DiscoveredMonitor>
+{
+  std::mutex mutex;
+  std::condition_variable done;
+  std::optional<DiscoveredMonitor> winner;
+  auto remaining = devices.size();
+  std::atomic<bool> cancelled{false};
+
+  std::vector<std::thread> probes;
+  probes.reserve(devices.size());
+  for (const auto& device : devices) {
+    probes.emplace_back([&, device] {
+      auto monitor = probe_monitor(device, timeout_ms, cancelled);
+      std::scoped_lock lock(mutex);
+      if (monitor.has_value() && !winner.has_value()) {
+        winner = std::move(monitor);
+      }
+      --remaining;
+      done.notify_one();
+    });
+  }
+
+  {
+    std::unique_lock lock(mutex);
+    done.wait(lock, [&] { return winner.has_value() || remaining == 0; });
+  }
+  cancelled = true;
+  for (auto& probe : probes) {
+    probe.join();
+  }
+  return winner;
+}
+
+auto discover_monitor(const std::vector<std::string>& devices, const std::filesystem::path& cache_path, int timeout_ms)
+    -> std::optional<DiscoveredMonitor>
+{
+  const auto cached_device = read_cached_device(cache_path);
+  if (!cached_device.empty()) {
+    if (auto monitor = probe_monitors({cached_device}, timeout_ms); monitor.has_value()) {
+      return monitor;
+    }
+  }
+
+  std::vector<std::string> others;
+  std::ranges::copy_if(devices, std::back_inserter(others), [&](const auto& device) { return device != cached_device; });
+  auto monitor = probe_monitors(others, timeout_ms);
+  if (monitor.has_value()) {
+    write_cached_device(cache_path, monitor->device);
+  }
+  return monitor;
+}
+
+auto default_discovery_cache_path() -> std::filesystem::path
+{
+  std::filesystem::path cache_dir;
+  if (const char* xdg_cache_home = std::getenv("XDG_CACHE_HOME"); xdg_cache_home != nullptr && *xdg_cache_home != 0) {
+    cache_dir = xdg_cache_home;
+  }
+  else if (const char* home = std::getenv("HOME"); home != nullptr && *home != 0) {
+    cache_dir = std::filesystem::path(home) / ".cache";
+  }
+  else {
+    cache_dir = std::filesystem::temp_directory_path();
+  }
+  return cache_dir / "m65dap" / "last_monitor";
+}
+
+}  // namespace m65dap
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "connection.h"
+#include "monitor_dialect.h"
+
+namespace m65dap {
+
+// Longest time a device gets to answer the help command while discovering
+constexpr int default_probe_timeout_ms = 300;
+
+/**
+ * @brief Opens a serial port, a Unix domain socket ("unix#<path>") or a TCP connection ("tcp#<host:port>")
+ */
+auto open_device(std::string_view device) -> std::unique_ptr<Connection>;
+
+struct DiscoveredMonitor {
+  std::string device;
+  bool is_xemu{false};
+};
+
+/**
+ * @brief Lists the devices a monitor may be attached to
+ *
+ * These are the USB serial ports (ttyUSB*, ttyACM*, cu.usbserial*) in dev_dir, the Unix domain sockets of Xemu and
+ * the broker in the temp directory and Xemu's default TCP monitor port on localhost.
+ */
+auto monitor_candidates(const std::filesystem::path& dev_dir = "/dev") -> std::vector<std::string>;
+
+/**
+ * @brief Sends the help command to all devices at once, each one from its own thread
+ *
+ * @return The device answering first as MEGA65 or Xemu monitor, no value if none did within the timeout
+ */
+auto probe_monitors(const std::vector<std::string>& devices, int timeout_ms = default_probe_timeout_ms)
+    -> std::optional<DiscoveredMonitor>;
+
+/**
+ * @brief Probes the devices for a monitor, starting with the one found last time
+ *
+ * The device found last is stored in cache_path and probed on its own first, the other devices are only probed if
+ * it doesn't answer.
+ */
+auto discover_monitor(const std::vector<std::string>& devices,
+                      const std::filesystem::path& cache_path,
+                      int timeout_ms = default_probe_timeout_ms) -> std::optional<DiscoveredMonitor>;
+
+/**
+ * @brief File the device found last is kept in, in the user's cache directory
+ */
+auto default_discovery_cache_path() -> std::filesystem::path;
+
+}  // namespace m65dap
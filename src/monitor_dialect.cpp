@@ -0,0 +1,29 @@
+#include "monitor_dialect.h"
+
+namespace m65dap {
+
+auto Registers::flags_string() const -> std::string
+{
+  static constexpr std::string_view flag_names{"NVEBDIZC"};
+  std::string result(flag_names.size(), '.');
+  for (std::size_t idx{0}; idx < flag_names.size(); ++idx) {
+    if ((flags & (0x80 >> idx)) != 0) {
+      result[idx] = flag_names[idx];
+    }
+  }
+  return result;
+}
+
+auto mega65_dialect() -> const MonitorDialect&
+{
+  static const MonitorDialectImpl<Mega65Monitor> dialect;
+  return dialect;
+}
+
+auto xemu_dialect() -> const MonitorDialect&
+{
+  static const MonitorDialectImpl<XemuMonitor> dialect;
+  return dialect;
+}
+
+}  // namespace m65dap
@@ -0,0 +1,297 @@
+#pragma once
+
+namespace m65dap {
+
+// First line of the reply to the help command
+constexpr std::string_view mega65_ident = "MEGA65 Serial Monitor";
+constexpr std::string_view xemu_ident = "Xemu/MEGA65 Serial Monitor";
+
+// Line preceding the register values in the reply to the registers command, a step or a breakpoint trigger
+constexpr std::string_view register_header = "PC   A  X  Y  Z  B  SP";
+
+/**
+ * @brief CPU state from the register dump of the monitor
+ *
+ * Values are kept at their size on the wire, so copying the registers on every step doesn't allocate.
+ */
+struct Registers {
+  std::uint16_t pc{0};
+  std::uint16_t sp{0};
+  std::uint16_t maph{0};
+  std::uint16_t mapl{0};
+  std::uint16_t last_op{0};
+  std::uint8_t a{0};
+  std::uint8_t x{0};
+  std::uint8_t y{0};
+  std::uint8_t z{0};
+  std::uint8_t b{0};
+  std::uint8_t in{0};
+  std::uint8_t p{0};
+  std::uint8_t flags{0};
+  std::uint8_t us{0};
+  std::uint8_t ws{0};
+  char io{' '};
+  char h{' '};
+  std::array<char, 4> rgp{};
+  std::array<char, 8> reca8lhc{};
+
+  /**
+   * @brief Flags with the names of the set ones, e.g. "N.E....C"
+   */
+  auto flags_string() const -> std::string;
+};
+
+/**
+ * @brief Wire format of a monitor, the UART monitor of the MEGA65 or Xemu's emulation of it
+ *
+ * Implemented by MonitorDialectImpl for a traits struct describing the dialect, see Mega65Monitor. Scanning lines
+ * and parsing registers are specialized for each dialect at compile time, so they don't test the dialect per
+ * character or field. A new dialect only needs its traits and an instance like those of mega65_dialect().
+ */
+class MonitorDialect {
+ public:
+  virtual ~MonitorDialect() = default;
+
+  virtual auto name() const -> std::string_view = 0;
+  virtual auto ident() const -> std::string_view = 0;
+  // Sent at the end of every reply
+  virtual auto reply_end() const -> std::string_view = 0;
+  // Sent ahead of the registers when a breakpoint triggers
+  virtual auto breakpoint_trigger() const -> std::string_view = 0;
+  // Start of the reply to the reset command
+  virtual auto reset_reply() const -> std::string_view = 0;
+  virtual auto can_reset() const -> bool = 0;
+  // Number of prompts ending the reply to a step
+  virtual auto step_reply_prompts() const -> int = 0;
+
+  /**
+   * @brief Help command sent by sync attempt number attempt, numbered if the monitor echoes the number
+   */
+  virtual auto sync_command(int attempt) const -> std::string = 0;
+
+  /**
+   * @brief Takes the next line from the received data
+   *
+   * The prompt is returned as ".", a breakpoint trigger as "!" even before its line break arrived.
+   *
+   * @return No value while the line isn't complete
+   */
+  virtual auto take_line(std::string& buffer) const -> std::optional<std::string> = 0;
+
+  /**
+   * @brief Reads the registers sent after a breakpoint trigger
+   *
+   * @param next_line Returns the next line received, throws on timeout
+   */
+  virtual auto read_breakpoint_block(const std::function<std::string()>& next_line) const
+      -> std::vector<std::string> = 0;
+
+  /**
+   * @brief Parses the line following the register header
+   *
+   * @return False if a value is missing or malformed, registers is left unchanged then
+   */
+  virtual auto parse_registers(std::string_view line, Registers& registers) const -> bool = 0;
+};
+
+template <typename T>
+  requires std::is_unsigned_v<T>
+auto parse_register_value(std::string_view text, T& value) -> bool
+{
+  const auto* end = text.data() + text.size();
+  const auto [ptr, ec] = std::from_chars(text.data(), end, value, 16);
+  return ec == std::errc() && ptr == end;
+}
+
+inline auto parse_register_value(std::string_view text, char& value) -> bool
+{
+  value = text.front();
+  return true;
+}
+
+template <std::size_t N>
+auto parse_register_value(std::string_view text, std::array<char, N>& value) -> bool
+{
+  std::copy_n(text.begin(), N, value.begin());
+  return true;
+}
+
+/**
+ * @brief Register value at a fixed position of the register dump, as hex number or text
+ */
+template <std::size_t Offset, std::size_t Width, auto Field>
+struct RegisterColumn {
+  static auto parse(std::string_view line, Registers& registers) -> bool
+  {
+    return line.size() >= Offset + Width && parse_register_value(line.substr(Offset, Width), registers.*Field);
+  }
+};
+
+/**
+ * @brief Flags shown as one character per flag, the character of a cleared flag differs between the dialects
+ */
+template <std::size_t Offset, char Cleared>
+struct FlagsColumn {
+  static auto parse(std::string_view line, Registers& registers) -> bool
+  {
+    if (line.size() < Offset + 8) {
+      return false;
+    }
+    std::uint8_t flags{0};
+    for (std::size_t idx{0}; idx < 8; ++idx) {
+      flags |= static_cast<std::uint8_t>(line[Offset + idx] != Cleared) << (7 - idx);
+    }
+    registers.flags = flags;
+    return true;
+  }
+};
+
+/**
+ * @brief Columns of the register dump
+ *
+ * The monitors print the registers with a fixed format, so each value is taken from its position in the line
+ * without tokenizing it. All columns are parsed by code generated for the layout, without allocating.
+ */
+template <typename... Columns>
+struct RegisterLayout {
+  static auto parse(std::string_view line, Registers& registers) -> bool
+  {
+    return (Columns::parse(line, registers) && ...);
+  }
+};
+
+struct Mega65Monitor {
+  static constexpr std::string_view name = "MEGA65";
+  static constexpr std::string_view ident = mega65_ident;
+  static constexpr std::string_view prompt = ".";
+  static constexpr std::string_view reply_end = "\r\n.";
+  static constexpr std::string_view breakpoint_trigger = "!";
+  static constexpr std::string_view reset_reply = "!\r\n@";
+  static constexpr bool can_reset = true;
+  static constexpr bool numbered_sync = true;
+  static constexpr int step_reply_prompts = 1;
+  // Registers of a breakpoint trigger are followed by a prompt
+  static constexpr int breakpoint_block_lines = 0;
+
+  // PC   A  X  Y  Z  B  SP   MAPH MAPL LAST-OP In     P  P-FLAGS   RGP uS IO ws h RECA8LHC
+  // 2058 12 FF 00 00 00 01FF 0000 0000 A912    00     21 ..E....C ...P 15 -  00 - .....l.c
+  using register_layout =
+      RegisterLayout<RegisterColumn<0, 4, &Registers::pc>, RegisterColumn<5, 2, &Registers::a>,
+                     RegisterColumn<8, 2, &Registers::x>, RegisterColumn<11, 2, &Registers::y>,
+                     RegisterColumn<14, 2, &Registers::z>, RegisterColumn<17, 2, &Registers::b>,
+                     RegisterColumn<20, 4, &Registers::sp>, RegisterColumn<25, 4, &Registers::maph>,
+                     RegisterColumn<30, 4, &Registers::mapl>, RegisterColumn<35, 4, &Registers::last_op>,
+                     RegisterColumn<43, 2, &Registers::in>, RegisterColumn<50, 2, &Registers::p>, FlagsColumn<53, '.'>,
+                     RegisterColumn<62, 4, &Registers::rgp>, RegisterColumn<67, 2, &Registers::us>,
+                     RegisterColumn<70, 1, &Registers::io>, RegisterColumn<73, 2, &Registers::ws>,
+                     RegisterColumn<76, 1, &Registers::h>, RegisterColumn<78, 8, &Registers::reca8lhc>>;
+};
+
+struct XemuMonitor {
+  static constexpr std::string_view name = "Xemu";
+  static constexpr std::string_view ident = xemu_ident;
+  static constexpr std::string_view prompt = ".\r\n";
+  static constexpr std::string_view reply_end = ".\r\n";
+  static constexpr std::string_view breakpoint_trigger = "";
+  static constexpr std::string_view reset_reply = "!\r\n?";
+  static constexpr bool can_reset = false;
+  static constexpr bool numbered_sync = false;
+  // A step is answered with a prompt, followed by the registers and another prompt
+  static constexpr int step_reply_prompts = 2;
+  // Register header, values and the instruction at PC, without a prompt
+  static constexpr int breakpoint_block_lines = 3;
+
+  // No "In" column and the last opcode without its operands. The status register is followed by a value without
+  // header, RGP, uS and IO are left empty.
+  // PC   A  X  Y  Z  B  SP   MAPH MAPL LAST-OP     P  P-FLAGS   RGP uS IO
+  // 2056 00 FF 00 00 00 01FF 0000 0000 9A       A1 00 N-E----C
+  using register_layout =
+      RegisterLayout<RegisterColumn<0, 4, &Registers::pc>, RegisterColumn<5, 2, &Registers::a>,
+                     RegisterColumn<8, 2, &Registers::x>, RegisterColumn<11, 2, &Registers::y>,
+                     RegisterColumn<14, 2, &Registers::z>, RegisterColumn<17, 2, &Registers::b>,
+                     RegisterColumn<20, 4, &Registers::sp>, RegisterColumn<25, 4, &Registers::maph>,
+                     RegisterColumn<30, 4, &Registers::mapl>, RegisterColumn<35, 2, &Registers::last_op>,
+                     RegisterColumn<44, 2, &Registers::p>, FlagsColumn<50, '-'>>;
+};
+
+template <typename Traits>
+class MonitorDialectImpl : public MonitorDialect {
+ public:
+  auto name() const -> std::string_view override { return Traits::name; }
+  auto ident() const -> std::string_view override { return Traits::ident; }
+  auto reply_end() const -> std::string_view override { return Traits::reply_end; }
+  auto breakpoint_trigger() const -> std::string_view override { return Traits::breakpoint_trigger; }
+  auto reset_reply() const -> std::string_view override { return Traits::reset_reply; }
+  auto can_reset() const -> bool override { return Traits::can_reset; }
+  auto step_reply_prompts() const -> int override { return Traits::step_reply_prompts; }
+
+  auto sync_command(int attempt) const -> std::string override
+  {
+    if constexpr (Traits::numbered_sync) {
+      return fmt::format("?{}\n", attempt);
+    }
+    else {
+      return "?\n";
+    }
+  }
+
+  auto take_line(std::string& buffer) const -> std::optional<std::string> override
+  {
+    if (buffer.starts_with(Traits::prompt)) {
+      buffer.erase(0, Traits::prompt.size());
+      return ".";
+    }
+    const auto eol = buffer.find('\n');
+    if (eol == std::string::npos) {
+      if (buffer.starts_with('!')) {
+        buffer.erase(0, 1);
+        return "!";
+      }
+      return {};
+    }
+    auto line = buffer.substr(0, eol);
+    buffer.erase(0, eol + 1);
+    if (line.ends_with('\r')) {
+      line.pop_back();
+    }
+    return line;
+  }
+
+  auto read_breakpoint_block(const std::function<std::string()>& next_line) const
+      -> std::vector<std::string> override
+  {
+    std::vector<std::string> lines;
+    if constexpr (Traits::breakpoint_block_lines == 0) {
+      for (auto line = next_line(); line != "."; line = next_line()) {
+        lines.push_back(std::move(line));
+      }
+    }
+    else {
+      for (int idx{0}; idx < Traits::breakpoint_block_lines; ++idx) {
+        lines.push_back(next_line());
+      }
+      throw_if<std::runtime_error>(!lines.front().starts_with(register_header),
+                                   "Expected register header in breakpoint response");
+      throw_if<std::runtime_error>(!lines.back().starts_with(",0777"),
+                                   "Expected instruction at PC in breakpoint response");
+    }
+    return lines;
+  }
+
+  auto parse_registers(std::string_view line, Registers& registers) const -> bool override
+  {
+    // Registers are only updated as a whole, a line failing halfway leaves them untouched. Values not covered by
+    // the layout keep their previous values.
+    auto parsed = registers;
+    if (!Traits::register_layout::parse(line, parsed)) {
+      return false;
+    }
+    registers = parsed;
+    return true;
+  }
+};
+
+auto mega65_dialect() -> const MonitorDialect&;
+auto xemu_dialect() -> const MonitorDialect&;
+
+}  // namespace m65dap
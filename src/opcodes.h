@@ -2,9 +2,55 @@
 
 namespace m65dap {
 
-enum class Mnemonic { Illegal, BSR, JSR };
+enum class Mnemonic {
+  Illegal,
+  BSR,
+  JSR,
+  BRK,
+  STA,
+  STX,
+  STY,
+  STZ,
+  INC,
+  DEC,
+  ASL,
+  LSR,
+  ROL,
+  ROR,
+  ASR,
+  TSB,
+  TRB,
+  RMB,
+  SMB,
+  INW,
+  DEW,
+  ASW,
+  ROW,
+  PHA,
+  PHP,
+  PHX,
+  PHY,
+  PHZ,
+  PHW
+};
 
-enum class AddressingMode { Absolute, AbsoluteIndirect, AbsoluteIndirectX, RelativeWord };
+enum class AddressingMode {
+  Implied,
+  ImmediateWord,
+  ZeroPage,
+  ZeroPageX,
+  ZeroPageY,
+  Absolute,
+  AbsoluteX,
+  AbsoluteY,
+  AbsoluteIndirect,
+  AbsoluteIndirectX,
+  IndirectX,
+  IndirectY,
+  IndirectZ,
+  StackIndirectY,
+  RelativeWord
+};
 
 struct Opcode {
   std::byte code;
@@ -12,11 +58,103 @@ struct Opcode {
   AddressingMode mode{AddressingMode::Absolute};
 };
 
-constexpr std::array<Opcode, 5> opcodes{{{},
-                                         {std::byte{0x20}, Mnemonic::JSR, AddressingMode::Absolute},
-                                         {std::byte{0x22}, Mnemonic::JSR, AddressingMode::AbsoluteIndirect},
-                                         {std::byte{0x23}, Mnemonic::JSR, AddressingMode::AbsoluteIndirectX},
-                                         {std::byte{0x63}, Mnemonic::BSR, AddressingMode::RelativeWord}}};
+// Instructions writing to memory (stores, read-modify-write and stack pushes), grouped by mnemonic.
+// Zero page addresses are relative to the base page register B.
+constexpr auto opcodes = std::to_array<Opcode>({{},
+                                                {std::byte{0x20}, Mnemonic::JSR, AddressingMode::Absolute},
+                                                {std::byte{0x22}, Mnemonic::JSR, AddressingMode::AbsoluteIndirect},
+                                                {std::byte{0x23}, Mnemonic::JSR, AddressingMode::AbsoluteIndirectX},
+                                                {std::byte{0x63}, Mnemonic::BSR, AddressingMode::RelativeWord},
+                                                {std::byte{0x00}, Mnemonic::BRK, AddressingMode::Implied},
+                                                {std::byte{0x85}, Mnemonic::STA, AddressingMode::ZeroPage},
+                                                {std::byte{0x95}, Mnemonic::STA, AddressingMode::ZeroPageX},
+                                                {std::byte{0x8D}, Mnemonic::STA, AddressingMode::Absolute},
+                                                {std::byte{0x9D}, Mnemonic::STA, AddressingMode::AbsoluteX},
+                                                {std::byte{0x99}, Mnemonic::STA, AddressingMode::AbsoluteY},
+                                                {std::byte{0x81}, Mnemonic::STA, AddressingMode::IndirectX},
+                                                {std::byte{0x91}, Mnemonic::STA, AddressingMode::IndirectY},
+                                                {std::byte{0x92}, Mnemonic::STA, AddressingMode::IndirectZ},
+                                                {std::byte{0x82}, Mnemonic::STA, AddressingMode::StackIndirectY},
+                                                {std::byte{0x86}, Mnemonic::STX, AddressingMode::ZeroPage},
+                                                {std::byte{0x96}, Mnemonic::STX, AddressingMode::ZeroPageY},
+                                                {std::byte{0x8E}, Mnemonic::STX, AddressingMode::Absolute},
+                                                {std::byte{0x9B}, Mnemonic::STX, AddressingMode::AbsoluteY},
+                                                {std::byte{0x84}, Mnemonic::STY, AddressingMode::ZeroPage},
+                                                {std::byte{0x94}, Mnemonic::STY, AddressingMode::ZeroPageX},
+                                                {std::byte{0x8C}, Mnemonic::STY, AddressingMode::Absolute},
+                                                {std::byte{0x8B}, Mnemonic::STY, AddressingMode::AbsoluteX},
+                                                {std::byte{0x64}, Mnemonic::STZ, AddressingMode::ZeroPage},
+                                                {std::byte{0x74}, Mnemonic::STZ, AddressingMode::ZeroPageX},
+                                                {std::byte{0x9C}, Mnemonic::STZ, AddressingMode::Absolute},
+                                                {std::byte{0x9E}, Mnemonic::STZ, AddressingMode::AbsoluteX},
+                                                {std::byte{0xE6}, Mnemonic::INC, AddressingMode::ZeroPage},
+                                                {std::byte{0xF6}, Mnemonic::INC, AddressingMode::ZeroPageX},
+                                                {std::byte{0xEE}, Mnemonic::INC, AddressingMode::Absolute},
+                                                {std::byte{0xFE}, Mnemonic::INC, AddressingMode::AbsoluteX},
+                                                {std::byte{0xC6}, Mnemonic::DEC, AddressingMode::ZeroPage},
+                                                {std::byte{0xD6}, Mnemonic::DEC, AddressingMode::ZeroPageX},
+                                                {std::byte{0xCE}, Mnemonic::DEC, AddressingMode::Absolute},
+                                                {std::byte{0xDE}, Mnemonic::DEC, AddressingMode::AbsoluteX},
+                                                {std::byte{0x06}, Mnemonic::ASL, AddressingMode::ZeroPage},
+                                                {std::byte{0x16}, Mnemonic::ASL, AddressingMode::ZeroPageX},
+                                                {std::byte{0x0E}, Mnemonic::ASL, AddressingMode::Absolute},
+                                                {std::byte{0x1E}, Mnemonic::ASL, AddressingMode::AbsoluteX},
+                                                {std::byte{0x46}, Mnemonic::LSR, AddressingMode::ZeroPage},
+                                                {std::byte{0x56}, Mnemonic::LSR, AddressingMode::ZeroPageX},
+                                                {std::byte{0x4E}, Mnemonic::LSR, AddressingMode::Absolute},
+                                                {std::byte{0x5E}, Mnemonic::LSR, AddressingMode::AbsoluteX},
+                                                {std::byte{0x26}, Mnemonic::ROL, AddressingMode::ZeroPage},
+                                                {std::byte{0x36}, Mnemonic::ROL, AddressingMode::ZeroPageX},
+                                                {std::byte{0x2E}, Mnemonic::ROL, AddressingMode::Absolute},
+                                                {std::byte{0x3E}, Mnemonic::ROL, AddressingMode::AbsoluteX},
+                                                {std::byte{0x66}, Mnemonic::ROR, AddressingMode::ZeroPage},
+                                                {std::byte{0x76}, Mnemonic::ROR, AddressingMode::ZeroPageX},
+                                                {std::byte{0x6E}, Mnemonic::ROR, AddressingMode::Absolute},
+                                                {std::byte{0x7E}, Mnemonic::ROR, AddressingMode::AbsoluteX},
+                                                {std::byte{0x44}, Mnemonic::ASR, AddressingMode::ZeroPage},
+                                                {std::byte{0x54}, Mnemonic::ASR, AddressingMode::ZeroPageX},
+                                                {std::byte{0x04}, Mnemonic::TSB, AddressingMode::ZeroPage},
+                                                {std::byte{0x0C}, Mnemonic::TSB, AddressingMode::Absolute},
+                                                {std::byte{0x14}, Mnemonic::TRB, AddressingMode::ZeroPage},
+                                                {std::byte{0x1C}, Mnemonic::TRB, AddressingMode::Absolute},
+                                                {std::byte{0x07}, Mnemonic::RMB, AddressingMode::ZeroPage},
+                                                {std::byte{0x17}, Mnemonic::RMB, AddressingMode::ZeroPage},
+                                                {std::byte{0x27}, Mnemonic::RMB, AddressingMode::ZeroPage},
+                                                {std::byte{0x37}, Mnemonic::RMB, AddressingMode::ZeroPage},
+                                                {std::byte{0x47}, Mnemonic::RMB, AddressingMode::ZeroPage},
+                                                {std::byte{0x57}, Mnemonic::RMB, AddressingMode::ZeroPage},
+                                                {std::byte{0x67}, Mnemonic::RMB, AddressingMode::ZeroPage},
+                                                {std::byte{0x77}, Mnemonic::RMB, AddressingMode::ZeroPage},
+                                                {std::byte{0x87}, Mnemonic::SMB, AddressingMode::ZeroPage},
+                                                {std::byte{0x97}, Mnemonic::SMB, AddressingMode::ZeroPage},
+                                                {std::byte{0xA7}, Mnemonic::SMB, AddressingMode::ZeroPage},
+                                                {std::byte{0xB7}, Mnemonic::SMB, AddressingMode::ZeroPage},
+                                                {std::byte{0xC7}, Mnemonic::SMB, AddressingMode::ZeroPage},
+                                                {std::byte{0xD7}, Mnemonic::SMB, AddressingMode::ZeroPage},
+                                                {std::byte{0xE7}, Mnemonic::SMB, AddressingMode::ZeroPage},
+                                                {std::byte{0xF7}, Mnemonic::SMB, AddressingMode::ZeroPage},
+                                                {std::byte{0xE3}, Mnemonic::INW, AddressingMode::ZeroPage},
+                                                {std::byte{0xC3}, Mnemonic::DEW, AddressingMode::ZeroPage},
+                                                {std::byte{0xCB}, Mnemonic::ASW, AddressingMode::Absolute},
+                                                {std::byte{0xEB}, Mnemonic::ROW, AddressingMode::Absolute},
+                                                {std::byte{0x48}, Mnemonic::PHA, AddressingMode::Implied},
+                                                {std::byte{0x08}, Mnemonic::PHP, AddressingMode::Implied},
+                                                {std::byte{0xDA}, Mnemonic::PHX, AddressingMode::Implied},
+                                                {std::byte{0x5A}, Mnemonic::PHY, AddressingMode::Implied},
+                                                {std::byte{0xDB}, Mnemonic::PHZ, AddressingMode::Implied},
+                                                {std::byte{0xF4}, Mnemonic::PHW, AddressingMode::ImmediateWord},
+                                                {std::byte{0xFC}, Mnemonic::PHW, AddressingMode::Absolute}});
+
+static_assert(opcodes.size() < 256);
+
+// Index into opcodes for every opcode byte, 0 (Illegal) for the ones not listed
+constexpr auto opcode_lookup = [] {
+  std::array<std::uint8_t, 256> lookup{};
+  for (std::size_t i = 1; i < opcodes.size(); ++i) {
+    lookup[std::to_integer<std::size_t>(opcodes[i].code)] = static_cast<std::uint8_t>(i);
+  }
+  return lookup;
+}();
 
 constexpr auto get_num_opcodes(Mnemonic m) -> int
 {
@@ -38,11 +176,7 @@ constexpr auto get_opcodes(Mnemonic m) -> const std::span<const Opcode>
 
 constexpr auto get_opcode(std::byte code) -> const Opcode&
 {
-  const auto it = std::find_if(opcodes.begin(), opcodes.end(), [&](const Opcode& o) { return o.code == code; });
-  if (it == opcodes.end()) {
-    return *(opcodes.begin());
-  }
-  return *it;
+  return opcodes[opcode_lookup[std::to_integer<std::size_t>(code)]];
 };
 
 }  // namespace m65dap
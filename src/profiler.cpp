@@ -0,0 +1,68 @@
+#include "profiler.h"
+
+namespace m65dap {
+
+Profiler::Profiler() : histogram_(num_addresses) {}
+
+void Profiler::start(int sample_rate_hz)
+{
+  throw_if<std::invalid_argument>(sample_rate_hz <= 0 || sample_rate_hz > 100000, "Invalid profiler sample rate");
+  sample_interval_us_ = 1000000 / sample_rate_hz;
+  active_ = true;
+}
+
+void Profiler::stop() { active_ = false; }
+
+void Profiler::reset()
+{
+  for (auto& counter : histogram_) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+  total_samples_ = 0;
+}
+
+void Profiler::record_sample(int pc)
+{
+  histogram_[pc & (num_addresses - 1)].fetch_add(1, std::memory_order_relaxed);
+  total_samples_.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto Profiler::sample_count(int pc) const -> std::uint32_t
+{
+  return histogram_[pc & (num_addresses - 1)].load(std::memory_order_relaxed);
+}
+
+auto Profiler::to_collapsed_stacks(const C64DebuggerData* dbg_data) const -> std::string
+{
+  std::map<std::string, std::uint64_t> stacks;
+
+  for (int pc{0}; pc < num_addresses; ++pc) {
+    auto count = histogram_[pc].load(std::memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+
+    AddressInfo info;
+    if (dbg_data) {
+      info = dbg_data->lookup_address(pc);
+    }
+
+    if (info.entry == nullptr) {
+      stacks[fmt::format("unknown;${:04X}", pc)] += count;
+      continue;
+    }
+
+    std::filesystem::path src_path{dbg_data->get_file(info.entry->file_index)};
+    auto frame = fmt::format("{};{};{}:{}", info.segment->name, info.block->name,
+                             from_u8string(src_path.filename().u8string()), info.entry->line1);
+    stacks[frame] += count;
+  }
+
+  std::string result;
+  for (const auto& [frame, count] : stacks) {
+    result.append(fmt::format("{} {}\n", frame, count));
+  }
+  return result;
+}
+
+}  // namespace m65dap
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "c64_debugger_data.h"
+
+namespace m65dap {
+
+/**
+ * @brief Statistical PC sampling profiler
+ *
+ * Samples are aggregated per CPU address in a histogram of atomic counters, so the debugger thread can record
+ * samples while another thread exports a report without any locking.
+ */
+class Profiler {
+ public:
+  static constexpr int num_addresses = 0x10000;
+
+ private:
+  std::vector<std::atomic<std::uint32_t>> histogram_;
+  std::atomic<std::uint64_t> total_samples_{0};
+  std::atomic<bool> active_{false};
+  std::atomic<int> sample_interval_us_{10000};
+
+ public:
+  Profiler();
+
+  void start(int sample_rate_hz);
+  void stop();
+  void reset();
+  auto is_active() const -> bool { return active_.load(std::memory_order_relaxed); }
+  auto sample_interval_us() const -> int { return sample_interval_us_.load(std::memory_order_relaxed); }
+
+  void record_sample(int pc);
+  auto total_samples() const -> std::uint64_t { return total_samples_.load(std::memory_order_relaxed); }
+  auto sample_count(int pc) const -> std::uint32_t;
+
+  /**
+   * @brief Exports the histogram in collapsed stack format (as consumed by flamegraph.pl)
+   *
+   * Each line has the form "segment;block;file:line count". Addresses without debug information are reported as
+   * "unknown;$XXXX".
+   *
+   * @param dbg_data Debug data used to map addresses to source positions (may be nullptr)
+   * @return std::string Collapsed stack text, sorted by stack name
+   */
+  auto to_collapsed_stacks(const C64DebuggerData* dbg_data) const -> std::string;
+};
+
+}  // namespace m65dap
@@ -0,0 +1,278 @@
+#include "session_recording.h"
+
+namespace {
+
+constexpr std::array<char, 8> recording_magic{'M', '6', '5', 'W', 'I', 'R', 'E', 'S'};
+constexpr std::uint32_t recording_version = 1;
+// Written data shown in the error of a diverged replay
+constexpr std::size_t max_shown_data = 40;
+
+void append_varint(std::string& out, std::uint64_t value)
+{
+  do {
+    const auto byte = static_cast<std::uint8_t>(value & 0x7f);
+    value >>= 7;
+    out.push_back(static_cast<char>(value != 0 ? byte | 0x80 : byte));
+  } while (value != 0);
+}
+
+auto read_varint(std::string_view data, std::size_t& pos) -> std::uint64_t
+{
+  std::uint64_t value{0};
+  for (int shift{0}; shift < 64; shift += 7) {
+    m65dap::throw_if<std::runtime_error>(pos >= data.size(), "Session recording is truncated");
+    const auto byte = static_cast<std::uint8_t>(data[pos++]);
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  throw std::runtime_error("Invalid session recording");
+}
+
+template <typename T>
+void append_raw(std::string& out, const T& value)
+{
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+auto read_raw(std::string_view data, std::size_t& pos) -> T
+{
+  m65dap::throw_if<std::runtime_error>(data.size() - pos < sizeof(T), "Session recording is truncated");
+  T value;
+  std::memcpy(&value, data.data() + pos, sizeof(T));
+  pos += sizeof(T);
+  return value;
+}
+
+auto escaped(std::string_view data) -> std::string
+{
+  std::string result;
+  for (const char c : data.substr(0, max_shown_data)) {
+    if (c == '\n') {
+      result += "\\n";
+    }
+    else if (c == '\r') {
+      result += "\\r";
+    }
+    else if (c < 0x20 || c > 0x7e) {
+      result += fmt::format("\\x{:02X}", static_cast<std::uint8_t>(c));
+    }
+    else {
+      result += c;
+    }
+  }
+  return data.size() > max_shown_data ? result + "..." : result;
+}
+
+}  // namespace
+
+namespace m65dap {
+
+auto SessionRecording::load(const std::filesystem::path& path) -> SessionRecording
+{
+  std::ifstream file(path, std::ios::binary);
+  throw_if<std::runtime_error>(!file, fmt::format("Can't open session recording '{}'", path.string()));
+  const std::string data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+  std::size_t pos{0};
+  throw_if<std::runtime_error>(read_raw<std::array<char, 8>>(data, pos) != recording_magic,
+                               "Not a session recording");
+  throw_if<std::runtime_error>(read_raw<std::uint32_t>(data, pos) != recording_version,
+                               "Unsupported session recording version");
+  const auto device_size = read_raw<std::uint32_t>(data, pos);
+  throw_if<std::runtime_error>(data.size() - pos < device_size, "Session recording is truncated");
+
+  SessionRecording recording;
+  recording.device = data.substr(pos, device_size);
+  pos += device_size;
+  std::chrono::microseconds time{0};
+  while (pos < data.size()) {
+    const auto direction = static_cast<RecordedChunk::Direction>(data[pos++]);
+    throw_if<std::runtime_error>(direction != RecordedChunk::Direction::Write &&
+                                     direction != RecordedChunk::Direction::Read,
+                                 "Invalid session recording");
+    time += std::chrono::microseconds(read_varint(data, pos));
+    const auto size = read_varint(data, pos);
+    throw_if<std::runtime_error>(data.size() - pos < size, "Session recording is truncated");
+    recording.chunks.push_back(RecordedChunk{.direction = direction, .time = time, .data = data.substr(pos, size)});
+    pos += size;
+  }
+  return recording;
+}
+
+RecordingConnection::RecordingConnection(std::unique_ptr<Connection> connection,
+                                         const std::filesystem::path& path,
+                                         std::string_view device) :
+    conn_(std::move(connection)),
+    file_(path, std::ios::binary | std::ios::trunc), last_time_(clock::now())
+{
+  throw_if<std::invalid_argument>(!conn_, "Missing connection to record");
+  throw_if<std::runtime_error>(!file_, fmt::format("Can't create session recording '{}'", path.string()));
+
+  std::string header;
+  append_raw(header, recording_magic);
+  append_raw(header, recording_version);
+  append_raw(header, static_cast<std::uint32_t>(device.size()));
+  header.append(device);
+  file_.write(header.data(), static_cast<std::streamsize>(header.size()));
+}
+
+RecordingConnection::~RecordingConnection()
+{
+  try {
+    flush();
+  }
+  catch (...) {
+  }
+}
+
+void RecordingConnection::write(std::span<const char> buffer)
+{
+  // Recorded before it is sent, so the reply can't be recorded ahead of the command
+  append(RecordedChunk::Direction::Write, buffer);
+  conn_->write(buffer);
+}
+
+auto RecordingConnection::read(int bytes_to_read, int timeout_ms) -> std::string
+{
+  auto result = conn_->read(bytes_to_read, timeout_ms);
+  if (!result.empty()) {
+    append(RecordedChunk::Direction::Read, result);
+  }
+  return result;
+}
+
+void RecordingConnection::flush()
+{
+  std::scoped_lock lock(mutex_);
+  file_.flush();
+}
+
+void RecordingConnection::append(RecordedChunk::Direction direction, std::span<const char> data)
+{
+  std::scoped_lock lock(mutex_);
+  const auto now = clock::now();
+  std::string chunk;
+  chunk.push_back(static_cast<char>(direction));
+  append_varint(chunk, std::chrono::duration_cast<std::chrono::microseconds>(now - last_time_).count());
+  append_varint(chunk, data.size());
+  chunk.append(data.data(), data.size());
+  file_.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+  last_time_ = now;
+}
+
+ReplayConnection::ReplayConnection(SessionRecording recording, double speed) :
+    device_(std::move(recording.device)), speed_(speed), last_reply_time_(clock::now())
+{
+  throw_if<std::invalid_argument>(speed < 0.0, "Replay speed must not be negative");
+
+  std::chrono::microseconds last_write_time{0};
+  std::chrono::microseconds last_reply_time{0};
+  for (auto& chunk : recording.chunks) {
+    if (chunk.direction == RecordedChunk::Direction::Write) {
+      writes_.push_back(std::move(chunk.data));
+      last_write_time = chunk.time;
+      continue;
+    }
+    const auto delay = chunk.time - std::max(last_write_time, last_reply_time);
+    replies_.push_back(Reply{.data = std::move(chunk.data),
+                             .writes_before = writes_.size(),
+                             .delay = std::max(delay, std::chrono::microseconds(0))});
+    last_reply_time = chunk.time;
+  }
+}
+
+void ReplayConnection::write(std::span<const char> buffer)
+{
+  std::scoped_lock lock(mutex_);
+  for (std::size_t pos{0}; pos < buffer.size();) {
+    const std::string_view written(buffer.data() + pos, buffer.size() - pos);
+    const auto index = write_times_.size();
+    throw_if<std::runtime_error>(
+        index >= writes_.size(),
+        fmt::format("Replay diverged, \"{}\" written after the end of the recording", escaped(written)));
+
+    const std::string_view expected = std::string_view(writes_[index]).substr(write_pos_);
+    const auto count = std::min(expected.size(), written.size());
+    throw_if<std::runtime_error>(expected.substr(0, count) != written.substr(0, count),
+                                 fmt::format("Replay diverged at write {}: expected \"{}\", got \"{}\"", index + 1,
+                                             escaped(expected), escaped(written)));
+    pos += count;
+    write_pos_ += count;
+    if (write_pos_ == writes_[index].size()) {
+      write_times_.push_back(clock::now());
+      write_pos_ = 0;
+    }
+  }
+  written_.notify_all();
+}
+
+auto ReplayConnection::read(int bytes_to_read, int timeout_ms) -> std::string
+{
+  std::unique_lock lock(mutex_);
+  const auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+  std::string result;
+  while (result.size() < static_cast<std::size_t>(bytes_to_read)) {
+    const auto due = next_reply_time();
+    if (due.has_value() && due.value() <= clock::now()) {
+      const auto& data = replies_[reply_index_].data;
+      const auto count = std::min(data.size() - reply_pos_, bytes_to_read - result.size());
+      result.append(data, reply_pos_, count);
+      reply_pos_ += count;
+      if (reply_pos_ == data.size()) {
+        last_reply_time_ = due.value();
+        ++reply_index_;
+        reply_pos_ = 0;
+      }
+      continue;
+    }
+    if (!result.empty() || clock::now() >= deadline) {
+      break;
+    }
+    written_.wait_until(lock, due.has_value() ? std::min(due.value(), deadline) : deadline);
+  }
+  return result;
+}
+
+void ReplayConnection::wait_for_input(int timeout_ms)
+{
+  std::unique_lock lock(mutex_);
+  const auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (clock::now() < deadline) {
+    const auto due = next_reply_time();
+    if (due.has_value() && due.value() <= clock::now()) {
+      return;
+    }
+    written_.wait_until(lock, due.has_value() ? std::min(due.value(), deadline) : deadline);
+  }
+}
+
+auto ReplayConnection::finished() const -> bool
+{
+  std::scoped_lock lock(mutex_);
+  return write_times_.size() == writes_.size() && reply_index_ == replies_.size();
+}
+
+auto ReplayConnection::next_reply_time() const -> std::optional<clock::time_point>
+{
+  if (reply_index_ >= replies_.size()) {
+    return {};
+  }
+  const auto& reply = replies_[reply_index_];
+  if (write_times_.size() < reply.writes_before) {
+    return {};
+  }
+  auto start = last_reply_time_;
+  if (reply.writes_before > 0) {
+    start = std::max(start, write_times_[reply.writes_before - 1]);
+  }
+  if (speed_ == 0.0) {
+    return start;
+  }
+  const std::chrono::duration<double, std::micro> delay(static_cast<double>(reply.delay.count()) / speed_);
+  return start + std::chrono::duration_cast<clock::duration>(delay);
+}
+
+}  // namespace m65dap
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "connection.h"
+
+namespace m65dap {
+
+/**
+ * @brief Data written to or read from a connection at one point of a recorded session
+ */
+struct RecordedChunk {
+  enum class Direction : std::uint8_t { Write = 0, Read = 1 };
+
+  Direction direction{Direction::Write};
+  std::chrono::microseconds time{0};  // since the start of the recording
+  std::string data;
+};
+
+/**
+ * @brief Everything that went over the wire between the debugger and the monitor
+ *
+ * The log starts with a header holding the device the session was recorded with, so a replay talks the same
+ * monitor dialect. Each chunk follows as direction byte, time since the previous chunk in microseconds and data
+ * size, both as LEB128 varints, and the data. Most chunks are commands and short replies, so a chunk usually
+ * takes only a few bytes more than its data.
+ */
+struct SessionRecording {
+  std::string device;
+  std::vector<RecordedChunk> chunks;
+
+  static auto load(const std::filesystem::path& path) -> SessionRecording;
+};
+
+/**
+ * @brief Records all data written to and read from the wrapped connection to a session log
+ *
+ * Has to be the innermost decorator of a connection, so the time stamps are those of the writes to and reads from
+ * the device. read() and write() may be called from different threads.
+ */
+class RecordingConnection : public Connection {
+ public:
+  /**
+   * @param connection Connection to record
+   * @param path Session log to create, an existing file is replaced
+   * @param device Device the connection was opened with
+   */
+  RecordingConnection(std::unique_ptr<Connection> connection,
+                      const std::filesystem::path& path,
+                      std::string_view device);
+  ~RecordingConnection() override;
+
+  void write(std::span<const char> buffer) override;
+  auto read(int bytes_to_read, int timeout_ms = 1000) -> std::string override;
+  void wait_for_input(int timeout_ms) override { conn_->wait_for_input(timeout_ms); }
+  void discard_input() override { conn_->discard_input(); }
+  auto native_handle() const -> int override { return conn_->native_handle(); }
+
+  void flush();
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  void append(RecordedChunk::Direction direction, std::span<const char> data);
+
+  std::unique_ptr<Connection> conn_;
+  std::mutex mutex_;
+  std::ofstream file_;
+  clock::time_point last_time_;
+};
+
+/**
+ * @brief Connection serving the replies of a recorded session
+ *
+ * A reply is served once all commands written before it in the recording were written again and the recorded delay
+ * since the later of that command and the previous reply passed. The delays are divided by the speed factor, with
+ * a speed of 0 replies are served right away. Written data has to match the recording, a replay that diverged
+ * can't be continued and throws.
+ *
+ * As with a real connection, read() and write() may be called from different threads.
+ */
+class ReplayConnection : public Connection {
+ public:
+  explicit ReplayConnection(SessionRecording recording, double speed = 1.0);
+
+  void write(std::span<const char> buffer) override;
+  auto read(int bytes_to_read, int timeout_ms = 1000) -> std::string override;
+  void wait_for_input(int timeout_ms) override;
+
+  auto device() const -> const std::string& { return device_; }
+
+  /**
+   * @brief Returns true once all recorded data was written and read
+   */
+  auto finished() const -> bool;
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  struct Reply {
+    std::string data;
+    std::size_t writes_before{0};  // number of recorded writes preceding the reply
+    std::chrono::microseconds delay{0};
+  };
+
+  // Time the next reply is due, no value while it waits for writes or all replies were served
+  auto next_reply_time() const -> std::optional<clock::time_point>;
+
+  std::string device_;
+  double speed_{1.0};
+  std::vector<std::string> writes_;
+  std::vector<Reply> replies_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable written_;
+  std::vector<clock::time_point> write_times_;  // completion of the recorded writes replayed so far
+  std::size_t write_pos_{0};                    // bytes of the next recorded write already written
+  std::size_t reply_index_{0};
+  std::size_t reply_pos_{0};
+  clock::time_point last_reply_time_;  // when the previous reply was due
+};
+
+}  // namespace m65dap
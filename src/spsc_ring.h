@@ -0,0 +1,86 @@
+#pragma once
+
+namespace m65dap {
+
+/**
+ * @brief Lock-free ring buffer shared by exactly one producer and one consumer thread
+ *
+ * The producer only advances the tail, the consumer only the head, so neither has to wait for the other. Both
+ * indices count up without wrapping, the capacity is rounded up to a power of two to map them to items.
+ */
+template <typename T>
+class SpscRing {
+  static_assert(std::is_trivially_copyable_v<T>);
+  static constexpr std::size_t cache_line_size = 64;
+
+  std::vector<T> items_;
+  std::size_t mask_;
+  alignas(cache_line_size) std::atomic<std::size_t> head_{0};  // next item to pop
+  alignas(cache_line_size) std::atomic<std::size_t> tail_{0};  // next item to push
+
+ public:
+  explicit SpscRing(std::size_t capacity) : items_(std::bit_ceil(std::max<std::size_t>(capacity, 1)))
+  {
+    mask_ = items_.size() - 1;
+  }
+  SpscRing(const SpscRing&) = delete;
+  auto operator=(const SpscRing&) -> SpscRing& = delete;
+
+  auto capacity() const -> std::size_t { return items_.size(); }
+  auto size() const -> std::size_t
+  {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+  auto empty() const -> bool { return size() == 0; }
+
+  /**
+   * @brief Appends as many items as fit (producer only)
+   *
+   * @return Number of items pushed
+   */
+  auto push(std::span<const T> items) -> std::size_t
+  {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    const auto free = items_.size() - (tail - head_.load(std::memory_order_acquire));
+    const auto count = std::min(items.size(), free);
+    const auto first = tail & mask_;
+    const auto first_part = std::min(count, items_.size() - first);
+    std::copy_n(items.begin(), first_part, items_.begin() + first);
+    std::copy_n(items.begin() + first_part, count - first_part, items_.begin());
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  auto push(const T& item) -> bool { return push(std::span<const T>(&item, 1)) == 1; }
+
+  /**
+   * @brief Removes up to target.size() items (consumer only)
+   *
+   * @return Number of items copied to target
+   */
+  auto pop(std::span<T> target) -> std::size_t
+  {
+    const auto head = head_.load(std::memory_order_relaxed);
+    const auto available = tail_.load(std::memory_order_acquire) - head;
+    const auto count = std::min(target.size(), available);
+    const auto first = head & mask_;
+    const auto first_part = std::min(count, items_.size() - first);
+    std::copy_n(items_.begin() + first, first_part, target.begin());
+    std::copy_n(items_.begin(), count - first_part, target.begin() + first_part);
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  /**
+   * @brief Returns the oldest item without removing it, nullptr if empty (consumer only)
+   */
+  auto front() const -> const T*
+  {
+    const auto head = head_.load(std::memory_order_relaxed);
+    return head == tail_.load(std::memory_order_acquire) ? nullptr : &items_[head & mask_];
+  }
+
+  void pop_front() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+};
+
+}  // namespace m65dap
@@ -0,0 +1,100 @@
+#include "stack_unwinder.h"
+
+#include "opcodes.h"
+
+namespace {
+
+// JSR and BSR are three bytes long and push the address of their last byte
+const int call_instruction_size = 3;
+
+auto frame_name(int pc, const m65dap::C64DebuggerData* dbg_data) -> std::string
+{
+  if (dbg_data) {
+    if (const auto* label = dbg_data->get_label_before(pc)) {
+      return label->address == pc ? label->name : fmt::format("{}+${:X}", label->name, pc - label->address);
+    }
+    std::string segment;
+    std::string block;
+    if (dbg_data->get_block_entry(pc, &segment, &block)) {
+      return fmt::format("{}::{}", segment, block);
+    }
+  }
+  return fmt::format("${:04X}", pc);
+}
+
+auto is_known_code(int address, const m65dap::C64DebuggerData* dbg_data) -> bool
+{
+  return dbg_data && dbg_data->lookup_address(address).entry != nullptr;
+}
+
+// Checks whether the bytes before a return address are a call, returns the address of the call instruction
+auto find_call_site(int return_address, const m65dap::C64DebuggerData* dbg_data, const m65dap::MemoryReader& read_memory)
+    -> std::optional<int>
+{
+  const int call_address = return_address - call_instruction_size;
+  if (call_address < 0 || !is_known_code(call_address, dbg_data)) {
+    return {};
+  }
+
+  std::array<std::byte, call_instruction_size> instruction;
+  read_memory(call_address, instruction);
+  const auto& opcode = m65dap::get_opcode(instruction[0]);
+  const int operand = std::to_integer<int>(instruction[1]) | (std::to_integer<int>(instruction[2]) << 8);
+
+  switch (opcode.mnemonic) {
+    case m65dap::Mnemonic::JSR:
+      if (opcode.mode == m65dap::AddressingMode::Absolute && !is_known_code(operand, dbg_data)) {
+        return {};
+      }
+      return call_address;
+    case m65dap::Mnemonic::BSR: {
+      // The branch offset is relative to the last byte of the instruction
+      const int target = (call_address + 2 + static_cast<std::int16_t>(operand)) & 0xffff;
+      if (!is_known_code(target, dbg_data)) {
+        return {};
+      }
+      return call_address;
+    }
+    default:
+      return {};
+  }
+}
+
+}  // namespace
+
+namespace m65dap {
+
+auto unwind_stack(int pc,
+                  int sp,
+                  const C64DebuggerData* dbg_data,
+                  const MemoryReader& read_memory,
+                  std::size_t max_frames) -> std::vector<StackFrame>
+{
+  std::vector<StackFrame> frames{{.pc = pc, .name = frame_name(pc, dbg_data)}};
+
+  // The stack grows downwards, so everything pushed lies between SP and the end of its page
+  const int first_address = sp + 1;
+  const int end_address = (sp | 0xff) + 1;
+  if (first_address >= end_address - 1) {
+    return frames;
+  }
+  std::vector<std::byte> stack(end_address - first_address);
+  read_memory(first_address, stack);
+
+  for (std::size_t pos{0}; pos + 1 < stack.size() && frames.size() < max_frames;) {
+    // Return addresses are pushed high byte first and point to the last byte of the call
+    const int return_address = (std::to_integer<int>(stack[pos]) | (std::to_integer<int>(stack[pos + 1]) << 8)) + 1;
+    const auto call_site = find_call_site(return_address, dbg_data, read_memory);
+    if (!call_site.has_value()) {
+      ++pos;
+      continue;
+    }
+    frames.push_back({.pc = call_site.value(),
+                      .stack_address = first_address + static_cast<int>(pos),
+                      .name = frame_name(call_site.value(), dbg_data)});
+    pos += 2;
+  }
+  return frames;
+}
+
+}  // namespace m65dap
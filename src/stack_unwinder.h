@@ -0,0 +1,31 @@
+#pragma once
+
+#include "c64_debugger_data.h"
+
+namespace m65dap {
+
+struct StackFrame {
+  int pc{0};               // PC of the frame, for callers the address of their JSR/BSR instruction
+  int stack_address{-1};   // address the return address was found at, -1 for the innermost frame
+  std::string name;
+};
+
+using MemoryReader = std::function<void(int address, std::span<std::byte> target)>;
+
+/**
+ * @brief Reconstructs the call stack by scanning the stack page for return addresses pushed by JSR and BSR
+ *
+ * There are no frame pointers, so every byte pair above SP is a candidate. A candidate is accepted if the instruction
+ * it returns to is preceded by a JSR or BSR within a known block, and for calls with a direct target, if that target
+ * lies in a known block as well. Frames are named after the label preceding their PC.
+ *
+ * @param read_memory Reads target memory, the stack page is read with a single call
+ * @param max_frames Maximum number of frames returned, including the innermost one
+ */
+auto unwind_stack(int pc,
+                  int sp,
+                  const C64DebuggerData* dbg_data,
+                  const MemoryReader& read_memory,
+                  std::size_t max_frames = 32) -> std::vector<StackFrame>;
+
+}  // namespace m65dap
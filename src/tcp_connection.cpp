@@ -0,0 +1,109 @@
+#ifdef _POSIX_VERSION
+
+#include "tcp_connection.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace m65dap {
+
+namespace {
+
+// Large enough to hold a pipelined burst of memory dumps
+constexpr int socket_buffer_size = 0x40000;
+
+auto connect_socket(const addrinfo& info, int timeout_ms) -> int
+{
+  const int fd = ::socket(info.ai_family, info.ai_socktype, info.ai_protocol);
+  if (fd < 0) {
+    throw std::runtime_error(fmt::format("Open error: {}", strerror(errno)));
+  }
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  if (::fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+    const int error = errno;
+    ::close(fd);
+    throw std::runtime_error(fmt::format("Non-blocking mode error: {}", strerror(error)));
+  }
+
+  // Buffer sizes have to be set before connecting to affect the window scaling
+  const int one = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &socket_buffer_size, sizeof(socket_buffer_size));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &socket_buffer_size, sizeof(socket_buffer_size));
+  ::setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+  int error{0};
+  if (::connect(fd, info.ai_addr, info.ai_addrlen) < 0) {
+    error = errno;
+    if (error == EINPROGRESS) {
+      pollfd pfd{.fd = fd, .events = POLLOUT, .revents = 0};
+      const int ret = ::poll(&pfd, 1, timeout_ms);
+      socklen_t length = sizeof(error);
+      if (ret == 0) {
+        error = ETIMEDOUT;
+      }
+      else if (ret < 0 || ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+        error = errno;
+      }
+    }
+  }
+  if (error != 0) {
+    ::close(fd);
+    throw std::runtime_error(fmt::format("Connect error: {}", strerror(error)));
+  }
+  return fd;
+}
+
+}  // namespace
+
+auto split_host_port(std::string_view address) -> std::pair<std::string, std::string>
+{
+  const auto colon = address.rfind(':');
+  throw_if<std::invalid_argument>(colon == std::string_view::npos || colon + 1 == address.size(),
+                                  fmt::format("Missing port in '{}', expected host:port", address));
+  auto host = address.substr(0, colon);
+  if (host.starts_with('[') && host.ends_with(']')) {
+    host = host.substr(1, host.size() - 2);
+  }
+  throw_if<std::invalid_argument>(host.empty(), fmt::format("Missing host in '{}', expected host:port", address));
+  return {std::string(host), std::string(address.substr(colon + 1))};
+}
+
+TcpConnection::TcpConnection(std::string_view address, int connect_timeout_ms)
+{
+  const auto [host, port] = split_host_port(address);
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result{nullptr};
+  if (const int ret = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &result); ret != 0) {
+    throw std::runtime_error(fmt::format("Can't resolve '{}': {}", address, gai_strerror(ret)));
+  }
+  std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> addresses(result, &freeaddrinfo);
+
+  // Try all addresses the host resolves to, report the error of the last one
+  std::string last_error;
+  for (const auto* info = addresses.get(); info != nullptr; info = info->ai_next) {
+    try {
+      fd_ = connect_socket(*info, connect_timeout_ms);
+      return;
+    }
+    catch (const std::runtime_error& e) {
+      last_error = e.what();
+    }
+  }
+  throw std::runtime_error(last_error);
+}
+
+}  // namespace m65dap
+
+#endif  // _POSIX_VERSION
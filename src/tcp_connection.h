@@ -0,0 +1,26 @@
+#pragma once
+
+#include "unix_connection.h"
+
+namespace m65dap {
+
+/**
+ * @brief Connection to a monitor exposed over TCP, e.g. by Xemu or by a host a MEGA65 is attached to
+ *
+ * Nagle's algorithm is disabled, as the monitor protocol consists of short commands answered one by one.
+ */
+class TcpConnection : public UnixConnection {
+ public:
+  /**
+   * @param address "host:port", IPv6 addresses are enclosed in brackets ("[::1]:4510")
+   * @param connect_timeout_ms Time to wait for the connection to be established
+   */
+  explicit TcpConnection(std::string_view address, int connect_timeout_ms = 5000);
+};
+
+/**
+ * @brief Splits "host:port" or "[ipv6]:port" into host and port
+ */
+auto split_host_port(std::string_view address) -> std::pair<std::string, std::string>;
+
+}  // namespace m65dap
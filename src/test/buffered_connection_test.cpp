@@ -0,0 +1,91 @@
+#include "buffered_connection.h"
+
+#include <gtest/gtest.h>
+
+#include "duration.h"
+
+namespace m65dap::test {
+
+namespace {
+
+// Answers every write after a delay, fails once closed
+class DelayedEcho : public Connection {
+  std::mutex mutex_;
+  std::string pending_;
+  std::chrono::steady_clock::time_point ready_;
+  bool closed_{false};
+  int delay_ms_;
+
+ public:
+  explicit DelayedEcho(int delay_ms) : delay_ms_(delay_ms) {}
+
+  void write(std::span<const char> buffer) override
+  {
+    std::scoped_lock lock(mutex_);
+    pending_.append(buffer.begin(), buffer.end());
+    ready_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay_ms_);
+  }
+
+  auto read(int bytes_to_read, int) -> std::string override
+  {
+    std::scoped_lock lock(mutex_);
+    throw_if<std::runtime_error>(closed_, "Connection closed");
+    if (std::chrono::steady_clock::now() < ready_) {
+      return {};
+    }
+    auto result = pending_.substr(0, bytes_to_read);
+    pending_.erase(0, result.size());
+    return result;
+  }
+
+  void close()
+  {
+    std::scoped_lock lock(mutex_);
+    closed_ = true;
+  }
+};
+
+}  // namespace
+
+TEST(BufferedConnectionSuite, ReadsWhatArrives)
+{
+  auto echo = std::make_unique<DelayedEcho>(20);
+  BufferedConnection conn(std::move(echo), 16);
+
+  conn.write(std::string_view("m2000\n"));
+  EXPECT_TRUE(conn.read(6, 0).empty());
+  Duration t;
+  EXPECT_EQ(conn.read(6, 1000), "m2000\n");
+  EXPECT_LT(t.elapsed_ms(), 500);
+
+  // Replies larger than the receive buffer are passed on while being consumed
+  const std::string long_reply(100, 'x');
+  conn.write(long_reply);
+  EXPECT_EQ(conn.read(100, 1000), long_reply);
+
+  Duration timeout;
+  EXPECT_TRUE(conn.read(1, 50).empty());
+  EXPECT_GE(timeout.elapsed_ms(), 45);
+
+  const auto stats = conn.get_stats();
+  EXPECT_EQ(stats.bytes, 106);
+  EXPECT_EQ(stats.replies, 2);
+  EXPECT_GE(stats.max_reply_us, 20000);
+  EXPECT_GT(stats.ring_full_stalls, 0);
+}
+
+TEST(BufferedConnectionSuite, RethrowsReceiveErrors)
+{
+  auto echo = std::make_unique<DelayedEcho>(0);
+  auto* target = echo.get();
+  BufferedConnection conn(std::move(echo));
+
+  conn.write(std::string_view("."));
+  conn.wait_for_input(1000);
+  target->close();
+  // Data received before the error is still read
+  EXPECT_EQ(conn.read(1, 1000), ".");
+  EXPECT_THROW(conn.read(1, 1000), std::runtime_error);
+}
+
+}  // namespace m65dap::test
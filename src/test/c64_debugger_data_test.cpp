@@ -0,0 +1,108 @@
+#include "c64_debugger_data.h"
+
+#include <gtest/gtest.h>
+
+namespace m65dap::test {
+
+namespace {
+
+// Debug data with the given block entries (START,END per line) in one segment
+auto write_dbg_file(std::string_view name, std::string_view entries) -> std::filesystem::path
+{
+  const auto path = std::filesystem::temp_directory_path() / fmt::format("m65dap_{}.dbg", name);
+  std::ofstream(path) << fmt::format(R"(<C64debugger version="1.0">
+   <Sources values="INDEX,FILE">
+      0,test.asm
+   </Sources>
+   <Segment name="Code" dest="" values="START,END,FILE_IDX,LINE1,COL1,LINE2,COL2">
+      <Block name="Main">
+{}
+      </Block>
+   </Segment>
+   <Labels values="SEGMENT,ADDRESS,NAME,START,END,FILE_IDX,LINE1,COL1,LINE2,COL2">
+   </Labels>
+</C64debugger>
+)",
+                                     entries);
+  return path;
+}
+
+}  // namespace
+
+TEST(DebuggerDataSuite, LookupAddress)
+{
+  C64DebuggerData dbg_data("data/test.dbg");
+
+  auto info = dbg_data.lookup_address(0x2058);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.segment->name, "Code");
+  EXPECT_EQ(info.block->name, "Main");
+  EXPECT_EQ(info.entry->line1, 80);
+
+  info = dbg_data.lookup_address(0x2001);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.segment->name, "BasicUpstart");
+  EXPECT_EQ(info.block->name, "BasicUpstartMega65");
+  EXPECT_EQ(info.entry->line1, 8);
+
+  EXPECT_EQ(dbg_data.lookup_address(0x2000).entry, nullptr);
+  EXPECT_EQ(dbg_data.lookup_address(0x2015).entry, nullptr);
+  EXPECT_EQ(dbg_data.lookup_address(0x2261).entry, nullptr);
+}
+
+TEST(DebuggerDataSuite, LookupNestedRanges)
+{
+  const auto path = write_dbg_file("nested", R"(
+         $1010,$1012,0,1,1,1,1
+         $1000,$10ff,0,2,1,2,1
+         $1020,$1021,0,3,1,3,1
+         $1020,$1023,0,4,1,4,1
+         $1200,$1201,0,5,1,5,1)");
+  C64DebuggerData dbg_data(path);
+  std::filesystem::remove(path);
+
+  // The outer range covers the gaps between the nested ones
+  auto info = dbg_data.lookup_address(0x1050);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.entry->line1, 2);
+  info = dbg_data.lookup_address(0x1000);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.entry->line1, 2);
+
+  // Of the ranges covering an address, the first one in the file wins
+  info = dbg_data.lookup_address(0x1011);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.entry->line1, 1);
+  info = dbg_data.lookup_address(0x1020);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.entry->line1, 2);
+
+  EXPECT_EQ(dbg_data.lookup_address(0x0FFF).entry, nullptr);
+  EXPECT_EQ(dbg_data.lookup_address(0x1100).entry, nullptr);
+  info = dbg_data.lookup_address(0x1201);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.entry->line1, 5);
+}
+
+TEST(DebuggerDataSuite, LookupEqualStarts)
+{
+  const auto path = write_dbg_file("equal_starts", R"(
+         $2000,$2001,0,1,1,1,1
+         $2000,$2003,0,2,1,2,1
+         $2000,$2000,0,3,1,3,1)");
+  C64DebuggerData dbg_data(path);
+  std::filesystem::remove(path);
+
+  auto info = dbg_data.lookup_address(0x2000);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.entry->line1, 1);
+  info = dbg_data.lookup_address(0x2001);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.entry->line1, 1);
+  info = dbg_data.lookup_address(0x2003);
+  ASSERT_NE(info.entry, nullptr);
+  EXPECT_EQ(info.entry->line1, 2);
+  EXPECT_EQ(dbg_data.lookup_address(0x2004).entry, nullptr);
+}
+
+}  // namespace m65dap::test
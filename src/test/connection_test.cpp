@@ -1,11 +1,100 @@
 #include <gtest/gtest.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#endif
+
+#include "duration.h"
 #include "mock_mega65_fixture.h"
 #include "mock_xemu_fixture.h"
 #include "test_common.h"
+#include "unix_serial_connection.h"
 
 namespace m65dap::test {
 
+#if defined(__unix__) || defined(__APPLE__)
+
+namespace {
+
+// Master side of a pseudo terminal, its slave is opened as serial port
+class PtyMaster {
+  int fd_;
+
+ public:
+  PtyMaster() : fd_(posix_openpt(O_RDWR | O_NOCTTY))
+  {
+    throw_if<std::runtime_error>(fd_ < 0 || grantpt(fd_) != 0 || unlockpt(fd_) != 0, "Failed to open pty");
+  }
+  PtyMaster(const PtyMaster&) = delete;
+  auto operator=(const PtyMaster&) -> PtyMaster& = delete;
+  ~PtyMaster() { ::close(fd_); }
+
+  auto slave_name() const -> std::string { return ptsname(fd_); }
+
+  void write(std::string_view data) { ASSERT_EQ(::write(fd_, data.data(), data.size()), data.size()); }
+
+  auto read(int timeout_ms) -> std::string
+  {
+    pollfd pfd{.fd = fd_, .events = POLLIN, .revents = 0};
+    if (::poll(&pfd, 1, timeout_ms) <= 0) {
+      return {};
+    }
+    std::string data(256, '\0');
+    const auto n = ::read(fd_, data.data(), data.size());
+    data.resize(std::max<ssize_t>(n, 0));
+    return data;
+  }
+};
+
+}  // namespace
+
+TEST(UnixSerialConnectionSuite, RawModeOnPty)
+{
+  PtyMaster pty;
+  UnixSerialConnection conn(pty.slave_name());
+
+  // Output is passed on untranslated
+  conn.write(std::string_view("t0\nm2000\r"));
+  EXPECT_EQ(pty.read(1000), "t0\nm2000\r");
+
+  // Input is neither echoed nor translated or interpreted as line editing or signal characters
+  pty.write(std::string_view(".\r\n\x03\x7f\x04\x11\x13", 8));
+  EXPECT_EQ(conn.read(8), std::string(".\r\n\x03\x7f\x04\x11\x13", 8));
+  EXPECT_TRUE(pty.read(50).empty());
+
+  // Reads return what arrived once the timeout expires
+  pty.write("A");
+  Duration t;
+  EXPECT_EQ(conn.read(10, 100), "A");
+  EXPECT_GE(t.elapsed_ms(), 90);
+  EXPECT_LT(t.elapsed_ms(), 1000);
+
+  // Waiting for input returns as soon as data arrives
+  std::thread responder([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    pty.write("B");
+  });
+  Duration wait;
+  conn.wait_for_input(5000);
+  EXPECT_LT(wait.elapsed_ms(), 1000);
+  responder.join();
+  EXPECT_EQ(conn.read(1, 0), "B");
+}
+
+#ifdef __linux__
+TEST(UnixSerialConnectionSuite, CustomBaudRate)
+{
+  PtyMaster pty;
+  EXPECT_NO_THROW(UnixSerialConnection(pty.slave_name(), 4000000));
+  EXPECT_NO_THROW(UnixSerialConnection(pty.slave_name(), 115200));
+}
+#endif
+
+#endif
+
 TEST_F(MockMega65Fixture, ReadTimeout)
 {
   auto line = conn.read_line();
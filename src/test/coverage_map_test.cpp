@@ -0,0 +1,102 @@
+#include "coverage_map.h"
+
+#include <gtest/gtest.h>
+
+#include "m65_debugger.h"
+#include "mock_mega65.h"
+
+using namespace std::chrono_literals;
+
+namespace m65dap::test {
+
+TEST(CoverageMapSuite, AddPcs)
+{
+  C64DebuggerData dbg_data("data/test.dbg");
+  CoverageMap coverage(dbg_data);
+  EXPECT_EQ(coverage.total_entries(), 48);
+  EXPECT_EQ(coverage.covered_entries(), 0);
+
+  coverage.add_pc(0x2059);
+  coverage.add_pc(0x2058);
+  coverage.add_pc(0x2001);
+  coverage.add_pc(0x3000);
+
+  EXPECT_EQ(coverage.covered_entries(), 2);
+  EXPECT_TRUE(coverage.is_covered(0x2058));
+  EXPECT_TRUE(coverage.is_covered(0x2002));
+  EXPECT_FALSE(coverage.is_covered(0x205A));
+  EXPECT_FALSE(coverage.is_covered(0x3000));
+
+  coverage.reset();
+  EXPECT_EQ(coverage.covered_entries(), 0);
+}
+
+TEST(CoverageMapSuite, LcovExport)
+{
+  C64DebuggerData dbg_data("data/test.dbg");
+  CoverageMap coverage(dbg_data);
+  coverage.add_pc(0x2058);
+
+  const auto lcov = coverage.to_lcov();
+  EXPECT_TRUE(lcov.starts_with("SF:"));
+  EXPECT_NE(lcov.find("test_main.asm\nDA:8,0\n"), std::string::npos);
+  EXPECT_NE(lcov.find("DA:80,1\nDA:81,0\n"), std::string::npos);
+  EXPECT_TRUE(lcov.ends_with("LH:1\nLF:48\nend_of_record\n"));
+}
+
+TEST(CoverageMapSuite, MergeRuns)
+{
+  C64DebuggerData dbg_data("data/test.dbg");
+  CoverageMap run1(dbg_data);
+  run1.add_pc(0x2058);
+  CoverageMap run2(dbg_data);
+  run2.add_pc(0x205A);
+  run2.add_pc(0x2001);
+
+  run1.merge(run2);
+  EXPECT_EQ(run1.covered_entries(), 3);
+
+  const auto path = std::filesystem::temp_directory_path() / "m65dap_coverage_test.bin";
+  run2.save(path);
+  CoverageMap run3(dbg_data);
+  run3.add_pc(0x2016);
+  run3.merge_file(path);
+  EXPECT_EQ(run3.covered_entries(), 3);
+  EXPECT_TRUE(run3.is_covered(0x2001));
+  EXPECT_TRUE(run3.is_covered(0x2016));
+
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "M65COVER garbage";
+  }
+  EXPECT_THROW(run3.merge_file(path), std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST(CoverageMapSuite, CoverageFromTrace)
+{
+  struct EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+
+  const auto path = std::filesystem::temp_directory_path() / "m65dap_coverage_test.trace";
+  M65Debugger debugger(std::make_unique<mock::MockMega65>(), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.run_target();
+  debugger.start_trace_recording(path, 1000);
+  for (int i{0}; i < 500 && debugger.get_trace_record_count() < 20; ++i) {
+    std::this_thread::sleep_for(1ms);
+  }
+  debugger.stop_trace_recording();
+
+  // The mock steps through the main loop of the test program
+  const auto coverage = debugger.get_coverage();
+  EXPECT_EQ(coverage.covered_entries(), 5);
+  EXPECT_TRUE(coverage.is_covered(0x2056));
+  EXPECT_TRUE(coverage.is_covered(0x205E));
+  EXPECT_FALSE(coverage.is_covered(0x2055));
+
+  std::filesystem::remove(path);
+}
+
+}  // namespace m65dap::test
@@ -0,0 +1,192 @@
+#include "execution_history.h"
+
+#include <gtest/gtest.h>
+
+#include "m65_debugger.h"
+#include "mock_mega65.h"
+
+using namespace std::chrono_literals;
+
+namespace m65dap::test {
+
+namespace {
+
+auto make_record(int pc, std::array<std::uint8_t, 3> instruction) -> TraceRecord
+{
+  TraceRecord record;
+  record.pc = static_cast<std::uint16_t>(pc);
+  record.sp = 0x01FF;
+  record.flags = 0x20;  // 8 bit stack
+  record.instruction = instruction;
+  return record;
+}
+
+struct ExecutionHistoryFixture : public ::testing::Test {
+  ExecutionHistoryFixture() : memory(ExecutionHistory::memory_size) { memory[0x10] = std::byte{0x80}; }
+
+  std::vector<std::byte> memory;
+  ExecutionHistory history;
+};
+
+}  // namespace
+
+TEST_F(ExecutionHistoryFixture, StoresAndReadModifyWrite)
+{
+  history.reset(memory, 100);
+
+  auto sta = make_record(0x2000, {0x8D, 0x00, 0x30});  // STA $3000
+  sta.a = 0x42;
+  history.add_step(sta);
+  auto stx = make_record(0x2003, {0x96, 0x20, 0x00});  // STX $20,Y with B=$12, Y=$F0
+  stx.x = 0x11;
+  stx.y = 0xF0;
+  stx.b = 0x12;
+  history.add_step(stx);
+  auto ror = make_record(0x2005, {0x66, 0x10, 0x00});  // ROR $10 with carry set
+  ror.flags |= 0x01;
+  history.add_step(ror);
+  auto inw = make_record(0x2007, {0xE3, 0xFF, 0x00});  // INW $FF, wraps within the base page
+  history.add_step(inw);
+  auto sta_ind = make_record(0x2009, {0x91, 0xFF, 0x00});  // STA ($FF),Y
+  sta_ind.a = 0x99;
+  sta_ind.y = 0x02;
+  history.add_step(sta_ind);
+
+  EXPECT_EQ(history.first_index(), 100);
+  EXPECT_EQ(history.end_index(), 105);
+  EXPECT_EQ(history.write_count(), 6);
+
+  // Writes become visible after their instruction
+  EXPECT_EQ(history.memory_at(100, 0x3000), 0x00);
+  EXPECT_EQ(history.memory_at(101, 0x3000), 0x42);
+  EXPECT_EQ(history.memory_at(104, 0x3000), 0x42);
+  EXPECT_EQ(history.memory_at(102, 0x1210), 0x11);
+  EXPECT_EQ(history.memory_at(102, 0x0010), 0x80);
+  EXPECT_EQ(history.memory_at(103, 0x0010), 0xC0);
+  EXPECT_EQ(history.memory_at(104, 0x00FF), 0x01);
+  EXPECT_EQ(history.memory_at(104, 0x0000), 0x00);
+  EXPECT_EQ(history.memory_at(105, 0x0003), 0x99);
+
+  std::byte bytes[2];
+  history.read_memory(104, 0x2FFF, bytes);
+  EXPECT_EQ(bytes[0], std::byte{0x00});
+  EXPECT_EQ(bytes[1], std::byte{0x42});
+}
+
+TEST_F(ExecutionHistoryFixture, StoresToIoAreNotLogged)
+{
+  memory[0xD020] = std::byte{0x55};
+  history.reset(memory, 0);
+
+  auto sta_io = make_record(0x2000, {0x8D, 0x20, 0xD0});  // STA $D020
+  sta_io.a = 0x06;
+  history.add_step(sta_io);
+  auto sta_ram = make_record(0x2003, {0x8D, 0x00, 0xE0});  // STA $E000
+  sta_ram.a = 0x07;
+  history.add_step(sta_ram);
+
+  EXPECT_EQ(history.write_count(), 1);
+  EXPECT_EQ(history.memory_at(2, 0xD020), 0x55);
+  EXPECT_EQ(history.memory_at(2, 0xE000), 0x07);
+}
+
+TEST_F(ExecutionHistoryFixture, StackPushes)
+{
+  history.reset(memory, 0);
+
+  auto jsr = make_record(0x2010, {0x20, 0x00, 0x30});  // JSR $3000
+  history.add_step(jsr);
+  auto pha = make_record(0x3000, {0x48, 0x00, 0x00});  // PHA, 8 bit stack wraps within the stack page
+  pha.sp = 0x0100;
+  pha.a = 0x55;
+  history.add_step(pha);
+  auto phw = make_record(0x3001, {0xF4, 0x34, 0x12});  // PHW #$1234
+  phw.sp = 0x01FF;
+  history.add_step(phw);
+
+  EXPECT_EQ(history.memory_at(1, 0x01FF), 0x20);
+  EXPECT_EQ(history.memory_at(1, 0x01FE), 0x12);
+  EXPECT_EQ(history.memory_at(2, 0x0100), 0x55);
+  EXPECT_EQ(history.memory_at(3, 0x01FF), 0x12);
+  EXPECT_EQ(history.memory_at(3, 0x01FE), 0x34);
+  EXPECT_EQ(history.memory_at(1, 0x01FF), 0x20);
+}
+
+TEST_F(ExecutionHistoryFixture, FindPositions)
+{
+  history.reset(memory, 10);
+  for (int i{0}; i < 3; ++i) {
+    history.add_step(make_record(0x2000, {0xEA, 0x00, 0x00}));
+    history.add_step(make_record(0x2001, {0xEA, 0x00, 0x00}));
+  }
+
+  EXPECT_EQ(history.find_previous(0x2000, 14), 12);
+  EXPECT_EQ(history.find_previous(0x2000, 12), 10);
+  EXPECT_FALSE(history.find_previous(0x2000, 10).has_value());
+  EXPECT_EQ(history.find_next(0x2001, 11), 13);
+  EXPECT_FALSE(history.find_next(0x2001, 15).has_value());
+  EXPECT_FALSE(history.find_next(0x3000, 10).has_value());
+}
+
+TEST(ExecutionHistorySuite, StepBackThroughRecordedTrace)
+{
+  struct EventHandler : public M65Debugger::EventHandlerInterface {
+    std::atomic<int> breakpoint_count{0};
+    void handle_debugger_stopped(M65Debugger::StoppedReason reason) override
+    {
+      if (reason == M65Debugger::StoppedReason::Breakpoint) {
+        ++breakpoint_count;
+      }
+    }
+  };
+  EventHandler handler;
+
+  const auto path = std::filesystem::temp_directory_path() / "m65dap_step_back.trace";
+  M65Debugger debugger(std::make_unique<mock::MockMega65>(), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.run_target();
+  EXPECT_THROW(debugger.step_back(), std::runtime_error);
+
+  debugger.start_trace_recording(path, 1000);
+  for (int i{0}; i < 500 && debugger.get_trace_record_count() < 50; ++i) {
+    std::this_thread::sleep_for(1ms);
+  }
+  debugger.stop_trace_recording();
+  const auto end = debugger.get_trace_record_count();
+  EXPECT_FALSE(debugger.get_replay_position().has_value());
+
+  debugger.step_back();
+  EXPECT_EQ(debugger.get_replay_position(), end - 2);
+
+  // Without breakpoint, runs back to the start of the recording
+  debugger.reverse_cont();
+  EXPECT_EQ(debugger.get_replay_position(), 0u);
+  EXPECT_EQ(debugger.get_registers().pc, 0x2058);
+  EXPECT_THROW(debugger.step_back(), std::runtime_error);
+
+  // The test program stores $12 to $02 at $2058 and $34 to $03 at $205C, memory in the mock doesn't change
+  EXPECT_EQ(debugger.evaluate_expression("$02", true).result_string, "00");
+  debugger.next();
+  EXPECT_EQ(debugger.get_registers().pc, 0x205A);
+  EXPECT_EQ(debugger.evaluate_expression("$02", true).result_string, "12");
+  EXPECT_EQ(debugger.evaluate_expression("$03", true).result_string, "00");
+  debugger.next();
+  debugger.next();
+  EXPECT_EQ(debugger.get_registers().pc, 0x205E);
+  EXPECT_EQ(debugger.get_registers().a, 0x34);
+  EXPECT_EQ(debugger.evaluate_expression("$03", true).result_string, "34");
+
+  debugger.set_breakpoint("data/test_main.asm", 82);  // STA $03 at $205C
+  debugger.cont();
+  EXPECT_EQ(debugger.get_replay_position(), 7u);
+  EXPECT_EQ(debugger.get_registers().pc, 0x205C);
+  debugger.reverse_cont();
+  EXPECT_EQ(debugger.get_replay_position(), 2u);
+  EXPECT_EQ(handler.breakpoint_count, 2);
+  debugger.reverse_cont();
+  EXPECT_EQ(debugger.get_replay_position(), 0u);
+
+  std::filesystem::remove(path);
+}
+
+}  // namespace m65dap::test
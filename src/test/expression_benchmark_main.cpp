@@ -0,0 +1,75 @@
+#include "c64_debugger_data.h"
+#include "expression.h"
+
+namespace {
+
+const int iterations = 200000;
+
+const std::array<std::string_view, 6> expressions{
+    "$2001",
+    "$2001,w,4",
+    "Entry + 2,x,q",
+    "(end)",
+    "word(Entry) + end[2] as {x: byte, y: byte, hp: word}[8]",
+    "#(Entry - end) << 2 | >$1234",
+};
+
+class MemoryContext : public m65dap::ExpressionContext {
+  std::vector<std::byte> memory_ = std::vector<std::byte>(0x20000);
+
+ public:
+  void read_memory(int address, std::span<std::byte> target) override
+  {
+    std::copy_n(memory_.begin() + (address & 0xffff), target.size(), target.begin());
+  }
+
+  auto get_register(char) const -> int override { return 3; }
+};
+
+template <typename Fn>
+void measure(std::string_view name, Fn&& fn)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (int idx{0}; idx < iterations; ++idx) {
+    fn(expressions[idx % expressions.size()]);
+  }
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+  fmt::print("{:<20} {:>10.0f} expressions/s  {:>8.1f} ns/expression\n", name, iterations / elapsed.count(),
+             elapsed.count() * 1e9 / iterations);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  try {
+    const m65dap::C64DebuggerData symbols(argc > 1 ? argv[1] : "data/test.dbg");
+    MemoryContext context;
+    m65dap::ExpressionCache cache;
+    std::size_t checksum{0};
+
+    measure("parse", [&](std::string_view text) {
+      checksum += m65dap::Expression::parse(text, &symbols).byte_size();
+    });
+    measure("cached parse", [&](std::string_view text) { checksum += cache.get(text, &symbols, 1)->byte_size(); });
+
+    std::vector<m65dap::Expression> parsed;
+    for (auto text : expressions) {
+      parsed.push_back(m65dap::Expression::parse(text, &symbols));
+    }
+    int idx{0};
+    measure("evaluate", [&](std::string_view) {
+      checksum += parsed[idx++ % parsed.size()].evaluate(context).value.length();
+    });
+    measure("parse + evaluate", [&](std::string_view text) {
+      checksum += cache.get(text, &symbols, 1)->evaluate(context).value.length();
+    });
+
+    fmt::print("checksum {}\n", checksum);
+  }
+  catch (const std::exception& e) {
+    fmt::print(stderr, "Error: {}\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -1,10 +1,35 @@
 #include <gtest/gtest.h>
 
+#include "expression.h"
 #include "m65_debugger.h"
 #include "mock_mega65.h"
 
 namespace m65dap::test {
 
+namespace {
+
+class MemoryContext : public ExpressionContext {
+ public:
+  std::vector<std::byte> memory = std::vector<std::byte>(0x10000);
+  int x{0};
+
+  void read_memory(int address, std::span<std::byte> target) override
+  {
+    std::copy_n(memory.begin() + address, target.size(), target.begin());
+  }
+
+  auto get_register(char name) const -> int override { return name == 'x' ? x : 0; }
+
+  void poke(int address, std::initializer_list<int> bytes)
+  {
+    for (auto b : bytes) {
+      memory[address++] = static_cast<std::byte>(b);
+    }
+  }
+};
+
+}  // namespace
+
 struct ExpressionsFixture : public ::testing::Test, public M65Debugger::EventHandlerInterface {
   ExpressionsFixture(bool is_xemu) :
       debugger(std::make_unique<mock::MockMega65>(is_xemu), this, nullptr /*logger*/, is_xemu)
@@ -119,4 +144,135 @@ TEST_F(XemuExpressionsFixture, DirectAddressQuadFormat)
   EXPECT_EQ(eval_result.result_string, "04722009 003002FE 16E22013");
 }
 
+TEST_F(M65ExpressionsFixture, LabelArithmetic)
+{
+  auto eval_result = debugger.evaluate_expression("Entry", true);
+  EXPECT_EQ(eval_result.address, 0x2016);
+
+  eval_result = debugger.evaluate_expression("end - $12,w", true);
+  EXPECT_EQ(eval_result.address, 0x2001);
+  EXPECT_EQ(eval_result.result_string, "2009");
+
+  eval_result = debugger.evaluate_expression("#Entry - end", false);
+  EXPECT_EQ(eval_result.address, -1);
+  EXPECT_EQ(eval_result.result_string, "3");
+
+  EXPECT_THROW(debugger.evaluate_expression("NoSuchLabel", true), std::invalid_argument);
+}
+
+TEST_F(M65ExpressionsFixture, LocalVariables)
+{
+  auto locals = debugger.get_local_variables(0, true);
+  ASSERT_EQ(locals.size(), 1);
+  EXPECT_EQ(locals[0].name, "Entry");
+  EXPECT_EQ(locals[0].type, "byte");
+  EXPECT_EQ(locals[0].value, "A9");
+  EXPECT_EQ(locals[0].variables_reference, 0);
+
+  debugger.set_variable_types({{"Entry", "{op: byte, operand: word}"}});
+  locals = debugger.get_local_variables(0, true);
+  ASSERT_EQ(locals.size(), 1);
+  EXPECT_EQ(locals[0].value, "{op: A9, operand: 8541}");
+  EXPECT_EQ(locals[0].named_children, 2);
+  auto fields = debugger.get_child_variables(locals[0].variables_reference, 0, 0, true);
+  ASSERT_EQ(fields.size(), 2);
+  EXPECT_EQ(fields[1].name, "operand");
+  EXPECT_EQ(fields[1].address, 0x2017);
+  EXPECT_EQ(fields[1].value, "8541");
+
+  // Arrays are paged
+  debugger.set_variable_types({{"Entry", "byte[4096]"}});
+  locals = debugger.get_local_variables(0, true);
+  ASSERT_EQ(locals.size(), 1);
+  EXPECT_EQ(locals[0].type, "byte[4096]");
+  EXPECT_EQ(locals[0].indexed_children, 4096);
+  auto elements = debugger.get_child_variables(locals[0].variables_reference, 10, 2, true);
+  ASSERT_EQ(elements.size(), 2);
+  EXPECT_EQ(elements[0].name, "[10]");
+  EXPECT_EQ(elements[0].address, 0x2020);
+  EXPECT_EQ(elements[0].value, "A8");
+  EXPECT_EQ(elements[1].value, "4B");
+
+  EXPECT_THROW(debugger.set_variable_types({{"Entry", "long"}}), std::invalid_argument);
+  EXPECT_THROW(debugger.get_child_variables(12345, 0, 0, true), std::out_of_range);
+}
+
+TEST(ExpressionSuite, Arithmetic)
+{
+  MemoryContext ctx;
+  EXPECT_EQ(Expression::parse("#1 + 2 * 3", nullptr).evaluate(ctx, false).value, "7");
+  EXPECT_EQ(Expression::parse("#(1 + 2) * 3", nullptr).evaluate(ctx, false).value, "9");
+  EXPECT_EQ(Expression::parse("#$ff & %1010 | 0x100", nullptr).evaluate(ctx).value, "10A");
+  EXPECT_EQ(Expression::parse("#1 << 4 >> 2", nullptr).evaluate(ctx, false).value, "4");
+  EXPECT_EQ(Expression::parse("#<$1234", nullptr).evaluate(ctx).value, "34");
+  EXPECT_EQ(Expression::parse("#>$1234", nullptr).evaluate(ctx).value, "12");
+  EXPECT_EQ(Expression::parse("#-2 + 10 / 3", nullptr).evaluate(ctx, false).value, "1");
+  EXPECT_THROW(Expression::parse("#1 / 0", nullptr).evaluate(ctx), std::domain_error);
+}
+
+TEST(ExpressionSuite, SyntaxErrors)
+{
+  EXPECT_THROW(Expression::parse("", nullptr), std::invalid_argument);
+  EXPECT_THROW(Expression::parse("$", nullptr), std::invalid_argument);
+  EXPECT_THROW(Expression::parse("(1 + 2", nullptr), std::invalid_argument);
+  EXPECT_THROW(Expression::parse("1 +", nullptr), std::invalid_argument);
+  EXPECT_THROW(Expression::parse("1 ? 2", nullptr), std::invalid_argument);
+  EXPECT_THROW(Expression::parse("label", nullptr), std::invalid_argument);
+  EXPECT_THROW(Expression::parse("$1000,k", nullptr), std::invalid_argument);
+  EXPECT_THROW(Expression::parse("$1000 as long", nullptr), std::invalid_argument);
+}
+
+TEST(ExpressionSuite, DereferenceAndIndex)
+{
+  MemoryContext ctx;
+  ctx.poke(0x10, {0x00, 0x30});
+  ctx.poke(0x3000, {0x11, 0x22, 0x33, 0x44, 0x55, 0x66});
+
+  auto result = Expression::parse("(16)", nullptr).evaluate(ctx);
+  EXPECT_EQ(result.address, 0x3000);
+  EXPECT_EQ(result.value, "11");
+
+  result = Expression::parse("word($10) + 1,w", nullptr).evaluate(ctx);
+  EXPECT_EQ(result.address, 0x3001);
+  EXPECT_EQ(result.value, "3322");
+
+  result = Expression::parse("$3000[2],w", nullptr).evaluate(ctx);
+  EXPECT_EQ(result.address, 0x3004);
+  EXPECT_EQ(result.value, "6655");
+
+  ctx.x = 3;
+  result = Expression::parse("$3000,x,b,2", nullptr).evaluate(ctx);
+  EXPECT_EQ(result.address, 0x3003);
+  EXPECT_EQ(result.value, "44 55");
+
+  EXPECT_EQ(Expression::parse("#byte($3001) + quad($3000)", nullptr).evaluate(ctx).value, "44332233");
+}
+
+TEST(ExpressionSuite, StructCast)
+{
+  MemoryContext ctx;
+  ctx.poke(0x4000, {0x01, 0x02, 0x34, 0x12, 0x03, 0x04, 0x78, 0x56});
+
+  auto expr = Expression::parse("$4000 as {x: byte, y: byte, hp: word}[2]", nullptr);
+  EXPECT_EQ(expr.byte_size(), 8);
+  EXPECT_TRUE(expr.type().is_struct());
+  EXPECT_EQ(expr.evaluate(ctx).value, "{x: 01, y: 02, hp: 1234} {x: 03, y: 04, hp: 5678}");
+
+  expr = Expression::parse("$4000[1] as {pos: byte[2], hp: word}", nullptr);
+  auto result = expr.evaluate(ctx, false);
+  EXPECT_EQ(result.address, 0x4004);
+  EXPECT_EQ(result.value, "{pos: 3 4, hp: 22136}");
+}
+
+TEST(ExpressionSuite, CacheKeepsParsedExpressionsPerGeneration)
+{
+  ExpressionCache cache;
+  auto first = cache.get("$1000,w", nullptr, 1);
+  EXPECT_EQ(cache.get("$1000,w", nullptr, 1), first);
+  EXPECT_EQ(cache.size(), 1);
+
+  EXPECT_NE(cache.get("$1000,w", nullptr, 2), first);
+  EXPECT_EQ(cache.size(), 1);
+}
+
 }  // namespace m65dap::test
@@ -0,0 +1,143 @@
+#include "frame_timer.h"
+
+#include <gtest/gtest.h>
+
+#include "m65_debugger.h"
+#include "mock_mega65.h"
+#include "test_common.h"
+
+using namespace std::chrono_literals;
+
+namespace m65dap::test {
+
+TEST(FrameTimerSuite, Statistics)
+{
+  FrameTimer timer;
+  timer.start(0x2000, 0x2100, false, 312);
+  EXPECT_TRUE(timer.is_active());
+  EXPECT_EQ(timer.next_breakpoint_pc(), 0x2000);
+
+  timer.add_measurement(10);
+  EXPECT_EQ(timer.next_breakpoint_pc(), 0x2100);
+  timer.add_measurement(30);
+  EXPECT_EQ(timer.next_breakpoint_pc(), 0x2000);
+  timer.add_measurement(100);
+  timer.add_measurement(140);
+
+  const auto& report = timer.report();
+  EXPECT_EQ(report.raster_lines.count, 2);
+  EXPECT_EQ(report.raster_lines.min, 20);
+  EXPECT_EQ(report.raster_lines.max, 40);
+  EXPECT_DOUBLE_EQ(report.raster_lines.average(), 30.0);
+  EXPECT_EQ(report.cia_ticks.count, 0);
+  EXPECT_EQ(report.histogram.size(), 2);
+  EXPECT_EQ(report.histogram.at(16), 1);
+  EXPECT_EQ(report.histogram.at(40), 1);
+}
+
+TEST(FrameTimerSuite, RasterAndTimerWrapAround)
+{
+  FrameTimer timer;
+  timer.start(0x2000, 0x2100, true, 312);
+  timer.add_measurement(300, 0x0010);
+  timer.add_measurement(5, 0xFFF0);
+
+  const auto& report = timer.report();
+  EXPECT_EQ(report.raster_lines.min, 17);
+  EXPECT_EQ(report.cia_ticks.count, 1);
+  EXPECT_EQ(report.cia_ticks.min, 0x20);
+}
+
+TEST(FrameTimerSuite, NoFramesReport)
+{
+  FrameTimer timer;
+  EXPECT_EQ(timer.report().to_string(), "No frames measured");
+}
+
+TEST(FrameTimerSuite, MeasureRunningTarget)
+{
+  struct EventHandler : public M65Debugger::EventHandlerInterface {
+    bool stopped{false};
+    void handle_debugger_stopped(M65Debugger::StoppedReason) override { stopped = true; }
+  };
+  EventHandler handler;
+
+  M65Debugger debugger(std::make_unique<mock::MockMega65>(), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.run_target();
+  debugger.start_frame_timing("Entry", "$205A", true);
+
+  FrameTimer::Report report;
+  for (int i{0}; i < 500 && report.raster_lines.count < 5; ++i) {
+    std::this_thread::sleep_for(1ms);
+    report = debugger.get_frame_timing_report();
+  }
+  debugger.stop_frame_timing();
+
+  ASSERT_GE(report.raster_lines.count, 5);
+  // The mock advances the raster by 37 lines and CIA timer A by 2345 ticks per breakpoint hit
+  EXPECT_EQ(report.raster_lines.min, 37);
+  EXPECT_EQ(report.raster_lines.max, 37);
+  EXPECT_EQ(report.cia_ticks.min, 2345);
+  EXPECT_EQ(report.cia_ticks.max, 2345);
+  EXPECT_FALSE(handler.stopped);
+}
+
+TEST(FrameTimerSuite, NoReadSensitiveRegisterRead)
+{
+  struct EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  std::vector<std::string> commands;
+
+  {
+    M65Debugger debugger(std::make_unique<CommandRecorder>(commands), &handler);
+    debugger.set_target("data/test.prg");
+    debugger.run_target();
+    debugger.start_frame_timing("Entry", "$205A", true);
+    for (int i{0}; i < 500 && debugger.get_frame_timing_report().raster_lines.count < 5; ++i) {
+      std::this_thread::sleep_for(1ms);
+    }
+    debugger.stop_frame_timing();
+  }
+
+  // Raster, PAL/NTSC and CIA timer are read with windows ending ahead of the collision and interrupt registers
+  std::vector<int> sensitive;
+  for (const auto& bank : get_register_banks()) {
+    for (const int chip : bank.chip_offsets) {
+      for (const int reg : bank.read_sensitive) {
+        sensitive.push_back(io_personality_base + chip + reg);
+      }
+    }
+  }
+  int io_reads{0};
+  for (const auto& command : commands) {
+    std::istringstream lines(command);
+    std::string line;
+    while (std::getline(lines, line)) {
+      if (!line.starts_with('m') && !line.starts_with('M')) {
+        continue;
+      }
+      const int start = std::stoi(line.substr(1), nullptr, 16);
+      const int end = start + (line.starts_with('m') ? 16 : 256);
+      io_reads += start >= io_personality_base && start < io_personality_base + 0x1000;
+      for (const int reg : sensitive) {
+        EXPECT_FALSE(reg >= start && reg < end) << "Read of " << line << " covers read sensitive register";
+      }
+    }
+  }
+  EXPECT_GE(io_reads, 5);
+}
+
+TEST(FrameTimerSuite, UnknownLocation)
+{
+  struct EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+
+  M65Debugger debugger(std::make_unique<mock::MockMega65>(), &handler);
+  debugger.set_target("data/test.prg");
+  EXPECT_THROW(debugger.start_frame_timing("NoSuchLabel", "$205A", false), std::runtime_error);
+}
+
+}  // namespace m65dap::test
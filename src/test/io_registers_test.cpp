@@ -0,0 +1,97 @@
+#include "io_registers.h"
+
+#include <gtest/gtest.h>
+
+namespace m65dap::test {
+
+namespace {
+
+auto find_bank(std::string_view name) -> const RegisterBank&
+{
+  const auto banks = get_register_banks();
+  const auto it = std::find_if(banks.begin(), banks.end(), [&](const auto& bank) { return bank.name == name; });
+  EXPECT_NE(it, banks.end());
+  return *it;
+}
+
+auto find_register(const std::vector<RegisterValue>& registers, std::string_view name) -> const RegisterValue&
+{
+  const auto it = std::find_if(registers.begin(), registers.end(), [&](const auto& reg) { return reg.name == name; });
+  EXPECT_NE(it, registers.end());
+  return *it;
+}
+
+// Reads the planned windows from a $D000-$DFFF image
+auto read_windows(std::span<const int> plan, const std::vector<std::byte>& io) -> std::vector<std::byte>
+{
+  std::vector<std::byte> windows;
+  for (const int start : plan) {
+    windows.insert(windows.end(), io.begin() + start, io.begin() + start + register_window_size);
+  }
+  return windows;
+}
+
+}  // namespace
+
+TEST(IoRegistersSuite, PlanAvoidsReadSensitiveRegisters)
+{
+  for (const auto& bank : get_register_banks()) {
+    for (const int start : plan_register_reads(bank)) {
+      const int end = start + register_window_size;
+      EXPECT_GE(start, 0) << bank.name;
+      EXPECT_LE(end, 0x1000) << bank.name;
+      for (const int sensitive : {0x01E, 0x01F, 0xC0B, 0xC0D, 0xD0B, 0xD0D}) {
+        EXPECT_FALSE(sensitive >= start && sensitive < end) << bank.name << " window at " << start;
+      }
+    }
+  }
+
+  // The collision registers split the VIC-II registers, the second window is moved back to end in front of them
+  const auto vic_plan = plan_register_reads(find_bank("VIC-IV"));
+  ASSERT_GE(vic_plan.size(), 3);
+  EXPECT_EQ(vic_plan[0], 0x000);
+  EXPECT_EQ(vic_plan[1], 0x00E);
+  EXPECT_EQ(vic_plan[2], 0x020);
+
+  const auto cia_plan = plan_register_reads(find_bank("CIA"));
+  EXPECT_EQ(cia_plan, (std::vector<int>{0xBFB, 0xC0E, 0xCFB, 0xD0E}));
+}
+
+TEST(IoRegistersSuite, DecodeFields)
+{
+  std::vector<std::byte> io(0x1000);
+  io[0x011] = std::byte{0x9B};  // RC8, BLNK, RSEL, YSCL 3
+  io[0x012] = std::byte{0x37};
+  io[0x060] = std::byte{0x00};
+  io[0x061] = std::byte{0x08};
+  io[0x062] = std::byte{0x04};
+  io[0x063] = std::byte{0xF0};  // upper nibble isn't part of SCRNPTR
+  io[0xD04] = std::byte{0x34};
+  io[0xD05] = std::byte{0x12};
+
+  const auto& vic = find_bank("VIC-IV");
+  const auto vic_plan = plan_register_reads(vic);
+  const auto vic_registers = decode_registers(vic, vic_plan, read_windows(vic_plan, io));
+  EXPECT_EQ(find_register(vic_registers, "YSCL").value, 3);
+  EXPECT_EQ(find_register(vic_registers, "RSEL").value, 1);
+  EXPECT_EQ(find_register(vic_registers, "BMM").value, 0);
+  EXPECT_EQ(find_register(vic_registers, "RC8").value, 1);
+  EXPECT_EQ(find_register(vic_registers, "RC").value, 0x37);
+  EXPECT_EQ(find_register(vic_registers, "RC").address, 0xD012);
+  EXPECT_EQ(find_register(vic_registers, "SCRNPTR").value, 0x40800);
+  EXPECT_FALSE(find_register(vic_registers, "SSC").value.has_value());
+
+  const auto& cia = find_bank("CIA");
+  const auto cia_plan = plan_register_reads(cia);
+  const auto cia_registers = decode_registers(cia, cia_plan, read_windows(cia_plan, io));
+  EXPECT_EQ(cia_registers.size(), 2 * cia.fields.size());
+  EXPECT_EQ(find_register(cia_registers, "CIA2 TA").value, 0x1234);
+  EXPECT_EQ(find_register(cia_registers, "CIA2 TA").address, 0xDD04);
+  EXPECT_EQ(find_register(cia_registers, "CIA1 CRA").value, 0);
+  EXPECT_FALSE(find_register(cia_registers, "CIA1 ICR").value.has_value());
+  EXPECT_FALSE(find_register(cia_registers, "CIA1 TOD HR").value.has_value());
+
+  EXPECT_THROW(decode_registers(cia, cia_plan, std::span(io).first(16)), std::invalid_argument);
+}
+
+}  // namespace m65dap::test
@@ -3,6 +3,8 @@
 #include <gtest/gtest.h>
 
 #include "mock_mega65.h"
+#include "tcp_mock_server.h"
+#include "test_common.h"
 
 namespace m65dap::test {
 
@@ -11,6 +13,114 @@ struct DebuggerFixture : public ::testing::Test, public M65Debugger::EventHandle
   M65Debugger debugger;
 };
 
+// Lets the test change target memory behind the back of the debugger, as the running program would
+class ChangingTarget : public Connection {
+  mock::MockMega65 mock_;
+  std::mutex mutex_;
+
+ public:
+  void write(std::span<const char> buffer) override
+  {
+    std::scoped_lock lock(mutex_);
+    mock_.write(buffer);
+  }
+
+  auto read(int bytes_to_read, int timeout_ms) -> std::string override
+  {
+    std::scoped_lock lock(mutex_);
+    return mock_.read(bytes_to_read, timeout_ms);
+  }
+
+  void store(std::string_view cmd)
+  {
+    std::scoped_lock lock(mutex_);
+    mock_.write(cmd);
+    mock_.flush_rx_buffers();
+  }
+};
+
+// Stream mock counting the bytes written, fails a write once the armed limit would be exceeded
+class InterruptedTarget : public Connection {
+  MockMega65Stream stream_;
+  std::size_t written_{0};
+  std::optional<std::size_t> interrupt_after_;
+
+ public:
+  void write(std::span<const char> buffer) override
+  {
+    if (interrupt_after_.has_value()) {
+      if (buffer.size() > interrupt_after_.value()) {
+        interrupt_after_.reset();
+        throw std::runtime_error("Connection interrupted");
+      }
+      interrupt_after_.value() -= buffer.size();
+    }
+    written_ += buffer.size();
+    stream_.write(buffer);
+  }
+
+  auto read(int bytes_to_read, int timeout_ms) -> std::string override
+  {
+    return stream_.read(bytes_to_read, timeout_ms);
+  }
+
+  void interrupt_after(std::size_t bytes) { interrupt_after_ = bytes; }
+  auto written() const -> std::size_t { return written_; }
+};
+
+// Mock shared by the connections to it, keeping its state like a MEGA65 whose USB cable glitched
+struct SharedTarget {
+  mock::MockMega65 mock;
+  std::mutex mutex;
+  std::vector<std::string> commands;
+};
+
+// Connection to a SharedTarget that fails once cut
+class CuttableLink : public Connection {
+  std::shared_ptr<SharedTarget> target_;
+  std::atomic<bool> cut_{false};
+  std::string cut_before_;  // guarded by the mutex of the target, like cut_after_
+  std::string cut_after_;
+
+ public:
+  explicit CuttableLink(std::shared_ptr<SharedTarget> target) : target_(std::move(target)) {}
+
+  void write(std::span<const char> buffer) override
+  {
+    throw_if<connection_error>(cut_, "Link cut");
+    std::scoped_lock lock(target_->mutex);
+    const std::string command(buffer.begin(), buffer.end());
+    // The command is lost before it reaches the target
+    cut_ = command == cut_before_;
+    throw_if<connection_error>(cut_, "Link cut");
+    target_->commands.push_back(command);
+    target_->mock.write(buffer);
+    // The command reaches the target, but its reply is lost
+    cut_ = command == cut_after_;
+  }
+
+  auto read(int bytes_to_read, int timeout_ms) -> std::string override
+  {
+    throw_if<connection_error>(cut_, "Link cut");
+    std::scoped_lock lock(target_->mutex);
+    return target_->mock.read(bytes_to_read, timeout_ms);
+  }
+
+  void cut() { cut_ = true; }
+
+  void cut_before(std::string command)
+  {
+    std::scoped_lock lock(target_->mutex);
+    cut_before_ = std::move(command);
+  }
+
+  void cut_after(std::string command)
+  {
+    std::scoped_lock lock(target_->mutex);
+    cut_after_ = std::move(command);
+  }
+};
+
 TEST(DebuggerSuite, CreateAndDestroyDebugger)
 {
   class EventHandler : public M65Debugger::EventHandlerInterface {
@@ -32,4 +142,454 @@ TEST_F(DebuggerFixture, SetBreakpoint)
   debugger.set_breakpoint(src_path, 79);
 }
 
+TEST_F(DebuggerFixture, ReadMemory)
+{
+  debugger.set_target("data/test.prg");
+
+  std::ifstream prg_file("data/test.prg", std::ios::binary);
+  std::vector<char> prg((std::istreambuf_iterator<char>(prg_file)), std::istreambuf_iterator<char>());
+  ASSERT_GT(prg.size(), 2);
+  const int load_address = static_cast<std::uint8_t>(prg[0]) | (static_cast<std::uint8_t>(prg[1]) << 8);
+  auto expected_at = [&](int address) {
+    const int offset = address - load_address + 2;
+    return offset >= 2 && offset < static_cast<int>(prg.size()) ? std::byte(prg[offset]) : std::byte{0};
+  };
+
+  // Served by the memory cache
+  std::vector<std::byte> small(0x234);
+  debugger.read_memory(0x1F80, small);
+  for (int idx{0}; idx < static_cast<int>(small.size()); ++idx) {
+    ASSERT_EQ(small[idx], expected_at(0x1F80 + idx)) << fmt::format("at ${:X}", 0x1F80 + idx);
+  }
+
+  // Streamed in chunks, not ending on a line boundary
+  std::vector<std::byte> large(0x9009);
+  debugger.read_memory(0x1F00, large);
+  for (int idx{0}; idx < static_cast<int>(large.size()); ++idx) {
+    ASSERT_EQ(large[idx], expected_at(0x1F00 + idx)) << fmt::format("at ${:X}", 0x1F00 + idx);
+  }
+
+  EXPECT_THROW(debugger.read_memory(address_space_size - 8, small), std::out_of_range);
+}
+
+TEST(DebuggerSuite, ClampToAddressSpace)
+{
+  auto range = clamp_to_address_space(0x2000, 16);
+  EXPECT_EQ(range.first, 0x2000);
+  EXPECT_EQ(range.size, 16);
+  EXPECT_EQ(range.unreadable, 0);
+
+  // Bytes behind the end of the address space are unreadable
+  range = clamp_to_address_space(address_space_size - 4, 16);
+  EXPECT_EQ(range.first, address_space_size - 4);
+  EXPECT_EQ(range.size, 4);
+  EXPECT_EQ(range.unreadable, 12);
+
+  // A range entirely behind the end is unreadable as a whole, not up to its end
+  range = clamp_to_address_space(std::int64_t{address_space_size} + 10, 5);
+  EXPECT_EQ(range.first, address_space_size);
+  EXPECT_EQ(range.size, 0);
+  EXPECT_EQ(range.unreadable, 5);
+}
+
+TEST_F(DebuggerFixture, SearchMemory)
+{
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  // Small ranges are searched in the memory cache
+  EXPECT_EQ(debugger.search_memory(0x2000, 0x20FF, SearchPattern::parse("A9 41 85 00"), 10),
+            (std::vector<int>{0x2016}));
+
+  // Matches spanning two transferred chunks are found, and reported per chunk
+  const auto marker = std::to_array({std::byte{0xDE}, std::byte{0xAD}, std::byte{0xBE}, std::byte{0xEF}});
+  debugger.write_memory(0x13FFE, marker);
+  debugger.write_memory(0x1A000, marker);
+  std::vector<int> reported;
+  const auto matches = debugger.search_memory(0x10000, 0x1FFFF, SearchPattern::parse("DE AD BE EF"), 10,
+                                              [&](std::span<const int> chunk_matches) {
+                                                EXPECT_EQ(chunk_matches.size(), 1);
+                                                reported.insert(reported.end(), chunk_matches.begin(),
+                                                                chunk_matches.end());
+                                              });
+  EXPECT_EQ(matches, (std::vector<int>{0x13FFE, 0x1A000}));
+  EXPECT_EQ(reported, matches);
+
+  EXPECT_EQ(debugger.search_memory(0x10000, 0x1FFFF, SearchPattern::parse("DE AD BE EF"), 1).size(), 1);
+  EXPECT_THROW(debugger.search_memory(0x2000, 0x1FFF, SearchPattern::parse("00"), 1), std::out_of_range);
+}
+
+TEST(DebuggerSuite, WriteMemory)
+{
+  struct EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  std::vector<std::string> commands;
+
+  M65Debugger debugger(std::make_unique<CommandRecorder>(commands), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  std::vector<std::byte> before(0x20);
+  debugger.read_memory(0x3000, before);
+
+  commands.clear();
+  const std::array<std::byte, 3> small{std::byte{0x11}, std::byte{0x22}, std::byte{0x33}};
+  debugger.write_memory(0x3001, small);
+  ASSERT_EQ(commands.size(), 1);
+  EXPECT_EQ(commands[0], "s3001 11 22 33\n");
+
+  // Served from the updated cache line
+  commands.clear();
+  std::vector<std::byte> after(0x20);
+  debugger.read_memory(0x3000, after);
+  EXPECT_TRUE(commands.empty());
+  EXPECT_EQ(after[0], std::byte{0x00});
+  EXPECT_EQ(after[1], std::byte{0x11});
+  EXPECT_EQ(after[3], std::byte{0x33});
+
+  // Long spans are sent as binary load, which must not cross a 64 KB bank boundary
+  std::vector<std::byte> large(0x120);
+  std::iota(reinterpret_cast<std::uint8_t*>(large.data()), reinterpret_cast<std::uint8_t*>(large.data() + 0x100), 0);
+  commands.clear();
+  debugger.write_memory(0xFFE8, large);
+  ASSERT_EQ(commands.size(), 4);
+  EXPECT_EQ(commands[0], "sFFE8 00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F\n");
+  EXPECT_EQ(commands[1], "sFFF8 10 11 12 13 14 15 16 17 18 19 1A 1B 1C 1D 1E 1F\n");
+  EXPECT_EQ(commands[2], "l10008 108\n");
+  EXPECT_EQ(commands[3].size(), 0x100);
+
+  debugger.pause();  // invalidates the cache
+  std::vector<std::byte> readback(large.size());
+  debugger.read_memory(0xFFE8, readback);
+  EXPECT_EQ(readback, large);
+
+  // Expressions take one value per element
+  EXPECT_EQ(debugger.evaluate_expression("$3010,w,2", true).result_string, "0000 0000");
+  commands.clear();
+  EXPECT_EQ(debugger.set_expression("$3010,w,2", "1234 $ABCD").result_string, "1234 ABCD");
+  ASSERT_EQ(commands.size(), 1);
+  EXPECT_EQ(commands[0], "s3010 34 12 CD AB\n");
+  EXPECT_EQ(debugger.set_expression("$3010", "%1010").result_string, "0A");
+  EXPECT_THROW(debugger.set_expression("$3010,w,2", "1234"), std::invalid_argument);
+  EXPECT_THROW(debugger.set_expression("$3010", "100"), std::out_of_range);
+  EXPECT_THROW(debugger.set_expression("$3010", "xyz"), std::invalid_argument);
+}
+
+TEST(DebuggerSuite, WatchPrefetch)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  std::vector<std::string> commands;
+
+  M65Debugger debugger(std::make_unique<CommandRecorder>(commands), &handler);
+  // No working set of an earlier run, so only the memory read below is fetched ahead
+  debugger.set_working_set_dir({});
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  const std::array<std::byte, 2> pointer{std::byte{0x00}, std::byte{0x50}};
+  debugger.write_memory(0x10, pointer);
+  const std::array<std::string_view, 3> watches{"$3000,w", "$4000,q", "(16)"};
+  for (auto watch : watches) {
+    debugger.evaluate_expression(watch, true, true);
+  }
+
+  // One batch for the watched memory and the pointer, one for the memory the pointer refers to. The pointer is
+  // moved out of the working set learned during this stop, which is fetched with the first batch.
+  const std::array<std::byte, 2> moved_pointer{std::byte{0x00}, std::byte{0x60}};
+  debugger.write_memory(0x10, moved_pointer);
+  commands.clear();
+  debugger.pause();
+  auto is_memory_read = [](const std::string& cmd) { return cmd.starts_with('M') || cmd.starts_with('m'); };
+  EXPECT_EQ(std::count_if(commands.begin(), commands.end(), is_memory_read), 2);
+
+  commands.clear();
+  for (auto watch : watches) {
+    debugger.evaluate_expression(watch, true, true);
+  }
+  EXPECT_TRUE(commands.empty());
+}
+
+TEST(DebuggerSuite, StopWarmup)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  std::vector<std::string> commands;
+
+  M65Debugger debugger(std::make_unique<CommandRecorder>(commands), &handler);
+  debugger.set_working_set_dir({});
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  // Stack, base page and the code at PC are fetched when the target stops
+  const auto registers = debugger.get_registers();
+  commands.clear();
+  std::vector<std::byte> data(0x10);
+  debugger.read_memory(registers.sp & 0xff00, data);
+  debugger.read_memory((registers.b & 0xff) << 8, data);
+  debugger.read_memory(registers.pc, data);
+  EXPECT_TRUE(commands.empty());
+
+  // Memory read during a stop is fetched ahead at the next one
+  debugger.read_memory(0x7000, data);
+  debugger.pause();
+  commands.clear();
+  debugger.read_memory(0x7000, data);
+  EXPECT_TRUE(commands.empty());
+
+  const auto metrics = debugger.get_stop_metrics();
+  EXPECT_GE(metrics.warmup_lines, 3);
+  EXPECT_EQ(metrics.missed_lines, 0);
+}
+
+TEST(DebuggerSuite, IoRegisterBanks)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  std::vector<std::string> commands;
+
+  M65Debugger debugger(std::make_unique<CommandRecorder>(commands), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  const auto banks = get_register_banks();
+  const auto cia_idx = std::distance(
+      banks.begin(), std::find_if(banks.begin(), banks.end(), [](const auto& bank) { return bank.name == "CIA"; }));
+
+  // One batch of single line reads per bank and stop, none of them touching the interrupt control registers
+  commands.clear();
+  const auto registers = debugger.get_io_registers(cia_idx, true);
+  EXPECT_EQ(registers.size(), 2 * banks[cia_idx].fields.size());
+  EXPECT_EQ(commands.size(), 1);
+  EXPECT_EQ(commands.front(), "mFFD3BFB\nmFFD3C0E\nmFFD3CFB\nmFFD3D0E\n");
+
+  const auto icr = std::find_if(registers.begin(), registers.end(), [](const auto& v) { return v.name == "CIA1 ICR"; });
+  ASSERT_NE(icr, registers.end());
+  EXPECT_EQ(icr->value, "(not read, changes when read)");
+  EXPECT_EQ(icr->address, io_personality_base + 0xC0D);
+
+  commands.clear();
+  debugger.get_io_registers(cia_idx, false);
+  EXPECT_TRUE(commands.empty());
+
+  debugger.pause();
+  commands.clear();
+  debugger.get_io_registers(cia_idx, true);
+  EXPECT_EQ(commands.size(), 1);
+
+  EXPECT_THROW(debugger.get_io_registers(banks.size(), true), std::out_of_range);
+}
+
+TEST(DebuggerSuite, MemoryChangeRanges)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+   public:
+    std::vector<std::pair<int, int>> changed;
+
+    void handle_memory_changed(std::span<const std::pair<int, int>> ranges) override
+    {
+      changed.assign(ranges.begin(), ranges.end());
+    }
+  };
+  EventHandler handler;
+  auto connection = std::make_unique<ChangingTarget>();
+  auto* target = connection.get();
+
+  M65Debugger debugger(std::move(connection), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  // The watched word is compared byte by byte, the memory read by the client per line
+  std::vector<std::byte> data(16);
+  debugger.evaluate_expression("$3010,w", true, true);
+  debugger.read_memory(0x5000, data);
+  debugger.pause();
+  debugger.evaluate_expression("$3010,w", true, true);
+  debugger.read_memory(0x5000, data);
+
+  target->store("s3011 AA\n");
+  target->store("s5020 55 56\n");
+  handler.changed.clear();
+  debugger.pause();
+  EXPECT_EQ(handler.changed, (std::vector<std::pair<int, int>>{{0x3011, 0x3011}, {0x5000, 0x50FF}}));
+
+  // Nothing changed since, and writes of the debugger itself are not reported
+  const std::array<std::byte, 1> value{std::byte{0x12}};
+  debugger.evaluate_expression("$3010,w", true, true);
+  debugger.read_memory(0x5000, data);
+  debugger.write_memory(0x3010, value);
+  handler.changed.clear();
+  debugger.pause();
+  EXPECT_TRUE(handler.changed.empty());
+}
+
+TEST(DebuggerSuite, ReceiveThread)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  auto connection = std::make_unique<BufferedConnection>(std::make_unique<ChangingTarget>());
+
+  M65Debugger debugger(std::move(connection), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  const std::array<std::byte, 3> values{std::byte{0x11}, std::byte{0x22}, std::byte{0x33}};
+  debugger.write_memory(0x4000, values);
+  std::array<std::byte, 3> readback{};
+  debugger.read_memory(0x4000, readback);
+  EXPECT_EQ(readback, values);
+
+  const auto stats = debugger.get_receive_stats();
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_GT(stats->bytes, 0);
+  EXPECT_GT(stats->replies, 0);
+}
+
+TEST(DebuggerSuite, EscapeHangingLoad)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  auto connection = std::make_unique<InterruptedTarget>();
+  auto* target = connection.get();
+  // Load command left by a previous session, waiting for 4K more bytes
+  connection->write(std::string("l2000 3000\n") + std::string(100, 'x'));
+
+  M65Debugger debugger(std::move(connection), &handler);
+  EXPECT_LT(target->written(), 0x2000);
+  std::array<std::byte, 3> readback{};
+  debugger.read_memory(0x2000, readback);
+  EXPECT_EQ(readback, (std::array<std::byte, 3>{std::byte{'x'}, std::byte{'x'}, std::byte{'x'}}));
+}
+
+TEST(DebuggerSuite, CompleteInterruptedLoad)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  auto connection = std::make_unique<InterruptedTarget>();
+  auto* target = connection.get();
+  M65Debugger debugger(std::move(connection), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  // Fails after the load command and the first block of data
+  target->interrupt_after(std::string_view("l8000 A000\n").size() + 0x1000);
+  const std::vector<std::byte> data(0x2000, std::byte{0x5A});
+  EXPECT_THROW(debugger.write_memory(0x8000, data), std::runtime_error);
+
+  // The missing data is sent before the next command, which is answered as usual
+  const auto written = target->written();
+  std::array<std::byte, 3> readback{};
+  debugger.read_memory(0xA000, readback);
+  EXPECT_EQ(readback, (std::array<std::byte, 3>{}));
+  EXPECT_LT(target->written() - written, 0x1100);
+}
+
+TEST(DebuggerSuite, ReconnectRestoresSession)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  auto target = std::make_shared<SharedTarget>();
+  auto connection = std::make_unique<CuttableLink>(target);
+  auto* link = connection.get();
+  M65Debugger debugger(std::move(connection), &handler, nullptr, false, false, true,
+                       [target] { return std::make_unique<CuttableLink>(target); });
+  debugger.set_target("data/test.prg");
+  debugger.set_breakpoint("data/test_main.asm", 82);
+  debugger.pause();
+  std::array<std::byte, 16> code{};
+  debugger.read_memory(0x2000, code);
+
+  // The request hitting the cut link is run again after reconnecting
+  link->cut();
+  std::array<std::byte, 3> readback{};
+  debugger.read_memory(0x5000, readback);
+  EXPECT_EQ(debugger.get_reconnect_count(), 1);
+  {
+    std::scoped_lock lock(target->mutex);
+    const auto& commands = target->commands;
+    EXPECT_NE(std::find(commands.begin(), commands.end(), "b205C\n"), commands.end());
+    EXPECT_NE(std::find(commands.begin(), commands.end(), "t1\n"), commands.end());
+    target->commands.clear();
+  }
+
+  // Still stopped at the same PC, so the cached memory is kept
+  std::array<std::byte, 16> cached{};
+  debugger.read_memory(0x2000, cached);
+  EXPECT_EQ(cached, code);
+  std::scoped_lock lock(target->mutex);
+  EXPECT_TRUE(target->commands.empty());
+}
+
+TEST(DebuggerSuite, ReconnectRunsStepOnce)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  auto target = std::make_shared<SharedTarget>();
+  auto connection = std::make_unique<CuttableLink>(target);
+  CuttableLink* link = connection.get();
+  M65Debugger debugger(std::move(connection), &handler, nullptr, false, false, true, [target, &link] {
+    auto connection = std::make_unique<CuttableLink>(target);
+    link = connection.get();
+    return connection;
+  });
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+  auto count_steps = [&] {
+    std::scoped_lock lock(target->mutex);
+    return std::count(target->commands.begin(), target->commands.end(), "\n");
+  };
+
+  // A step failing before it was sent is run once the connection is restored
+  const int pc = debugger.get_pc();
+  link->cut_before("\n");
+  debugger.next();
+  EXPECT_EQ(debugger.get_reconnect_count(), 1);
+  EXPECT_EQ(count_steps(), 1);
+  EXPECT_NE(debugger.get_pc(), pc);
+
+  // A step whose reply was lost isn't sent again, the request fails after the session was restored
+  link->cut_after("\n");
+  EXPECT_THROW(debugger.next(), connection_error);
+  EXPECT_EQ(debugger.get_reconnect_count(), 2);
+  EXPECT_EQ(count_steps(), 2);
+
+  // Reads are run again
+  link->cut_after("t1\n");
+  debugger.pause();
+  EXPECT_EQ(debugger.get_reconnect_count(), 3);
+  std::vector<std::byte> readback(0x2000);
+  link->cut();
+  debugger.read_memory(0x5000, readback);
+  EXPECT_EQ(debugger.get_reconnect_count(), 4);
+}
+
+TEST(DebuggerSuite, LostLinkFailsRequests)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  auto connection = std::make_unique<CuttableLink>(std::make_shared<SharedTarget>());
+  auto* link = connection.get();
+  M65Debugger debugger(std::move(connection), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  // Without a way to reconnect, requests fail instead of terminating the main loop. Large reads bypass the cache,
+  // which may have been warmed up with the memory read by other tests.
+  link->cut();
+  std::vector<std::byte> readback(0x2000);
+  EXPECT_THROW(debugger.read_memory(0x5000, readback), connection_error);
+  EXPECT_THROW(debugger.read_memory(0x5000, readback), connection_error);
+  EXPECT_EQ(debugger.get_reconnect_count(), 0);
+}
+
 }  // namespace m65dap::test
@@ -0,0 +1,79 @@
+#include "memory_search.h"
+
+#include <gtest/gtest.h>
+
+namespace m65dap::test {
+
+namespace {
+
+auto to_bytes(std::initializer_list<int> values) -> std::vector<std::byte>
+{
+  std::vector<std::byte> result;
+  for (const int v : values) {
+    result.push_back(static_cast<std::byte>(v));
+  }
+  return result;
+}
+
+auto find_all(const SearchPattern& pattern, std::span<const std::byte> data) -> std::vector<std::size_t>
+{
+  std::vector<std::size_t> result;
+  std::size_t pos{0};
+  while (const auto match = pattern.find(data, pos)) {
+    result.push_back(match.value());
+    pos = match.value() + 1;
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(MemorySearchSuite, ParsePattern)
+{
+  const auto data = to_bytes({0x12, 0x52, 0x45, 0x41, 0x44, 0x59, 0x2E, 0x00, 0x4A, 0x3F});
+  EXPECT_EQ(SearchPattern::parse("\"ready.\" 00").find(data), 1);
+  EXPECT_EQ(SearchPattern::parse("\"READY.\",00").find(data), 1);
+  EXPECT_EQ(SearchPattern::parse("4? ?F").find(data), 8);
+  EXPECT_EQ(SearchPattern::parse("45 ?? 44").find(data), 2);
+  EXPECT_EQ(SearchPattern::parse("45 ? 44").find(data), 2);
+  EXPECT_FALSE(SearchPattern::parse("45 44").find(data).has_value());
+
+  EXPECT_THROW(SearchPattern::parse(""), std::invalid_argument);
+  EXPECT_THROW(SearchPattern::parse("4"), std::invalid_argument);
+  EXPECT_THROW(SearchPattern::parse("123"), std::invalid_argument);
+  EXPECT_THROW(SearchPattern::parse("XY"), std::invalid_argument);
+  EXPECT_THROW(SearchPattern::parse("\"open"), std::invalid_argument);
+}
+
+TEST(MemorySearchSuite, ShortAndLongPatterns)
+{
+  std::vector<std::byte> data(0x1000);
+  for (std::size_t idx{0}; idx < data.size(); ++idx) {
+    data[idx] = static_cast<std::byte>(idx * 7);
+  }
+  const auto code = to_bytes({0xA9, 0x00, 0x8D, 0x20, 0xD0});
+  std::copy(code.begin(), code.end(), data.begin() + 0x123);
+  std::copy(code.begin(), code.end(), data.begin() + 0xFFB);
+
+  // Located with memchr
+  EXPECT_EQ(find_all(SearchPattern::parse("8D 20"), data), (std::vector<std::size_t>{0x125, 0xFFD}));
+  EXPECT_EQ(find_all(SearchPattern::parse("?? 20 D0"), data), (std::vector<std::size_t>{0x125, 0xFFD}));
+  // Horspool, also with wildcards at the end
+  EXPECT_EQ(find_all(SearchPattern::parse("A9 00 8D 20 D0"), data), (std::vector<std::size_t>{0x123, 0xFFB}));
+  EXPECT_EQ(find_all(SearchPattern::parse("A9 ?? 8D ?? D?"), data), (std::vector<std::size_t>{0x123, 0xFFB}));
+  EXPECT_EQ(find_all(SearchPattern::parse("?? ?? ?? ?? ??"), data).size(), data.size() - 4);
+  EXPECT_FALSE(SearchPattern::parse("A9 00 8D 20 D1").find(data).has_value());
+  EXPECT_FALSE(SearchPattern::parse("A9 00").find(std::span(data).first(1)).has_value());
+}
+
+TEST(MemorySearchSuite, MatchesAcrossChunks)
+{
+  const auto pattern = SearchPattern::parse("11 22 33 44");
+  StreamSearch search(pattern);
+  EXPECT_EQ(search.feed(0x1000, to_bytes({0x11, 0x22, 0x33, 0x44, 0x00, 0x11})), (std::vector<int>{0x1000}));
+  EXPECT_TRUE(search.feed(0x1006, to_bytes({0x22})).empty());
+  EXPECT_EQ(search.feed(0x1007, to_bytes({0x33, 0x44, 0x11, 0x22})), (std::vector<int>{0x1005}));
+  EXPECT_THROW(search.feed(0x2000, to_bytes({0x33})), std::invalid_argument);
+}
+
+}  // namespace m65dap::test
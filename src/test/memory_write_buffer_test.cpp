@@ -0,0 +1,54 @@
+#include "memory_write_buffer.h"
+
+#include <gtest/gtest.h>
+
+namespace m65dap::test {
+
+namespace {
+
+auto bytes(std::initializer_list<int> values) -> std::vector<std::byte>
+{
+  std::vector<std::byte> result;
+  for (auto v : values) {
+    result.push_back(static_cast<std::byte>(v));
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(MemoryWriteBufferSuite, MergesAdjacentWrites)
+{
+  MemoryWriteBuffer buffer;
+  EXPECT_TRUE(buffer.empty());
+
+  buffer.add(0x1002, bytes({3, 4}));
+  buffer.add(0x1000, bytes({1, 2}));
+  buffer.add(0x1004, bytes({5}));
+  buffer.add(0x2000, bytes({9}));
+
+  ASSERT_EQ(buffer.spans().size(), 2);
+  EXPECT_EQ(buffer.spans().at(0x1000), bytes({1, 2, 3, 4, 5}));
+  EXPECT_EQ(buffer.spans().at(0x2000), bytes({9}));
+
+  buffer.clear();
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(MemoryWriteBufferSuite, LaterWritesWin)
+{
+  MemoryWriteBuffer buffer;
+  buffer.add(0x1000, bytes({1, 2, 3}));
+  buffer.add(0x1005, bytes({6, 7}));
+  buffer.add(0x1002, bytes({0x33, 0x44, 0x55, 0x66}));
+
+  ASSERT_EQ(buffer.spans().size(), 1);
+  EXPECT_EQ(buffer.spans().at(0x1000), bytes({1, 2, 0x33, 0x44, 0x55, 0x66, 7}));
+
+  // Fully covering an existing span
+  buffer.add(0x0FFF, bytes({0, 0, 0, 0, 0, 0, 0, 0, 0, 0}));
+  ASSERT_EQ(buffer.spans().size(), 1);
+  EXPECT_EQ(buffer.spans().at(0x0FFF).size(), 10);
+}
+
+}  // namespace m65dap::test
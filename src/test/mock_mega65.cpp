@@ -4,30 +4,73 @@ namespace {
 
 const std::string eol_str{"\r\n"};
 
+// I/O area with VIC-IV personality ($D000-$DFFF)
+const int io_base = 0xFFD3000;
+const int io_size = 0x1000;
+
+// Raster lines and CIA timer ticks that pass between two breakpoint hits
+const int raster_lines_per_trigger = 37;
+const int cia_ticks_per_trigger = 2345;
+
+struct LoopInstruction {
+  int pc;
+  std::string_view bytes;
+  std::string_view disassembly;
+};
+
+// Main loop of the test program, single stepped endlessly after the canned register outputs
+const std::array<LoopInstruction, 5> test_main_loop{{{0x2056, "A9 12", "LDA   #$12"},
+                                                      {0x2058, "85 02", "STA   $02"},
+                                                      {0x205A, "A9 34", "LDA   #$34"},
+                                                      {0x205C, "85 03", "STA   $03"},
+                                                      {0x205E, "4C 56 20", "JMP   $2056"}}};
+
 }  // namespace
 namespace m65dap::test::mock {
 
-MockMega65::MockMega65(bool is_xemu) : memory_(384 * 1024), is_xemu_(is_xemu) {}
+MockMega65::MockMega65(bool is_xemu) :
+    memory_(384 * 1024), io_(io_size), is_xemu_(is_xemu), dialect_(is_xemu ? &xemu_dialect() : &mega65_dialect())
+{
+}
 
 void MockMega65::write(std::span<const char> buffer)
 {
-  if (load_remaining_bytes_ > 0) {
-    buffer = process_load_bytes(buffer);
-  }
+  bool first_cmd = true;
 
-  if (buffer.size() == 0) {
-    return;
-  }
+  while (true) {
+    if (load_remaining_bytes_ > 0) {
+      buffer = process_load_bytes(buffer);
+    }
 
-  auto it = std::find_first_of(buffer.begin(), buffer.end(), eol_str.begin(), eol_str.end());
-  throw_if<std::invalid_argument>(it == buffer.end(), "No eol char found");
+    if (buffer.size() == 0) {
+      return;
+    }
+
+    auto it = std::find_first_of(buffer.begin(), buffer.end(), eol_str.begin(), eol_str.end());
+    if (it == buffer.end()) {
+      throw_if<std::invalid_argument>(first_cmd, "No eol char found");
+      return;
+    }
 
-  if (it == buffer.begin()) {
+    std::string_view input_str(buffer.data(), it - buffer.begin());
+    auto next_it = it + 1;
+    if (*it == '\r' && next_it != buffer.end() && *next_it == '\n') {
+      ++next_it;
+    }
+    buffer = buffer.subspan(next_it - buffer.begin());
+    first_cmd = false;
+
+    process_cmd(input_str);
+  }
+}
+
+void MockMega65::process_cmd(std::string_view input_str)
+{
+  if (input_str.empty()) {
     next_cmd();
     return;
   }
 
-  std::string_view input_str(buffer.data(), it - buffer.begin());
   if (parse_help_cmd(input_str)) {
     return;
   }
@@ -89,21 +132,13 @@ auto MockMega65::read(int bytes_to_read, int timeout_ms) -> std::string
 
 void MockMega65::flush_rx_buffers() { output_buffer_.clear(); }
 
-void MockMega65::append_prompt()
-{
-  if (is_xemu_) {
-    output_buffer_.append(".").append(eol_str);
-  }
-  else {
-    output_buffer_.append(eol_str).append(".");
-  }
-}
+void MockMega65::append_prompt() { output_buffer_.append(dialect_->reply_end()); }
 
 void MockMega65::next_cmd()
 {
   ++current_reg_out_;
   output_buffer_.append(eol_str);
-  if (is_xemu_) {
+  for (int idx{1}; idx < dialect_->step_reply_prompts(); ++idx) {
     append_prompt();
   }
   output_buffer_.append(eol_str);
@@ -139,18 +174,12 @@ auto MockMega65::parse_help_cmd(std::string_view line) -> bool
     return false;
   }
 
-  output_buffer_.append(line).append(eol_str);
+  output_buffer_.append(line).append(eol_str).append(dialect_->ident()).append(eol_str);
   if (is_xemu_) {
-    output_buffer_.append("Xemu/MEGA65 Serial Monitor")
-        .append(eol_str)
-        .append("Warning: not 100% compatible with UART monitor of a *real* MEGA65 ...")
-        .append(eol_str);
+    output_buffer_.append("Warning: not 100% compatible with UART monitor of a *real* MEGA65 ...").append(eol_str);
   }
   else {
-    output_buffer_.append("MEGA65 Serial Monitor")
-        .append(eol_str)
-        .append("build GIT: development,20220305.00,ee4f29d")
-        .append(eol_str);
+    output_buffer_.append("build GIT: development,20220305.00,ee4f29d").append(eol_str);
   }
   append_prompt();
   return true;
@@ -169,13 +198,15 @@ auto MockMega65::parse_memory_cmd(std::string_view line) -> bool
   const auto& address_match{match[2]};
   int address = str_to_int(address_match.str(), 16);
   int num_lines = *cmd_match.first == 'm' ? 1 : 16;
-  throw_if<std::out_of_range>(
-      address + num_lines * 16 >= memory_.size(),
-      fmt::format("Memory request at address {} with size {} out of range", address, num_lines * 16));
+  memory_at(address);
+  memory_at(address + num_lines * 16 - 1);
 
   output_buffer_.append(line).append(eol_str);
   for (int i{0}; i < num_lines; ++i) {
-    auto mem_range{std::span<std::uint8_t>(memory_).subspan(address, 16)};
+    std::array<std::uint8_t, 16> mem_range;
+    for (int idx{0}; idx < 16; ++idx) {
+      mem_range[idx] = memory_at(address + idx);
+    }
     if (is_xemu_) {
       output_buffer_.append(fmt::format(":{:08X}:{:02X}\n", address, fmt::join(mem_range, "")));
     }
@@ -201,6 +232,11 @@ auto MockMega65::parse_trace_cmd(std::string_view line) -> bool
   trace_mode_ = *param.first == '1';
   output_buffer_.append(line).append(eol_str);
   append_prompt();
+
+  if (!trace_mode_ && running_ && breakpoint_set_) {
+    // The test program loops over the breakpoint, so continuing hits it again
+    trigger_breakpoint();
+  }
   return true;
 }
 
@@ -222,7 +258,7 @@ auto MockMega65::parse_reset_cmd(std::string_view line) -> bool
 
 auto MockMega65::parse_load_cmd(std::string_view line) -> bool
 {
-  static const std::regex r(R"(^\s*l\s*([0-9a-fA-F]{1,4})\s+([0-9a-fA-F]{1,4})\s*$)");
+  static const std::regex r(R"(^\s*l\s*([0-9a-fA-F]{1,7})\s+([0-9a-fA-F]{1,4})\s*$)");
 
   std::cmatch match;
   if (!regex_search(line, match, r)) {
@@ -233,7 +269,8 @@ auto MockMega65::parse_load_cmd(std::string_view line) -> bool
   const auto& addr_end_match{match[2]};
   load_addr_ = str_to_int(addr_begin_match.str(), 16);
   int addr_end = str_to_int(addr_end_match.str(), 16);
-  load_remaining_bytes_ = addr_end - load_addr_;
+  // The end address only has 16 bits, the load stays within the bank of the start address
+  load_remaining_bytes_ = addr_end - (load_addr_ & 0xffff);
   if (load_remaining_bytes_ < 0) {
     load_remaining_bytes_ += 0x10000;
   }
@@ -246,7 +283,7 @@ auto MockMega65::parse_load_cmd(std::string_view line) -> bool
 
 auto MockMega65::parse_break_cmd(std::string_view line) -> bool
 {
-  static const std::regex r(R"(^\s*b\s*([0-9a-fA-F]{1,4})\s*$)");
+  static const std::regex r(R"(^\s*b\s*([0-9a-fA-F]{1,7})?\s*$)");
 
   std::cmatch match;
   if (!regex_search(line, match, r)) {
@@ -255,19 +292,30 @@ auto MockMega65::parse_break_cmd(std::string_view line) -> bool
 
   output_buffer_.append(line).append(eol_str);
   append_prompt();
-  breakpoint_set_ = true;
+  breakpoint_set_ = match[1].matched;
+
+  if (breakpoint_set_ && running_ && !trace_mode_) {
+    trigger_breakpoint();
+  }
   return true;
 }
 
 auto MockMega65::parse_store_cmd(std::string_view line) -> bool
 {
-  static const std::regex r(R"(^\s*s\s*([0-9a-fA-F]{1,4})((\s+[0-9a-fA-F]{1,2})+)\s*$)");
+  static const std::regex r(R"(^\s*s\s*([0-9a-fA-F]{1,7})((\s+[0-9a-fA-F]{1,2})+)\s*$)");
 
   std::cmatch match;
   if (!regex_search(line, match, r)) {
     return false;
   }
 
+  int address = str_to_int(match[1].str(), 16);
+  std::istringstream values(match[2].str());
+  std::string value;
+  while (values >> value) {
+    memory_at(address++) = static_cast<std::uint8_t>(str_to_int(value, 16));
+  }
+
   output_buffer_.append(line).append(eol_str);
   append_prompt();
 
@@ -275,14 +323,7 @@ auto MockMega65::parse_store_cmd(std::string_view line) -> bool
     // assuming RUN cmd
     running_ = true;
     if (breakpoint_set_) {
-      if (!is_xemu_) {
-        output_buffer_.append("!");
-      }
-      output_buffer_.append(eol_str);
-      output_registers();
-      if (!is_xemu_) {
-        append_prompt();
-      }
+      trigger_breakpoint();
     }
   }
 
@@ -303,6 +344,33 @@ auto MockMega65::parse_registers_cmd(std::string_view line) -> bool
   return true;
 }
 
+void MockMega65::trigger_breakpoint()
+{
+  raster_line_ = (raster_line_ + raster_lines_per_trigger) % 312;
+  io_[0x011] = (io_[0x011] & 0x7F) | ((raster_line_ >> 1) & 0x80);
+  io_[0x012] = raster_line_ & 0xFF;
+  cia_timer_ = (cia_timer_ - cia_ticks_per_trigger) & 0xFFFF;
+  io_[0xC04] = cia_timer_ & 0xFF;
+  io_[0xC05] = cia_timer_ >> 8;
+  trace_mode_ = true;
+
+  output_buffer_.append(dialect_->breakpoint_trigger()).append(eol_str);
+  output_registers();
+  if (!is_xemu_) {
+    append_prompt();
+  }
+}
+
+auto MockMega65::memory_at(int address) -> std::uint8_t&
+{
+  if (address >= io_base && address < io_base + io_size) {
+    return io_[address - io_base];
+  }
+  throw_if<std::out_of_range>(address < 0 || address >= static_cast<int>(memory_.size()),
+                              fmt::format("Memory request at address {:X} out of range", address));
+  return memory_[address];
+}
+
 void MockMega65::output_registers()
 {
   if (is_xemu_) {
@@ -338,8 +406,29 @@ void MockMega65::output_registers()
             .append(",0777205A  A9 34     LDA   #$34");
       }
       break;
-    default:
-      throw std::logic_error("Unable to provide register command output");
+    default: {
+      // Continue stepping through the main loop, starting after the canned output at $205A
+      const auto& instr = test_main_loop[(current_reg_out_ + 1) % test_main_loop.size()];
+      const auto& prev_instr = test_main_loop[current_reg_out_ % test_main_loop.size()];
+      const int a = instr.pc == 0x2058 || instr.pc == 0x205A ? 0x12 : 0x34;
+      auto last_op = prev_instr.bytes.substr(0, 5);
+      if (is_xemu_) {
+        output_buffer_.append(fmt::format("{:04X} {:02X} FF 00 00 00 01FF 0000 0000 {}       21 00 --E----C ", instr.pc,
+                                          a, last_op.substr(0, 2)))
+            .append(eol_str)
+            .append(fmt::format(",0777{:04X}", instr.pc));
+      }
+      else {
+        std::string last_op_str(last_op);
+        std::erase(last_op_str, ' ');
+        output_buffer_
+            .append(fmt::format("{:04X} {:02X} FF 00 00 00 01FF 0000 0000 {:<4}    00     21 ..E....C ...P 15 -  00 - "
+                                ".....l.c",
+                                instr.pc, a, last_op_str))
+            .append(eol_str)
+            .append(fmt::format(",0777{:04X}  {:<8}  {}", instr.pc, instr.bytes, instr.disassembly));
+      }
+    }
   }
   output_buffer_.append(eol_str);
 }
@@ -1,19 +1,24 @@
 #pragma once
 
 #include "connection.h"
+#include "monitor_dialect.h"
 
 namespace m65dap::test::mock {
 
 class MockMega65 : public Connection {
   std::string output_buffer_;
   std::vector<uint8_t> memory_;
+  std::vector<uint8_t> io_;
   bool is_xemu_{false};
+  const MonitorDialect* dialect_;
   bool running_{false};
   bool trace_mode_{false};
   bool breakpoint_set_{false};
   int load_addr_{0};
   int load_remaining_bytes_{0};
   int current_reg_out_{0};
+  int raster_line_{0};
+  int cia_timer_{0xFFFF};
 
  public:
   MockMega65(bool is_xemu = false);
@@ -22,8 +27,11 @@ class MockMega65 : public Connection {
   auto read(int bytes_to_read, int timeout_ms = 1000) -> std::string override final;
   auto read_line(int timeout_ms = 1000) -> std::pair<std::string, bool>;
   void flush_rx_buffers();
+  // Bytes of a running load command still expected, they are taken as data instead of commands
+  auto pending_load_bytes() const -> int { return load_remaining_bytes_; }
 
  private:
+  void process_cmd(std::string_view input_str);
   void append_prompt();
   void next_cmd();
   auto process_load_bytes(std::span<const char> buffer) -> std::span<const char>;
@@ -36,6 +44,8 @@ class MockMega65 : public Connection {
   auto parse_store_cmd(std::string_view line) -> bool;
   auto parse_registers_cmd(std::string_view line) -> bool;
   void output_registers();
+  void trigger_breakpoint();
+  auto memory_at(int address) -> std::uint8_t&;
 };
 
 }  // namespace m65dap::test::mock
@@ -0,0 +1,159 @@
+#include "monitor_broker.h"
+
+#include <gtest/gtest.h>
+
+#include "duration.h"
+#include "m65_debugger.h"
+#include "mock_mega65.h"
+#include "unix_domain_socket_connection.h"
+
+namespace m65dap::test {
+
+namespace {
+
+auto socket_path(std::string_view name) -> std::filesystem::path
+{
+  return std::filesystem::temp_directory_path() / fmt::format("m65dap_{}_{}.sock", name, getpid());
+}
+
+// Reads until the given number of prompts arrived
+auto read_replies(Connection& conn, int count) -> std::string
+{
+  std::string result;
+  Duration t;
+  auto prompts = [&] {
+    int n{0};
+    for (auto pos = result.find("\r\n."); pos != std::string::npos; pos = result.find("\r\n.", pos + 3)) {
+      ++n;
+    }
+    return n;
+  };
+  while (prompts() < count && t.elapsed_ms() < 2000) {
+    result += conn.read(4096, 50);
+  }
+  return result;
+}
+
+auto wait_for_clients(const MonitorBroker& broker, int count) -> bool
+{
+  Duration t;
+  while (broker.client_count() != count && t.elapsed_ms() < 2000) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return broker.client_count() == count;
+}
+
+// Mock that holds back its replies until opened, recording the commands received
+class GatedTarget : public Connection {
+  mock::MockMega65 mock_;
+  std::mutex mutex_;
+  std::vector<std::string> commands_;
+  std::atomic<bool> open_{false};
+
+ public:
+  void write(std::span<const char> buffer) override
+  {
+    std::scoped_lock lock(mutex_);
+    commands_.emplace_back(buffer.begin(), buffer.end());
+    mock_.write(buffer);
+  }
+
+  auto read(int bytes_to_read, int timeout_ms) -> std::string override
+  {
+    std::scoped_lock lock(mutex_);
+    return open_ ? mock_.read(bytes_to_read, timeout_ms) : std::string();
+  }
+
+  void open() { open_ = true; }
+
+  auto commands() -> std::vector<std::string>
+  {
+    std::scoped_lock lock(mutex_);
+    return commands_;
+  }
+};
+
+}  // namespace
+
+TEST(MonitorBrokerSuite, RepliesGoToTheirClients)
+{
+  MonitorBroker broker(std::make_unique<mock::MockMega65>(), socket_path("replies"));
+  UnixDomainSocketConnection first(broker.socket_path());
+  UnixDomainSocketConnection second(broker.socket_path());
+  ASSERT_TRUE(wait_for_clients(broker, 2));
+
+  first.write(std::string_view("m2000\n?\n"));
+  second.write(std::string_view("m3000\n"));
+  const auto first_replies = read_replies(first, 2);
+  const auto second_replies = read_replies(second, 1);
+  EXPECT_TRUE(first_replies.starts_with("m2000\r\n:00002000:")) << first_replies;
+  EXPECT_NE(first_replies.find("?\r\nMEGA65 Serial Monitor"), std::string::npos) << first_replies;
+  EXPECT_EQ(first_replies.find("m3000"), std::string::npos) << first_replies;
+  EXPECT_TRUE(second_replies.starts_with("m3000\r\n:00003000:")) << second_replies;
+  EXPECT_EQ(second_replies.find("MEGA65"), std::string::npos) << second_replies;
+
+  // Load data is passed on with its command, even if it contains line breaks
+  first.write(std::string_view("l2000 2004\n\n\n"));
+  first.write(std::string_view("\n\nm2000\n"));
+  const auto load_replies = read_replies(first, 2);
+  EXPECT_NE(load_replies.find(":00002000:0A0A0A0A"), std::string::npos) << load_replies;
+
+  // Breakpoint triggers are passed on to all clients
+  second.write(std::string_view("b2056\nsD0 4\n"));
+  EXPECT_NE(read_replies(second, 3).find("!\r\n"), std::string::npos);
+  EXPECT_TRUE(read_replies(first, 1).starts_with("!\r\n"));
+}
+
+TEST(MonitorBrokerSuite, HigherPriorityFirst)
+{
+  auto target = std::make_unique<GatedTarget>();
+  auto* gated = target.get();
+  MonitorBroker broker(std::move(target), socket_path("priority"));
+  UnixDomainSocketConnection background(broker.socket_path());
+  UnixDomainSocketConnection session(broker.socket_path());
+  ASSERT_TRUE(wait_for_clients(broker, 2));
+
+  std::string commands;
+  for (int idx{0}; idx < 12; ++idx) {
+    commands += fmt::format("m{:X}\n", 0x2000 + idx * 16);
+  }
+  background.write(commands);
+  Duration t;
+  while (gated->commands().size() < MonitorBroker::max_commands_in_flight && t.elapsed_ms() < 2000) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  session.write(std::string_view("#priority 1\n?\n"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  gated->open();
+
+  EXPECT_TRUE(read_replies(session, 1).starts_with("?\r\n"));
+  EXPECT_EQ(read_replies(background, 12).find("?\r\n"), std::string::npos);
+  const auto sent = gated->commands();
+  ASSERT_EQ(sent.size(), 13);
+  // The commands in flight when the session's command arrived are answered first
+  EXPECT_EQ(sent[MonitorBroker::max_commands_in_flight], "?\n");
+}
+
+TEST(MonitorBrokerSuite, DebugThroughBroker)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+
+  MonitorBroker broker(std::make_unique<mock::MockMega65>(), socket_path("debug"));
+  UnixDomainSocketConnection viewer(broker.socket_path());
+  M65Debugger debugger(fmt::format("unix#{}", broker.socket_path().string()), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  const std::array<std::byte, 3> values{std::byte{0x11}, std::byte{0x22}, std::byte{0x33}};
+  debugger.write_memory(0x4000, values);
+  viewer.write(std::string_view("m4000\n"));
+  EXPECT_TRUE(read_replies(viewer, 1).starts_with("m4000\r\n:00004000:112233")) << "viewer sees debugger's writes";
+
+  std::array<std::byte, 3> readback{};
+  debugger.read_memory(0x4000, readback);
+  EXPECT_EQ(readback, values);
+}
+
+}  // namespace m65dap::test
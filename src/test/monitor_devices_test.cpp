@@ -0,0 +1,149 @@
+#include "monitor_devices.h"
+
+#include <gtest/gtest.h>
+
+#include "duration.h"
+#include "m65_debugger.h"
+#include "mock_mega65.h"
+#include "monitor_broker.h"
+#include "pty_mock_server.h"
+#include "tcp_mock_server.h"
+
+namespace m65dap::test {
+
+namespace {
+
+auto temp_path(std::string_view name) -> std::filesystem::path
+{
+  return std::filesystem::temp_directory_path() / fmt::format("m65dap_{}_{}", name, getpid());
+}
+
+// Serial device without a monitor, it never answers
+class SilentTarget : public Connection {
+ public:
+  void write(std::span<const char>) override {}
+  auto read(int, int timeout_ms) -> std::string override
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeout_ms, 1)));
+    return {};
+  }
+};
+
+}  // namespace
+
+TEST(MonitorDevicesSuite, Candidates)
+{
+  const auto dev_dir = temp_path("dev");
+  std::filesystem::create_directories(dev_dir);
+  for (const auto* name : {"ttyUSB0", "ttyACM1", "ttyS0", "cu.usbserial-251633000A", "null"}) {
+    std::ofstream(dev_dir / name);
+  }
+  MonitorBroker broker(std::make_unique<mock::MockMega65>(), temp_path("m65dbg.sock"));
+
+  const auto candidates = monitor_candidates(dev_dir);
+  std::filesystem::remove_all(dev_dir);
+  auto contains = [&](const std::string& device) { return std::ranges::find(candidates, device) != candidates.end(); };
+  EXPECT_TRUE(contains((dev_dir / "ttyUSB0").string()));
+  EXPECT_TRUE(contains((dev_dir / "ttyACM1").string()));
+  EXPECT_TRUE(contains((dev_dir / "cu.usbserial-251633000A").string()));
+  EXPECT_FALSE(contains((dev_dir / "ttyS0").string()));
+  EXPECT_FALSE(contains((dev_dir / "null").string()));
+  EXPECT_TRUE(contains("unix#" + broker.socket_path().string()));
+  ASSERT_FALSE(candidates.empty());
+  EXPECT_EQ(candidates.back(), "tcp#127.0.0.1:4510");
+}
+
+TEST(MonitorDevicesSuite, ProbeConcurrently)
+{
+  std::vector<std::unique_ptr<PtyMonitorServer>> silent;
+  std::vector<std::string> devices{"/dev/m65dap_missing"};
+  for (int idx{0}; idx < 4; ++idx) {
+    silent.push_back(std::make_unique<PtyMonitorServer>(std::make_unique<SilentTarget>()));
+    devices.push_back(silent.back()->device());
+  }
+  PtyMonitorServer mega65(std::make_unique<MockMega65Stream>());
+  devices.push_back(mega65.device());
+
+  // Answers as soon as the monitor replied, without waiting for the silent devices
+  Duration t;
+  const auto monitor = probe_monitors(devices, 500);
+  EXPECT_LT(t.elapsed_ms(), 400);
+  ASSERT_TRUE(monitor.has_value());
+  EXPECT_EQ(monitor->device, mega65.device());
+  EXPECT_FALSE(monitor->is_xemu);
+
+  // The silent devices are probed at the same time, not one after the other
+  devices.pop_back();
+  t.reset();
+  EXPECT_FALSE(probe_monitors(devices, 200).has_value());
+  EXPECT_GE(t.elapsed_ms(), 200);
+  EXPECT_LT(t.elapsed_ms(), 600);
+  EXPECT_FALSE(probe_monitors({}).has_value());
+}
+
+TEST(MonitorDevicesSuite, ProbeXemu)
+{
+  PtyMonitorServer xemu_pty(std::make_unique<MockMega65Stream>(true));
+  const auto monitor = probe_monitors({xemu_pty.device()});
+  ASSERT_TRUE(monitor.has_value());
+  EXPECT_TRUE(monitor->is_xemu);
+
+  TcpMonitorServer xemu_tcp([] { return std::make_unique<MockMega65Stream>(true); });
+  const auto tcp_monitor = probe_monitors({"/dev/m65dap_missing", xemu_tcp.address()});
+  ASSERT_TRUE(tcp_monitor.has_value());
+  EXPECT_EQ(tcp_monitor->device, xemu_tcp.address());
+  EXPECT_TRUE(tcp_monitor->is_xemu);
+}
+
+TEST(MonitorDevicesSuite, CacheLastMonitor)
+{
+  const auto cache_path = temp_path("cache") / "last_monitor";
+  PtyMonitorServer first(std::make_unique<MockMega65Stream>());
+  PtyMonitorServer silent(std::make_unique<SilentTarget>());
+
+  auto monitor = discover_monitor({silent.device(), first.device()}, cache_path);
+  ASSERT_TRUE(monitor.has_value());
+  EXPECT_EQ(monitor->device, first.device());
+  std::string cached;
+  std::getline(std::ifstream(cache_path), cached);
+  EXPECT_EQ(cached, first.device());
+
+  // The cached device is tried first, even if it isn't among the candidates any more
+  PtyMonitorServer second(std::make_unique<MockMega65Stream>());
+  monitor = discover_monitor({second.device()}, cache_path);
+  ASSERT_TRUE(monitor.has_value());
+  EXPECT_EQ(monitor->device, first.device());
+
+  // Other devices are probed once the cached one doesn't answer
+  std::ofstream(cache_path) << silent.device() << '\n';
+  monitor = discover_monitor({silent.device(), second.device()}, cache_path);
+  ASSERT_TRUE(monitor.has_value());
+  EXPECT_EQ(monitor->device, second.device());
+  std::getline(std::ifstream(cache_path), cached);
+  EXPECT_EQ(cached, second.device());
+
+  std::filesystem::remove_all(cache_path.parent_path());
+}
+
+TEST(MonitorDevicesSuite, DebugDiscoveredMonitor)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  PtyMonitorServer mega65(std::make_unique<MockMega65Stream>());
+  PtyMonitorServer silent(std::make_unique<SilentTarget>());
+
+  const auto monitor = probe_monitors({silent.device(), mega65.device()});
+  ASSERT_TRUE(monitor.has_value());
+  M65Debugger debugger(monitor->device, &handler);
+  debugger.set_target("data/test.prg");
+  debugger.pause();
+
+  const std::array<std::byte, 3> values{std::byte{0x11}, std::byte{0x22}, std::byte{0x33}};
+  debugger.write_memory(0x4000, values);
+  std::array<std::byte, 3> readback{};
+  debugger.read_memory(0x4000, readback);
+  EXPECT_EQ(readback, values);
+}
+
+}  // namespace m65dap::test
@@ -0,0 +1,108 @@
+#include "monitor_dialect.h"
+
+#include <gtest/gtest.h>
+
+namespace m65dap::test {
+
+namespace {
+
+auto take_all(const MonitorDialect& dialect, std::string& buffer) -> std::vector<std::string>
+{
+  std::vector<std::string> lines;
+  for (auto line = dialect.take_line(buffer); line.has_value(); line = dialect.take_line(buffer)) {
+    lines.push_back(std::move(line.value()));
+  }
+  return lines;
+}
+
+}  // namespace
+
+TEST(MonitorDialectSuite, ScanMega65Lines)
+{
+  const auto& dialect = mega65_dialect();
+  std::string buffer = "m2000\r\n:00002000:00\r\n.";
+  EXPECT_EQ(take_all(dialect, buffer), (std::vector<std::string>{"m2000", ":00002000:00", "."}));
+  EXPECT_TRUE(buffer.empty());
+
+  // The trigger is taken before its line break arrived, incomplete lines are kept
+  buffer = "!";
+  EXPECT_EQ(take_all(dialect, buffer), (std::vector<std::string>{"!"}));
+  buffer = "\r\nPC   A";
+  EXPECT_EQ(take_all(dialect, buffer), (std::vector<std::string>{""}));
+  EXPECT_EQ(buffer, "PC   A");
+}
+
+TEST(MonitorDialectSuite, ScanXemuLines)
+{
+  const auto& dialect = xemu_dialect();
+  std::string buffer = "m2000\r\n:00002000:00\n.\r";
+  EXPECT_EQ(take_all(dialect, buffer), (std::vector<std::string>{"m2000", ":00002000:00"}));
+  // The prompt is only complete with its line break
+  EXPECT_EQ(buffer, ".\r");
+  buffer += "\n";
+  EXPECT_EQ(take_all(dialect, buffer), (std::vector<std::string>{"."}));
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(MonitorDialectSuite, ParseRegisters)
+{
+  Registers registers;
+  EXPECT_TRUE(mega65_dialect().parse_registers(
+      "2058 12 FF 00 00 00 01FF 0000 0000 A912    00     21 ..E....C ...P 15 -  00 - .....l.c", registers));
+  EXPECT_EQ(registers.pc, 0x2058);
+  EXPECT_EQ(registers.a, 0x12);
+  EXPECT_EQ(registers.x, 0xFF);
+  EXPECT_EQ(registers.sp, 0x01FF);
+  EXPECT_EQ(registers.last_op, 0xA912);
+  EXPECT_EQ(registers.p, 0x21);
+  EXPECT_EQ(registers.flags, 0x21);
+  EXPECT_EQ(registers.flags_string(), "..E....C");
+  EXPECT_EQ(std::string_view(registers.reca8lhc.data(), registers.reca8lhc.size()), ".....l.c");
+  EXPECT_EQ(registers.io, '-');
+
+  registers = {};
+  EXPECT_TRUE(
+      xemu_dialect().parse_registers("2056 00 FF 00 00 00 01FF 0000 0000 9A       A1 00 N-E----C ", registers));
+  EXPECT_EQ(registers.pc, 0x2056);
+  EXPECT_EQ(registers.sp, 0x01FF);
+  EXPECT_EQ(registers.last_op, 0x9A);
+  EXPECT_EQ(registers.p, 0xA1);
+  EXPECT_EQ(registers.flags, 0xA1);
+  EXPECT_EQ(registers.flags_string(), "N.E....C");
+
+  // Truncated lines and values that aren't hex numbers are rejected without changing any register
+  EXPECT_FALSE(xemu_dialect().parse_registers("3000 11 FF 00 00 00 01F0 0000 0000 9A       A1 00 N-E", registers));
+  EXPECT_FALSE(
+      xemu_dialect().parse_registers("3000 11 FF 0G 00 00 01F0 0000 0000 9A       A1 00 N-E----C ", registers));
+  EXPECT_FALSE(mega65_dialect().parse_registers("", registers));
+  EXPECT_EQ(registers.pc, 0x2056);
+  EXPECT_EQ(registers.a, 0x00);
+  EXPECT_EQ(registers.sp, 0x01FF);
+  EXPECT_EQ(registers.flags, 0xA1);
+}
+
+TEST(MonitorDialectSuite, BreakpointBlock)
+{
+  std::vector<std::string> received{"", "PC   A  X  Y  Z  B  SP", "2058 12", ",07772058  85 02     STA   $02", "."};
+  auto next = received.begin();
+  auto next_line = [&] { return *next++; };
+  EXPECT_EQ(mega65_dialect().read_breakpoint_block(next_line).size(), 4);
+  EXPECT_EQ(next, received.end());
+
+  received = {"PC   A  X  Y  Z  B  SP", "2056 00", ",07772056", "m2000"};
+  next = received.begin();
+  EXPECT_EQ(xemu_dialect().read_breakpoint_block(next_line).size(), 3);
+  EXPECT_EQ(*next, "m2000");
+
+  received = {"PC   A  X  Y  Z  B  SP", "2056 00", "m2000"};
+  next = received.begin();
+  EXPECT_THROW(xemu_dialect().read_breakpoint_block(next_line), std::runtime_error);
+}
+
+TEST(MonitorDialectSuite, SyncCommand)
+{
+  EXPECT_EQ(mega65_dialect().sync_command(7), "?7\n");
+  EXPECT_EQ(xemu_dialect().sync_command(7), "?\n");
+}
+
+}  // namespace m65dap::test
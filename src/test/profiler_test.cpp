@@ -0,0 +1,79 @@
+#include "profiler.h"
+
+#include <gtest/gtest.h>
+
+#include "m65_debugger.h"
+#include "mock_mega65.h"
+
+using namespace std::chrono_literals;
+
+namespace m65dap::test {
+
+TEST(ProfilerSuite, RecordSamples)
+{
+  Profiler profiler;
+  profiler.record_sample(0x2058);
+  profiler.record_sample(0x2058);
+  profiler.record_sample(0x1000);
+
+  EXPECT_EQ(profiler.total_samples(), 3);
+  EXPECT_EQ(profiler.sample_count(0x2058), 2);
+  EXPECT_EQ(profiler.sample_count(0x1000), 1);
+
+  profiler.reset();
+  EXPECT_EQ(profiler.total_samples(), 0);
+  EXPECT_EQ(profiler.sample_count(0x2058), 0);
+}
+
+TEST(ProfilerSuite, InvalidSampleRate)
+{
+  Profiler profiler;
+  EXPECT_THROW(profiler.start(0), std::invalid_argument);
+  EXPECT_FALSE(profiler.is_active());
+  profiler.start(1000);
+  EXPECT_TRUE(profiler.is_active());
+  EXPECT_EQ(profiler.sample_interval_us(), 1000);
+}
+
+TEST(ProfilerSuite, CollapsedStacks)
+{
+  C64DebuggerData dbg_data("data/test.dbg");
+  Profiler profiler;
+  profiler.record_sample(0x2058);
+  profiler.record_sample(0x2059);
+  profiler.record_sample(0x205A);
+  profiler.record_sample(0x1000);
+
+  EXPECT_EQ(profiler.to_collapsed_stacks(&dbg_data),
+            "Code;Main;test_main.asm:80 2\n"
+            "Code;Main;test_main.asm:81 1\n"
+            "unknown;$1000 1\n");
+  EXPECT_EQ(profiler.to_collapsed_stacks(nullptr),
+            "unknown;$1000 1\n"
+            "unknown;$2058 1\n"
+            "unknown;$2059 1\n"
+            "unknown;$205A 1\n");
+}
+
+TEST(ProfilerSuite, SampleRunningTarget)
+{
+  struct EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler dummy_handler;
+
+  M65Debugger debugger(std::make_unique<mock::MockMega65>(), &dummy_handler);
+  debugger.set_target("data/test.prg");
+  debugger.run_target();
+  debugger.start_profiling(1000);
+
+  for (int i{0}; i < 500 && debugger.get_profile_sample_count() < 10; ++i) {
+    std::this_thread::sleep_for(1ms);
+  }
+  debugger.stop_profiling();
+
+  auto num_samples = debugger.get_profile_sample_count();
+  ASSERT_GE(num_samples, 10);
+  EXPECT_EQ(debugger.get_profile_collapsed_stacks(), fmt::format("Code;Main;test_main.asm:80 {}\n", num_samples));
+}
+
+}  // namespace m65dap::test
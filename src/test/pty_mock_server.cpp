@@ -0,0 +1,82 @@
+#include "pty_mock_server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+
+namespace m65dap::test {
+
+namespace {
+
+constexpr int forward_chunk_size = 0x10000;
+// Longest time the server waits for input before checking whether it has to stop
+constexpr int poll_interval_ms = 10;
+
+}  // namespace
+
+PtyMonitorServer::PtyMonitorServer(std::unique_ptr<Connection> target) : target_(std::move(target))
+{
+  master_fd_ = ::posix_openpt(O_RDWR | O_NOCTTY);
+  throw_if<std::runtime_error>(master_fd_ < 0, fmt::format("Open error: {}", strerror(errno)));
+  const char* slave_name = nullptr;
+  if (::grantpt(master_fd_) != 0 || ::unlockpt(master_fd_) != 0 || (slave_name = ::ptsname(master_fd_)) == nullptr) {
+    const int error = errno;
+    ::close(master_fd_);
+    throw std::runtime_error(fmt::format("Can't create pseudo terminal: {}", strerror(error)));
+  }
+  device_ = slave_name;
+
+  // Raw until the debugger configures the slave, so nothing is echoed or translated before
+  termios tty;
+  if (::tcgetattr(master_fd_, &tty) == 0) {
+    cfmakeraw(&tty);
+    ::tcsetattr(master_fd_, TCSANOW, &tty);
+  }
+  ::fcntl(master_fd_, F_SETFL, ::fcntl(master_fd_, F_GETFL) | O_NONBLOCK);
+  thread_ = std::thread([this] { forward(); });
+}
+
+PtyMonitorServer::~PtyMonitorServer()
+{
+  stop_ = true;
+  thread_.join();
+  ::close(master_fd_);
+}
+
+void PtyMonitorServer::forward()
+{
+  std::string buffer(forward_chunk_size, '\0');
+  while (!stop_) {
+    // Reads of the master fail with EIO while the slave isn't open, so the server just polls again later
+    bool idle{true};
+    if (const auto n = ::read(master_fd_, buffer.data(), buffer.size()); n > 0) {
+      target_->write(std::span<const char>(buffer.data(), n));
+      idle = false;
+    }
+    if (const auto reply = target_->read(forward_chunk_size, 0); !reply.empty()) {
+      std::string_view data(reply);
+      while (!data.empty() && !stop_) {
+        const auto n = ::write(master_fd_, data.data(), data.size());
+        if (n < 0) {
+          if (errno != EAGAIN && errno != EINTR) {
+            break;
+          }
+          pollfd pfd{.fd = master_fd_, .events = POLLOUT, .revents = 0};
+          ::poll(&pfd, 1, poll_interval_ms);
+          continue;
+        }
+        data.remove_prefix(n);
+      }
+      idle = false;
+    }
+    if (idle) {
+      pollfd pfd{.fd = master_fd_, .events = POLLIN, .revents = 0};
+      if (::poll(&pfd, 1, 1) > 0 && (pfd.revents & POLLHUP) != 0) {
+        // No slave open, poll returns right away
+        std::this_thread::sleep_for(std::chrono::milliseconds(poll_interval_ms));
+      }
+    }
+  }
+}
+
+}  // namespace m65dap::test
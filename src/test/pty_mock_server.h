@@ -0,0 +1,35 @@
+#pragma once
+
+#include "connection.h"
+
+namespace m65dap::test {
+
+/**
+ * @brief Exposes a monitor connection on a pseudo terminal, as if it was attached to a serial port
+ *
+ * The debugger opens the slave side given by device(), data written to it is passed on to the connection and its
+ * replies are sent back. The slave may be opened and closed any number of times, the connection is kept.
+ */
+class PtyMonitorServer {
+ public:
+  explicit PtyMonitorServer(std::unique_ptr<Connection> target);
+  PtyMonitorServer(const PtyMonitorServer&) = delete;
+  auto operator=(const PtyMonitorServer&) -> PtyMonitorServer& = delete;
+  ~PtyMonitorServer();
+
+  /**
+   * @brief Path of the slave side, e.g. "/dev/pts/3"
+   */
+  auto device() const -> const std::string& { return device_; }
+
+ private:
+  void forward();
+
+  std::unique_ptr<Connection> target_;
+  int master_fd_{-1};
+  std::string device_;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+}  // namespace m65dap::test
@@ -0,0 +1,94 @@
+#include "monitor_dialect.h"
+
+namespace {
+
+// A trace recording of a few seconds parses this many register dumps
+const int iterations = 2000000;
+const int distinct_lines = 256;
+
+auto mega65_lines() -> std::vector<std::string>
+{
+  std::vector<std::string> lines;
+  for (int idx{0}; idx < distinct_lines; ++idx) {
+    lines.push_back(fmt::format("{:04X} {:02X} FF 00 00 00 01FF 0000 0000 A912    00     21 ..E....C ...P 15 -  00 - "
+                                ".....l.c",
+                                0x2000 + idx * 3, idx));
+  }
+  return lines;
+}
+
+auto xemu_lines() -> std::vector<std::string>
+{
+  std::vector<std::string> lines;
+  for (int idx{0}; idx < distinct_lines; ++idx) {
+    lines.push_back(
+        fmt::format("{:04X} {:02X} FF 00 00 00 01FF 0000 0000 9A       A1 00 N-E----C ", 0x2000 + idx * 3, idx));
+  }
+  return lines;
+}
+
+// Register parsing before the fixed column layouts, kept as baseline
+void parse_with_stream(const std::string& line, m65dap::Registers& registers)
+{
+  std::istringstream sstr(line);
+  sstr >> std::hex;
+  int pc{0};
+  int a{0};
+  int x{0};
+  int y{0};
+  int z{0};
+  int b{0};
+  int sp{0};
+  int maph{0};
+  int mapl{0};
+  int last_op{0};
+  int in{0};
+  int p{0};
+  std::string flags_string;
+  sstr >> pc >> a >> x >> y >> z >> b >> sp >> maph >> mapl >> last_op >> in >> p >> flags_string;
+  registers.pc = static_cast<std::uint16_t>(pc);
+  registers.sp = static_cast<std::uint16_t>(sp);
+  registers.a = static_cast<std::uint8_t>(a);
+  registers.flags = 0;
+  for (std::size_t idx{0}; idx < 8 && idx < flags_string.size(); ++idx) {
+    if (flags_string[idx] != '.' && flags_string[idx] != '-') {
+      registers.flags |= 0x80 >> idx;
+    }
+  }
+}
+
+template <typename Fn>
+void measure(std::string_view name, const std::vector<std::string>& lines, Fn&& fn)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (int idx{0}; idx < iterations; ++idx) {
+    fn(lines[idx % lines.size()]);
+  }
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+  fmt::print("{:<20} {:>12.0f} lines/s  {:>8.1f} ns/line\n", name, iterations / elapsed.count(),
+             elapsed.count() * 1e9 / iterations);
+}
+
+}  // namespace
+
+int main()
+{
+  const auto hw_lines = mega65_lines();
+  const auto emulator_lines = xemu_lines();
+  m65dap::Registers registers;
+  std::size_t checksum{0};
+
+  measure("istringstream", hw_lines, [&](const std::string& line) {
+    parse_with_stream(line, registers);
+    checksum += registers.pc + registers.flags;
+  });
+  measure("MEGA65 columns", hw_lines, [&](const std::string& line) {
+    checksum += m65dap::mega65_dialect().parse_registers(line, registers) ? registers.pc + registers.flags : 0;
+  });
+  measure("Xemu columns", emulator_lines, [&](const std::string& line) {
+    checksum += m65dap::xemu_dialect().parse_registers(line, registers) ? registers.pc + registers.flags : 0;
+  });
+
+  fmt::print("checksum {}\n", checksum);
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+
+#include "duration.h"
+#include "unix_serial_connection.h"
+
+// Measures the round trip time of monitor commands over a serial connection, waiting for the reply either by
+// sleeping between reads or with poll(). Without a device given, a pseudo terminal emulating the monitor is used.
+
+namespace {
+
+const int iterations = 2000;
+constexpr std::string_view command = "m2000\n";
+constexpr std::string_view reply = "m2000\r\n:00002000:A9008D20D0A9008D21D060EAEAEAEA\r\n.";
+
+// Answers every command line written to the slave side of a pseudo terminal like the monitor does
+class PtyMonitor {
+  int fd_;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+
+ public:
+  PtyMonitor() : fd_(posix_openpt(O_RDWR | O_NOCTTY))
+  {
+    if (fd_ < 0 || grantpt(fd_) != 0 || unlockpt(fd_) != 0) {
+      throw std::runtime_error("Failed to open pty");
+    }
+    thread_ = std::thread([this] { run(); });
+  }
+  PtyMonitor(const PtyMonitor&) = delete;
+  auto operator=(const PtyMonitor&) -> PtyMonitor& = delete;
+  ~PtyMonitor()
+  {
+    stop_ = true;
+    thread_.join();
+    ::close(fd_);
+  }
+
+  auto slave_name() const -> std::string { return ptsname(fd_); }
+
+ private:
+  void run()
+  {
+    std::string line;
+    char buffer[256];
+    while (!stop_) {
+      pollfd pfd{.fd = fd_, .events = POLLIN, .revents = 0};
+      if (::poll(&pfd, 1, 10) <= 0) {
+        continue;
+      }
+      const auto n = ::read(fd_, buffer, sizeof buffer);
+      if (n <= 0) {
+        continue;
+      }
+      line.append(buffer, n);
+      for (auto pos = line.find('\n'); pos != std::string::npos; pos = line.find('\n')) {
+        line.erase(0, pos + 1);
+        if (::write(fd_, reply.data(), reply.size()) < 0) {
+          return;
+        }
+      }
+    }
+  }
+};
+
+// Reads until the prompt, either sleeping a millisecond whenever no data is available or waiting with poll()
+auto read_reply(m65dap::Connection& conn, bool sleep_polling) -> bool
+{
+  std::string received;
+  m65dap::Duration t;
+  while (received.find('.') == std::string::npos) {
+    const auto data = conn.read(1024, 0);
+    if (!data.empty()) {
+      received += data;
+      continue;
+    }
+    if (t.elapsed_ms() > 1000) {
+      return false;
+    }
+    if (sleep_polling) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    else {
+      conn.wait_for_input(1000);
+    }
+  }
+  return true;
+}
+
+void measure(std::string_view name, m65dap::Connection& conn, bool sleep_polling)
+{
+  std::vector<double> round_trips;
+  round_trips.reserve(iterations);
+  for (int idx{0}; idx < iterations; ++idx) {
+    m65dap::Duration t;
+    conn.write(command);
+    if (!read_reply(conn, sleep_polling)) {
+      throw std::runtime_error("No reply from monitor");
+    }
+    round_trips.push_back(static_cast<double>(t.elapsed_us()));
+  }
+  std::sort(round_trips.begin(), round_trips.end());
+  const double mean = std::accumulate(round_trips.begin(), round_trips.end(), 0.0) / iterations;
+  fmt::print("{:<16} mean {:>8.1f} us  median {:>8.1f} us  p99 {:>8.1f} us\n", name, mean,
+             round_trips[iterations / 2], round_trips[iterations * 99 / 100]);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  try {
+    std::unique_ptr<PtyMonitor> monitor;
+    std::string device;
+    if (argc > 1) {
+      device = argv[1];
+    }
+    else {
+      monitor = std::make_unique<PtyMonitor>();
+      device = monitor->slave_name();
+    }
+    m65dap::UnixSerialConnection conn(device);
+    measure("sleep polling", conn, true);
+    measure("poll", conn, false);
+  }
+  catch (const std::exception& e) {
+    fmt::print(stderr, "Error: {}\n", e.what());
+    return 1;
+  }
+  return 0;
+}
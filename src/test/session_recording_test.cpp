@@ -0,0 +1,137 @@
+#include "session_recording.h"
+
+#include <gtest/gtest.h>
+
+#include "duration.h"
+#include "m65_debugger.h"
+#include "mock_mega65.h"
+
+namespace m65dap::test {
+
+namespace {
+
+auto recording_path(std::string_view name) -> std::filesystem::path
+{
+  return std::filesystem::temp_directory_path() / fmt::format("m65dap_{}_{}.m65wire", name, getpid());
+}
+
+// Command "m2000" answered after 100ms in two chunks
+auto slow_reply_recording() -> SessionRecording
+{
+  using std::chrono::microseconds;
+  using Direction = RecordedChunk::Direction;
+  return SessionRecording{.device = "/dev/ttyUSB0",
+                          .chunks = {{.direction = Direction::Write, .time = microseconds(0), .data = "m2000\n"},
+                                     {.direction = Direction::Read, .time = microseconds(100000), .data = "m2000\r\n"},
+                                     {.direction = Direction::Read, .time = microseconds(101000), .data = ":0000\r\n."}}};
+}
+
+auto read_reply(Connection& conn) -> std::string
+{
+  std::string result;
+  while (!result.ends_with('.')) {
+    const auto data = conn.read(1024, 1000);
+    if (data.empty()) {
+      break;
+    }
+    result += data;
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(SessionRecordingSuite, RecordsWritesAndReads)
+{
+  const auto path = recording_path("chunks");
+  {
+    RecordingConnection conn(std::make_unique<mock::MockMega65>(), path, "/dev/ttyUSB0");
+    conn.write(std::string_view("m2000\n"));
+    EXPECT_TRUE(read_reply(conn).starts_with("m2000\r\n:00002000:"));
+  }
+
+  const auto recording = SessionRecording::load(path);
+  std::filesystem::remove(path);
+  EXPECT_EQ(recording.device, "/dev/ttyUSB0");
+  ASSERT_GE(recording.chunks.size(), 2);
+  EXPECT_EQ(recording.chunks[0].direction, RecordedChunk::Direction::Write);
+  EXPECT_EQ(recording.chunks[0].data, "m2000\n");
+  std::string reply;
+  for (std::size_t idx{1}; idx < recording.chunks.size(); ++idx) {
+    EXPECT_EQ(recording.chunks[idx].direction, RecordedChunk::Direction::Read);
+    EXPECT_GE(recording.chunks[idx].time, recording.chunks[idx - 1].time);
+    reply += recording.chunks[idx].data;
+  }
+  EXPECT_TRUE(reply.starts_with("m2000\r\n:00002000:")) << reply;
+
+  EXPECT_THROW(SessionRecording::load(recording_path("missing")), std::runtime_error);
+}
+
+TEST(SessionRecordingSuite, ReplayTiming)
+{
+  // Replies aren't served before their command was written
+  ReplayConnection original(slow_reply_recording());
+  EXPECT_EQ(original.read(1024, 20), "");
+  original.write(std::string_view("m2000\n"));
+  EXPECT_EQ(original.read(1024, 0), "");
+  Duration t;
+  EXPECT_EQ(read_reply(original), "m2000\r\n:0000\r\n.");
+  EXPECT_GE(t.elapsed_ms(), 90);
+  EXPECT_TRUE(original.finished());
+
+  ReplayConnection accelerated(slow_reply_recording(), 10.0);
+  accelerated.write(std::string_view("m20"));
+  accelerated.write(std::string_view("00\n"));
+  t.reset();
+  EXPECT_EQ(read_reply(accelerated), "m2000\r\n:0000\r\n.");
+  EXPECT_GE(t.elapsed_ms(), 9);
+  EXPECT_LT(t.elapsed_ms(), 80);
+
+  ReplayConnection unthrottled(slow_reply_recording(), 0.0);
+  unthrottled.write(std::string_view("m2000\n"));
+  EXPECT_EQ(unthrottled.read(3, 0), "m20");
+  EXPECT_EQ(unthrottled.read(1024, 0), "00\r\n:0000\r\n.");
+  EXPECT_EQ(unthrottled.read(1024, 0), "");
+}
+
+TEST(SessionRecordingSuite, ReplayDiverges)
+{
+  ReplayConnection replay(slow_reply_recording(), 0.0);
+  EXPECT_THROW(replay.write(std::string_view("m3000\n")), std::runtime_error);
+
+  ReplayConnection completed(slow_reply_recording(), 0.0);
+  completed.write(std::string_view("m2000\n"));
+  EXPECT_THROW(completed.write(std::string_view("r\n")), std::runtime_error);
+}
+
+TEST(SessionRecordingSuite, ReplayDebugSession)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+  const auto path = recording_path("session");
+  const std::array<std::byte, 3> values{std::byte{0x11}, std::byte{0x22}, std::byte{0x33}};
+
+  auto debug_session = [&](M65Debugger& debugger) {
+    debugger.set_target("data/test.prg");
+    debugger.pause();
+    debugger.write_memory(0x4000, values);
+    std::array<std::byte, 3> readback{};
+    debugger.read_memory(0x4000, readback);
+    return readback;
+  };
+
+  {
+    auto recording = std::make_unique<RecordingConnection>(std::make_unique<mock::MockMega65>(), path, "mock");
+    M65Debugger debugger(std::move(recording), &handler);
+    EXPECT_EQ(debug_session(debugger), values);
+  }
+  {
+    // Same session without a target, the replay throws as soon as the debugger writes something else
+    M65Debugger debugger(fmt::format("replay#{}", path.string()), &handler, nullptr, false, true, true, {}, 0.0);
+    EXPECT_EQ(debug_session(debugger), values);
+  }
+  std::filesystem::remove(path);
+}
+
+}  // namespace m65dap::test
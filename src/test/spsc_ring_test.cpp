@@ -0,0 +1,67 @@
+#include "spsc_ring.h"
+
+#include <gtest/gtest.h>
+
+namespace m65dap::test {
+
+TEST(SpscRingSuite, PushAndPopWrapAround)
+{
+  SpscRing<int> ring(6);
+  EXPECT_EQ(ring.capacity(), 8);
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ(ring.front(), nullptr);
+
+  const std::array<int, 6> values{1, 2, 3, 4, 5, 6};
+  EXPECT_EQ(ring.push(values), 6);
+  std::array<int, 4> target{};
+  EXPECT_EQ(ring.pop(target), 4);
+  EXPECT_EQ(target, (std::array<int, 4>{1, 2, 3, 4}));
+
+  // Crosses the end of the buffer, only the free space is filled
+  EXPECT_EQ(ring.push(values), 6);
+  EXPECT_EQ(ring.size(), 8);
+  EXPECT_FALSE(ring.push(7));
+
+  ASSERT_NE(ring.front(), nullptr);
+  EXPECT_EQ(*ring.front(), 5);
+  ring.pop_front();
+  std::array<int, 8> rest{};
+  EXPECT_EQ(ring.pop(rest), 7);
+  EXPECT_EQ(rest, (std::array<int, 8>{6, 1, 2, 3, 4, 5, 6, 0}));
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(SpscRingSuite, ProducerAndConsumerThreads)
+{
+  constexpr std::uint32_t count = 1000000;
+  SpscRing<std::uint32_t> ring(1000);
+
+  std::thread producer([&] {
+    std::array<std::uint32_t, 37> block{};
+    std::uint32_t next{0};
+    while (next < count) {
+      const auto size = std::min<std::size_t>(block.size(), count - next);
+      std::iota(block.begin(), block.begin() + size, next);
+      std::span<const std::uint32_t> remaining(block.data(), size);
+      while (!remaining.empty()) {
+        remaining = remaining.subspan(ring.push(remaining));
+      }
+      next += size;
+    }
+  });
+
+  std::array<std::uint32_t, 53> block{};
+  std::uint32_t expected{0};
+  bool in_order{true};
+  while (expected < count) {
+    const auto n = ring.pop(block);
+    for (std::size_t idx{0}; idx < n; ++idx) {
+      in_order &= block[idx] == expected++;
+    }
+  }
+  producer.join();
+  EXPECT_TRUE(in_order);
+  EXPECT_TRUE(ring.empty());
+}
+
+}  // namespace m65dap::test
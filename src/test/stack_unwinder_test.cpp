@@ -0,0 +1,71 @@
+#include "stack_unwinder.h"
+
+#include <gtest/gtest.h>
+
+namespace m65dap::test {
+
+namespace {
+
+struct TestMemory {
+  std::vector<std::byte> data = std::vector<std::byte>(0x10000);
+  int reads_at_stack{0};
+
+  void poke(int address, std::initializer_list<int> bytes)
+  {
+    for (auto b : bytes) {
+      data[address++] = static_cast<std::byte>(b);
+    }
+  }
+
+  auto reader(int stack_address) -> MemoryReader
+  {
+    return [this, stack_address](int address, std::span<std::byte> target) {
+      reads_at_stack += address == stack_address ? 1 : 0;
+      std::copy_n(data.begin() + address, target.size(), target.begin());
+    };
+  }
+};
+
+}  // namespace
+
+TEST(StackUnwinderSuite, ValidatesCallSites)
+{
+  C64DebuggerData dbg_data("data/test.dbg");
+  TestMemory memory;
+  memory.poke(0x2029, {0x20, 0x16, 0x20});  // JSR Entry
+  memory.poke(0x2033, {0x63, 0xE1, 0xFF});  // BSR Entry
+  memory.poke(0x2036, {0x20, 0x00, 0x90});  // JSR to unknown code
+
+  // Garbage, the unknown JSR, the BSR and the first JSR
+  memory.poke(0x1F1, {0x55, 0x38, 0x20, 0x35, 0x20, 0x2B, 0x20});
+
+  const auto frames = unwind_stack(0x2016, 0x1F0, &dbg_data, memory.reader(0x1F1));
+  ASSERT_EQ(frames.size(), 3);
+  EXPECT_EQ(frames[0].pc, 0x2016);
+  EXPECT_EQ(frames[0].stack_address, -1);
+  EXPECT_EQ(frames[0].name, "Entry");
+  EXPECT_EQ(frames[1].pc, 0x2033);
+  EXPECT_EQ(frames[1].stack_address, 0x1F4);
+  EXPECT_EQ(frames[1].name, "Entry+$1D");
+  EXPECT_EQ(frames[2].pc, 0x2029);
+  EXPECT_EQ(frames[2].stack_address, 0x1F6);
+  EXPECT_EQ(memory.reads_at_stack, 1);
+}
+
+TEST(StackUnwinderSuite, LimitsFrames)
+{
+  C64DebuggerData dbg_data("data/test.dbg");
+  TestMemory memory;
+  memory.poke(0x2029, {0x20, 0x16, 0x20});
+  for (int address{0x100}; address < 0x200; address += 2) {
+    memory.poke(address, {0x2B, 0x20});
+  }
+
+  EXPECT_EQ(unwind_stack(0x2016, 0x101, &dbg_data, memory.reader(0x102), 8).size(), 8);
+  EXPECT_EQ(unwind_stack(0x2016, 0x1FF, &dbg_data, memory.reader(0x200)).size(), 1);
+
+  // Without debug data no call can be validated
+  EXPECT_EQ(unwind_stack(0x2016, 0x101, nullptr, memory.reader(0x102)).front().name, "$2016");
+}
+
+}  // namespace m65dap::test
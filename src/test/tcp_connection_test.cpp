@@ -0,0 +1,82 @@
+#include "tcp_connection.h"
+
+#include <gtest/gtest.h>
+
+#include "m65_debugger.h"
+#include "tcp_mock_server.h"
+
+namespace m65dap::test {
+
+namespace {
+
+auto serve_mock(bool is_xemu) -> TcpMonitorServer
+{
+  return TcpMonitorServer([is_xemu] { return std::make_unique<MockMega65Stream>(is_xemu); });
+}
+
+}  // namespace
+
+TEST(TcpConnectionSuite, SplitHostPort)
+{
+  EXPECT_EQ(split_host_port("localhost:4510"), (std::pair<std::string, std::string>{"localhost", "4510"}));
+  EXPECT_EQ(split_host_port("192.168.1.2:23"), (std::pair<std::string, std::string>{"192.168.1.2", "23"}));
+  EXPECT_EQ(split_host_port("[::1]:4510"), (std::pair<std::string, std::string>{"::1", "4510"}));
+  EXPECT_THROW(split_host_port("localhost"), std::invalid_argument);
+  EXPECT_THROW(split_host_port("localhost:"), std::invalid_argument);
+  EXPECT_THROW(split_host_port(":4510"), std::invalid_argument);
+}
+
+TEST(TcpConnectionSuite, ConnectErrors)
+{
+  int port{0};
+  {
+    auto server = serve_mock(false);
+    port = server.port();
+  }
+  EXPECT_THROW(TcpConnection(fmt::format("127.0.0.1:{}", port)), std::runtime_error);
+  EXPECT_THROW(TcpConnection("host.invalid:4510"), std::runtime_error);
+}
+
+TEST(TcpConnectionSuite, CommandsSplitAcrossWrites)
+{
+  auto server = serve_mock(false);
+  TcpConnection conn(server.address().substr(4));
+
+  conn.write(std::string_view("?"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  conn.write(std::string_view("\nm2000\n"));
+
+  std::string reply;
+  Duration t;
+  while (std::count(reply.begin(), reply.end(), '.') < 2 && t.elapsed_ms() < 2000) {
+    reply += conn.read(1024, 100);
+  }
+  EXPECT_TRUE(reply.starts_with("?\r\nMEGA65 Serial Monitor")) << reply;
+  EXPECT_NE(reply.find("m2000\r\n:00002000:"), std::string::npos) << reply;
+}
+
+TEST(TcpConnectionSuite, DebugOverTcp)
+{
+  class EventHandler : public M65Debugger::EventHandlerInterface {
+  };
+  EventHandler handler;
+
+  // The monitor dialect is detected from the reply to the help command
+  for (const bool is_xemu : {false, true}) {
+    auto server = serve_mock(is_xemu);
+    M65Debugger debugger(server.address(), &handler);
+    debugger.set_target("data/test.prg");
+    debugger.pause();
+
+    std::vector<std::byte> values(0x300);
+    for (std::size_t idx{0}; idx < values.size(); ++idx) {
+      values[idx] = static_cast<std::byte>(idx * 3);
+    }
+    debugger.write_memory(0x4000, values);
+    std::vector<std::byte> readback(values.size());
+    debugger.read_memory(0x4000, readback);
+    EXPECT_EQ(readback, values) << (is_xemu ? "Xemu" : "MEGA65");
+  }
+}
+
+}  // namespace m65dap::test
@@ -0,0 +1,151 @@
+#include "tcp_mock_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace m65dap::test {
+
+namespace {
+
+constexpr int forward_chunk_size = 0x10000;
+// Longest time the server waits for input before checking whether it has to stop
+constexpr int poll_interval_ms = 10;
+
+auto wait_readable(int fd, int timeout_ms) -> bool
+{
+  pollfd pfd{.fd = fd, .events = POLLIN, .revents = 0};
+  return ::poll(&pfd, 1, timeout_ms) > 0;
+}
+
+auto send_all(int fd, std::string_view data) -> bool
+{
+  while (!data.empty()) {
+    const auto n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0 && errno != EINTR) {
+      return false;
+    }
+    data.remove_prefix(std::max<ssize_t>(n, 0));
+  }
+  return true;
+}
+
+}  // namespace
+
+void MockMega65Stream::write(std::span<const char> buffer)
+{
+  pending_.append(buffer.begin(), buffer.end());
+  while (!pending_.empty()) {
+    if (const auto load_bytes = static_cast<std::size_t>(mock_.pending_load_bytes()); load_bytes > 0) {
+      const auto count = std::min(load_bytes, pending_.size());
+      mock_.write(std::string_view(pending_).substr(0, count));
+      pending_.erase(0, count);
+      continue;
+    }
+    auto eol = pending_.find_first_of("\r\n");
+    if (eol == std::string::npos || (pending_[eol] == '\r' && eol + 1 == pending_.size())) {
+      return;
+    }
+    if (pending_[eol] == '\r' && pending_[eol + 1] == '\n') {
+      ++eol;
+    }
+    mock_.write(std::string_view(pending_).substr(0, eol + 1));
+    pending_.erase(0, eol + 1);
+  }
+}
+
+auto MockMega65Stream::read(int bytes_to_read, int timeout_ms) -> std::string
+{
+  return mock_.read(bytes_to_read, timeout_ms);
+}
+
+TcpMonitorServer::TcpMonitorServer(ConnectionFactory factory, int port, std::string_view bind_address) :
+    factory_(std::move(factory)), bind_address_(bind_address)
+{
+  listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+  throw_if<std::runtime_error>(listen_fd_ < 0, fmt::format("Open error: {}", strerror(errno)));
+  const int one = 1;
+  ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<std::uint16_t>(port));
+  if (::inet_pton(AF_INET, bind_address_.c_str(), &addr.sin_addr) != 1 ||
+      ::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(listen_fd_, 1) < 0) {
+    const int error = errno;
+    ::close(listen_fd_);
+    throw std::runtime_error(fmt::format("Can't listen on {}:{}: {}", bind_address_, port, strerror(error)));
+  }
+
+  socklen_t length = sizeof(addr);
+  ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &length);
+  port_ = ntohs(addr.sin_port);
+  thread_ = std::thread([this] { serve(); });
+}
+
+TcpMonitorServer::~TcpMonitorServer()
+{
+  stop_ = true;
+  thread_.join();
+  ::close(listen_fd_);
+}
+
+auto TcpMonitorServer::address() const -> std::string { return fmt::format("tcp#{}:{}", bind_address_, port_); }
+
+void TcpMonitorServer::serve()
+{
+  while (!stop_) {
+    if (!wait_readable(listen_fd_, poll_interval_ms)) {
+      continue;
+    }
+    const int client_fd = ::accept(listen_fd_, nullptr, nullptr);
+    if (client_fd < 0) {
+      continue;
+    }
+    const int one = 1;
+    ::setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    try {
+      auto target = factory_();
+      forward(client_fd, *target);
+    }
+    catch (const std::exception& e) {
+      fmt::print(stderr, "Monitor connection failed: {}\n", e.what());
+    }
+    ::close(client_fd);
+  }
+}
+
+void TcpMonitorServer::forward(int client_fd, Connection& target)
+{
+  std::string buffer(forward_chunk_size, '\0');
+  while (!stop_) {
+    bool idle{true};
+    if (wait_readable(client_fd, 0)) {
+      const auto n = ::recv(client_fd, buffer.data(), buffer.size(), 0);
+      if (n <= 0) {
+        return;
+      }
+      target.write(std::span<const char>(buffer.data(), n));
+      idle = false;
+    }
+    if (const auto reply = target.read(forward_chunk_size, 0); !reply.empty()) {
+      if (!send_all(client_fd, reply)) {
+        return;
+      }
+      idle = false;
+    }
+    if (idle) {
+      // Input of the client is picked up at most a millisecond late
+      target.wait_for_input(1);
+    }
+  }
+}
+
+}  // namespace m65dap::test
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "connection.h"
+#include "mock_mega65.h"
+
+namespace m65dap::test {
+
+/**
+ * @brief MockMega65 accepting commands split at arbitrary positions, as they arrive from a stream socket
+ *
+ * The mock expects complete command lines per write, incomplete ones are kept until the rest arrives.
+ */
+class MockMega65Stream : public Connection {
+  mock::MockMega65 mock_;
+  std::string pending_;
+
+ public:
+  explicit MockMega65Stream(bool is_xemu = false) : mock_(is_xemu) {}
+
+  void write(std::span<const char> buffer) override;
+  auto read(int bytes_to_read, int timeout_ms = 1000) -> std::string override;
+};
+
+/**
+ * @brief Exposes a monitor connection over TCP, serving one client at a time
+ *
+ * Every client gets a new connection from the factory, so a mock starts in the same state for each of them.
+ */
+class TcpMonitorServer {
+ public:
+  using ConnectionFactory = std::function<std::unique_ptr<Connection>()>;
+
+  /**
+   * @param factory Creates the connection forwarded to a client
+   * @param port Port to listen on, 0 picks a free one
+   * @param bind_address Address to listen on, loopback only by default
+   */
+  explicit TcpMonitorServer(ConnectionFactory factory, int port = 0, std::string_view bind_address = "127.0.0.1");
+  TcpMonitorServer(const TcpMonitorServer&) = delete;
+  auto operator=(const TcpMonitorServer&) -> TcpMonitorServer& = delete;
+  ~TcpMonitorServer();
+
+  auto port() const -> int { return port_; }
+
+  /**
+   * @brief Address to pass to the debugger, e.g. "tcp#127.0.0.1:4510"
+   */
+  auto address() const -> std::string;
+
+ private:
+  void serve();
+  void forward(int client_fd, Connection& target);
+
+  ConnectionFactory factory_;
+  std::string bind_address_;
+  int listen_fd_{-1};
+  int port_{0};
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+}  // namespace m65dap::test
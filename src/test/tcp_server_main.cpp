@@ -0,0 +1,70 @@
+#include <csignal>
+
+#include "tcp_mock_server.h"
+#include "unix_serial_connection.h"
+
+// Exposes the mock, or the monitor of a MEGA65 attached to a serial port, over TCP, to debug with
+// "serialPort": "tcp#<host>:<port>"
+
+namespace {
+
+constexpr int default_port = 4510;
+
+void usage()
+{
+  fmt::print(stderr,
+             "Usage: m65_tcp_server [--port <port>] [--bind <address>] [--xemu] [<serial device>]\n"
+             "Without a serial device a mock MEGA65 (or Xemu with --xemu) is served\n");
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  int port{default_port};
+  std::string bind_address{"127.0.0.1"};
+  bool is_xemu{false};
+  std::string device;
+
+  const std::vector<std::string_view> args(argv + 1, argv + argc);
+  for (std::size_t idx{0}; idx < args.size(); ++idx) {
+    if (args[idx] == "--port" && idx + 1 < args.size()) {
+      port = m65dap::str_to_int(args[++idx]);
+    }
+    else if (args[idx] == "--bind" && idx + 1 < args.size()) {
+      bind_address = args[++idx];
+    }
+    else if (args[idx] == "--xemu") {
+      is_xemu = true;
+    }
+    else if (!args[idx].starts_with("-") && device.empty()) {
+      device = args[idx];
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  try {
+    signal(SIGPIPE, SIG_IGN);
+    m65dap::test::TcpMonitorServer server(
+        [&]() -> std::unique_ptr<m65dap::Connection> {
+          if (device.empty()) {
+            return std::make_unique<m65dap::test::MockMega65Stream>(is_xemu);
+          }
+          return std::make_unique<m65dap::UnixSerialConnection>(device);
+        },
+        port, bind_address);
+    fmt::print("Serving {} on {}\n", device.empty() ? "mock" : device, server.address());
+    std::fflush(stdout);
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::hours(1));
+    }
+  }
+  catch (const std::exception& e) {
+    fmt::print(stderr, "Error: {}\n", e.what());
+    return 1;
+  }
+  return 0;
+}
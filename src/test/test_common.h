@@ -6,4 +6,21 @@ namespace m65dap::test {
 
 void test_command(mock::MockMega65& conn, std::string_view cmd, const std::vector<std::string>& expected_lines);
 
+// Passes everything through to the mock, recording the commands sent by the debugger
+class CommandRecorder : public Connection {
+  mock::MockMega65 mock_;
+  std::vector<std::string>& commands_;
+
+ public:
+  explicit CommandRecorder(std::vector<std::string>& commands) : commands_(commands) {}
+
+  void write(std::span<const char> buffer) override
+  {
+    commands_.emplace_back(buffer.begin(), buffer.end());
+    mock_.write(buffer);
+  }
+
+  auto read(int bytes_to_read, int timeout_ms) -> std::string override { return mock_.read(bytes_to_read, timeout_ms); }
+};
+
 }
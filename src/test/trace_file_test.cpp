@@ -0,0 +1,211 @@
+#include "trace_file.h"
+
+#include <gtest/gtest.h>
+
+#include "m65_debugger.h"
+#include "mock_mega65.h"
+
+using namespace std::chrono_literals;
+
+namespace m65dap::test {
+
+namespace {
+
+auto temp_trace_path() -> std::filesystem::path
+{
+  return std::filesystem::temp_directory_path() /
+         fmt::format("m65dap_{}.trace", ::testing::UnitTest::GetInstance()->current_test_info()->name());
+}
+
+auto make_record(int pc) -> TraceRecord
+{
+  TraceRecord record;
+  record.pc = static_cast<std::uint16_t>(pc);
+  record.a = static_cast<std::uint8_t>(pc & 0xff);
+  record.instruction = {0xEA, 0x00, 0x00};
+  record.instruction_length = 1;
+  return record;
+}
+
+void record_trace(M65Debugger& debugger, const std::filesystem::path& path, std::uint64_t min_records)
+{
+  debugger.set_target("data/test.prg");
+  debugger.run_target();
+  debugger.start_trace_recording(path, 1000);
+  EXPECT_TRUE(debugger.is_trace_recording());
+  for (int i{0}; i < 500 && debugger.get_trace_record_count() < min_records; ++i) {
+    std::this_thread::sleep_for(1ms);
+  }
+  debugger.stop_trace_recording();
+  EXPECT_FALSE(debugger.is_trace_recording());
+}
+
+struct EventHandler : public M65Debugger::EventHandlerInterface {
+  std::atomic<int> stopped_count{0};
+  void handle_debugger_stopped(M65Debugger::StoppedReason) override { ++stopped_count; }
+};
+
+}  // namespace
+
+TEST(TraceFileSuite, RingBufferWrapAround)
+{
+  const auto path = temp_trace_path();
+  TraceFile trace(path, 4);
+  EXPECT_EQ(trace.size(), 0);
+
+  for (int pc = 0x2000; pc < 0x2006; ++pc) {
+    trace.append(make_record(pc));
+  }
+
+  EXPECT_EQ(trace.total_records(), 6);
+  EXPECT_EQ(trace.size(), 4);
+  EXPECT_EQ(trace.first_index(), 2);
+  EXPECT_EQ(trace.at(2).pc, 0x2002);
+  EXPECT_EQ(trace.at(5).pc, 0x2005);
+  EXPECT_THROW(trace.at(1), std::out_of_range);
+  EXPECT_THROW(trace.at(6), std::out_of_range);
+
+  std::filesystem::remove(path);
+}
+
+TEST(TraceFileSuite, QueryInstructions)
+{
+  const auto path = temp_trace_path();
+  TraceFile trace(path, 100);
+  for (int i{0}; i < 3; ++i) {
+    for (int pc = 0x2000; pc < 0x2005; ++pc) {
+      trace.append(make_record(pc));
+    }
+  }
+
+  EXPECT_EQ(trace.find_last(0x2002), 12);
+  EXPECT_EQ(trace.find_last(0x2002, 12), 7);
+  EXPECT_FALSE(trace.find_last(0x3000).has_value());
+
+  auto records = trace.last_instructions_before_pc(0x2002, 3);
+  ASSERT_EQ(records.size(), 3);
+  EXPECT_EQ(records[0].pc, 0x2004);
+  EXPECT_EQ(records[1].pc, 0x2000);
+  EXPECT_EQ(records[2].pc, 0x2001);
+
+  EXPECT_EQ(trace.last_instructions_before_pc(0x2001, 100).size(), 11);
+  EXPECT_TRUE(trace.last_instructions_before_pc(0x3000, 100).empty());
+
+  records = trace.last_instructions(2);
+  ASSERT_EQ(records.size(), 2);
+  EXPECT_EQ(records[0].pc, 0x2003);
+  EXPECT_EQ(records[1].pc, 0x2004);
+
+  std::filesystem::remove(path);
+}
+
+TEST(TraceFileSuite, ReopenReadOnly)
+{
+  const auto path = temp_trace_path();
+  {
+    TraceFile trace(path, 8);
+    for (int pc = 0x2000; pc < 0x200A; ++pc) {
+      trace.append(make_record(pc));
+    }
+  }
+
+  const TraceFile trace(path);
+  EXPECT_EQ(trace.capacity(), 8);
+  EXPECT_EQ(trace.total_records(), 10);
+  EXPECT_EQ(trace.at(9).pc, 0x2009);
+  EXPECT_EQ(trace.at(9).a, 0x09);
+  EXPECT_EQ(trace.at(9).to_string(), "2009  EA        A:09 X:00 Y:00 Z:00 B:00 SP:0000 P:00");
+
+  std::filesystem::remove(path);
+}
+
+TEST(TraceFileSuite, InvalidFile)
+{
+  const auto path = temp_trace_path();
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "This is not a trace file, just some text";
+  }
+  EXPECT_THROW(TraceFile trace(path), std::runtime_error);
+  EXPECT_THROW(TraceFile trace(path, 0), std::invalid_argument);
+
+  std::filesystem::remove(path);
+}
+
+TEST(TraceFileSuite, RecordRunningTarget)
+{
+  const auto path = temp_trace_path();
+  EventHandler handler;
+  M65Debugger debugger(std::make_unique<mock::MockMega65>(), &handler);
+  record_trace(debugger, path, 100);
+
+  EXPECT_GE(debugger.get_trace_record_count(), 100);
+  EXPECT_EQ(handler.stopped_count, 1);
+
+  // The mock steps endlessly through the main loop of the test program
+  auto records = debugger.get_trace_instructions(4, 0x2056);
+  ASSERT_EQ(records.size(), 4);
+  EXPECT_EQ(records[0].pc, 0x2058);
+  EXPECT_EQ(records[1].pc, 0x205A);
+  EXPECT_EQ(records[2].pc, 0x205C);
+  EXPECT_EQ(records[2].a, 0x34);
+  EXPECT_EQ(records[3].pc, 0x205E);
+  EXPECT_EQ(records[3].instruction_length, 3);
+  EXPECT_EQ(records[3].instruction, (std::array<std::uint8_t, 3>{0x4C, 0x56, 0x20}));
+
+  std::filesystem::remove(path);
+}
+
+TEST(TraceFileSuite, RecordUntilBreakpoint)
+{
+  struct BreakpointHandler : public M65Debugger::EventHandlerInterface {
+    std::atomic<int> breakpoint_count{0};
+    void handle_debugger_stopped(M65Debugger::StoppedReason reason) override
+    {
+      breakpoint_count += reason == M65Debugger::StoppedReason::Breakpoint ? 1 : 0;
+    }
+  };
+  const auto path = temp_trace_path();
+  BreakpointHandler handler;
+  M65Debugger debugger(std::make_unique<mock::MockMega65>(), &handler);
+  debugger.set_target("data/test.prg");
+  debugger.set_breakpoint("data/test_main.asm", 82);  // STA $03 at $205C
+  debugger.run_target();
+  for (int i{0}; i < 500 && handler.breakpoint_count < 1; ++i) {
+    std::this_thread::sleep_for(1ms);
+  }
+  ASSERT_EQ(handler.breakpoint_count, 1);
+  debugger.start_trace_recording(path, 1000);
+  for (int i{0}; i < 500 && handler.breakpoint_count < 2; ++i) {
+    std::this_thread::sleep_for(1ms);
+  }
+
+  // Stopped at the first step reaching the breakpoint, though the rest of the batch was recorded as well. The mock
+  // reports the trigger at $2058.
+  ASSERT_FALSE(debugger.is_trace_recording());
+  EXPECT_EQ(handler.breakpoint_count, 2);
+  EXPECT_EQ(debugger.get_registers().pc, 0x205C);
+  EXPECT_EQ(debugger.get_replay_position(), 2u);
+  EXPECT_GT(debugger.get_trace_record_count(), 3u);
+
+  std::filesystem::remove(path);
+}
+
+TEST(TraceFileSuite, RecordRunningTargetXemu)
+{
+  const auto path = temp_trace_path();
+  EventHandler handler;
+  M65Debugger debugger(std::make_unique<mock::MockMega65>(true), &handler, nullptr, true);
+  record_trace(debugger, path, 50);
+
+  // Xemu doesn't disassemble, instruction bytes are read from memory
+  auto records = debugger.get_trace_instructions(1, 0x2056);
+  ASSERT_EQ(records.size(), 1);
+  EXPECT_EQ(records[0].pc, 0x205E);
+  EXPECT_EQ(records[0].instruction_length, 0);
+  EXPECT_EQ(records[0].instruction, (std::array<std::uint8_t, 3>{0x4C, 0x56, 0x20}));
+
+  std::filesystem::remove(path);
+}
+
+}  // namespace m65dap::test
@@ -39,4 +39,37 @@ TEST(UtilSuite, ReplaceAllNoMatchTest)
   EXPECT_EQ(str, "The quick brown fox jumps over the lazy dog.");
 }
 
+TEST(UtilSuite, Base64EncodeTest)
+{
+  auto encode = [](std::string_view str) { return base64_encode(std::as_bytes(std::span(str))); };
+  EXPECT_EQ(encode(""), "");
+  EXPECT_EQ(encode("f"), "Zg==");
+  EXPECT_EQ(encode("fo"), "Zm8=");
+  EXPECT_EQ(encode("foo"), "Zm9v");
+  EXPECT_EQ(encode("foob"), "Zm9vYg==");
+  EXPECT_EQ(encode("fooba"), "Zm9vYmE=");
+  EXPECT_EQ(encode("foobar"), "Zm9vYmFy");
+
+  const std::array<std::byte, 4> binary{std::byte{0xFB}, std::byte{0xFF}, std::byte{0x00}, std::byte{0x3E}};
+  EXPECT_EQ(base64_encode(binary), "+/8APg==");
+}
+
+TEST(UtilSuite, Base64DecodeTest)
+{
+  auto decode = [](std::string_view str) {
+    const auto data = base64_decode(str);
+    return std::string(reinterpret_cast<const char*>(data.data()), data.size());
+  };
+  EXPECT_EQ(decode(""), "");
+  EXPECT_EQ(decode("Zg=="), "f");
+  EXPECT_EQ(decode("Zm8="), "fo");
+  EXPECT_EQ(decode("Zm9vYmFy"), "foobar");
+  EXPECT_EQ(base64_decode("+/8APg=="),
+            std::vector<std::byte>({std::byte{0xFB}, std::byte{0xFF}, std::byte{0x00}, std::byte{0x3E}}));
+
+  EXPECT_THROW(base64_decode("Zg="), std::invalid_argument);
+  EXPECT_THROW(base64_decode("Z!=="), std::invalid_argument);
+  EXPECT_THROW(base64_decode("Zg==Zg=="), std::invalid_argument);
+}
+
 }  // namespace m65dap::test
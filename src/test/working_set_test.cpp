@@ -0,0 +1,60 @@
+#include "working_set.h"
+
+#include <gtest/gtest.h>
+
+namespace m65dap::test {
+
+TEST(WorkingSetSuite, LearnAndReload)
+{
+  const auto path = std::filesystem::temp_directory_path() / "m65dap_test.workingset";
+  std::filesystem::remove(path);
+
+  WorkingSet working_set;
+  working_set.load(path);
+  EXPECT_TRUE(working_set.line_addresses().empty());
+
+  const std::vector<int> lines{0x2000, 0x100, 0xFFD3000};
+  working_set.learn(lines);
+  EXPECT_EQ(working_set.line_addresses(), lines);
+
+  // Stops without reads keep the previous set
+  working_set.learn({});
+  EXPECT_EQ(working_set.line_addresses(), lines);
+
+  WorkingSet reloaded;
+  reloaded.load(path);
+  EXPECT_EQ(reloaded.line_addresses(), lines);
+
+  std::filesystem::remove(path);
+}
+
+TEST(WorkingSetSuite, KeepsFirstLinesRead)
+{
+  std::vector<int> lines(WorkingSet::max_lines + 10);
+  for (std::size_t idx{0}; idx < lines.size(); ++idx) {
+    lines[idx] = static_cast<int>(idx) * 0x100;
+  }
+
+  WorkingSet working_set;
+  working_set.learn(lines);
+  ASSERT_EQ(working_set.line_addresses().size(), WorkingSet::max_lines);
+  EXPECT_EQ(working_set.line_addresses().back(), (WorkingSet::max_lines - 1) * 0x100);
+}
+
+TEST(WorkingSetSuite, Paths)
+{
+  const auto dir = std::filesystem::temp_directory_path() / "m65dap_test_dir";
+  const auto path = WorkingSet::file_path(dir, "data/test.prg");
+  EXPECT_EQ(path.parent_path(), dir);
+  EXPECT_TRUE(path.filename().string().starts_with("test-"));
+  EXPECT_NE(path, WorkingSet::file_path(dir, "other/test.prg"));
+
+  // Without a path the set is only kept in memory
+  const std::vector<int> lines{0x2000};
+  WorkingSet working_set;
+  working_set.load({});
+  working_set.learn(lines);
+  EXPECT_EQ(working_set.line_addresses(), lines);
+}
+
+}  // namespace m65dap::test
@@ -0,0 +1,179 @@
+#include "trace_file.h"
+
+#ifdef _POSIX_VERSION
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+constexpr std::array<char, 8> trace_file_magic{'M', '6', '5', 'T', 'R', 'A', 'C', 'E'};
+constexpr std::uint32_t trace_file_version = 1;
+
+// Keep the file size within what can be mapped on 32 bit systems
+constexpr std::uint64_t max_capacity = 64 * 1024 * 1024;
+
+}  // namespace
+
+namespace m65dap {
+
+auto TraceRecord::to_string() const -> std::string
+{
+  std::string bytes;
+  for (int i{0}; i < (instruction_length > 0 ? instruction_length : 3); ++i) {
+    bytes += fmt::format("{:02X} ", instruction[i]);
+  }
+  return fmt::format("{:04X}  {:<9} A:{:02X} X:{:02X} Y:{:02X} Z:{:02X} B:{:02X} SP:{:04X} P:{:02X}", pc, bytes, a, x, y,
+                     z, b, sp, flags);
+}
+
+TraceFile::TraceFile(const std::filesystem::path& path, std::uint64_t capacity) : path_(path)
+{
+  throw_if<std::invalid_argument>(capacity == 0 || capacity > max_capacity, "Invalid trace buffer capacity");
+  const std::size_t file_size = sizeof(Header) + capacity * sizeof(TraceRecord);
+
+#ifdef _POSIX_VERSION
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  throw_if<std::runtime_error>(fd_ < 0, fmt::format("Can't create trace file: {}", strerror(errno)));
+  if (ftruncate(fd_, static_cast<off_t>(file_size)) != 0) {
+    close(fd_);
+    throw std::runtime_error(fmt::format("Can't resize trace file: {}", strerror(errno)));
+  }
+#endif
+  map_file(file_size);
+
+  auto& h = header();
+  h.magic = trace_file_magic;
+  h.version = trace_file_version;
+  h.record_size = sizeof(TraceRecord);
+  h.capacity = capacity;
+  h.total_records = 0;
+}
+
+TraceFile::TraceFile(const std::filesystem::path& path) : path_(path), read_only_(true)
+{
+  const auto file_size = std::filesystem::file_size(path);
+  throw_if<std::runtime_error>(file_size < sizeof(Header), "Trace file too small");
+
+#ifdef _POSIX_VERSION
+  fd_ = open(path.c_str(), O_RDONLY);
+  throw_if<std::runtime_error>(fd_ < 0, fmt::format("Can't open trace file: {}", strerror(errno)));
+#endif
+  map_file(file_size);
+
+  const auto& h = header();
+  throw_if<std::runtime_error>(h.magic != trace_file_magic, "Not a trace file");
+  throw_if<std::runtime_error>(h.version != trace_file_version || h.record_size != sizeof(TraceRecord),
+                               "Unsupported trace file version");
+  throw_if<std::runtime_error>(h.capacity == 0 || sizeof(Header) + h.capacity * sizeof(TraceRecord) > file_size,
+                               "Trace file is truncated");
+}
+
+TraceFile::~TraceFile()
+{
+  try {
+    flush();
+  }
+  catch (...) {
+  }
+#ifdef _POSIX_VERSION
+  munmap(data_, mapped_size_);
+  close(fd_);
+#endif
+}
+
+void TraceFile::map_file(std::size_t size)
+{
+  mapped_size_ = size;
+#ifdef _POSIX_VERSION
+  const int prot = read_only_ ? PROT_READ : PROT_READ | PROT_WRITE;
+  void* ptr = mmap(nullptr, size, prot, MAP_SHARED, fd_, 0);
+  if (ptr == MAP_FAILED) {
+    close(fd_);
+    throw std::runtime_error(fmt::format("Can't map trace file: {}", strerror(errno)));
+  }
+  data_ = static_cast<std::byte*>(ptr);
+#else
+  buffer_.resize(size);
+  if (read_only_) {
+    std::ifstream in(path_, std::ios::binary);
+    in.read(reinterpret_cast<char*>(buffer_.data()), size);
+  }
+  data_ = buffer_.data();
+#endif
+}
+
+void TraceFile::append(const TraceRecord& record)
+{
+  assert(!read_only_);
+  auto& h = header();
+  records()[h.total_records % h.capacity] = record;
+  ++h.total_records;
+}
+
+void TraceFile::flush()
+{
+  if (read_only_) {
+    return;
+  }
+#ifdef _POSIX_VERSION
+  throw_if<std::runtime_error>(msync(data_, mapped_size_, MS_SYNC) != 0,
+                               fmt::format("Can't write trace file: {}", strerror(errno)));
+#else
+  std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+#endif
+}
+
+auto TraceFile::at(std::uint64_t index) const -> TraceRecord
+{
+  if (index < first_index() || index >= total_records()) {
+    throw std::out_of_range(fmt::format("Trace record {} is not available", index));
+  }
+  return records()[index % capacity()];
+}
+
+auto TraceFile::find_last(int pc, std::uint64_t before_index) const -> std::optional<std::uint64_t>
+{
+  const auto first = first_index();
+  const auto cap = capacity();
+  const auto* recs = records();
+  for (auto index = std::min(before_index, total_records()); index > first; --index) {
+    if (recs[(index - 1) % cap].pc == pc) {
+      return index - 1;
+    }
+  }
+  return {};
+}
+
+auto TraceFile::last_instructions_before_pc(int pc, std::uint64_t count) const -> std::vector<TraceRecord>
+{
+  const auto index = find_last(pc);
+  if (!index.has_value()) {
+    return {};
+  }
+  const auto first = std::max(first_index(), index.value() - std::min(index.value(), count));
+  return records_range(first, index.value());
+}
+
+auto TraceFile::last_instructions(std::uint64_t count) const -> std::vector<TraceRecord>
+{
+  const auto last = total_records();
+  return records_range(last - std::min(size(), count), last);
+}
+
+auto TraceFile::records_range(std::uint64_t first, std::uint64_t last) const -> std::vector<TraceRecord>
+{
+  std::vector<TraceRecord> result;
+  result.reserve(last - first);
+  const auto cap = capacity();
+  const auto* recs = records();
+  for (auto index = first; index < last; ++index) {
+    result.push_back(recs[index % cap]);
+  }
+  return result;
+}
+
+}  // namespace m65dap
@@ -0,0 +1,124 @@
+#pragma once
+
+namespace m65dap {
+
+/**
+ * @brief CPU state before executing one instruction
+ *
+ * Records have a fixed size, so any step of a trace can be accessed directly by its index.
+ */
+struct TraceRecord {
+  std::uint16_t pc{0};
+  std::uint16_t sp{0};
+  std::uint8_t a{0};
+  std::uint8_t x{0};
+  std::uint8_t y{0};
+  std::uint8_t z{0};
+  std::uint8_t b{0};
+  std::uint8_t flags{0};
+  std::array<std::uint8_t, 3> instruction{};
+  std::uint8_t instruction_length{0};  // 0 if the monitor didn't provide the instruction length
+  std::array<std::uint8_t, 2> reserved{};
+
+  auto to_string() const -> std::string;
+};
+
+static_assert(sizeof(TraceRecord) == 16);
+static_assert(std::is_trivially_copyable_v<TraceRecord>);
+
+/**
+ * @brief Instruction trace stored in a ring buffer file
+ *
+ * The file consists of a small header followed by a fixed number of record slots. Once all slots are used, the
+ * oldest records are overwritten. On POSIX systems the file is memory mapped, so appending a record is a plain
+ * memory write and millions of steps don't need to be held in the process heap.
+ *
+ * Records are addressed by their absolute index since the start of the recording. Only the indices in the range
+ * [first_index(), total_records()) are still available.
+ */
+class TraceFile {
+ public:
+  struct Header {
+    std::array<char, 8> magic;
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint64_t capacity;
+    std::uint64_t total_records;
+  };
+
+ private:
+  std::filesystem::path path_;
+  bool read_only_{false};
+  std::size_t mapped_size_{0};
+  std::byte* data_{nullptr};
+  std::vector<std::byte> buffer_;  // used instead of a memory mapping on non-POSIX systems
+#ifdef _POSIX_VERSION
+  int fd_{-1};
+#endif
+
+ public:
+  /**
+   * @brief Creates a new trace file (truncating an existing one) for recording
+   *
+   * @param path Path of the trace file
+   * @param capacity Number of records the ring buffer can hold
+   */
+  TraceFile(const std::filesystem::path& path, std::uint64_t capacity);
+
+  /**
+   * @brief Opens an existing trace file read-only
+   */
+  explicit TraceFile(const std::filesystem::path& path);
+
+  TraceFile(const TraceFile&) = delete;
+  TraceFile& operator=(const TraceFile&) = delete;
+  ~TraceFile();
+
+  auto path() const -> const std::filesystem::path& { return path_; }
+  auto capacity() const -> std::uint64_t { return header().capacity; }
+  auto total_records() const -> std::uint64_t { return header().total_records; }
+  auto size() const -> std::uint64_t { return std::min(total_records(), capacity()); }
+  auto first_index() const -> std::uint64_t { return total_records() - size(); }
+
+  void append(const TraceRecord& record);
+  void flush();
+
+  auto at(std::uint64_t index) const -> TraceRecord;
+
+  /**
+   * @brief Searches backwards for the last record with the given PC
+   *
+   * @param pc PC to search for
+   * @param before_index Only records with an index lower than this are considered
+   * @return Index of the record, or no value if the PC isn't part of the available trace
+   */
+  auto find_last(int pc, std::uint64_t before_index) const -> std::optional<std::uint64_t>;
+  auto find_last(int pc) const -> std::optional<std::uint64_t> { return find_last(pc, total_records()); }
+
+  /**
+   * @brief Returns the instructions executed before the last time the PC was reached
+   *
+   * @param pc PC to search for
+   * @param count Maximum number of instructions to return
+   * @return Records in execution order, not including the record at pc itself. Empty if pc wasn't found.
+   */
+  auto last_instructions_before_pc(int pc, std::uint64_t count) const -> std::vector<TraceRecord>;
+
+  /**
+   * @brief Returns the last recorded instructions
+   *
+   * @param count Maximum number of instructions to return
+   * @return Records in execution order
+   */
+  auto last_instructions(std::uint64_t count) const -> std::vector<TraceRecord>;
+
+ private:
+  void map_file(std::size_t size);
+  auto header() const -> const Header& { return *reinterpret_cast<const Header*>(data_); }
+  auto header() -> Header& { return *reinterpret_cast<Header*>(data_); }
+  auto records() const -> const TraceRecord* { return reinterpret_cast<const TraceRecord*>(data_ + sizeof(Header)); }
+  auto records() -> TraceRecord* { return reinterpret_cast<TraceRecord*>(data_ + sizeof(Header)); }
+  auto records_range(std::uint64_t first, std::uint64_t last) const -> std::vector<TraceRecord>;
+};
+
+}  // namespace m65dap
@@ -0,0 +1,49 @@
+#include "trace_file.h"
+
+namespace {
+
+const std::uint64_t default_count = 1000;
+
+void print_usage(const char* argv0)
+{
+  fmt::print(stderr,
+             "Usage:\n"
+             "  {} <trace-file> [count] [$pc]\n\n"
+             "Prints the last <count> (default {}) recorded instructions. If $pc is given, prints the\n"
+             "instructions executed before the last time $pc was reached.\n",
+             std::filesystem::path(argv0).filename().string(), default_count);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2 || argc > 4) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    const m65dap::TraceFile trace(argv[1]);
+    const std::uint64_t count = argc > 2 ? m65dap::str_to_int(argv[2]) : default_count;
+
+    std::vector<m65dap::TraceRecord> records;
+    if (argc > 3) {
+      records = trace.last_instructions_before_pc(m65dap::parse_c64_hex(argv[3]), count);
+    }
+    else {
+      records = trace.last_instructions(count);
+    }
+
+    fmt::print("{} steps recorded, {} available\n", trace.total_records(), trace.size());
+    for (const auto& record : records) {
+      fmt::print("{}\n", record.to_string());
+    }
+  }
+  catch (const std::exception& e) {
+    fmt::print(stderr, "Error: {}\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -2,28 +2,34 @@
 
 #include "unix_connection.h"
 
+#include <poll.h>
 #include <unistd.h>
 
 #include "duration.h"
 
-using namespace std::chrono_literals;
-
 namespace m65dap {
 
+UnixConnection::~UnixConnection()
+{
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
 void UnixConnection::write(std::span<const char> buffer)
 {
   int written = 0;
   while (written < buffer.size()) {
     auto n = ::write(fd_, buffer.data() + written, buffer.size() - written);
-    if (n < 0 && errno != EAGAIN) {
-      throw std::runtime_error(fmt::format("Error writing to serial port: {}", strerror(errno)));
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      throw connection_error(fmt::format("Error writing to serial port: {}", strerror(errno)));
     }
     else if (n > 0) {
       written += n;
       assert(written <= buffer.size());
     }
     else {
-      std::this_thread::sleep_for(1ms);
+      wait_for(POLLOUT, 1000);
     }
   }
 }
@@ -36,23 +42,43 @@ auto UnixConnection::read(int bytes_to_read, int timeout_ms) -> std::string
   std::string tmp;
   tmp.resize(bytes_to_read);
 
-  do {
+  bool readable{false};
+  while (sum < bytes_to_read) {
     n = ::read(fd_, tmp.data() + sum, bytes_to_read - sum);
     if (n > 0) {
       sum += n;
+      readable = false;
+      continue;
     }
-    else if (n < 0 && errno != EAGAIN) {
-      throw std::runtime_error(fmt::format("MEGA65 debugger interface read error: {}", strerror(errno)));
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      throw connection_error(fmt::format("MEGA65 debugger interface read error: {}", strerror(errno)));
+    }
+    // Without data, non-blocking terminals return 0 just like closed connections, but aren't reported readable
+    throw_if<connection_error>(n == 0 && readable, "MEGA65 debugger interface closed");
+    const auto remaining_ms = timeout_ms - static_cast<int>(t.elapsed_ms());
+    readable = remaining_ms > 0 && wait_for(POLLIN, remaining_ms);
+    if (!readable) {
+      break;
     }
-  } while (sum < bytes_to_read && t.elapsed_ms() < timeout_ms);
-
-  if (sum < bytes_to_read) {
-    tmp.resize(sum);
   }
 
+  tmp.resize(sum);
   return tmp;
 }
 
+void UnixConnection::wait_for_input(int timeout_ms) { wait_for(POLLIN, timeout_ms); }
+
+auto UnixConnection::wait_for(short events, int timeout_ms) -> bool
+{
+  pollfd pfd{.fd = fd_, .events = events, .revents = 0};
+  const int ret = ::poll(&pfd, 1, timeout_ms);
+  if (ret < 0 && errno != EINTR) {
+    throw connection_error(fmt::format("MEGA65 debugger interface poll error: {}", strerror(errno)));
+  }
+  // Errors and hangups are reported by the following read or write
+  return ret > 0;
+}
+
 }  // namespace m65dap
 
 #endif  // _POSIX_VERSION
@@ -4,14 +4,29 @@
 
 namespace m65dap {
 
+/**
+ * @brief Connection over a non-blocking file descriptor, waiting for it with poll()
+ */
 class UnixConnection : public Connection {
  protected:
-  int fd_;
+  int fd_{-1};
 
  public:
+  UnixConnection() = default;
+  UnixConnection(const UnixConnection&) = delete;
+  auto operator=(const UnixConnection&) -> UnixConnection& = delete;
+  ~UnixConnection() override;
+
   void write(std::span<const char> buffer) override;
 
   auto read(int bytes_to_read, int timeout_ms = 1000) -> std::string override;
+
+  void wait_for_input(int timeout_ms) override;
+
+  auto native_handle() const -> int override { return fd_; }
+
+ private:
+  auto wait_for(short events, int timeout_ms) -> bool;
 };
 
 }  // namespace m65dap
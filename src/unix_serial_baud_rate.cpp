@@ -0,0 +1,35 @@
+#ifdef _POSIX_VERSION
+
+#include "unix_serial_connection.h"
+
+#ifdef __linux__
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace m65dap {
+
+auto set_custom_baud_rate(int fd, int baud_rate) -> bool
+{
+#if defined(__linux__) && defined(BOTHER)
+  termios2 tty;
+  if (ioctl(fd, TCGETS2, &tty) != 0) {
+    return false;
+  }
+  tty.c_cflag &= ~CBAUD;
+  tty.c_cflag |= BOTHER;
+  tty.c_cflag &= ~(CBAUD << IBSHIFT);
+  tty.c_cflag |= BOTHER << IBSHIFT;
+  tty.c_ispeed = baud_rate;
+  tty.c_ospeed = baud_rate;
+  return ioctl(fd, TCSETS2, &tty) == 0;
+#else
+  (void)fd;
+  (void)baud_rate;
+  return false;
+#endif
+}
+
+}  // namespace m65dap
+
+#endif  // _POSIX_VERSION
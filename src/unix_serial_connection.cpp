@@ -11,38 +11,78 @@
 #include <IOKit/serial/ioss.h>
 #endif
 
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
 namespace m65dap {
 
-UnixSerialConnection::UnixSerialConnection(std::string_view port)
+namespace {
+
+void set_low_latency(int fd)
+{
+  // Best effort, not every driver (e.g. pseudo terminals) supports it
+#ifdef __linux__
+  serial_struct serial;
+  if (ioctl(fd, TIOCGSERIAL, &serial) == 0) {
+    serial.flags |= ASYNC_LOW_LATENCY;
+    ioctl(fd, TIOCSSERIAL, &serial);
+  }
+#endif
+#ifdef __APPLE__
+  unsigned long latency_us = 1;
+  ioctl(fd, IOSSDATALAT, &latency_us);
+#endif
+}
+
+}  // namespace
+
+UnixSerialConnection::UnixSerialConnection(std::string_view port, int baud_rate)
 {
-  fd_ = open(std::string(port).c_str(), O_RDWR | O_NOCTTY | O_SYNC);
+  fd_ = open(std::string(port).c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
   if (fd_ < 0) {
     throw std::runtime_error(fmt::format("Open error: {}", strerror(errno)));
   }
 
-  struct termios tty;
-  memset(&tty, 0, sizeof tty);
+  termios tty;
   if (tcgetattr(fd_, &tty) != 0) {
-    throw std::runtime_error(fmt::format("error {} from tcgetattr", errno));
+    throw std::runtime_error(fmt::format("error {} from tcgetattr", strerror(errno)));
   }
 
-#ifdef __APPLE__
-  if (tcgetattr(fd_, &tty)) throw std::runtime_error("Failed to get terminal parameters");
+  // No line editing, echo or character translation, 8N1 without flow control
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+  // Reads return immediately with the data available, waiting for data is done with poll()
   tty.c_cc[VMIN] = 0;
   tty.c_cc[VTIME] = 0;
+#if !defined(__APPLE__)
+  if (baud_rate == default_baud_rate) {
+    throw_if<std::runtime_error>(cfsetospeed(&tty, B2000000) != 0, "Failed to set baudrate for output");
+    throw_if<std::runtime_error>(cfsetispeed(&tty, B2000000) != 0, "Failed to set baudrate for input");
+  }
+#endif
 
-  if (tcsetattr(fd_, TCSANOW, &tty)) throw std::runtime_error(fmt::format("error {} from tcsetattr", strerror(errno)));
+  if (tcsetattr(fd_, TCSANOW, &tty) != 0) {
+    throw std::runtime_error(fmt::format("error {} from tcsetattr", strerror(errno)));
+  }
 
-  speed_t speed_apple = 2000000;
+#ifdef __APPLE__
+  speed_t speed_apple = baud_rate;
   if (ioctl(fd_, IOSSIOSPEED, &speed_apple) == -1) {
     throw std::runtime_error("Failed to set output baud rate using IOSSIOSPEED");
   }
 #else
-  throw_if<std::runtime_error>(cfsetospeed(&tty, B2000000) != 0, "Failed to set baudrate for output");
-  throw_if<std::runtime_error>(cfsetispeed(&tty, B2000000) != 0, "Failed to set baudrate for input");
+  throw_if<std::runtime_error>(baud_rate != default_baud_rate && !set_custom_baud_rate(fd_, baud_rate),
+                               fmt::format("Baud rate {} not supported", baud_rate));
 #endif
+
+  set_low_latency(fd_);
+  tcflush(fd_, TCIOFLUSH);
 }
 
+void UnixSerialConnection::discard_input() { tcflush(fd_, TCIFLUSH); }
+
 }  // namespace m65dap
 
 #endif  // _POSIX_VERSION
@@ -4,9 +4,29 @@
 
 namespace m65dap {
 
+// Baud rate of the MEGA65 serial monitor
+constexpr int default_baud_rate = 2000000;
+
+/**
+ * @brief Serial port in raw, non-blocking mode, configured for low latency
+ *
+ * Reads return whatever arrived (VMIN = VTIME = 0) and waiting is done with poll(). The driver is asked to pass
+ * received bytes on right away (ASYNC_LOW_LATENCY on Linux, a data latency of 1 µs on macOS) where supported.
+ */
 class UnixSerialConnection : public UnixConnection {
  public:
-  UnixSerialConnection(std::string_view port);
+  UnixSerialConnection(std::string_view port, int baud_rate = default_baud_rate);
+
+  void discard_input() override;
 };
 
+/**
+ * @brief Sets any baud rate the driver supports with termios2 (Linux only)
+ *
+ * Kept apart as <asm/termbits.h> can't be included together with <termios.h>.
+ *
+ * @return False if custom baud rates are not supported
+ */
+auto set_custom_baud_rate(int fd, int baud_rate) -> bool;
+
 }  // namespace m65dap
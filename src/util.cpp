@@ -1,5 +1,29 @@
 #include "util.h"
 
+namespace {
+
+constexpr std::string_view base64_chars{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
+
+// Output character pairs for every 12 bit input value, so 3 input bytes take two lookups instead of four
+constexpr auto base64_pairs = [] {
+  std::array<std::array<char, 2>, 4096> table{};
+  for (std::size_t idx{0}; idx < table.size(); ++idx) {
+    table[idx] = {base64_chars[idx >> 6], base64_chars[idx & 0x3f]};
+  }
+  return table;
+}();
+
+constexpr auto base64_values = [] {
+  std::array<std::int8_t, 256> table{};
+  table.fill(-1);
+  for (std::size_t idx{0}; idx < base64_chars.size(); ++idx) {
+    table[static_cast<unsigned char>(base64_chars[idx])] = static_cast<std::int8_t>(idx);
+  }
+  return table;
+}();
+
+}  // namespace
+
 namespace m65dap {
 
 std::vector<std::string> split(const std::string& str, char delim)
@@ -15,4 +39,62 @@ std::vector<std::string> split(const std::string& str, char delim)
   return result;
 }
 
+auto base64_encode(std::span<const std::byte> data) -> std::string
+{
+  std::string result((data.size() + 2) / 3 * 4, '=');
+  const auto* in = reinterpret_cast<const std::uint8_t*>(data.data());
+  char* out = result.data();
+
+  const std::size_t full_groups = data.size() / 3;
+  for (std::size_t group{0}; group < full_groups; ++group) {
+    const std::uint32_t bits = (in[0] << 16) | (in[1] << 8) | in[2];
+    const auto& hi = base64_pairs[bits >> 12];
+    const auto& lo = base64_pairs[bits & 0xfff];
+    out[0] = hi[0];
+    out[1] = hi[1];
+    out[2] = lo[0];
+    out[3] = lo[1];
+    in += 3;
+    out += 4;
+  }
+
+  const std::size_t remaining = data.size() - full_groups * 3;
+  if (remaining > 0) {
+    const std::uint32_t bits = (in[0] << 16) | (remaining > 1 ? in[1] << 8 : 0);
+    out[0] = base64_chars[bits >> 18];
+    out[1] = base64_chars[(bits >> 12) & 0x3f];
+    if (remaining > 1) {
+      out[2] = base64_chars[(bits >> 6) & 0x3f];
+    }
+  }
+
+  return result;
+}
+
+auto base64_decode(std::string_view str) -> std::vector<std::byte>
+{
+  throw_if<std::invalid_argument>(str.length() % 4 != 0, "Invalid base64 length");
+  std::size_t padding{0};
+  if (!str.empty() && str.back() == '=') {
+    padding = str[str.length() - 2] == '=' ? 2 : 1;
+  }
+
+  std::vector<std::byte> result(str.length() / 4 * 3 - padding);
+  auto out = result.begin();
+  for (std::size_t pos{0}; pos < str.length(); pos += 4) {
+    std::uint32_t bits{0};
+    for (std::size_t idx{0}; idx < 4; ++idx) {
+      const char c = str[pos + idx];
+      const bool is_padding = c == '=' && pos + 4 == str.length() && idx >= 4 - padding;
+      const int value = is_padding ? 0 : base64_values[static_cast<unsigned char>(c)];
+      throw_if<std::invalid_argument>(value < 0, "Invalid base64 character");
+      bits = (bits << 6) | value;
+    }
+    for (int shift{16}; shift >= 0 && out != result.end(); shift -= 8) {
+      *out++ = static_cast<std::byte>(bits >> shift);
+    }
+  }
+  return result;
+}
+
 }  // namespace m65dap
@@ -24,6 +24,16 @@ inline auto is_ascii(std::span<const char> buffer) -> bool
 
 std::vector<std::string> split(const std::string&, char delim);
 
+/**
+ * @brief Encodes binary data as base64 (RFC 4648, with padding)
+ */
+auto base64_encode(std::span<const std::byte> data) -> std::string;
+
+/**
+ * @brief Decodes base64 encoded data, throws std::invalid_argument for malformed input
+ */
+auto base64_decode(std::string_view str) -> std::vector<std::byte>;
+
 template <typename ExceptionType>
 void throw_if(bool condition, std::string_view msg)
 {
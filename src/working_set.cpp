@@ -0,0 +1,61 @@
+#include "working_set.h"
+
+namespace m65dap {
+
+void WorkingSet::load(const std::filesystem::path& path)
+{
+  path_ = path;
+  line_addresses_.clear();
+
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line) && line_addresses_.size() < max_lines) {
+    int address{0};
+    const auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.length(), address, 16);
+    if (ec != std::errc() || address < 0) {
+      line_addresses_.clear();
+      return;
+    }
+    line_addresses_.push_back(address);
+  }
+}
+
+void WorkingSet::learn(std::span<const int> line_addresses)
+{
+  if (line_addresses.empty()) {
+    return;
+  }
+  const auto learned = line_addresses.first(std::min(line_addresses.size(), max_lines));
+  if (std::equal(learned.begin(), learned.end(), line_addresses_.begin(), line_addresses_.end())) {
+    return;
+  }
+  line_addresses_.assign(learned.begin(), learned.end());
+  save();
+}
+
+auto WorkingSet::default_dir() -> std::filesystem::path
+{
+  return std::filesystem::temp_directory_path() / "m65dap";
+}
+
+auto WorkingSet::file_path(const std::filesystem::path& dir, const std::filesystem::path& prg_path)
+    -> std::filesystem::path
+{
+  const auto hash = std::hash<std::string>{}(std::filesystem::absolute(prg_path).string());
+  return dir / fmt::format("{}-{:016x}.workingset", prg_path.stem().string(), hash);
+}
+
+void WorkingSet::save() const
+{
+  if (path_.empty()) {
+    return;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(path_.parent_path(), ec);
+  std::ofstream out(path_, std::ios::trunc);
+  for (auto address : line_addresses_) {
+    out << fmt::format("{:X}\n", address);
+  }
+}
+
+}  // namespace m65dap
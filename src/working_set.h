@@ -0,0 +1,50 @@
+#pragma once
+
+namespace m65dap {
+
+/**
+ * @brief Memory lines read while the target was stopped, fetched ahead of the client requests at the next stop
+ *
+ * The set of a program is kept in a file, so it is available from the first stop of the next session already.
+ */
+class WorkingSet {
+  std::vector<int> line_addresses_;
+  std::filesystem::path path_;
+
+ public:
+  static constexpr std::size_t max_lines = 64;
+
+  /**
+   * @brief Loads the set stored for a program, a missing or unreadable file results in an empty set
+   *
+   * @param path File the set is stored in, the set is only kept in memory if empty
+   */
+  void load(const std::filesystem::path& path);
+
+  /**
+   * @brief Replaces the set with the lines read during the last stop, and stores it if it changed
+   *
+   * Stops without any reads keep the previous set.
+   *
+   * @param line_addresses Lines in order of their first read, only the first max_lines are kept
+   */
+  void learn(std::span<const int> line_addresses);
+
+  auto line_addresses() const -> const std::vector<int>& { return line_addresses_; }
+
+  /**
+   * @brief Directory in the temp directory the sets are stored in unless another one is configured
+   */
+  static auto default_dir() -> std::filesystem::path;
+
+  /**
+   * @brief File in dir the set of a program is stored in
+   */
+  static auto file_path(const std::filesystem::path& dir, const std::filesystem::path& prg_path)
+      -> std::filesystem::path;
+
+ private:
+  void save() const;
+};
+
+}  // namespace m65dap